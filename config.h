@@ -9,6 +9,73 @@
 // Scheduler server port.
 #define SCHEDULERPORT "2050"
 
+// Priority of servers which have no priority in servers file.
+#define SCHEDULER_DEFAULT_PRIORITY 1
+
+// Base period in seconds between crawls of a server, see FreshnessPolicy.
+#define SCHEDULER_CRAWL_INTERVAL 3600
+
+// Change rate added to the observed one, so that servers which never change
+// are still crawled every SCHEDULER_CRAWL_INTERVAL / SCHEDULER_MIN_CHANGE_RATE
+// seconds at priority 1.
+#define SCHEDULER_MIN_CHANGE_RATE 0.1
+
+// Weight of the last crawl in moving averages of change rate and crawl
+// duration of a server.
+#define SCHEDULER_STATS_WEIGHT 0.5
+
+// Maximum size of one scheduler command or reply. Work items split from a
+// server are named by paths, so they can be longer than a domain name.
+#define SCHEDULER_COMMAND_SIZE 4096
+
+// Version of the binary scheduler protocol, see scheduler/protocol.h. It is
+// the first byte of every message and must not be a printable character.
+#define SCHEDULER_PROTOCOL_VERSION 1
+
+// Maximum size of one scheduler message, the maximum UDP payload.
+#define SCHEDULER_PACKET_SIZE 65507
+
+// Maximum number of items in one scheduler message. Together with
+// SCHEDULER_COMMAND_SIZE it keeps messages below SCHEDULER_PACKET_SIZE.
+#define SCHEDULER_MAX_ITEMS 8
+
+// Maximum number of seconds a spider waits before asking for leases again
+// when there are no free servers.
+#define SCHEDULER_MAX_RETRY_AFTER 5
+
+// Timeout in milliseconds of a scheduler request and number of attempts,
+// the timeout doubles after each attempt.
+#define SCHEDULER_RETRY_TIMEOUT 250
+#define SCHEDULER_RETRIES 5
+
+// Number of spiders for which the scheduler keeps last replies to answer
+// retried requests.
+#define SCHEDULER_MAX_CLIENTS 1024
+
+// Number of last replies the scheduler keeps for every spider. A spider has
+// requests of several threads in flight at once, a retried request must
+// find its reply even if other requests were answered after it.
+#define SCHEDULER_REPLY_WINDOW 32
+
+// Number of sockets and threads which receive scheduler commands, 0 for one
+// per core. They share the port with SO_REUSEPORT.
+#define SCHEDULER_SHARDS 0
+
+// Maximum number of datagrams received or sent by one system call of the
+// scheduler.
+#define SCHEDULER_BATCH 32
+
+// Path prefix of scheduler state files, see scheduler/statelog.h.
+#define SCHEDULER_STATE_FILE "../var/lib/u-search/scheduler"
+
+// Whether the scheduler state log is synced to disk after every batch of
+// commands. Without it a crash of the machine may lose the last changes.
+#define SCHEDULER_STATE_SYNC 0
+
+// Size in bytes of the scheduler state log after which a new snapshot is
+// written.
+#define SCHEDULER_SNAPSHOT_SIZE (16 << 20)
+
 // Spider configuration file.
 #define SPIDER_CONFIG "/etc/u-search/spider.dat"
 
@@ -17,19 +84,163 @@
 // run on the same machine.
 #define SPIDERPORT "2051"
 
+// Search daemon port.
+#define SEARCHDPORT "2052"
+
+// Number of threads which execute search requests.
+#define SEARCHD_WORKERS 4
+
+// Period in seconds of rebuilding the file name index of the search daemon.
+// Files added between rebuilds are found by a scan of new ids.
+#define SEARCHD_NAME_INDEX_SEC 600
+
+// Maximum number of files in one page of search results.
+#define SEARCHD_PAGE_SIZE 100
+
+// Maximum size of one search request in bytes.
+#define SEARCHD_MAX_REQUEST (64 * 1024)
+
+// Size of listen queue of the search daemon.
+#define SEARCHD_BACKLOG 128
+
+// Maximum number of epoll events handled at once by the search daemon.
+#define SEARCHD_EVENTS 64
+
+// Size of buffer which is used to read search requests.
+#define SEARCHD_READ_SIZE 4096
+
+// Size of responses queued to one client of the search daemon after which
+// its requests are suspended until the client reads them.
+#define SEARCHD_MAX_OUTPUT (1024 * 1024)
+
+// Maximum number of files a worker finds for a request of the search daemon
+// before it turns to other requests. Must be a multiple of SEARCHD_PAGE_SIZE.
+#define SEARCHD_SLICE_SIZE (10 * SEARCHD_PAGE_SIZE)
+
 // Database configuration file.
 #define DATABASE_CONFIG "/etc/u-search/database.dat"
 
+// Default number of threads which scan smb directories in one spider.
+#define CRAWLER_THREADS 8
+
 // Size of buffer which used to get smb directory entries.
 #define BUF_SIZE 512
 
-// Maximum size of vector with scan results.
+// Default size of buffer which crawl backends fill with directory entries in
+// one getdents call, can be changed with "dirents_size" spider option.
+#define DIRENTS_SIZE (256 * 1024)
+
+// Minimal size of the directory entries buffer, it must hold at least one
+// entry with the longest name.
+#define DIRENTS_MIN_SIZE 4096
+
+// Directories which take longer to read are logged by the crawler,
+// milliseconds.
+#define SLOW_DIR_MS 1000
+
+// Maximum number of open connections to data base in one process.
+#define DB_POOL_SIZE 8
+
+// How long in seconds a thread waits for a free data base connection.
+#define DB_POOL_TIMEOUT 30
+
+// Idle data base connections older than this number of seconds are pinged
+// before reuse.
+#define DB_PING_INTERVAL 60
+
+// Number of attempts to connect to data base and the delay in milliseconds
+// before the second one, the delay doubles after each failed attempt.
+#define DB_CONNECT_ATTEMPTS 3
+#define DB_CONNECT_DELAY 100
+
+// Maximum number of attributes and of files kept in memory by each data
+// storage entity cache, and number of independently locked parts of a cache.
+#define ENTITY_CACHE_SIZE 65536
+#define ENTITY_CACHE_SHARDS 16
+
+// Time in milliseconds after which a cached entity is read from the data
+// base again, so that rows changed by other processes are seen.
+#define ENTITY_CACHE_TTL_MS 30000
+
+// Maximum number of files in a batch of scan results.
 #define VECTOR_SIZE 2048
 
-// Name of directory to store headrs of files.
-#define TMPDIR "/tmp/u-search"
+// Initial size of the buffer with names of directories and files of a batch
+// of scan results, it grows when needed and is reused by next batches.
+#define BATCH_BYTES (VECTOR_SIZE * 64)
+
+// Maximum size in bytes of one multi-row statement sent to the database.
+// Must be below max_allowed_packet of the database server.
+#define BATCH_STATEMENT_SIZE (1 << 20)
+
+// Number of rows in one prepared multi-row insert of batch writer. Rows
+// which don't make a full statement are sent as text.
+#define BATCH_PREPARED_ROWS 128
+
+// Maximum number of file ids found by the name index which are checked with
+// one query.
+#define NAME_INDEX_CHUNK 1000
+
+// Maximum number of file ids in one query which loads parameters of a set
+// of files.
+#define PARAMETER_LOAD_CHUNK 1000
+
+// Number of filled result vectors which may wait to be dumped to database
+// while spider keeps scanning.
+#define DUMP_QUEUE_SIZE 2
+
+// Whether spider skips files which size and modification time didn't change
+// since the previous crawl. Can be changed with "incremental" option.
+#define INCREMENTAL_CRAWL 1
+
+// Whether spider stores a hash of sampled content of every indexed file to
+// find duplicates. Off by default: the writer thread opens every new or
+// changed file, even when its MIME type is known by extension. Can be
+// changed with "content_hash" option.
+#define CONTENT_HASH 0
+
+// Size of blocks which are hashed to build the content hash of a file. Can
+// be changed with "content_block_size" option.
+#define CONTENT_BLOCK_SIZE (64 * 1024)
+
+// Number of blocks spread from the beginning to the end of a file which are
+// hashed, so the hash of a file of any size costs this many reads.
+#define CONTENT_SAMPLES 3
+
+// Whether files with equal content hashes are hashed whole by a background
+// thread of spider to confirm they are duplicates. Can be changed with
+// "verify_duplicates" option.
+#define VERIFY_DUPLICATES 0
+
+// Number of groups of duplicates loaded and verified at once, full hashes
+// of their files are looked up and written page by page.
+#define VERIFY_PAGE_GROUPS 1000
+
+// Whether spider stores search tokens of file names. Off by default:
+// searchd doesn't use them yet and tokenizing costs more per file than the
+// plain name parsing. Can be changed with "tokenize_names" option.
+#define TOKENIZE_NAMES 0
+
+// Whether spider detects MIME type by file extension when the extension is
+// known, without reading the file. Can be changed with "mime_by_extension"
+// option, for all servers or for one.
+#define MIME_BY_EXTENSION 1
+
+// Number of leases a spider takes at once, so that it starts the next server
+// without waiting for scheduler. Can be changed with "leases" option, no
+// greater than SCHEDULER_MAX_ITEMS.
+#define SPIDER_LEASES 4
+
+// Spider hands back to scheduler subdirectories of a directory which has at
+// least SPIDER_SPLIT_DIRS subdirectories and is less than SPIDER_SPLIT_DEPTH
+// levels below the server root, so they are crawled as separate work items.
+// Shares of a server are always handed back. Can be changed with "split_dirs"
+// and "split_depth" options, split_dirs 0 disables splitting.
+#define SPIDER_SPLIT_DIRS 64
+#define SPIDER_SPLIT_DEPTH 3
 
-// The size of file header to copy in TMPDIR to detect mime type of file.
+// Default size of file header which is read to detect mime type of file.
+// Can be changed with "header_size" option.
 #define HEADERSIZE 10
 
 // The address family
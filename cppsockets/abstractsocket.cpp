@@ -69,7 +69,7 @@ void AbstractSocket::set_remote_address(SocketAddress *address) {
 }
 
 int AbstractSocket::Close() {
-  if (socket_ > 0 && state_ != UnconnectedState) {
+  if (socket_ > 0) {
     if (close(socket_) == -1) {
       DetectError();
       MSS_DEBUG_ERROR("close", error_);
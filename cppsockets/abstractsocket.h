@@ -143,6 +143,13 @@ class AbstractSocket {
    */
   inline SocketAddress &get_remote_socket_address() { return remote_address_; }
 
+  /**
+   * Get file descriptor of the socket, e.g. to wait for it with epoll.
+   *
+   * @return File descriptor of the socket.
+   */
+  inline int get_descriptor() const { return socket_; }
+
   /**
    * Close the socket.
    *
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "data-storage/batchwriter.h"
+#include "common-inl.h"
+
+BatchWriter::BatchWriter(const size_t statement_size)
+  : statement_size_(statement_size),
+    touched_count_(0) {
+}
+
+void BatchWriter::AddFile(const std::string &name, const std::string &path,
+                          const std::string &server) {
+  files_.push_back(FileRow());
+  FileRow &row = files_.back();
+  row.name = name;
+  row.path = path;
+  row.server = server;
+}
+
+void BatchWriter::AddParameter(const std::string &path,
+                               const std::string &server, const int attr_id,
+                               const std::string &str_value,
+                               const int num_value, const bool bool_value) {
+  parameters_.push_back(ParameterRow());
+  ParameterRow &row = parameters_.back();
+  row.path = path;
+  row.server = server;
+  row.attr_id = attr_id;
+  row.str_value = str_value;
+  row.num_value = num_value;
+  row.bool_value = bool_value;
+}
+
+void BatchWriter::TouchFile(const std::string &path,
+                            const std::string &server) {
+  if (touched_[server].insert(path).second)
+    ++touched_count_;
+}
+
+bool BatchWriter::LoadParameters(
+    const std::vector<std::pair<std::string, std::string> > &files,
+    const int attr_id, std::unordered_map<std::string, std::string> *values) {
+  ServerPaths paths;
+  for (const auto &file : files)
+    paths[file.first].insert(file.second);
+
+  try {
+    mysqlpp::Query query = get_db_connection().query();
+    std::vector<std::string> statements;
+
+    for (const auto &server : paths) {
+      statements.clear();
+      BuildPathStatements(query, "select files.file_path, param.str_value "
+                          "from mss_files files join mss_parameters param "
+                          "on param.file_id = files.id where param.attr_id = " +
+                          std::to_string(attr_id) + " and ", server.first,
+                          server.second, &statements);
+
+      for (const std::string &statement : statements) {
+        mysqlpp::StoreQueryResult result = query.store(statement);
+        for (const mysqlpp::Row &row : result) {
+          std::string key(server.first);
+          key.push_back('/');
+          key.append(row[0].data(), row[0].length());
+          (*values)[key].assign(row[1].data(), row[1].length());
+        }
+      }
+    }
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return false;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = e.what();
+    return false;
+  }
+
+  return true;
+}
+
+bool BatchWriter::Flush() {
+  try {
+    mysqlpp::Query query = get_db_connection().query();
+    std::vector<std::string> tuples;
+
+    // Files. Full chunks go through a prepared statement, the rest is sent
+    // as text.
+    const std::string files_prefix("insert into mss_files "
+                                   "(name, file_path, server_name, last_seen) "
+                                   "values ");
+    const std::string files_suffix(" on duplicate key update "
+                                   "name = values(name), "
+                                   "last_seen = values(last_seen)");
+    PreparedStatement *insert_files = NULL;
+    for (size_t begin = 0; begin < files_.size();
+         begin += BATCH_PREPARED_ROWS) {
+      size_t end = std::min(files_.size(), begin + BATCH_PREPARED_ROWS);
+
+      size_t size = 0;
+      for (size_t i = begin; i < end; ++i)
+        size += files_[i].name.size() + files_[i].path.size() +
+                files_[i].server.size();
+
+      if (end - begin == BATCH_PREPARED_ROWS && size < statement_size_) {
+        if (insert_files == NULL) {
+          insert_files = &get_statement(
+              RepeatRow(files_prefix, "(?,?,?,current_timestamp)",
+                        BATCH_PREPARED_ROWS, files_suffix));
+        }
+        size_t param = 0;
+        for (size_t i = begin; i < end; ++i) {
+          insert_files->BindString(param++, files_[i].name);
+          insert_files->BindString(param++, files_[i].path);
+          insert_files->BindString(param++, files_[i].server);
+        }
+        insert_files->Execute();
+        continue;
+      }
+
+      for (size_t i = begin; i < end; ++i) {
+        std::string tuple("(");
+        AppendQuoted(query, files_[i].name, &tuple);
+        tuple.push_back(',');
+        AppendQuoted(query, files_[i].path, &tuple);
+        tuple.push_back(',');
+        AppendQuoted(query, files_[i].server, &tuple);
+        tuple.append(",current_timestamp)");
+        tuples.push_back(tuple);
+      }
+    }
+    ExecuteBatched(&query, files_prefix, tuples, files_suffix);
+
+    // Parameters.
+    if (!parameters_.empty()) {
+      std::unordered_map<std::string, int> ids;
+      ResolveFileIds(&query, &ids);
+
+      std::vector<std::pair<const ParameterRow *, int> > rows;
+      rows.reserve(parameters_.size());
+      for (const ParameterRow &row : parameters_) {
+        auto id = ids.find(row.server + "/" + row.path);
+        if (UNLIKELY(id == ids.end())) {
+          MSS_DEBUG_MESSAGE(("No file for parameter: " + row.server + "/" +
+                             row.path).c_str());
+          continue;
+        }
+        rows.push_back(std::make_pair(&row, id->second));
+      }
+
+      const std::string parameters_prefix("insert into mss_parameters "
+                                          "(attr_id, file_id, str_value, "
+                                          "num_value, bool_value) values ");
+      const std::string parameters_suffix(" on duplicate key update "
+                                          "str_value = values(str_value), "
+                                          "num_value = values(num_value), "
+                                          "bool_value = values(bool_value)");
+      PreparedStatement *insert_parameters = NULL;
+      tuples.clear();
+      for (size_t begin = 0; begin < rows.size();
+           begin += BATCH_PREPARED_ROWS) {
+        size_t end = std::min(rows.size(), begin + BATCH_PREPARED_ROWS);
+
+        size_t size = 0;
+        for (size_t i = begin; i < end; ++i)
+          size += rows[i].first->str_value.size();
+
+        if (end - begin == BATCH_PREPARED_ROWS && size < statement_size_) {
+          if (insert_parameters == NULL) {
+            insert_parameters = &get_statement(
+                RepeatRow(parameters_prefix, "(?,?,?,?,?)",
+                          BATCH_PREPARED_ROWS, parameters_suffix));
+          }
+          size_t param = 0;
+          for (size_t i = begin; i < end; ++i) {
+            const ParameterRow &row = *rows[i].first;
+            insert_parameters->BindInt(param++, row.attr_id);
+            insert_parameters->BindInt(param++, rows[i].second);
+            insert_parameters->BindString(param++, row.str_value);
+            insert_parameters->BindInt(param++, row.num_value);
+            insert_parameters->BindInt(param++, row.bool_value ? 1 : 0);
+          }
+          insert_parameters->Execute();
+          continue;
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+          const ParameterRow &row = *rows[i].first;
+          std::string tuple("(");
+          tuple.append(std::to_string(row.attr_id));
+          tuple.push_back(',');
+          tuple.append(std::to_string(rows[i].second));
+          tuple.push_back(',');
+          AppendQuoted(query, row.str_value, &tuple);
+          tuple.push_back(',');
+          tuple.append(std::to_string(row.num_value));
+          tuple.append(row.bool_value ? ",1)" : ",0)");
+          tuples.push_back(tuple);
+        }
+      }
+      ExecuteBatched(&query, parameters_prefix, tuples, parameters_suffix);
+    }
+
+    // Files which are known to be unchanged.
+    std::vector<std::string> statements;
+    for (const auto &server : touched_) {
+      BuildPathStatements(query, "update mss_files set last_seen = "
+                          "current_timestamp where ", server.first,
+                          server.second, &statements);
+    }
+    for (const std::string &statement : statements)
+      query.execute(statement);
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    UncacheFiles();
+    return false;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = e.what();
+    UncacheFiles();
+    return false;
+  }
+
+  UncacheFiles();
+  files_.clear();
+  parameters_.clear();
+  touched_.clear();
+  touched_count_ = 0;
+  return true;
+}
+
+void BatchWriter::UncacheFiles() {
+  for (const FileRow &row : files_)
+    FileEntry::Uncache(row.path, row.server);
+  for (const auto &server : touched_) {
+    for (const std::string &path : server.second)
+      FileEntry::Uncache(path, server.first);
+  }
+}
+
+void BatchWriter::AppendQuoted(const mysqlpp::Query &query,
+                               const std::string &value, std::string *result) {
+  std::string escaped;
+  query.escape_string(&escaped, value.data(), value.size());
+  result->push_back('\'');
+  result->append(escaped);
+  result->push_back('\'');
+}
+
+std::string BatchWriter::RepeatRow(const std::string &prefix,
+                                   const std::string &row, const size_t count,
+                                   const std::string &suffix) {
+  std::string statement(prefix);
+  statement.reserve(prefix.size() + (row.size() + 1) * count + suffix.size());
+  for (size_t i = 0; i < count; ++i) {
+    if (i > 0)
+      statement.push_back(',');
+    statement.append(row);
+  }
+  statement.append(suffix);
+  return statement;
+}
+
+void BatchWriter::ExecuteBatched(mysqlpp::Query *query,
+                                 const std::string &prefix,
+                                 const std::vector<std::string> &tuples,
+                                 const std::string &suffix) {
+  std::string statement;
+  for (const std::string &tuple : tuples) {
+    if (statement.size() > prefix.size() &&
+        statement.size() + tuple.size() + suffix.size() + 1 >
+        statement_size_) {
+      statement.append(suffix);
+      query->execute(statement);
+      statement.clear();
+    }
+
+    if (statement.empty()) {
+      statement.reserve(statement_size_);
+      statement.append(prefix);
+    } else {
+      statement.push_back(',');
+    }
+    statement.append(tuple);
+  }
+
+  if (!statement.empty()) {
+    statement.append(suffix);
+    query->execute(statement);
+  }
+}
+
+void BatchWriter::BuildPathStatements(
+    const mysqlpp::Query &query, const std::string &prefix,
+    const std::string &server, const std::unordered_set<std::string> &paths,
+    std::vector<std::string> *statements) {
+  std::string head(prefix);
+  head.append("server_name = ");
+  AppendQuoted(query, server, &head);
+  head.append(" and file_path in (");
+
+  auto path = paths.begin();
+  while (path != paths.end()) {
+    std::string statement(head);
+    bool first = true;
+    // Escaping at most doubles the length of a path.
+    for (; path != paths.end() &&
+         (first || statement.size() + path->size() * 2 + 4 <
+                   statement_size_); ++path) {
+      if (!first)
+        statement.push_back(',');
+      AppendQuoted(query, *path, &statement);
+      first = false;
+    }
+    statement.push_back(')');
+    statements->push_back(statement);
+  }
+}
+
+void BatchWriter::ResolveFileIds(mysqlpp::Query *query,
+                                 std::unordered_map<std::string, int> *ids) {
+  // Group paths by server, so each statement is one index range scan.
+  ServerPaths paths;
+  for (const ParameterRow &row : parameters_)
+    paths[row.server].insert(row.path);
+
+  std::vector<std::string> statements;
+  for (const auto &server : paths) {
+    statements.clear();
+    BuildPathStatements(*query, "select id, file_path from mss_files where ",
+                        server.first, server.second, &statements);
+
+    for (const std::string &statement : statements) {
+      mysqlpp::StoreQueryResult result = query->store(statement);
+      for (const mysqlpp::Row &row : result) {
+        std::string key(server.first);
+        key.push_back('/');
+        key.append(row[1].data(), row[1].length());
+        (*ids)[key] = row[0];
+      }
+    }
+  }
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DATA_STORAGE_BATCHWRITER_H_
+#define DATA_STORAGE_BATCHWRITER_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "data-storage/entities.h"
+#include "common-inl.h"
+#include "config.h"
+
+/**
+ * Buffers mss_files and mss_parameters rows and writes them with multi-row
+ * "insert ... on duplicate key update" statements.
+ *
+ * Parameters are added by path and server of the file, file ids are resolved
+ * in bulk during Flush(), after the files themselves are written. Unlike
+ * "replace", "on duplicate key update" keeps the id of an existing file, so
+ * its parameters stay valid.
+ */
+class BatchWriter : DatabaseEntity {
+  public:
+    /**
+     * Constructor.
+     *
+     * @param statement_size Maximum size of one statement in bytes. It must
+     * be below max_allowed_packet of the data base server.
+     */
+    explicit BatchWriter(const size_t statement_size = BATCH_STATEMENT_SIZE);
+
+    /**
+     * Same as Flush().
+     */
+    virtual bool Commit() { return Flush(); }
+    virtual bool Delete() { return false; }
+
+    /**
+     * Buffer a file entry. Last seen time of the entry is set to the time of
+     * flush.
+     *
+     * @param name Name of the file.
+     * @param path Path to file on server.
+     * @param server Name or ip address of server where file located.
+     */
+    void AddFile(const std::string &name, const std::string &path,
+                 const std::string &server);
+
+    /**
+     * Buffer a parameter of a file. The file should be added to this writer
+     * or already exist in the data base.
+     *
+     * @param path Path to file on server.
+     * @param server Name or ip address of server where file located.
+     * @param attr_id Id of the attribute.
+     * @param str_value Parameter string value.
+     * @param num_value Parameter numerical value.
+     * @param bool_value Parameter boolean value.
+     */
+    void AddParameter(const std::string &path, const std::string &server,
+                      const int attr_id, const std::string &str_value,
+                      const int num_value, const bool bool_value);
+
+    /**
+     * Buffer an update of the last seen time of an existing file.
+     *
+     * @param path Path to file on server.
+     * @param server Name or ip address of server where file located.
+     */
+    void TouchFile(const std::string &path, const std::string &server);
+
+    /**
+     * Find string values of the attribute for a set of files right now,
+     * without flushing the buffers.
+     *
+     * @param files Pairs of server and path of the files.
+     * @param attr_id Id of the attribute.
+     * @param values Where to store values, key is server + "/" + path. Files
+     * without the parameter are not stored.
+     *
+     * @return true on success, false otherwise.
+     */
+    bool LoadParameters(
+        const std::vector<std::pair<std::string, std::string> > &files,
+        const int attr_id,
+        std::unordered_map<std::string, std::string> *values);
+
+    /**
+     * Write all buffered rows to the data base and clear the buffers.
+     * Parameters of files which are not found in the data base are dropped.
+     *
+     * @return true on success, false otherwise.
+     */
+    bool Flush();
+
+    /**
+     * Get number of buffered files.
+     *
+     * @return Number of buffered files.
+     */
+    inline size_t get_files_count() const { return files_.size(); }
+
+    /**
+     * Get number of buffered parameters.
+     *
+     * @return Number of buffered parameters.
+     */
+    inline size_t get_parameters_count() const { return parameters_.size(); }
+
+    /**
+     * Get number of buffered last seen time updates.
+     *
+     * @return Number of buffered updates.
+     */
+    inline size_t get_touched_count() const { return touched_count_; }
+
+  private:
+    /**
+     * Paths of files grouped by server.
+     */
+    typedef std::unordered_map<std::string, std::unordered_set<std::string> >
+        ServerPaths;
+
+    /**
+     * Buffered mss_files row.
+     */
+    struct FileRow {
+      std::string name;
+      std::string path;
+      std::string server;
+    };
+
+    /**
+     * Buffered mss_parameters row.
+     */
+    struct ParameterRow {
+      std::string path;
+      std::string server;
+      int attr_id;
+      std::string str_value;
+      int num_value;
+      bool bool_value;
+    };
+
+    /**
+     * Drop cached entries of buffered files, some of them may be written
+     * already.
+     */
+    void UncacheFiles();
+
+    /**
+     * Quote and escape a string for the query.
+     *
+     * @param query Query which knows the connection charset.
+     * @param value String to be quoted.
+     * @param result Where to append the quoted string.
+     */
+    static void AppendQuoted(const mysqlpp::Query &query,
+                             const std::string &value, std::string *result);
+
+    /**
+     * Build statement prefix + count comma separated copies of row + suffix.
+     *
+     * @param prefix Beginning of the statement.
+     * @param row Row with placeholders.
+     * @param count Number of rows.
+     * @param suffix End of the statement.
+     *
+     * @return Statement text.
+     */
+    static std::string RepeatRow(const std::string &prefix,
+                                 const std::string &row, const size_t count,
+                                 const std::string &suffix);
+
+    /**
+     * Execute prefix + tuples + suffix, split in as many statements as needed
+     * to keep each one below statement_size_.
+     *
+     * @param query Query to execute statements with.
+     * @param prefix Beginning of each statement.
+     * @param tuples Comma separated parts of each statement.
+     * @param suffix End of each statement.
+     */
+    void ExecuteBatched(mysqlpp::Query *query, const std::string &prefix,
+                        const std::vector<std::string> &tuples,
+                        const std::string &suffix);
+
+    /**
+     * Build statements prefix + "server_name = server and file_path in (" +
+     * paths + ")", as many as needed to keep each one below statement_size_.
+     *
+     * @param query Query which knows the connection charset.
+     * @param prefix Beginning of each statement.
+     * @param server Name of the server.
+     * @param paths Paths of the files.
+     * @param statements Where to store the statements.
+     */
+    void BuildPathStatements(const mysqlpp::Query &query,
+                             const std::string &prefix,
+                             const std::string &server,
+                             const std::unordered_set<std::string> &paths,
+                             std::vector<std::string> *statements);
+
+    /**
+     * Find ids of files referenced by the buffered parameters.
+     *
+     * @param query Query to execute statements with.
+     * @param ids Where to store ids, key is server + "/" + path.
+     */
+    void ResolveFileIds(mysqlpp::Query *query,
+                        std::unordered_map<std::string, int> *ids);
+
+    /**
+     * Maximum size of one statement.
+     */
+    size_t statement_size_;
+
+    /**
+     * Buffered files.
+     */
+    std::vector<FileRow> files_;
+
+    /**
+     * Buffered parameters.
+     */
+    std::vector<ParameterRow> parameters_;
+
+    /**
+     * Files which last seen time should be updated.
+     */
+    ServerPaths touched_;
+
+    /**
+     * Number of paths in touched_.
+     */
+    size_t touched_count_;
+
+    DISALLOW_COPY_AND_ASSIGN(BatchWriter);
+};
+
+#endif  // DATA_STORAGE_BATCHWRITER_H_
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "data-storage/connectionpool.h"
+
+ConnectionPool::ConnectionPool(const std::string &db_name,
+                               const std::string &server,
+                               const std::string &user,
+                               const std::string &password,
+                               const size_t size,
+                               const int timeout)
+    : db_name_(db_name),
+      server_(server),
+      user_(user),
+      password_(password),
+      size_(size > 0 ? size : 1),
+      timeout_(timeout),
+      open_(0),
+      closed_(false) {
+}
+
+ConnectionPool::~ConnectionPool() {
+  Close();
+}
+
+PooledConnection * ConnectionPool::Checkout(std::string *error) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::seconds(timeout_);
+
+  while (true) {
+    if (UNLIKELY(closed_)) {
+      error->assign("Connection pool is closed");
+      return nullptr;
+    }
+
+    if (!idle_.empty()) {
+      IdleConnection idle = idle_.back();
+      idle_.pop_back();
+      lock.unlock();
+
+      if (time(NULL) - idle.since < DB_PING_INTERVAL ||
+          idle.connection->ping())
+        return idle.connection;
+
+      // Server closed the connection, open a new one in place of it.
+      MSS_DEBUG_MESSAGE("Data base connection lost, reconnecting");
+      delete idle.connection;
+      break;
+    }
+
+    if (open_ < size_) {
+      ++open_;
+      lock.unlock();
+      break;
+    }
+
+    if (released_.wait_until(lock, deadline) == std::cv_status::timeout &&
+        idle_.empty() && open_ >= size_) {
+      error->assign("Timed out waiting for a free data base connection");
+      return nullptr;
+    }
+  }
+
+  PooledConnection *connection = Connect(error);
+  if (UNLIKELY(connection == nullptr)) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    --open_;
+    released_.notify_one();
+  }
+  return connection;
+}
+
+void ConnectionPool::Release(PooledConnection *connection,
+                             const bool broken) {
+  if (connection == nullptr)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!closed_ && !broken) {
+      idle_.push_back({connection, time(NULL)});
+      released_.notify_one();
+      return;
+    }
+    --open_;
+    released_.notify_one();
+  }
+  delete connection;
+}
+
+void ConnectionPool::Close() {
+  std::vector<IdleConnection> idle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    open_ -= idle_.size();
+    idle.swap(idle_);
+    released_.notify_all();
+  }
+
+  for (auto &entry : idle)
+    delete entry.connection;
+}
+
+size_t ConnectionPool::get_open_count() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return open_;
+}
+
+size_t ConnectionPool::get_idle_count() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return idle_.size();
+}
+
+PooledConnection * ConnectionPool::Connect(std::string *error) {
+  int delay = DB_CONNECT_DELAY;
+
+  for (int attempt = 1; ; ++attempt) {
+    try {
+      std::unique_ptr<PooledConnection> connection(
+          new PooledConnection(db_name_, server_, user_, password_));
+      // We need in utf-8 encoding support
+      connection->query("SET CHARSET UTF8").execute();
+      return connection.release();
+    } catch(const mysqlpp::Exception &exception) {
+      error->assign(exception.what());
+    } catch(const std::bad_alloc &exception) {
+      error->assign(exception.what());
+      return nullptr;
+    }
+
+    if (attempt >= DB_CONNECT_ATTEMPTS)
+      return nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (closed_)
+        return nullptr;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+    delay *= 2;
+  }
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DATA_STORAGE_CONNECTIONPOOL_H_
+#define DATA_STORAGE_CONNECTIONPOOL_H_
+
+#define MYSQLPP_MYSQL_HEADERS_BURIED
+
+#include <time.h>
+
+#include <mysql++/mysql++.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "data-storage/preparedstatement.h"
+#include "common-inl.h"
+#include "config.h"
+
+/**
+ * Connection of a pool with its prepared statements.
+ */
+class PooledConnection : public mysqlpp::TCPConnection {
+  public:
+    /**
+     * Connect to server.
+     *
+     * @param db_name Name of the database on the server.
+     * @param server Domain name or ip address of server.
+     * @param user Username with access to the database.
+     * @param password Password for specifed user.
+     */
+    PooledConnection(const std::string &db_name, const std::string &server,
+                     const std::string &user, const std::string &password)
+        : mysqlpp::TCPConnection(server.c_str(), db_name.c_str(),
+                                 user.c_str(), password.c_str()),
+          statements_(driver()->mysql_handle()) {
+    }
+
+    /**
+     * Get prepared statements of this connection.
+     *
+     * @return Statement cache.
+     */
+    inline StatementCache & get_statements() { return statements_; }
+
+  private:
+    /**
+     * Closed before the connection itself.
+     */
+    StatementCache statements_;
+};
+
+/**
+ * Thread-safe pool of connections to one data base.
+ *
+ * Connections are opened lazily, up to the size of the pool. A connection
+ * idle for more than DB_PING_INTERVAL seconds is pinged before it is handed
+ * out and is replaced if the server doesn't answer. Failed connects are
+ * retried DB_CONNECT_ATTEMPTS times with exponential backoff.
+ */
+class ConnectionPool {
+  public:
+    /**
+     * Constructor. Doesn't connect to the server.
+     *
+     * @param db_name Name of the database on the server where data is stored.
+     * @param server Domain name or ip address of server where data is stored.
+     * @param user Username with access to the database.
+     * @param password Password for specifed user.
+     * @param size Maximum number of open connections.
+     * @param timeout How long in seconds Checkout() waits for a free
+     * connection when all of them are in use.
+     */
+    ConnectionPool(const std::string &db_name, const std::string &server,
+                   const std::string &user, const std::string &password,
+                   const size_t size = DB_POOL_SIZE,
+                   const int timeout = DB_POOL_TIMEOUT);
+
+    /**
+     * Destructor. Closes idle connections, connections which are still
+     * checked out are closed when released.
+     */
+    ~ConnectionPool();
+
+    /**
+     * Take a connection for exclusive use. Blocks while all connections are
+     * in use.
+     *
+     * @param error Where to store error message on failure.
+     *
+     * @return Connection or nullptr on error.
+     */
+    PooledConnection * Checkout(std::string *error);
+
+    /**
+     * Return a connection taken with Checkout().
+     *
+     * @param connection Connection to return.
+     * @param broken Whether the connection is known to be unusable, it is
+     * closed then instead of being reused.
+     */
+    void Release(PooledConnection *connection, const bool broken = false);
+
+    /**
+     * Close idle connections and fail all next checkouts.
+     */
+    void Close();
+
+    /**
+     * Get maximum number of open connections.
+     *
+     * @return Size of the pool.
+     */
+    inline size_t get_size() const { return size_; }
+
+    /**
+     * Get number of open connections, checked out and idle.
+     *
+     * @return Number of open connections.
+     */
+    size_t get_open_count();
+
+    /**
+     * Get number of idle connections.
+     *
+     * @return Number of idle connections.
+     */
+    size_t get_idle_count();
+
+  private:
+    /**
+     * Open a new connection, retrying with backoff.
+     *
+     * @param error Where to store error message on failure.
+     *
+     * @return Connection or nullptr on error.
+     */
+    PooledConnection * Connect(std::string *error);
+
+    /**
+     * Connection waiting for checkout.
+     */
+    struct IdleConnection {
+      PooledConnection *connection;
+      time_t since;
+    };
+
+    /**
+     * Connection parameters.
+     */
+    std::string db_name_;
+    std::string server_;
+    std::string user_;
+    std::string password_;
+
+    /**
+     * Maximum number of open connections.
+     */
+    size_t size_;
+
+    /**
+     * Checkout timeout in seconds.
+     */
+    int timeout_;
+
+    /**
+     * Protects all fields below.
+     */
+    std::mutex mutex_;
+
+    /**
+     * Signalled when a connection is released.
+     */
+    std::condition_variable released_;
+
+    /**
+     * Idle connections, the most recently used is the last.
+     */
+    std::vector<IdleConnection> idle_;
+
+    /**
+     * Number of open connections, including ones being opened.
+     */
+    size_t open_;
+
+    /**
+     * Set by Close().
+     */
+    bool closed_;
+
+    DISALLOW_COPY_AND_ASSIGN(ConnectionPool);
+};
+
+#endif  // DATA_STORAGE_CONNECTIONPOOL_H_
@@ -1,4 +1,6 @@
 TEMPLATE = lib
-SOURCES += entities.cpp
-HEADERS += entities.h
+SOURCES += entities.cpp batchwriter.cpp trigramindex.cpp connectionpool.cpp \
+           preparedstatement.cpp
+HEADERS += entities.h batchwriter.h trigramindex.h connectionpool.h \
+           preparedstatement.h entitycache.h
 OTHER_FILES += Makefile
@@ -26,62 +26,205 @@
 
 #define EXPAND_MY_SSQLS_STATICS
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "entities.h"
+#include "trigramindex.h"
 #include "common-inl.h"
+#include "config.h"
+
+std::shared_ptr<ConnectionPool> DatabaseEntity::pool_;
+std::mutex DatabaseEntity::pool_mutex_;
+thread_local DatabaseEntity::ThreadConnection
+    DatabaseEntity::thread_connection_;
+thread_local std::string DatabaseEntity::db_error_;
+std::shared_ptr<TrigramIndex> FileEntry::name_index_;
+EntityCache<int, FileAttribute> FileAttribute::cache_;
+EntityCache<int, FileEntry> FileEntry::cache_;
+EntityCache<std::string, int> FileEntry::path_cache_;
+
+/**
+ * Build the limit clause of a query, empty if all rows are needed.
+ *
+ * @param offset Number of rows to skip.
+ * @param limit Maximum number of rows, 0 for all.
+ */
+static std::string LimitClause(const uint64_t offset, const uint64_t limit) {
+  if (offset == 0 && limit == 0)
+    return std::string();
+
+  // MySQL has no offset without a limit, the maximum means all rows.
+  return " limit " + std::to_string(offset) + "," +
+         (limit ? std::to_string(limit) : "18446744073709551615");
+}
+
+/**
+ * Build the end of a where condition, order and limit clauses of a query
+ * over mss_files, empty if all rows are needed. Pages are taken in order of
+ * ids, so that consecutive pages neither skip nor repeat rows.
+ *
+ * @param offset Number of rows to skip.
+ * @param limit Maximum number of rows, 0 for all.
+ * @param after_id Only files with greater ids are selected, 0 for all.
+ */
+static std::string PageClause(const uint64_t offset, const uint64_t limit,
+                              const int after_id = 0) {
+  if (offset == 0 && limit == 0 && after_id <= 0)
+    return std::string();
+
+  std::string clause;
+  if (after_id > 0)
+    clause = " and files.id > " + std::to_string(after_id);
+  return clause + " order by files.id" + LimitClause(offset, limit);
+}
+
+/**
+ * Build the order and limit clauses which leave rows with numbers above
+ * min_rownum and below max_rownum, like the vector finders promise. Rows
+ * are always ordered by ids, so the numbers match the name index path.
+ *
+ * @param min_rownum Rows from 1 to min_rownum are removed, 0 for none.
+ * @param max_rownum Rows from max_rownum to last are removed, 0 for none.
+ */
+static std::string RownumClause(const int min_rownum, const int max_rownum) {
+  int64_t offset = std::max(min_rownum, 0);
+  if (max_rownum <= 0)
+    return " order by files.id" + LimitClause(offset, 0);
+
+  // "limit n,0" selects nothing when the range is empty.
+  int64_t limit = std::max<int64_t>(max_rownum - 1 - offset, 0);
+  return " order by files.id limit " + std::to_string(offset) + "," +
+         std::to_string(limit);
+}
+
+DatabaseEntity::ThreadConnection::~ThreadConnection() {
+  Release(false);
+}
+
+void DatabaseEntity::ThreadConnection::Release(const bool broken) {
+  if (connection == nullptr)
+    return;
+
+  bool rolled_back = true;
+  if (transaction != nullptr) {
+    try {
+      transaction->rollback();
+    } catch(const mysqlpp::Exception &e) {
+      rolled_back = false;
+    }
+    transaction.reset();
+  }
 
-mysqlpp::TCPConnection DatabaseEntity::db_connection_;
-std::string DatabaseEntity::db_error_;
-std::shared_ptr<mysqlpp::Transaction> DatabaseEntity::current_transaction_;
+  pool->Release(connection, broken || !rolled_back);
+  connection = nullptr;
+  pool.reset();
+}
 
 mysqlpp::TCPConnection & DatabaseEntity::get_db_connection() {
-  if (db_connection_.connected())
-    return db_connection_;
-  throw mysqlpp::ConnectionFailed();
+  ThreadConnection &bound = thread_connection_;
+  time_t now = time(NULL);
+
+  // Replace connection lost while the thread kept it, unless a transaction
+  // is open on it.
+  if (bound.connection != nullptr && bound.transaction == nullptr &&
+      now - bound.last_used >= DB_PING_INTERVAL &&
+      !bound.connection->ping()) {
+    MSS_DEBUG_MESSAGE("Data base connection lost, reconnecting");
+    bound.Release(true);
+  }
+
+  if (bound.connection == nullptr) {
+    std::shared_ptr<ConnectionPool> pool = std::atomic_load(&pool_);
+    if (UNLIKELY(pool == nullptr))
+      throw mysqlpp::ConnectionFailed("Not connected to data base");
+
+    std::string error;
+    bound.connection = pool->Checkout(&error);
+    if (UNLIKELY(bound.connection == nullptr))
+      throw mysqlpp::ConnectionFailed(error.c_str());
+    bound.pool = pool;
+  }
+
+  bound.last_used = now;
+  return *bound.connection;
+}
+
+PreparedStatement & DatabaseEntity::get_statement(const std::string &text) {
+  get_db_connection();
+  return thread_connection_.connection->get_statements().Get(text);
 }
 
 bool DatabaseEntity::ConnectToServer(const std::string &db_name,
                                      const std::string &server,
                                      const std::string &user,
                                      const std::string &password,
-                                     const bool reconnect) {
-  if (db_connection_.connected() && !reconnect)
+                                     const bool reconnect,
+                                     const size_t pool_size) {
+  std::lock_guard<std::mutex> lock(pool_mutex_);
+  if (std::atomic_load(&pool_) != nullptr && !reconnect)
     return true;
 
+  std::shared_ptr<ConnectionPool> pool;
   try {
-    db_connection_ = mysqlpp::TCPConnection(server.c_str(), db_name.c_str(),
-                                            user.c_str(), password.c_str());
-    // We need in utf-8 encoding support
-    db_connection_.query("SET CHARSET UTF8").execute();
-    return true;
-  } catch(const mysqlpp::Exception &exception) {
-    db_error_= std::string(exception.what());
+    pool = std::make_shared<ConnectionPool>(db_name, server, user, password,
+                                            pool_size);
+  } catch(const std::bad_alloc &e) {
+    db_error_ = e.what();
+    return false;
+  }
+
+  // Check parameters right away, the connection stays with this thread.
+  std::string error;
+  PooledConnection *connection = pool->Checkout(&error);
+  if (connection == nullptr) {
+    db_error_ = error;
     return false;
   }
+
+  thread_connection_.Release(false);
+  std::shared_ptr<ConnectionPool> old = std::atomic_exchange(&pool_, pool);
+  if (old != nullptr)
+    old->Close();
+
+  thread_connection_.pool = pool;
+  thread_connection_.connection = connection;
+  thread_connection_.last_used = time(NULL);
+
+  // Cached entities may belong to another data base.
+  FileAttribute::ClearCache();
+  FileEntry::ClearCache();
+  return true;
 }
 
 bool DatabaseEntity::Disconnect() {
-  if (!db_connection_.connected())
-    return true;
+  std::lock_guard<std::mutex> lock(pool_mutex_);
+  thread_connection_.Release(false);
 
-  try {
-    db_connection_.disconnect();
-    return true;
-  } catch(const mysqlpp::Exception &exception) {
-    db_error_ = std::string(exception.what());
-    return false;
-  }
+  std::shared_ptr<ConnectionPool> pool =
+      std::atomic_exchange(&pool_, std::shared_ptr<ConnectionPool>());
+  if (pool != nullptr)
+    pool->Close();
+
+  FileAttribute::ClearCache();
+  FileEntry::ClearCache();
+  return true;
+}
+
+void DatabaseEntity::ReleaseConnection() {
+  thread_connection_.Release(false);
 }
 
 bool DatabaseEntity::StartTransaction() {
-  if (current_transaction_ != nullptr)
+  ThreadConnection &bound = thread_connection_;
+  if (bound.transaction != nullptr)
     return true;
   try {
-    current_transaction_ =
+    mysqlpp::TCPConnection &connection = get_db_connection();
+    bound.transaction =
         std::shared_ptr<mysqlpp::Transaction>(
-            new mysqlpp::Transaction(get_db_connection()));
+            new mysqlpp::Transaction(connection));
     return true;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
@@ -93,14 +236,15 @@ bool DatabaseEntity::StartTransaction() {
 }
 
 bool DatabaseEntity::CommitTransaction() {
-  if (current_transaction_ == nullptr) {
+  ThreadConnection &bound = thread_connection_;
+  if (bound.transaction == nullptr) {
     MSS_DEBUG_MESSAGE("Attemp detecting to commit not started transaction");
     return true;
   }
 
   try {
-    current_transaction_->commit();
-    current_transaction_.reset();
+    bound.transaction->commit();
+    bound.transaction.reset();
     return true;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
@@ -109,14 +253,15 @@ bool DatabaseEntity::CommitTransaction() {
 }
 
 bool DatabaseEntity::RollbackTransaction() {
-  if (current_transaction_ == nullptr) {
+  ThreadConnection &bound = thread_connection_;
+  if (bound.transaction == nullptr) {
     MSS_DEBUG_MESSAGE("Attemp detecting to rollback not started transaction");
     return true;
   }
 
   try {
-    current_transaction_->rollback();
-    current_transaction_.reset();
+    bound.transaction->rollback();
+    bound.transaction.reset();
     return true;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
@@ -127,17 +272,24 @@ bool DatabaseEntity::RollbackTransaction() {
 FileAttribute::FileAttribute(const std::string &name,
                              const AttributeType type) {
   try {
-    mysqlpp::Query insert_query = get_db_connection().query();
     mss_attributes row(0, name, AttrTypeToString(type));
 
-    insert_query.replace(row);
-    insert_query.execute();
+    PreparedStatement &insert =
+        get_statement("replace into mss_attributes (name, type) "
+                      "values (?, ?)");
+    insert.BindString(0, row.name);
+    insert.BindString(1, row.type);
+    insert.Execute();
 
-    id_ = insert_query.insert_id();
+    id_ = insert.get_insert_id();
     row.id = id_;
     name_ = row.name;
     type_ = type;
     orig_row_ = row;
+
+    // "replace" drops the old row with the same name, its id is unknown.
+    cache_.Clear();
+    Cache(*this, cache_.get_version());
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
     throw e;
@@ -153,13 +305,26 @@ FileAttribute::FileAttribute(const mss_attributes &orig_row) {
 
 std::shared_ptr<FileAttribute> FileAttribute::GetById(const int id) {
   try {
-    mysqlpp::Query query = get_db_connection().query("select * from "
-                                                "mss_attributes attr where "
-                                                "attr.id = %0:id");
-    query.parse();
-    mss_attributes row(query.store(id)[0]);
+    std::shared_ptr<const FileAttribute> cached = cache_.Get(id);
+    if (cached != nullptr)
+      return std::shared_ptr<FileAttribute>(CopyToHeap(*cached));
+
+    uint64_t version = cache_.get_version();
+    PreparedStatement &query =
+        get_statement("select id, name, type from mss_attributes "
+                      "where id = ?");
+    query.BindInt(0, id);
+    query.Execute();
+    if (!query.Fetch()) {
+      db_error_ = "No attribute with id " + std::to_string(id);
+      return nullptr;
+    }
+    mss_attributes row(query.GetInt(0), query.GetString(1),
+                       query.GetString(2));
 
-    return std::shared_ptr<FileAttribute>(new FileAttribute(row));
+    std::shared_ptr<FileAttribute> attribute(new FileAttribute(row));
+    Cache(*attribute, version);
+    return attribute;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
     return nullptr;
@@ -176,9 +341,12 @@ std::shared_ptr<FileAttribute> FileAttribute::GetByName(
                                                 "mss_attributes attr where "
                                                 "attr.name like %0q:name");
     query.parse();
+    uint64_t version = cache_.get_version();
     mss_attributes row(query.store(name)[0]);
 
-    return std::shared_ptr<FileAttribute>(new FileAttribute(row));
+    std::shared_ptr<FileAttribute> attribute(new FileAttribute(row));
+    Cache(*attribute, version);
+    return attribute;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
     return nullptr;
@@ -197,13 +365,16 @@ std::shared_ptr<FileAttribute> FileAttribute::GetByNameAndType(
                                                 "and attr.type = %1q:type");
 
     query.parse();
+    uint64_t version = cache_.get_version();
     mysqlpp::StoreQueryResult findedRows
         = query.store(name, AttrTypeToString(type));
     if (findedRows.num_rows() < 1)
       return nullptr;
     mss_attributes row(findedRows[0]);
 
-    return std::shared_ptr<FileAttribute>(new FileAttribute(row));
+    std::shared_ptr<FileAttribute> attribute(new FileAttribute(row));
+    Cache(*attribute, version);
+    return attribute;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
     return nullptr;
@@ -213,6 +384,19 @@ std::shared_ptr<FileAttribute> FileAttribute::GetByNameAndType(
   }
 }
 
+void FileAttribute::ClearCache() {
+  cache_.Clear();
+}
+
+void FileAttribute::Cache(const FileAttribute &attribute,
+                          const uint64_t version) {
+  // Rows of an open transaction may be rolled back.
+  if (thread_connection_.transaction != nullptr)
+    return;
+  cache_.Put(attribute.id_, std::shared_ptr<const FileAttribute>(
+      CopyToHeap(attribute)), version);
+}
+
 std::string FileAttribute::AttrTypeToString(const AttributeType type) {
   std::string result;
   switch (type) {
@@ -266,23 +450,33 @@ FileEntry::FileEntry(const int id, const std::string &name,
 FileEntry::FileEntry(const std::string &file_name, const std::string &file_path,
                      const std::string &server_name) {
   try {
-    mysqlpp::Query insert_query = get_db_connection().query();
     struct timeval current_time;
     gettimeofday(&current_time, NULL);
 
     mss_files row(0, file_name, file_path, server_name);
 
-    insert_query.replace(row);
-    insert_query.execute();
+    PreparedStatement &insert =
+        get_statement("replace into mss_files "
+                      "(name, file_path, server_name, last_seen) "
+                      "values (?, ?, ?, current_timestamp)");
+    insert.BindString(0, file_name);
+    insert.BindString(1, file_path);
+    insert.BindString(2, server_name);
+    insert.Execute();
 
-    id_ = insert_query.insert_id();
+    id_ = insert.get_insert_id();
     row.id = id_;
+    row.last_seen = mysqlpp::DateTime(current_time.tv_sec);
 
     name_ = file_name;
     file_path_ = file_path;
     server_name_ = server_name;
     timestamp_ = current_time.tv_sec;
     orig_row_ = row;
+
+    // "replace" gives the file a new id.
+    Uncache(file_path, server_name);
+    Cache(*this, cache_.get_version());
   } catch(const mysqlpp::Exception &e) {
     db_error_ = std::string(e.what());
   }
@@ -290,191 +484,409 @@ FileEntry::FileEntry(const std::string &file_name, const std::string &file_path,
 
 std::vector<std::shared_ptr<FileEntry> > *FileEntry::FindByName(
     const std::string &name, const int min_rownum, const int max_rownum) {
-  mysqlpp::StoreQueryResult search_result;
+  std::shared_ptr<TrigramIndex> index = std::atomic_load(&name_index_);
+  std::vector<int> ids;
+  if (index && index->Find(name, &ids)) {
+    return FindByNameInIds(ids, index->get_last_id(), name, min_rownum,
+                           max_rownum);
+  }
 
   try {
-    // Create query for searching row with specifed name and beetwen
-    std::string query_text = "select * from mss_files files where "
-        "files.id like %0%q:name:%\n";
-    if (min_rownum > 0)
-      query_text.append("and rownum > %1:min_rownum \n");
-    if (max_rownum > 0)
-      query_text.append("and max_rownum < %2:max_rownum");
-
-    mysqlpp::Query search_query = get_db_connection().query(query_text.c_str());
+    mysqlpp::Query search_query = get_db_connection().query(
+        ("select * from mss_files files where files.name like %0q:name" +
+         RownumClause(min_rownum, max_rownum)).c_str());
     search_query.parse();
 
-    search_result = search_query.store(name.c_str(), min_rownum, max_rownum);
+    mysqlpp::UseQueryResult result = search_query.use("%" + name + "%");
+    return UseResultToVector(&result);
   } catch(const mysqlpp::Exception &e) {
     db_error_ = std::string(e.what());
     return NULL;
   }
+}
 
-  return QueryResultToVector(search_result);
+void FileEntry::set_name_index(const std::shared_ptr<TrigramIndex> &index) {
+  std::atomic_store(&name_index_, index);
+}
+
+std::vector<std::shared_ptr<FileEntry> > *FileEntry::FindByNameInIds(
+    const std::vector<int> &ids, const int last_id, const std::string &name,
+    const int min_rownum, const int max_rownum) {
+  auto final_result =
+      new(std::nothrow) std::vector<std::shared_ptr<FileEntry> >();
+  if (final_result == NULL)  {
+    db_error_ = std::string("Error while allocating memory");
+    return NULL;
+  }
+
+  // Number of matched rows, including skipped ones.
+  int rownum = 0;
+
+  auto collect = [&](const FileEntry &entry) {
+    ++rownum;
+    if (max_rownum > 0 && rownum >= max_rownum)
+      return false;
+    if (rownum > min_rownum)
+      final_result->push_back(std::make_shared<FileEntry>(entry));
+    return true;
+  };
+  if (!FindEachInIds(ids, last_id, name, collect)) {
+    delete final_result;
+    return NULL;
+  }
+
+  return final_result;
+}
+
+bool FileEntry::FindEachInIds(const std::vector<int> &ids, const int last_id,
+                              const std::string &name,
+                              const Visitor &visitor,
+                              const uint32_t offset, const uint32_t limit,
+                              const int after_id) {
+  // Chunks are limited to the rows which may still be needed, found files
+  // are skipped here because every chunk starts from zero.
+  uint32_t skip = offset;
+  uint32_t left = limit;
+  bool stopped = false;
+  auto limited = [&](const FileEntry &entry) {
+    if (skip > 0) {
+      --skip;
+      return true;
+    }
+    stopped = !visitor(entry) || (limit > 0 && --left == 0);
+    return !stopped;
+  };
+
+  try {
+    mysqlpp::Query query = get_db_connection().query();
+
+    // Candidates are a superset of the result, the data base checks names
+    // with the same collation as the full scan does.
+    std::string pattern("%" + name + "%");
+    std::string condition(") and files.name like '");
+    std::string escaped;
+    query.escape_string(&escaped, pattern.data(), pattern.size());
+    condition.append(escaped);
+    condition.append("' order by files.id");
+
+    size_t first = std::upper_bound(ids.begin(), ids.end(), after_id) -
+                   ids.begin();
+    for (size_t begin = first; begin < ids.size() && !stopped;
+         begin += NAME_INDEX_CHUNK) {
+      size_t end = std::min(ids.size(), begin + NAME_INDEX_CHUNK);
+      std::string statement("select * from mss_files files "
+                            "where files.id in (");
+      for (size_t i = begin; i < end; ++i) {
+        if (i != begin)
+          statement.push_back(',');
+        statement.append(std::to_string(ids[i]));
+      }
+      statement.append(condition);
+      if (limit > 0)
+        statement.append(LimitClause(0, static_cast<uint64_t>(skip) + left));
+
+      mysqlpp::UseQueryResult result = query.use(statement);
+      VisitRows(&result, limited);
+    }
+
+    // Files added after the index was built, ids grow.
+    if (!stopped) {
+      std::string statement("select * from mss_files files "
+                            "where (files.id > ");
+      statement.append(std::to_string(std::max(last_id, after_id)));
+      statement.append(condition);
+      statement.append(LimitClause(skip, left));
+      skip = 0;
+      mysqlpp::UseQueryResult result = query.use(statement);
+      VisitRows(&result, limited);
+    }
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = std::string(e.what());
+    return false;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = std::string(e.what());
+    return false;
+  }
+
+  return true;
 }
 
 std::vector<std::shared_ptr<FileEntry> > *FileEntry::GetByName(
     const std::string &name, const int min_rownum, const int max_rownum) {
-  mysqlpp::StoreQueryResult search_result;
-
   try {
-    // Create query for searching row with specifed name and beetwen
-    std::string query_text = "select * from mss_files files where "
-        "files.id like %0q:name:\n";
-    if (min_rownum > 0)
-      query_text.append("and rownum > %1:min_rownum \n");
-    if (max_rownum > 0)
-      query_text.append("and max_rownum < %2:max_rownum");
-
-    mysqlpp::Query search_query = get_db_connection().query(query_text.c_str());
+    mysqlpp::Query search_query = get_db_connection().query(
+        ("select * from mss_files files where files.name = %0q:name" +
+         RownumClause(min_rownum, max_rownum)).c_str());
     search_query.parse();
 
-    search_result = search_query.store(name.c_str(), min_rownum, max_rownum);
+    mysqlpp::UseQueryResult result = search_query.use(name);
+    return UseResultToVector(&result);
   } catch(const mysqlpp::Exception &e) {
     db_error_ = std::string(e.what());
     return NULL;
   }
-
-  return QueryResultToVector(search_result);
 }
 
 std::vector<std::shared_ptr<FileEntry> > *FileEntry::GetByServer(
     const std::string &server_name, const int min_rownum,
     const int max_rownum) {
-  mysqlpp::StoreQueryResult search_result;
-
   try {
-    // Create query for searching row with specifed name and beetwen
-    std::string query_text = "select * from mss_files files where "
-        "files.server_name like %0q:name:\n";
-    if (min_rownum > 0)
-      query_text.append("and rownum > %1:min_rownum \n");
-    if (max_rownum > 0)
-      query_text.append("and max_rownum < %2:max_rownum");
-
-    mysqlpp::Query search_query = get_db_connection().query(query_text.c_str());
+    mysqlpp::Query search_query = get_db_connection().query(
+        ("select * from mss_files files where files.server_name = "
+         "%0q:server" + RownumClause(min_rownum, max_rownum)).c_str());
     search_query.parse();
 
-    search_result = search_query.store(server_name.c_str(), min_rownum,
-                                       max_rownum);
+    mysqlpp::UseQueryResult result = search_query.use(server_name);
+    return UseResultToVector(&result);
   } catch(const mysqlpp::Exception &e) {
     db_error_ = std::string(e.what());
     return NULL;
   }
-
-  return QueryResultToVector(search_result);
 }
 
 std::shared_ptr<FileEntry> FileEntry::GetByPathOnServer(
     const std::string &path, const std::string &server) {
-  mysqlpp::StoreQueryResult result;
-
   try {
-    std::string query_text = "select * from mss_files files "
-        "where files.file_path = %0q:path and files.server_name = %1q:server";
-    mysqlpp::Query query = get_db_connection().query(query_text.c_str());
-    query.parse();
+    std::shared_ptr<const int> id = path_cache_.Get(CacheKey(path, server));
+    if (id != nullptr) {
+      std::shared_ptr<FileEntry> entry = FindCached(*id);
+      if (entry != nullptr && entry->file_path_ == path &&
+          entry->server_name_ == server)
+        return entry;
+    }
 
-    result = query.store(path, server);
+    uint64_t version = cache_.get_version();
+    PreparedStatement &query =
+        get_statement("select id, name, file_path, server_name, last_seen "
+                      "from mss_files where file_path = ? "
+                      "and server_name = ?");
+    query.BindString(0, path);
+    query.BindString(1, server);
+    query.Execute();
+    std::shared_ptr<FileEntry> entry = FetchOne(&query);
+    if (entry != nullptr)
+      Cache(*entry, version);
+    return entry;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
     MSS_DEBUG_MESSAGE(e.what());
+    return nullptr;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = e.what();
+    return nullptr;
   }
+}
 
-  // On Success
-  if (result.size() == 1) {
-    try {
-      mss_files result_row(result[0]);
-      return std::shared_ptr<FileEntry>(new FileEntry(result_row));
-    } catch(const std::bad_alloc &e) {
-      db_error_ = std::string(e.what());
-    }
+bool FileEntry::FindEachByName(const std::string &name,
+                               const Visitor &visitor,
+                               const uint32_t offset, const uint32_t limit,
+                               const int after_id) {
+  std::shared_ptr<TrigramIndex> index = std::atomic_load(&name_index_);
+  std::vector<int> ids;
+  if (index && index->Find(name, &ids)) {
+    return FindEachInIds(ids, index->get_last_id(), name, visitor, offset,
+                         limit, after_id);
+  }
+
+  try {
+    mysqlpp::Query query = get_db_connection().query(
+        ("select * from mss_files files where files.name like %0q:name" +
+         PageClause(offset, limit, after_id)).c_str());
+    query.parse();
+    mysqlpp::UseQueryResult result = query.use("%" + name + "%");
+    VisitRows(&result, visitor);
+    return true;
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = std::string(e.what());
+    return false;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = std::string(e.what());
+    return false;
+  }
+}
+
+bool FileEntry::GetEachByName(const std::string &name,
+                              const Visitor &visitor,
+                              const uint32_t offset, const uint32_t limit) {
+  try {
+    mysqlpp::Query query = get_db_connection().query(
+        ("select * from mss_files files where files.name = %0q:name" +
+         PageClause(offset, limit)).c_str());
+    query.parse();
+    mysqlpp::UseQueryResult result = query.use(name);
+    VisitRows(&result, visitor);
+    return true;
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = std::string(e.what());
+    return false;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = std::string(e.what());
+    return false;
   }
+}
 
-  // On error
-  if (result != 0)
-    db_error_ = std::string("More then one row finded, this is db error");
+bool FileEntry::GetEachByServer(const std::string &server_name,
+                                const Visitor &visitor,
+                                const uint32_t offset, const uint32_t limit,
+                                const int after_id) {
+  try {
+    mysqlpp::Query query = get_db_connection().query(
+        ("select * from mss_files files where files.server_name = "
+         "%0q:server" + PageClause(offset, limit, after_id)).c_str());
+    query.parse();
+    mysqlpp::UseQueryResult result = query.use(server_name);
+    VisitRows(&result, visitor);
+    return true;
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = std::string(e.what());
+    return false;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = std::string(e.what());
+    return false;
+  }
+}
 
-  return nullptr;
+void FileEntry::VisitRows(mysqlpp::UseQueryResult *result,
+                          const Visitor &visitor) {
+  bool visiting = true;
+  try {
+    while (mysqlpp::Row row = result->fetch_row()) {
+      if (!visiting)
+        continue;
+      mss_files typed_row(row);
+      visiting = visitor(FileEntry(typed_row));
+    }
+  } catch(...) {
+    // Rows left unread would break the next query of the connection.
+    while (result->fetch_row()) {
+    }
+    throw;
+  }
 }
 
-std::vector<std::shared_ptr<FileEntry> > *FileEntry::QueryResultToVector(
-    mysqlpp::StoreQueryResult &result) {
-  // Final query result
+std::vector<std::shared_ptr<FileEntry> > *FileEntry::UseResultToVector(
+    mysqlpp::UseQueryResult *result) {
   auto final_result =
-      new(std::nothrow) std::vector<std::shared_ptr<FileEntry>>(result.size());
+      new(std::nothrow) std::vector<std::shared_ptr<FileEntry> >();
   if (final_result == NULL)  {
     db_error_ = std::string("Error while allocating memory");
     return NULL;
   }
 
-  auto insert_iterator = final_result->begin();
-  for (mysqlpp::Row &row : result) {
-    mss_files typed_row(row);
-
-    try {
-      *insert_iterator = std::shared_ptr<FileEntry>(new FileEntry(typed_row));
-    } catch(const std::bad_alloc &e) {
-      db_error_ = std::string(e.what());
-      delete final_result;
-      return NULL;
-    }
-
-    insert_iterator++;
+  try {
+    VisitRows(result, [final_result](const FileEntry &entry) {
+      final_result->push_back(std::make_shared<FileEntry>(entry));
+      return true;
+    });
+  } catch(const std::bad_alloc &e) {
+    db_error_ = std::string(e.what());
+    delete final_result;
+    return NULL;
+  } catch(...) {
+    delete final_result;
+    throw;
   }
 
   return final_result;
 }
 
 std::shared_ptr<FileEntry> FileEntry::GetById(const int id) {
-  mysqlpp::Query query =
-      get_db_connection().query("select * from mss_files files "
-                                "where files.id = %0:id");
-  query.parse();
-
-  mss_files only_row;
   try {
-    mysqlpp::StoreQueryResult query_result = query.store(id);
-    if (query_result.num_rows() != 1) {
-      if (query_result.num_rows() == 0)
-        return nullptr;
-      db_error_ = std::string("Query return more than one row, "
-                              "this is db error");
-      return nullptr;
-    }
-    only_row = query_result[0];
+    std::shared_ptr<FileEntry> entry = FindCached(id);
+    if (entry != nullptr)
+      return entry;
+
+    uint64_t version = cache_.get_version();
+    PreparedStatement &query =
+        get_statement("select id, name, file_path, server_name, last_seen "
+                      "from mss_files where id = ?");
+    query.BindInt(0, id);
+    query.Execute();
+    entry = FetchOne(&query);
+    if (entry != nullptr)
+      Cache(*entry, version);
+    return entry;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = std::string(e.what());
     return nullptr;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = e.what();
+    return nullptr;
   }
+}
 
-  return std::shared_ptr<FileEntry> (new FileEntry(only_row));
+void FileEntry::Uncache(const std::string &path, const std::string &server) {
+  std::shared_ptr<const int> id = path_cache_.Remove(CacheKey(path, server));
+  if (id != nullptr)
+    cache_.Remove(*id);
+  else
+    cache_.Expire();
 }
 
-FileParameter::FileParameter(const mss_parameters &orig_row)
-  : str_value_(orig_row.str_value),
-    num_value_(orig_row.num_value),
-    bool_value_(orig_row.bool_value) {
+void FileEntry::ClearCache() {
+  cache_.Clear();
+  path_cache_.Clear();
+}
+
+std::shared_ptr<FileEntry> FileEntry::FindCached(const int id) {
+  std::shared_ptr<const FileEntry> cached = cache_.Get(id);
+  if (cached == nullptr)
+    return nullptr;
+  return std::shared_ptr<FileEntry>(CopyToHeap(*cached));
+}
+
+void FileEntry::Cache(const FileEntry &entry, const uint64_t version) {
+  // Rows of an open transaction may be rolled back.
+  if (thread_connection_.transaction != nullptr)
+    return;
+
+  // The path is mapped first, so Uncache() finds the id once the entry is
+  // stored. Mapping of an entry which is not stored is ignored on lookup and
+  // evicted from path_cache_ in time.
+  path_cache_.Put(CacheKey(entry.file_path_, entry.server_name_),
+                  std::make_shared<const int>(entry.id_));
+
+  std::shared_ptr<const FileEntry> evicted;
+  cache_.Put(entry.id_, std::shared_ptr<const FileEntry>(CopyToHeap(entry)),
+             version, &evicted);
+  if (evicted != nullptr) {
+    std::string key = CacheKey(evicted->file_path_, evicted->server_name_);
+    std::shared_ptr<const int> id = path_cache_.Get(key);
+    if (id != nullptr && *id == evicted->id_)
+      path_cache_.Remove(key);
+  }
+}
+
+std::shared_ptr<FileEntry> FileEntry::FetchOne(PreparedStatement *statement) {
+  if (statement->get_num_rows() > 1) {
+    db_error_ = std::string("Query return more than one row, "
+                            "this is db error");
+    return nullptr;
+  }
+  if (!statement->Fetch())
+    return nullptr;
+
+  mss_files row(statement->GetInt(0), statement->GetString(1),
+                statement->GetString(2), statement->GetString(3));
+  row.last_seen = mysqlpp::DateTime(statement->GetTime(4));
+
   try {
-    attr_ = FileAttribute::GetById(orig_row.attr_id);
-    if (attr_ == nullptr)
-      throw std::runtime_error("Error while get attribute with id: " +
-                               std::to_string(orig_row.attr_id));
-
-    file_ = FileEntry::GetById(orig_row.file_id);
-    if (file_ == nullptr)
-      throw std::runtime_error("Error while get file with id: " +
-                               std::to_string(orig_row.file_id));
-    orig_row_ = orig_row;
-  } catch(const mysqlpp::Exception &e) {
-    db_error_ = e.what();
+    return std::shared_ptr<FileEntry>(new FileEntry(row));
   } catch(const std::bad_alloc &e) {
-    db_error_ = e.what();
+    db_error_ = std::string(e.what());
+    return nullptr;
   }
 }
 
-FileParameter::FileParameter(const mysqlpp::Row &orig_row)
-  : FileParameter(mss_parameters(orig_row)) {
+FileParameter::FileParameter(const std::shared_ptr<FileEntry> &file,
+                             const std::shared_ptr<FileAttribute> &attribute,
+                             const mss_parameters &orig_row)
+  : attr_(attribute),
+    file_(file),
+    str_value_(orig_row.str_value),
+    num_value_(orig_row.num_value),
+    bool_value_(orig_row.bool_value),
+    orig_row_(orig_row) {
 }
 
 FileParameter::FileParameter(const FileEntry &file,
@@ -488,10 +900,7 @@ FileParameter::FileParameter(const FileEntry &file,
                      bool_value);
 
   try {
-    mysqlpp::Query insert_query = get_db_connection().query();
-
-    insert_query.replace(row);
-    insert_query.execute();
+    InsertRow(row);
 
     orig_row_ = row;
     attr_ =
@@ -512,47 +921,86 @@ FileParameter::FileParameter(const int file_id, const int attr_id,
                      bool_value);
 
   try {
-    mysqlpp::Query insert_query = get_db_connection().query();
-
-    insert_query.replace(row);
-    insert_query.execute();
+    InsertRow(row);
 
     orig_row_ = row;
-    attr_ = FileAttribute::GetById(file_id);
+    attr_ = FileAttribute::GetById(attr_id);
     file_ = FileEntry::GetById(file_id);
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
   }
 }
 
-std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
-FileParameter::GetByFileAndAttribute(const int file_id, const int attr_id) {
-  mysqlpp::Query query =
-      get_db_connection().query("select * from mss_parameters param "
-                           "where param.file_id = %0:file_id "
-                           "and param.attr_id = %1:attr_id");
-  query.parse();
+void FileParameter::InsertRow(const mss_parameters &row) {
+  PreparedStatement &insert =
+      get_statement("replace into mss_parameters "
+                    "(attr_id, file_id, str_value, num_value, bool_value) "
+                    "values (?, ?, ?, ?, ?)");
+  insert.BindInt(0, row.attr_id);
+  insert.BindInt(1, row.file_id);
+  insert.BindString(2, row.str_value);
+  insert.BindInt(3, row.num_value);
+  insert.BindInt(4, row.bool_value ? 1 : 0);
+  insert.Execute();
+}
 
-  try {
-    mysqlpp::StoreQueryResult result = query.store(file_id, attr_id);
+std::string FileParameter::SelectJoined(const std::string &condition) {
+  return "select param.attr_id, param.file_id, param.str_value, "
+         "param.num_value, param.bool_value, files.name, files.file_path, "
+         "files.server_name, files.last_seen, attr.name, attr.type "
+         "from mss_parameters param "
+         "join mss_files files on files.id = param.file_id "
+         "join mss_attributes attr on attr.id = param.attr_id where " +
+         condition;
+}
 
-    auto finded_parameters = QueryResultToVector(result);
+void FileParameter::AppendJoined(
+    const mysqlpp::StoreQueryResult &result, LoadedEntities *loaded,
+    std::vector<std::shared_ptr<FileParameter> > *parameters) {
+  parameters->reserve(parameters->size() + result.size());
+  for (const mysqlpp::Row &row : result) {
+    int attr_id = row[0];
+    int file_id = row[1];
+
+    std::shared_ptr<FileAttribute> &attr = loaded->attributes[attr_id];
+    if (attr == nullptr) {
+      mss_attributes attr_row(attr_id, std::string(row[9].data(),
+                                                   row[9].length()),
+                              std::string(row[10].data(), row[10].length()));
+      attr = std::shared_ptr<FileAttribute>(new FileAttribute(attr_row));
+    }
 
-    // Get associated with parameters file and attribute object
-    auto attr = FileAttribute::GetById(attr_id);
-    if (attr == nullptr)
-      return nullptr;
+    std::shared_ptr<FileEntry> &file = loaded->files[file_id];
+    if (file == nullptr) {
+      mss_files file_row(file_id, std::string(row[5].data(), row[5].length()),
+                         std::string(row[6].data(), row[6].length()),
+                         std::string(row[7].data(), row[7].length()));
+      file_row.last_seen = row[8];
+      file = std::shared_ptr<FileEntry>(new FileEntry(file_row));
+    }
 
-    auto file = FileEntry::GetById(file_id);
-    if (file == nullptr)
-      return nullptr;
+    mss_parameters param_row(attr_id, file_id,
+                             std::string(row[2].data(), row[2].length()),
+                             row[3], int(row[4]) != 0);
+    parameters->push_back(std::shared_ptr<FileParameter>(
+        new FileParameter(file, attr, param_row)));
+  }
+}
 
-    for (auto parameter : *finded_parameters) {
-      parameter->attr_ = attr;
-      parameter->file_ = file;
-    }
+template <class... Args>
+std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
+FileParameter::LoadJoined(const std::string &condition, const Args &... args) {
+  try {
+    mysqlpp::Query query =
+        get_db_connection().query(SelectJoined(condition).c_str());
+    query.parse();
+    mysqlpp::StoreQueryResult result = query.store(args...);
 
-    return finded_parameters;
+    auto parameters =
+        std::make_shared<std::vector<std::shared_ptr<FileParameter> > >();
+    LoadedEntities loaded;
+    AppendJoined(result, &loaded, parameters.get());
+    return parameters;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
     return nullptr;
@@ -562,49 +1010,62 @@ FileParameter::GetByFileAndAttribute(const int file_id, const int attr_id) {
   }
 }
 
+std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
+FileParameter::GetByFileAndAttribute(const int file_id, const int attr_id) {
+  return LoadJoined("param.file_id = %0:file_id "
+                    "and param.attr_id = %1:attr_id", file_id, attr_id);
+}
+
 std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
 FileParameter::GetByFileAndAttribute(const FileEntry &file,
                                      const FileAttribute &attribute) {
-  mysqlpp::Query query =
-      get_db_connection().query("select * from mss_parameters param "
-                           "where param.file_id = %0:file_id "
-                           "and param.attr_id = %1:attr_id");
-  query.parse();
-
-  try {
-    mysqlpp::StoreQueryResult result = query.store(file.get_id(),
-                                                   attribute.get_id());
-
-    std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
-        finded_parameters = QueryResultToVector(result);
+  return GetByFileAndAttribute(file.get_id(), attribute.get_id());
+}
 
-    auto file_obj = std::shared_ptr<FileEntry>(CopyToHeap<FileEntry>(file));
-    auto attr =
-        std::shared_ptr<FileAttribute>(CopyToHeap<FileAttribute>(attribute));
+std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
+FileParameter::GetByFile(const int file_id) {
+  return LoadJoined("param.file_id = %0:file_id", file_id);
+}
 
-    for (std::shared_ptr<FileParameter> parameter : *finded_parameters) {
-      parameter->attr_ = attr;
-      parameter->file_ = file_obj;
-    }
-    return finded_parameters;
-  } catch(const mysqlpp::Exception &e) {
-    db_error_ = e.what();
-    return nullptr;
-  } catch(const std::bad_alloc &e) {
-    db_error_ = e.what();
-    return nullptr;
-  }
+std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
+    FileParameter::GetByFile(const FileEntry &file) {
+  return GetByFile(file.get_id());
 }
 
 std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
-FileParameter::GetByFile(const int file_id) {
-  mysqlpp::Query query =
-      get_db_connection().query("select * from mss_parameters param "
-                           "where param.file_id = %0:file_id");
-  query.parse();
+FileParameter::GetByFiles(const std::vector<int> &file_ids,
+                          const int attr_id) {
   try {
-    mysqlpp::StoreQueryResult results = query.store(file_id);
-    return QueryResultToVector(results);
+    auto parameters =
+        std::make_shared<std::vector<std::shared_ptr<FileParameter> > >();
+    if (file_ids.empty())
+      return parameters;
+
+    std::vector<int> ids(file_ids);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    std::string condition(") order by param.file_id");
+    if (attr_id >= 0)
+      condition.insert(1, " and param.attr_id = " + std::to_string(attr_id));
+
+    mysqlpp::Query query = get_db_connection().query();
+    LoadedEntities loaded;
+    for (size_t begin = 0; begin < ids.size();
+         begin += PARAMETER_LOAD_CHUNK) {
+      size_t end = std::min(ids.size(), begin + PARAMETER_LOAD_CHUNK);
+      std::string ids_list("param.file_id in (");
+      for (size_t i = begin; i < end; ++i) {
+        if (i != begin)
+          ids_list.push_back(',');
+        ids_list.append(std::to_string(ids[i]));
+      }
+      ids_list.append(condition);
+
+      mysqlpp::StoreQueryResult result = query.store(SelectJoined(ids_list));
+      AppendJoined(result, &loaded, parameters.get());
+    }
+    return parameters;
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
     return nullptr;
@@ -615,19 +1076,43 @@ FileParameter::GetByFile(const int file_id) {
 }
 
 std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
-    FileParameter::GetByFile(const FileEntry &file) {
-  return GetByFile(file.get_id());
+FileParameter::GetByValue(const std::string &str_value, const int attr_id) {
+  std::string condition("param.str_value = %0q:str_value");
+  if (attr_id >= 0)
+    condition.append(" and param.attr_id = %1:attr_id");
+  return LoadJoined(condition, str_value, attr_id);
 }
 
 std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
-FileParameter::QueryResultToVector(const mysqlpp::StoreQueryResult &result) {
-  auto final_result =
-    std::shared_ptr<std::vector<std::shared_ptr<FileParameter>>>(
-        new std::vector<std::shared_ptr<FileParameter>>(result.size()));
+FileParameter::GetByValue(const int num_value, const int attr_id) {
+  std::string condition("param.num_value = %0:num_value");
+  if (attr_id >= 0)
+    condition.append(" and param.attr_id = %1:attr_id");
+  return LoadJoined(condition, num_value, attr_id);
+}
 
-  for (unsigned int i = 0; i < final_result->size(); ++i)
-    final_result->at(i) = std::shared_ptr<FileParameter>(
-        new FileParameter(result[i]));
+std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
+FileParameter::GetByValue(const bool bool_value, const int attr_id) {
+  std::string condition("param.bool_value = %0:bool_value");
+  if (attr_id >= 0)
+    condition.append(" and param.attr_id = %1:attr_id");
+  return LoadJoined(condition, bool_value, attr_id);
+}
 
-  return final_result;
+std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
+FileParameter::GetDuplicates(const int attr_id, const std::string &after,
+                             const size_t groups) {
+  // MySQL doesn't take LIMIT in an IN subquery, the page of values is a
+  // derived table.
+  std::string limit;
+  if (groups > 0)
+    limit = " order by str_value limit " + std::to_string(groups);
+  return LoadJoined("param.attr_id = %0:attr_id and param.str_value in "
+                    "(select str_value from "
+                    "(select str_value from mss_parameters "
+                    "where attr_id = %0:attr_id and str_value > %1q:after "
+                    "group by str_value having count(*) > 1" + limit +
+                    ") as page) "
+                    "order by param.str_value, files.server_name, "
+                    "files.file_path", attr_id, after);
 }
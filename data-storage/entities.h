@@ -37,10 +37,17 @@
 
 #include <mysql++/mysql++.h>
 #include <mysql++/ssqls.h>
+#include <functional>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
+#include "data-storage/connectionpool.h"
+#include "data-storage/entitycache.h"
+#include "config.h"
+
 sql_create_5(mss_parameters, 2, 5,
              mysqlpp::sql_int, attr_id,
              mysqlpp::sql_int, file_id,
@@ -60,6 +67,8 @@ sql_create_5(mss_files, 1, 4,
              mysqlpp::sql_varchar, server_name,
              mysqlpp::sql_timestamp, last_seen);
 
+class TrigramIndex;
+
 /**
  * Class to work with data base.
  */
@@ -76,6 +85,8 @@ class DatabaseEntity {
       * @param password Password for specifed user.
       * @param reconnect should we reconnect programm to another database (or
       * to the same) if we alredy connected?
+      * @param pool_size Maximum number of connections opened by the process.
+      * Every thread working with the data base checks out its own connection.
       *
       * @return true if connection successfull, false otherwise.
       */
@@ -83,15 +94,25 @@ class DatabaseEntity {
                                 const std::string &server,
                                 const std::string &user,
                                 const std::string &password,
-                                const bool reconnect);
+                                const bool reconnect,
+                                const size_t pool_size = DB_POOL_SIZE);
 
     /**
-     * Disconnect from connected server.
+     * Disconnect from connected server. Connections still used by other
+     * threads are closed when they are released.
      *
      * @return true on success, false otherwise.
      */
     static bool Disconnect();
 
+    /**
+     * Return the connection of the calling thread to the pool. An open
+     * transaction is rolled back. The next query of the thread checks out a
+     * connection again. The connection is also released when the thread
+     * exits.
+     */
+    static void ReleaseConnection();
+
     /**
      * Stores the object in the database.
      * If this object is new and it still does not correspond to any record in
@@ -114,8 +135,9 @@ class DatabaseEntity {
     virtual bool Delete() = 0;
 
     /**
-     * Start transaction for opened connection, all next quires will
-     * executed in this transaction, until it would be commited or rollbacked.
+     * Start transaction for connection of the calling thread, all next quires
+     * of the thread will executed in this transaction, until it would be
+     * commited or rollbacked.
      *
      * @return true on success, false otherwise.
      */
@@ -136,7 +158,7 @@ class DatabaseEntity {
     static bool RollbackTransaction();
 
     /**
-     * Returns last occures data base error.
+     * Returns last occures data base error in the calling thread.
      *
      * @return error string.
      */
@@ -144,26 +166,63 @@ class DatabaseEntity {
 
   protected:
     /**
-     * Get connection with data base.
+     * Get connection of the calling thread, check it out from the pool if
+     * the thread has none. Throws mysqlpp::ConnectionFailed if no connection
+     * is available.
      *
      * @return Connection with data base.
      */
     static mysqlpp::TCPConnection & get_db_connection();
 
     /**
-     * Connection with data base.
+     * Get prepared statement of the connection of the calling thread.
+     * Statements are prepared once per connection and cached. Throws
+     * mysqlpp::Exception on error.
+     *
+     * @param text Statement with "?" placeholders for parameters.
+     *
+     * @return Prepared statement.
      */
-    static mysqlpp::TCPConnection db_connection_;
+    static PreparedStatement & get_statement(const std::string &text);
 
     /**
-     * Last occured error.
+     * Connection checked out by a thread and its transaction.
      */
-    static std::string db_error_;
+    struct ThreadConnection {
+      ~ThreadConnection();
+
+      /**
+       * Return the connection to the pool.
+       *
+       * @param broken Whether the connection is unusable.
+       */
+      void Release(const bool broken);
+
+      std::shared_ptr<ConnectionPool> pool;
+      PooledConnection *connection = nullptr;
+      time_t last_used = 0;
+      std::shared_ptr<mysqlpp::Transaction> transaction;
+    };
 
     /**
-     * Current transaction.
+     * Pool of connections, nullptr if not connected.
      */
-    static std::shared_ptr<mysqlpp::Transaction> current_transaction_;
+    static std::shared_ptr<ConnectionPool> pool_;
+
+    /**
+     * Serializes ConnectToServer() and Disconnect().
+     */
+    static std::mutex pool_mutex_;
+
+    /**
+     * Connection of the current thread.
+     */
+    static thread_local ThreadConnection thread_connection_;
+
+    /**
+     * Last occured error in the current thread.
+     */
+    static thread_local std::string db_error_;
 
     /**
      * Last occured error.
@@ -237,6 +296,12 @@ class FileAttribute : DatabaseEntity {
     static std::shared_ptr<FileAttribute> GetByNameAndType(
         const std::string &name, const AttributeType type);
 
+    /**
+     * Drop all cached attributes. Attributes are cached by GetById() and
+     * should be dropped when they are changed by another process.
+     */
+    static void ClearCache();
+
     /**
      * Set a type of the attribute.
      *
@@ -302,8 +367,25 @@ class FileAttribute : DatabaseEntity {
     static AttributeType StringToAttrType(const std::string &string);
 
   private:
+    friend class FileParameter;
+
     FileAttribute();
     explicit FileAttribute(const mss_attributes &orig_row);
+
+    /**
+     * Store copy of the attribute in the cache.
+     *
+     * @param attribute Attribute to store.
+     * @param version Version of the cache taken before the attribute was
+     * read from the data base.
+     */
+    static void Cache(const FileAttribute &attribute, const uint64_t version);
+
+    /**
+     * Attributes by id.
+     */
+    static EntityCache<int, FileAttribute> cache_;
+
     int id_;
     std::string name_;
     AttributeType type_;
@@ -332,6 +414,14 @@ class FileEntry : DatabaseEntity {
     FileEntry(const std::string &file_name, const std::string &file_path,
               const std::string &server_name);
 
+    /**
+     * Function called by streaming finders for every found file, returns
+     * false to stop. The entry is valid during the call only. The function
+     * must not query the data base from the calling thread, its connection
+     * is busy with the rest of the result.
+     */
+    typedef std::function<bool(const FileEntry &entry)> Visitor;
+
     /**
      * The function finds the file entry by name. Insensitive comparison.
      *
@@ -339,6 +429,10 @@ class FileEntry : DatabaseEntity {
      * search for "Vladimir", the result will be records "Vladimir Visotsky",
      * "Putin Vladimir Vladimirovich" etc.
      *
+     * If a name index is set and the name is at least three characters long,
+     * only files found by the index are checked instead of the whole table.
+     * Either way files are ordered by ids.
+     *
      * Limitations on min_rownum and max_rownum allow DB to not make unnecessary
      * disk reads with long results. This significantly increases the speed of
      * such queries.
@@ -356,8 +450,16 @@ class FileEntry : DatabaseEntity {
         const std::string &name, const int min_rownum = 0,
         const int max_rownum = 0);
 
+    /**
+     * Set an index of file names to be used by FindByName(). Thread safe.
+     *
+     * @param index Index of file names, nullptr to scan the table again.
+     */
+    static void set_name_index(const std::shared_ptr<TrigramIndex> &index);
+
     /**
      * Find file entries with the name exactly matches with specified.
+     * Files are ordered by ids.
      *
      * @param name name to search.
      * @param min_rownum Limits founded rows from the top, rows from 1 to
@@ -374,6 +476,7 @@ class FileEntry : DatabaseEntity {
 
     /**
      * Find the entries relevant to file located on specified server.
+     * Files are ordered by ids.
      *
      * @param server_name name or ip address of server from which files should
      * be found
@@ -417,6 +520,64 @@ class FileEntry : DatabaseEntity {
     static std::shared_ptr<FileEntry> GetByPathOnServer(
         const std::string &path, const std::string &server);
 
+    /**
+     * Same as FindByName(), but rows are fetched from the data base one at a
+     * time and passed to the visitor, memory use does not depend on the
+     * number of found files. Offset and limit are applied by the data base
+     * server, so it stops after the last needed row. Files are ordered by
+     * ids when offset, limit or after_id is given.
+     *
+     * @param name name to search.
+     * @param visitor function called for every found file.
+     * @param offset number of found files to skip.
+     * @param limit maximum number of visited files, 0 for all.
+     * @param after_id only files with greater ids are visited, so the search
+     * can be continued after the last visited file. 0 for all.
+     *
+     * @return true on success, false on error. Some files may be visited
+     * before an error.
+     */
+    static bool FindEachByName(const std::string &name,
+                               const Visitor &visitor,
+                               const uint32_t offset = 0,
+                               const uint32_t limit = 0,
+                               const int after_id = 0);
+
+    /**
+     * Find files which names are equal to the name, rows are passed to the
+     * visitor one at a time. Files are ordered by ids when offset or limit
+     * is given.
+     *
+     * @param name name to search.
+     * @param visitor function called for every found file.
+     * @param offset number of found files to skip.
+     * @param limit maximum number of visited files, 0 for all.
+     *
+     * @return true on success, false on error.
+     */
+    static bool GetEachByName(const std::string &name, const Visitor &visitor,
+                              const uint32_t offset = 0,
+                              const uint32_t limit = 0);
+
+    /**
+     * Same as GetByServer(), but rows are passed to the visitor one at a
+     * time. Used to list all files of a server. Files are ordered by ids
+     * when offset, limit or after_id is given.
+     *
+     * @param server_name name or ip address of server.
+     * @param visitor function called for every found file.
+     * @param offset number of found files to skip.
+     * @param limit maximum number of visited files, 0 for all.
+     * @param after_id only files with greater ids are visited, 0 for all.
+     *
+     * @return true on success, false on error.
+     */
+    static bool GetEachByServer(const std::string &server_name,
+                                const Visitor &visitor,
+                                const uint32_t offset = 0,
+                                const uint32_t limit = 0,
+                                const int after_id = 0);
+
     /**
      * Find the file entry with specifed id.
      *
@@ -427,6 +588,21 @@ class FileEntry : DatabaseEntity {
      */
     static std::shared_ptr<FileEntry> GetById(const int id);
 
+    /**
+     * Drop cached entry of the file. Must be called after the row of the file
+     * is changed in the data base, GetById() and GetByPathOnServer() return
+     * cached entries.
+     *
+     * @param path Path to file on server.
+     * @param server Name or ip address of server where file located.
+     */
+    static void Uncache(const std::string &path, const std::string &server);
+
+    /**
+     * Drop all cached file entries.
+     */
+    static void ClearCache();
+
     /**
      * Set name of the file.
      *
@@ -500,6 +676,8 @@ class FileEntry : DatabaseEntity {
     }
 
   private:
+    friend class FileParameter;
+
     FileEntry();
 
     explicit FileEntry(const mss_files &orig_row);
@@ -508,8 +686,124 @@ class FileEntry : DatabaseEntity {
               const std::string &file_path, const std::string &server_name,
               const time_t timestamp, const mss_files &orig_row);
 
-    static std::vector<std::shared_ptr<FileEntry> > *QueryResultToVector(
-        mysqlpp::StoreQueryResult &result);
+    /**
+     * Pass rows of use() query to the visitor one at a time. The rest of
+     * rows is fetched and dropped when the visitor stops or throws, so the
+     * connection can be used again. Throws mysqlpp::Exception on error.
+     *
+     * @param result Result of use() query selecting all columns of
+     * mss_files.
+     * @param visitor Function called for every row.
+     */
+    static void VisitRows(mysqlpp::UseQueryResult *result,
+                          const Visitor &visitor);
+
+    /**
+     * Fetch all rows of use() query.
+     *
+     * @param result Result of use() query selecting all columns of
+     * mss_files.
+     *
+     * @return pointer to vector with entries, NULL on error.
+     */
+    static std::vector<std::shared_ptr<FileEntry> > *UseResultToVector(
+        mysqlpp::UseQueryResult *result);
+
+    /**
+     * Pass files found by the name index which really contain the name to
+     * the visitor, ids are checked in chunks of NAME_INDEX_CHUNK. Files
+     * added after the index was built are scanned after them.
+     *
+     * @param ids Ids of candidate files in ascending order.
+     * @param last_id The greatest id in the index.
+     * @param name Name to search.
+     * @param visitor Function called for every found file.
+     * @param offset Number of found files to skip.
+     * @param limit Maximum number of visited files, 0 for all.
+     * @param after_id Only files with greater ids are visited, 0 for all.
+     *
+     * @return true on success, false on error.
+     */
+    static bool FindEachInIds(const std::vector<int> &ids, const int last_id,
+                              const std::string &name,
+                              const Visitor &visitor,
+                              const uint32_t offset = 0,
+                              const uint32_t limit = 0,
+                              const int after_id = 0);
+
+    /**
+     * Make entry from the only row of executed statement which selects
+     * id, name, file_path, server_name and last_seen of mss_files.
+     *
+     * @param statement Executed statement.
+     *
+     * @return Entry or nullptr if there is no row or more than one.
+     */
+    static std::shared_ptr<FileEntry> FetchOne(PreparedStatement *statement);
+
+    /**
+     * Find entry in the cache.
+     *
+     * @param id Id of the file.
+     *
+     * @return Copy of cached entry or nullptr if it is not cached.
+     */
+    static std::shared_ptr<FileEntry> FindCached(const int id);
+
+    /**
+     * Store copy of the entry in the cache.
+     *
+     * @param entry Entry to store.
+     * @param version Version of cache_ taken before the entry was read from
+     * the data base.
+     */
+    static void Cache(const FileEntry &entry, const uint64_t version);
+
+    /**
+     * Key of the file in path_cache_.
+     *
+     * @param path Path to file on server.
+     * @param server Name or ip address of server where file located.
+     *
+     * @return Key of the file.
+     */
+    static inline std::string CacheKey(const std::string &path,
+                                       const std::string &server) {
+      return server + "/" + path;
+    }
+
+    /**
+     * Check which of the files found by the name index really contain the
+     * name, rows are limited like in FindByName().
+     *
+     * @param ids Ids of candidate files in ascending order.
+     * @param last_id The greatest id in the index.
+     * @param name Name to search.
+     * @param min_rownum Rows from 1 to min_rownum are removed.
+     * @param max_rownum Rows from max_rownum to last are removed.
+     *
+     * @return pointer to vector with found entries, NULL on error.
+     */
+    static std::vector<std::shared_ptr<FileEntry> > *FindByNameInIds(
+        const std::vector<int> &ids, const int last_id,
+        const std::string &name, const int min_rownum, const int max_rownum);
+
+    /**
+     * Index of file names used by FindByName(), may be nullptr.
+     */
+    static std::shared_ptr<TrigramIndex> name_index_;
+
+    /**
+     * Entries by id.
+     */
+    static EntityCache<int, FileEntry> cache_;
+
+    /**
+     * Ids of cached entries by CacheKey(). Ids are removed when their entries
+     * are evicted from cache_, ids of entries which were not stored are
+     * evicted by its own limit.
+     */
+    static EntityCache<std::string, int> path_cache_;
 
     int id_;
     std::string name_;
@@ -604,6 +898,22 @@ class FileParameter : DatabaseEntity {
     static std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
         GetByFile(const FileEntry &file);
 
+    /**
+     * Method returns all parameters of a set of files. Ids are sent in
+     * chunks of PARAMETER_LOAD_CHUNK, every query selects parameters
+     * together with their files and attributes.
+     *
+     * @param file_ids ids of the files.
+     * @param attr_id optionally we can get only parameters of specifed
+     * attribute.
+     *
+     * @return pointer to vector with objects corresponding to records founded
+     * in the database, if error will ocured - returns nullptr. Parameters of
+     * the same file or attribute share the file or attribute object.
+     */
+    static std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
+        GetByFiles(const std::vector<int> &file_ids, const int attr_id = -1);
+
     /**
      * Method search entries with specifed string value.
      *
@@ -640,6 +950,26 @@ class FileParameter : DatabaseEntity {
     static std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
         GetByValue(const bool bool_value, const int attr_id = -1);
 
+    /**
+     * Method returns parameters of the attribute which string value is
+     * shared by several files, e.g. content hashes of duplicate files on
+     * different servers. Parameters are ordered by value and then by
+     * server, so every group of duplicates is a run of equal values.
+     * Groups are paged by value: the next page starts after the value of
+     * the last parameter of the previous one.
+     *
+     * @param attr_id id of the attribute.
+     * @param after only groups with greater values are returned.
+     * @param groups maximum number of groups, 0 for all of them.
+     *
+     * @return pointer to vector with objects corresponding to records founded
+     * in the database, if error will ocured - returns nullptr.
+     */
+    static std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
+        GetDuplicates(const int attr_id,
+                      const std::string &after = std::string(),
+                      const size_t groups = 0);
+
     /**
      * Get the attribute the parameter associated with.
      *
@@ -676,12 +1006,69 @@ class FileParameter : DatabaseEntity {
     inline bool get_bool_value() const { return bool_value_; }
 
   private:
+    /**
+     * Files and attributes of loaded parameters by id.
+     */
+    struct LoadedEntities {
+      std::unordered_map<int, std::shared_ptr<FileEntry> > files;
+      std::unordered_map<int, std::shared_ptr<FileAttribute> > attributes;
+    };
+
     FileParameter();
-    explicit FileParameter(const mss_parameters &orig_row);
-    explicit FileParameter(const mysqlpp::Row &orig_row);
 
+    /**
+     * Constructor of parameter loaded from the database.
+     *
+     * @param file file of the parameter.
+     * @param attribute attribute of the parameter.
+     * @param orig_row row of the parameter.
+     */
+    FileParameter(const std::shared_ptr<FileEntry> &file,
+                  const std::shared_ptr<FileAttribute> &attribute,
+                  const mss_parameters &orig_row);
+
+    /**
+     * Make statement which selects parameters with their files and
+     * attributes. Columns are attr_id, file_id, str_value, num_value,
+     * bool_value of "param", name, file_path, server_name, last_seen of
+     * "files" and name, type of "attr".
+     *
+     * @param condition condition on columns of "param".
+     *
+     * @return statement text.
+     */
+    static std::string SelectJoined(const std::string &condition);
+
+    /**
+     * Convert rows selected by SelectJoined() statement to parameters.
+     *
+     * @param result result of the statement.
+     * @param loaded already made files and attributes, new ones are added.
+     * @param parameters where to append parameters.
+     */
+    static void AppendJoined(
+        const mysqlpp::StoreQueryResult &result, LoadedEntities *loaded,
+        std::vector<std::shared_ptr<FileParameter> > *parameters);
+
+    /**
+     * Execute template query made of SelectJoined() statement.
+     *
+     * @param condition condition on columns of "param" with template
+     * parameters.
+     * @param args values of template parameters.
+     *
+     * @return pointer to vector with parameters, nullptr on error.
+     */
+    template <class... Args>
     static std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > >
-        QueryResultToVector(const mysqlpp::StoreQueryResult &result);
+        LoadJoined(const std::string &condition, const Args &... args);
+
+    /**
+     * Replace the row in mss_parameters. Throws mysqlpp::Exception on error.
+     *
+     * @param row Row to store.
+     */
+    static void InsertRow(const mss_parameters &row);
 
     std::shared_ptr<FileAttribute> attr_;
     std::shared_ptr<FileEntry> file_;
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DATA_STORAGE_ENTITYCACHE_H_
+#define DATA_STORAGE_ENTITYCACHE_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common-inl.h"
+#include "config.h"
+
+/**
+ * Process-wide cache of immutable entity objects, thread safe.
+ *
+ * Keys are spread over shards by their hash, every shard has its own mutex
+ * and least recently used list, so threads looking up different keys rarely
+ * wait for each other. Every shard keeps at most capacity / shards values.
+ * Values older than the time to live are dropped on lookup, other processes
+ * may change the rows without removing them.
+ *
+ * Values loaded from the data base may race with writes of the same rows: a
+ * reader which missed the cache takes get_version() before its query and
+ * passes it to Put(), the value is dropped if anything was removed from the
+ * cache since then.
+ */
+template <class Key, class Value, class Hash = std::hash<Key> >
+class EntityCache {
+  public:
+    typedef std::shared_ptr<const Value> ValuePtr;
+
+    /**
+     * Constructor.
+     *
+     * @param capacity Maximum number of values, 0 for no limit.
+     * @param shards Number of shards.
+     * @param ttl_ms Time to live of values in milliseconds, 0 for no limit.
+     */
+    explicit EntityCache(const size_t capacity = ENTITY_CACHE_SIZE,
+                         const size_t shards = ENTITY_CACHE_SHARDS,
+                         const int64_t ttl_ms = ENTITY_CACHE_TTL_MS)
+        : shards_(shards > 0 ? shards : 1),
+          shard_capacity_(capacity == 0 ? 0 :
+                          std::max<size_t>(1, capacity / shards_.size())),
+          ttl_(ttl_ms),
+          version_(0),
+          hits_(0),
+          misses_(0) {
+    }
+
+    /**
+     * Find value and mark it as recently used.
+     *
+     * @param key Key of the value.
+     *
+     * @return Value or nullptr if it is not cached.
+     */
+    ValuePtr Get(const Key &key) {
+      Shard &shard = get_shard(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto found = shard.index.find(key);
+      if (found != shard.index.end() && ttl_.count() > 0 &&
+          Clock::now() - found->second->stored > ttl_) {
+        shard.lru.erase(found->second);
+        shard.index.erase(found);
+        found = shard.index.end();
+      }
+      if (found == shard.index.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return found->second->value;
+    }
+
+    /**
+     * Store value, replace the old one with the same key. The least recently
+     * used value of the shard is evicted if it is full.
+     *
+     * @param key Key of the value.
+     * @param value Value to store.
+     * @param evicted Where to store the evicted value, may be nullptr.
+     */
+    void Put(const Key &key, const ValuePtr &value,
+             ValuePtr *evicted = nullptr) {
+      Shard &shard = get_shard(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      Insert(&shard, key, value, evicted);
+    }
+
+    /**
+     * Store value loaded from the data base unless some value was removed
+     * since the version was taken.
+     *
+     * @param key Key of the value.
+     * @param value Value to store.
+     * @param version Result of get_version() taken before the value was read.
+     * @param evicted Where to store the evicted value, may be nullptr.
+     *
+     * @return true if value is stored, false otherwise.
+     */
+    bool Put(const Key &key, const ValuePtr &value, const uint64_t version,
+             ValuePtr *evicted = nullptr) {
+      Shard &shard = get_shard(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (version_.load() != version)
+        return false;
+      Insert(&shard, key, value, evicted);
+      return true;
+    }
+
+    /**
+     * Remove value.
+     *
+     * @param key Key of the value.
+     *
+     * @return Removed value or nullptr if it was not cached.
+     */
+    ValuePtr Remove(const Key &key) {
+      Shard &shard = get_shard(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      version_.fetch_add(1);
+      auto found = shard.index.find(key);
+      if (found == shard.index.end())
+        return nullptr;
+      ValuePtr value = found->second->value;
+      shard.lru.erase(found->second);
+      shard.index.erase(found);
+      return value;
+    }
+
+    /**
+     * Make values read from the data base before now be dropped by Put()
+     * without removing anything. Used when the key of a changed row is not
+     * known.
+     */
+    inline void Expire() { version_.fetch_add(1); }
+
+    /**
+     * Remove all values.
+     */
+    void Clear() {
+      for (Shard &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        version_.fetch_add(1);
+        shard.lru.clear();
+        shard.index.clear();
+      }
+    }
+
+    /**
+     * Get version of the cache, it changes when anything is removed.
+     *
+     * @return Version of the cache.
+     */
+    inline uint64_t get_version() const { return version_.load(); }
+
+    /**
+     * Get number of cached values.
+     *
+     * @return Number of values.
+     */
+    size_t get_size() {
+      size_t size = 0;
+      for (Shard &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size += shard.index.size();
+      }
+      return size;
+    }
+
+    /**
+     * Get number of successful lookups.
+     *
+     * @return Number of hits.
+     */
+    inline uint64_t get_hits() const { return hits_.load(); }
+
+    /**
+     * Get number of failed lookups.
+     *
+     * @return Number of misses.
+     */
+    inline uint64_t get_misses() const { return misses_.load(); }
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * Cached value with its key.
+     */
+    struct Item {
+      Key key;
+      ValuePtr value;
+
+      /**
+       * Time when the value was stored, set only if ttl_ is.
+       */
+      Clock::time_point stored;
+    };
+
+    typedef std::list<Item> List;
+
+    /**
+     * Part of the cache with its own lock.
+     */
+    struct Shard {
+      std::mutex mutex;
+      List lru;
+      std::unordered_map<Key, typename List::iterator, Hash> index;
+    };
+
+    inline Shard & get_shard(const Key &key) {
+      return shards_[Hash()(key) % shards_.size()];
+    }
+
+    /**
+     * Store value in locked shard.
+     *
+     * @param shard Shard of the key.
+     * @param key Key of the value.
+     * @param value Value to store.
+     * @param evicted Where to store the evicted value, may be nullptr.
+     */
+    void Insert(Shard *shard, const Key &key, const ValuePtr &value,
+                ValuePtr *evicted) {
+      Clock::time_point now;
+      if (ttl_.count() > 0)
+        now = Clock::now();
+
+      auto found = shard->index.find(key);
+      if (found != shard->index.end()) {
+        found->second->value = value;
+        found->second->stored = now;
+        shard->lru.splice(shard->lru.begin(), shard->lru, found->second);
+        return;
+      }
+
+      shard->lru.push_front(Item{key, value, now});
+      shard->index[key] = shard->lru.begin();
+      if (shard_capacity_ > 0 && shard->index.size() > shard_capacity_) {
+        if (evicted != nullptr)
+          *evicted = shard->lru.back().value;
+        shard->index.erase(shard->lru.back().key);
+        shard->lru.pop_back();
+      }
+    }
+
+    std::vector<Shard> shards_;
+    const size_t shard_capacity_;
+    const std::chrono::milliseconds ttl_;
+    std::atomic<uint64_t> version_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+
+    DISALLOW_COPY_AND_ASSIGN(EntityCache);
+};
+
+#endif  // DATA_STORAGE_ENTITYCACHE_H_
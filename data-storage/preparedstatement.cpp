@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define MYSQLPP_MYSQL_HEADERS_BURIED
+
+#include <string.h>
+
+#include <mysql++/mysql++.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "data-storage/preparedstatement.h"
+#include "config.h"
+
+PreparedStatement::PreparedStatement(MYSQL *mysql, const std::string &text)
+    : statement_(mysql_stmt_init(mysql)),
+      results_bound_(false) {
+  if (UNLIKELY(statement_ == NULL))
+    throw mysqlpp::BadQuery("Can't allocate prepared statement");
+
+  if (mysql_stmt_prepare(statement_, text.data(), text.size())) {
+    std::string error(mysql_stmt_error(statement_));
+    mysql_stmt_close(statement_);
+    throw mysqlpp::BadQuery(error.c_str());
+  }
+
+  size_t count = mysql_stmt_param_count(statement_);
+  params_.resize(count);
+  param_values_.resize(count);
+  memset(params_.data(), 0, sizeof(MYSQL_BIND) * count);
+  for (size_t i = 0; i < count; ++i) {
+    params_[i].buffer_type = MYSQL_TYPE_NULL;
+    params_[i].length = &param_values_[i].length;
+  }
+}
+
+PreparedStatement::~PreparedStatement() {
+  mysql_stmt_close(statement_);
+}
+
+void PreparedStatement::BindInt(const size_t index, const int64_t value) {
+  Param &param = param_values_.at(index);
+  param.number = value;
+  params_[index].buffer_type = MYSQL_TYPE_LONGLONG;
+  params_[index].buffer = &param.number;
+}
+
+void PreparedStatement::BindString(const size_t index,
+                                   const std::string &value) {
+  Param &param = param_values_.at(index);
+  param.text = value;
+  param.length = param.text.size();
+  params_[index].buffer_type = MYSQL_TYPE_STRING;
+  params_[index].buffer = const_cast<char *>(param.text.data());
+  params_[index].buffer_length = param.length;
+}
+
+void PreparedStatement::Execute() {
+  mysql_stmt_free_result(statement_);
+
+  if (!params_.empty() && mysql_stmt_bind_param(statement_, params_.data()))
+    Fail();
+  if (mysql_stmt_execute(statement_))
+    Fail();
+
+  if (mysql_stmt_field_count(statement_) == 0)
+    return;
+
+  if (!results_bound_)
+    BindResults();
+  if (mysql_stmt_store_result(statement_))
+    Fail();
+}
+
+bool PreparedStatement::Fetch() {
+  int status = mysql_stmt_fetch(statement_);
+  if (status == MYSQL_NO_DATA)
+    return false;
+  if (status == 1)
+    Fail();
+
+  if (status == MYSQL_DATA_TRUNCATED) {
+    // Grow buffers of long strings and fetch them again.
+    bool grown = false;
+    for (size_t i = 0; i < columns_.size(); ++i) {
+      Column &column = columns_[i];
+      if (!column.error || results_[i].buffer_type != MYSQL_TYPE_STRING)
+        continue;
+
+      column.text.resize(column.length);
+      results_[i].buffer = column.text.data();
+      results_[i].buffer_length = column.text.size();
+      if (mysql_stmt_fetch_column(statement_, &results_[i], i, 0))
+        Fail();
+      grown = true;
+    }
+
+    if (grown && mysql_stmt_bind_result(statement_, results_.data()))
+      Fail();
+  }
+  return true;
+}
+
+int64_t PreparedStatement::GetInt(const size_t column) const {
+  const Column &value = columns_.at(column);
+  return value.is_null ? 0 : value.number;
+}
+
+std::string PreparedStatement::GetString(const size_t column) const {
+  const Column &value = columns_.at(column);
+  if (value.is_null)
+    return std::string();
+  return std::string(value.text.data(),
+                     std::min<size_t>(value.length, value.text.size()));
+}
+
+time_t PreparedStatement::GetTime(const size_t column) const {
+  const Column &value = columns_.at(column);
+  if (value.is_null)
+    return 0;
+
+  struct tm time;
+  memset(&time, 0, sizeof(time));
+  time.tm_year = value.time.year - 1900;
+  time.tm_mon = value.time.month - 1;
+  time.tm_mday = value.time.day;
+  time.tm_hour = value.time.hour;
+  time.tm_min = value.time.minute;
+  time.tm_sec = value.time.second;
+  time.tm_isdst = -1;
+  return mktime(&time);
+}
+
+void PreparedStatement::BindResults() {
+  MYSQL_RES *metadata = mysql_stmt_result_metadata(statement_);
+  if (UNLIKELY(metadata == NULL))
+    Fail();
+
+  size_t count = mysql_num_fields(metadata);
+  MYSQL_FIELD *fields = mysql_fetch_fields(metadata);
+  results_.resize(count);
+  columns_.resize(count);
+  memset(results_.data(), 0, sizeof(MYSQL_BIND) * count);
+
+  for (size_t i = 0; i < count; ++i) {
+    MYSQL_BIND &bind = results_[i];
+    Column &column = columns_[i];
+    bind.is_null = &column.is_null;
+    bind.error = &column.error;
+    bind.length = &column.length;
+
+    switch (fields[i].type) {
+      case MYSQL_TYPE_TINY:
+      case MYSQL_TYPE_SHORT:
+      case MYSQL_TYPE_INT24:
+      case MYSQL_TYPE_LONG:
+      case MYSQL_TYPE_LONGLONG:
+      case MYSQL_TYPE_YEAR:
+        bind.buffer_type = MYSQL_TYPE_LONGLONG;
+        bind.buffer = &column.number;
+        break;
+      case MYSQL_TYPE_TIMESTAMP:
+      case MYSQL_TYPE_DATETIME:
+      case MYSQL_TYPE_DATE:
+        bind.buffer_type = MYSQL_TYPE_TIMESTAMP;
+        bind.buffer = &column.time;
+        break;
+      default:
+        // Most of names and paths fit, longer ones are fetched again.
+        column.text.resize(BUF_SIZE);
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer = column.text.data();
+        bind.buffer_length = column.text.size();
+        break;
+    }
+  }
+  mysql_free_result(metadata);
+
+  if (mysql_stmt_bind_result(statement_, results_.data()))
+    Fail();
+  results_bound_ = true;
+}
+
+void PreparedStatement::Fail() const {
+  throw mysqlpp::BadQuery(mysql_stmt_error(statement_),
+                          mysql_stmt_errno(statement_));
+}
+
+PreparedStatement & StatementCache::Get(const std::string &text) {
+  std::unique_ptr<PreparedStatement> &statement = statements_[text];
+  if (statement == nullptr) {
+    try {
+      statement.reset(new PreparedStatement(mysql_, text));
+    } catch(...) {
+      statements_.erase(text);
+      throw;
+    }
+  }
+  return *statement;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DATA_STORAGE_PREPAREDSTATEMENT_H_
+#define DATA_STORAGE_PREPAREDSTATEMENT_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <mysql/mysql.h>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Server-side prepared statement with binary parameters and results.
+ *
+ * The statement is parsed by the server once, every execution sends only
+ * the parameter values. Results are stored on the client after Execute(),
+ * so other statements may run on the connection while rows are fetched.
+ * All methods throw mysqlpp::BadQuery on error.
+ */
+class PreparedStatement {
+  public:
+    /**
+     * Prepare statement.
+     *
+     * @param mysql Connection handle.
+     * @param text Statement with "?" placeholders for parameters.
+     */
+    PreparedStatement(MYSQL *mysql, const std::string &text);
+
+    /**
+     * Destructor. Closes the statement on the server.
+     */
+    ~PreparedStatement();
+
+    /**
+     * Set integer parameter.
+     *
+     * @param index Index of the parameter, from 0.
+     * @param value Value of the parameter.
+     */
+    void BindInt(const size_t index, const int64_t value);
+
+    /**
+     * Set string parameter.
+     *
+     * @param index Index of the parameter, from 0.
+     * @param value Value of the parameter.
+     */
+    void BindString(const size_t index, const std::string &value);
+
+    /**
+     * Execute statement with the bound parameters and store its results.
+     */
+    void Execute();
+
+    /**
+     * Go to the next row of results.
+     *
+     * @return true if there is a row, false after the last one.
+     */
+    bool Fetch();
+
+    /**
+     * Get integer column of the current row.
+     *
+     * @param column Index of the column, from 0.
+     *
+     * @return Value or 0 if it is null.
+     */
+    int64_t GetInt(const size_t column) const;
+
+    /**
+     * Get string column of the current row.
+     *
+     * @param column Index of the column, from 0.
+     *
+     * @return Value or empty string if it is null.
+     */
+    std::string GetString(const size_t column) const;
+
+    /**
+     * Get date and time column of the current row.
+     *
+     * @param column Index of the column, from 0.
+     *
+     * @return Local time or 0 if it is null.
+     */
+    time_t GetTime(const size_t column) const;
+
+    /**
+     * Get number of rows in results.
+     *
+     * @return Number of rows.
+     */
+    inline uint64_t get_num_rows() const {
+      return mysql_stmt_num_rows(statement_);
+    }
+
+    /**
+     * Get id generated by the last insert.
+     *
+     * @return Inserted id.
+     */
+    inline uint64_t get_insert_id() const {
+      return mysql_stmt_insert_id(statement_);
+    }
+
+    /**
+     * Get number of parameters.
+     *
+     * @return Number of "?" placeholders in statement.
+     */
+    inline size_t get_param_count() const { return params_.size(); }
+
+  private:
+    /**
+     * Type of is_null and error flags of MYSQL_BIND, it differs between
+     * client library versions.
+     */
+    typedef std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type Flag;
+
+    /**
+     * Storage of a parameter.
+     */
+    struct Param {
+      long long number;
+      std::string text;
+      unsigned long length;
+    };
+
+    /**
+     * Storage of a result column.
+     */
+    struct Column {
+      Flag is_null;
+      Flag error;
+      unsigned long length;
+      long long number;
+      MYSQL_TIME time;
+      std::vector<char> text;
+    };
+
+    /**
+     * Bind result columns after the first execution.
+     */
+    void BindResults();
+
+    /**
+     * Throw mysqlpp::BadQuery with the statement error.
+     */
+    void Fail() const;
+
+    MYSQL_STMT *statement_;
+
+    std::vector<MYSQL_BIND> params_;
+    std::vector<Param> param_values_;
+
+    std::vector<MYSQL_BIND> results_;
+    std::vector<Column> columns_;
+
+    /**
+     * Whether results_ is bound.
+     */
+    bool results_bound_;
+
+    DISALLOW_COPY_AND_ASSIGN(PreparedStatement);
+};
+
+/**
+ * Prepared statements of one connection, prepared on the first use.
+ */
+class StatementCache {
+  public:
+    /**
+     * Constructor.
+     *
+     * @param mysql Connection handle.
+     */
+    explicit StatementCache(MYSQL *mysql) : mysql_(mysql) {}
+
+    /**
+     * Get statement, prepare it if it is not cached yet.
+     *
+     * @param text Statement with "?" placeholders for parameters.
+     *
+     * @return Prepared statement.
+     */
+    PreparedStatement & Get(const std::string &text);
+
+    /**
+     * Get number of cached statements.
+     *
+     * @return Number of statements.
+     */
+    inline size_t get_size() const { return statements_.size(); }
+
+  private:
+    MYSQL *mysql_;
+    std::unordered_map<std::string,
+                       std::unique_ptr<PreparedStatement> > statements_;
+
+    DISALLOW_COPY_AND_ASSIGN(StatementCache);
+};
+
+#endif  // DATA_STORAGE_PREPAREDSTATEMENT_H_
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ctype.h>
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "data-storage/trigramindex.h"
+
+/**
+ * Append an unsigned value to the string as a varint: 7 bits per byte, the
+ * highest bit is set in all bytes except the last one.
+ */
+static inline void AppendVarint(uint32_t value, std::string *data) {
+  while (value >= 0x80) {
+    data->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  data->push_back(static_cast<char>(value));
+}
+
+/**
+ * Read a varint from the string and move the position after it.
+ */
+static inline uint32_t ReadVarint(const std::string &data, size_t *pos) {
+  uint32_t value = 0;
+  int shift = 0;
+  uint8_t byte;
+  do {
+    byte = static_cast<uint8_t>(data[(*pos)++]);
+    value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+TrigramIndex::TrigramIndex()
+    : last_id_(0),
+      size_(0),
+      postings_size_(0) {
+}
+
+std::shared_ptr<TrigramIndex> TrigramIndex::Load() {
+  std::shared_ptr<TrigramIndex> index(new(std::nothrow) TrigramIndex());
+  if (!index) {
+    db_error_ = std::string("Error while allocating memory");
+    return nullptr;
+  }
+
+  try {
+    // Rows are streamed, the whole table doesn't fit in memory at once.
+    mysqlpp::Query query = get_db_connection().query(
+        "select id, name from mss_files order by id");
+    mysqlpp::UseQueryResult result = query.use();
+
+    std::string name;
+    while (mysqlpp::Row row = result.fetch_row()) {
+      name.assign(row[1].data(), row[1].length());
+      index->Add(row[0], name);
+    }
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = std::string(e.what());
+    return nullptr;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = std::string(e.what());
+    return nullptr;
+  }
+
+  return index;
+}
+
+bool TrigramIndex::Add(const int id, const std::string &name) {
+  if (id <= last_id_)
+    return false;
+
+  // Lead bytes of U+00C0..U+024F, which the collation may fold to ASCII.
+  for (char c : name) {
+    uint8_t byte = static_cast<uint8_t>(c);
+    if (byte >= 0xc3 && byte <= 0xc9) {
+      accented_.push_back(id);
+      break;
+    }
+  }
+
+  std::vector<uint32_t> trigrams;
+  Trigrams(name, &trigrams);
+
+  for (uint32_t trigram : trigrams) {
+    // New postings are value-initialized: empty, count and last are zero.
+    Posting &posting = postings_[trigram];
+    size_t old_size = posting.data.size();
+    AppendVarint(id - posting.last, &posting.data);
+    postings_size_ += posting.data.size() - old_size;
+    posting.last = id;
+    ++posting.count;
+  }
+
+  last_id_ = id;
+  ++size_;
+  return true;
+}
+
+bool TrigramIndex::Find(const std::string &substring,
+                        std::vector<int> *ids) const {
+  ids->clear();
+
+  // Folding of other characters is up to the collation, and wildcards
+  // match what trigrams can't describe.
+  for (char c : substring) {
+    if (static_cast<uint8_t>(c) >= 0x80 || c == '%' || c == '_' || c == '\\')
+      return false;
+  }
+
+  std::vector<uint32_t> trigrams;
+  Trigrams(substring, &trigrams);
+  if (trigrams.empty())
+    return false;
+
+  std::vector<const Posting *> lists;
+  for (uint32_t trigram : trigrams) {
+    auto posting = postings_.find(trigram);
+    if (posting == postings_.end()) {
+      // Nothing contains this trigram.
+      *ids = accented_;
+      return true;
+    }
+
+    lists.push_back(&posting->second);
+  }
+
+  // Start from the shortest list, so candidates only shrink.
+  std::sort(lists.begin(), lists.end(),
+            [](const Posting *a, const Posting *b) {
+              return a->count < b->count;
+            });
+
+  const Posting &first = *lists.front();
+  ids->reserve(first.count);
+  size_t pos = 0;
+  int id = 0;
+  for (uint32_t i = 0; i < first.count; ++i) {
+    id += ReadVarint(first.data, &pos);
+    ids->push_back(id);
+  }
+
+  for (size_t i = 1; i < lists.size() && !ids->empty(); ++i) {
+    const Posting &list = *lists[i];
+    auto out = ids->begin();
+    auto candidate = ids->begin();
+    pos = 0;
+    id = 0;
+
+    // Merge the list with candidates, keeping common ids in place.
+    for (uint32_t j = 0; j < list.count && candidate != ids->end(); ++j) {
+      id += ReadVarint(list.data, &pos);
+      while (candidate != ids->end() && *candidate < id)
+        ++candidate;
+      if (candidate != ids->end() && *candidate == id) {
+        *out++ = id;
+        ++candidate;
+      }
+    }
+
+    ids->erase(out, ids->end());
+  }
+
+  if (!accented_.empty()) {
+    std::vector<int> matched;
+    matched.swap(*ids);
+    ids->reserve(matched.size() + accented_.size());
+    std::set_union(matched.begin(), matched.end(), accented_.begin(),
+                   accented_.end(), std::back_inserter(*ids));
+  }
+
+  return true;
+}
+
+void TrigramIndex::Trigrams(const std::string &str,
+                            std::vector<uint32_t> *trigrams) {
+  trigrams->clear();
+  if (str.size() < 3)
+    return;
+
+  trigrams->reserve(str.size() - 2);
+  for (size_t i = 0; i + 2 < str.size(); ++i) {
+    uint32_t trigram = 0;
+    for (size_t j = i; j < i + 3; ++j)
+      trigram = (trigram << 8) | tolower(static_cast<uint8_t>(str[j]));
+    trigrams->push_back(trigram);
+  }
+
+  std::sort(trigrams->begin(), trigrams->end());
+  trigrams->erase(std::unique(trigrams->begin(), trigrams->end()),
+                  trigrams->end());
+}
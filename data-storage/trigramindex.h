@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DATA_STORAGE_TRIGRAMINDEX_H_
+#define DATA_STORAGE_TRIGRAMINDEX_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "data-storage/entities.h"
+#include "common-inl.h"
+
+/**
+ * In-memory inverted index from trigrams of file names to ids of mss_files
+ * rows, used to answer substring queries without a full table scan.
+ *
+ * Names are lower-cased (ASCII only) and split in overlapping three byte
+ * trigrams. Every trigram has a posting list of ids which is kept sorted
+ * and compressed: each id is stored as a varint of the difference with the
+ * previous one. A query is answered by intersecting posting lists of its
+ * trigrams, the result is a superset of the matching files and should be
+ * checked against real names.
+ *
+ * The data base compares names case and accent insensitively, so the index
+ * answers only ASCII queries without LIKE wildcards. Names with accented
+ * Latin letters may match such a query through folding, they are always
+ * returned as candidates.
+ *
+ * The index is a snapshot, files with ids above get_last_id() are not in
+ * it. It is not thread safe while being filled, but const methods may be
+ * called concurrently once it is built.
+ */
+class TrigramIndex : DatabaseEntity {
+  public:
+    virtual bool Commit() { return false; }
+    virtual bool Delete() { return false; }
+
+    /**
+     * Constructor of an empty index.
+     */
+    TrigramIndex();
+
+    /**
+     * Build an index over names of all files from the data base.
+     *
+     * @return Pointer to the index on success, nullptr otherwise.
+     */
+    static std::shared_ptr<TrigramIndex> Load();
+
+    /**
+     * Add a file name to the index.
+     *
+     * @param id Id of the file, must be greater than all previously added.
+     * @param name Name of the file.
+     *
+     * @return true on success, false if id is out of order.
+     */
+    bool Add(const int id, const std::string &name);
+
+    /**
+     * Find files which names may contain the substring.
+     *
+     * @param substring Substring to search, case insensitive.
+     * @param ids Where to store ids of candidate files in ascending order.
+     *
+     * @return true on success, false if the substring is shorter than a
+     * trigram, is not ASCII or has LIKE wildcards and the index can't help.
+     */
+    bool Find(const std::string &substring, std::vector<int> *ids) const;
+
+    /**
+     * Get number of indexed names.
+     *
+     * @return Number of indexed names.
+     */
+    inline size_t get_size() const { return size_; }
+
+    /**
+     * Get the greatest indexed id.
+     *
+     * @return The greatest indexed id, 0 if the index is empty.
+     */
+    inline int get_last_id() const { return last_id_; }
+
+    /**
+     * Get memory used by posting lists.
+     *
+     * @return Size of posting lists in bytes.
+     */
+    inline size_t get_postings_size() const { return postings_size_; }
+
+  private:
+    /**
+     * Compressed list of ids of files containing a trigram.
+     */
+    struct Posting {
+      /**
+       * Varint encoded differences between consecutive ids.
+       */
+      std::string data;
+
+      /**
+       * Number of ids in the list.
+       */
+      uint32_t count;
+
+      /**
+       * The last id in the list.
+       */
+      int last;
+    };
+
+    /**
+     * Split a string in lower-cased trigrams, duplicates are removed.
+     *
+     * @param str String to be splitted.
+     * @param trigrams Where to store trigrams.
+     */
+    static void Trigrams(const std::string &str,
+                         std::vector<uint32_t> *trigrams);
+
+    /**
+     * Posting lists by trigram.
+     */
+    std::unordered_map<uint32_t, Posting> postings_;
+
+    /**
+     * Ids of names with accented Latin letters in ascending order.
+     */
+    std::vector<int> accented_;
+
+    /**
+     * The greatest added id.
+     */
+    int last_id_;
+
+    /**
+     * Number of indexed names.
+     */
+    size_t size_;
+
+    /**
+     * Size of all posting lists in bytes.
+     */
+    size_t postings_size_;
+
+    DISALLOW_COPY_AND_ASSIGN(TrigramIndex);
+};
+
+#endif  // DATA_STORAGE_TRIGRAMINDEX_H_
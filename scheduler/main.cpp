@@ -25,9 +25,10 @@
  */
 
 #include "schedulerserver.h"
+#include "config.h"
 
 int main(int argc, char *argv[]) {
-  SchedulerServer serv("../etc/u-search/servers.dat");
+  SchedulerServer serv("../etc/u-search/servers.dat", SCHEDULER_STATE_FILE);
   if (serv.is_error()) {
     return 1;
   }
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+
+#include <string>
+
+#include "scheduler/protocol.h"
+#include "config.h"
+
+bool SchedulerProtocol::IsMessage(const char *data, const size_t size) {
+  return size > 0 && data[0] == SCHEDULER_PROTOCOL_VERSION;
+}
+
+void SchedulerProtocol::Encode(const SchedulerMessage &message,
+                               std::string *buf) {
+  buf->clear();
+  Append(SCHEDULER_PROTOCOL_VERSION, 1, buf);
+  Append(message.type, 1, buf);
+  Append(message.seq, 4, buf);
+  Append(message.ttl, 4, buf);
+  Append(message.value, 4, buf);
+  Append(message.items.size(), 2, buf);
+
+  for (const SchedulerItem &item : message.items) {
+    size_t size = item.name.size() > 0xffff ? 0xffff : item.name.size();
+    Append(size, 2, buf);
+    buf->append(item.name, 0, size);
+    Append(item.status, 1, buf);
+    Append(item.files, 8, buf);
+    Append(item.changed, 8, buf);
+  }
+}
+
+bool SchedulerProtocol::Decode(const char *data, const size_t size,
+                               SchedulerMessage *message) {
+  if (!IsMessage(data, size) || size < SCHEDULER_HEADER_SIZE)
+    return false;
+
+  size_t pos = 1;
+  uint64_t type, seq, ttl, value, count;
+  Read(data, size, 1, &pos, &type);
+  Read(data, size, 4, &pos, &seq);
+  Read(data, size, 4, &pos, &ttl);
+  Read(data, size, 4, &pos, &value);
+  Read(data, size, 2, &pos, &count);
+  message->type = type;
+  message->seq = seq;
+  message->ttl = ttl;
+  message->value = value;
+
+  // Each item takes at least 19 bytes.
+  if (count * 19 > size - pos)
+    return false;
+
+  message->items.resize(count);
+  for (SchedulerItem &item : message->items) {
+    uint64_t length, status, files, changed;
+    if (!Read(data, size, 2, &pos, &length) || pos + length > size)
+      return false;
+    item.name.assign(data + pos, length);
+    pos += length;
+
+    if (!Read(data, size, 1, &pos, &status) ||
+        !Read(data, size, 8, &pos, &files) ||
+        !Read(data, size, 8, &pos, &changed))
+      return false;
+    item.status = status;
+    item.files = files;
+    item.changed = changed;
+  }
+
+  return pos == size;
+}
+
+void SchedulerProtocol::Append(const uint64_t value, const int bytes,
+                               std::string *buf) {
+  for (int i = bytes - 1; i >= 0; --i)
+    buf->push_back(static_cast<char>(value >> (8 * i)));
+}
+
+bool SchedulerProtocol::Read(const char *data, const size_t size,
+                             const int bytes, size_t *pos, uint64_t *value) {
+  if (*pos + bytes > size)
+    return false;
+
+  *value = 0;
+  for (int i = 0; i < bytes; ++i)
+    *value = (*value << 8) | static_cast<uint8_t>(data[(*pos)++]);
+  return true;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SCHEDULER_PROTOCOL_H_
+#define SCHEDULER_PROTOCOL_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * Every message is one datagram:
+ *   uint8  protocol version, SCHEDULER_PROTOCOL_VERSION
+ *   uint8  message type
+ *   uint32 sequence number, chosen by the spider and echoed in the reply
+ *   uint32 lease time to live in seconds, 0 in requests
+ *   uint32 value, see below
+ *   uint16 count of items, each item is
+ *     string name, uint8 status, uint64 files, uint64 changed
+ * All integers are in network byte order, strings are uint16 length followed
+ * by bytes. Text commands of the first protocol start with a letter, so both
+ * can be served on one socket.
+ *
+ * LeaseMessage: the request value is the number of wanted leases, the reply
+ * items are leased servers. A reply without items has the number of seconds
+ * to wait before the next request as value.
+ * RenewMessage: items are leases to keep, reply status is 1 for every
+ * renewed lease and 0 for unknown, expired ones and leases held by another
+ * spider.
+ * ReleaseMessage: items are finished leases with number of found and changed
+ * files, files is -1 if unknown. The reply has no items.
+ * SplitMessage: items are work items split from a leased server, reply
+ * status is 1 if the item is queued and must be skipped by the spider.
+ *
+ * A request sent again with the same sequence number gets the same reply
+ * without being executed twice, so requests may be retried safely.
+ */
+
+/**
+ * Size of the message header.
+ */
+#define SCHEDULER_HEADER_SIZE 16
+
+/**
+ * Types of messages.
+ */
+enum SchedulerMessageType {
+  LeaseMessage = 1,
+  RenewMessage,
+  ReleaseMessage,
+  SplitMessage
+};
+
+/**
+ * Server or work item in a message.
+ */
+struct SchedulerItem {
+  std::string name;
+  uint8_t status = 0;
+  int64_t files = -1;
+  int64_t changed = 0;
+};
+
+/**
+ * Decoded message.
+ */
+struct SchedulerMessage {
+  uint8_t type = 0;
+  uint32_t seq = 0;
+  uint32_t ttl = 0;
+  uint32_t value = 0;
+  std::vector<SchedulerItem> items;
+};
+
+/**
+ * Encoding and decoding of scheduler messages.
+ */
+class SchedulerProtocol {
+ public:
+  /**
+   * Check whether a datagram is a message of this protocol rather than a
+   * text command.
+   *
+   * @param data Received datagram.
+   * @param size Size of the datagram.
+   *
+   * @return true for binary messages, false otherwise.
+   */
+  static bool IsMessage(const char *data, const size_t size);
+
+  /**
+   * Encode a message.
+   *
+   * @param message Message to encode.
+   * @param buf Where to store the datagram.
+   */
+  static void Encode(const SchedulerMessage &message, std::string *buf);
+
+  /**
+   * Decode a message.
+   *
+   * @param data Received datagram.
+   * @param size Size of the datagram.
+   * @param message Where to store the message.
+   *
+   * @return true on success, false if the datagram is malformed.
+   */
+  static bool Decode(const char *data, const size_t size,
+                     SchedulerMessage *message);
+
+ private:
+  /**
+   * Append an integer of the given size in bytes.
+   */
+  static void Append(const uint64_t value, const int bytes, std::string *buf);
+
+  /**
+   * Read an integer of the given size in bytes at pos and move pos after it.
+   *
+   * @return false if the datagram is too short, true otherwise.
+   */
+  static bool Read(const char *data, const size_t size, const int bytes,
+                   size_t *pos, uint64_t *value);
+};
+
+#endif  // SCHEDULER_PROTOCOL_H_
@@ -1,4 +1,4 @@
 TEMPLATE=app
-SOURCES = main.cpp serverqueue.cpp schedulerserver.cpp
-HEADERS = serverqueue.h schedulerserver.h
+SOURCES = main.cpp serverqueue.cpp schedulerserver.cpp schedulingpolicy.cpp protocol.cpp statelog.cpp
+HEADERS = serverqueue.h schedulerserver.h schedulingpolicy.h protocol.h statelog.h
 OTHER_FILES = Makefile
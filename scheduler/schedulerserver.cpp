@@ -24,23 +24,49 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <sys/file.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <list>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "scheduler/schedulerserver.h"
 #include "scheduler/serverqueue.h"
 #include "common-inl.h"
 #include "config.h"
 
-SchedulerServer::SchedulerServer(const std::string serversfile)
-    : queue_(serversfile) {
+SchedulerServer::SchedulerServer(const std::string serversfile,
+                                 const std::string &statefile,
+                                 const int shards)
+    : queue_(serversfile),
+      lockfd_(-1) {
+  queue_.set_policy(
+      std::unique_ptr<SchedulingPolicy>(new FreshnessPolicy()));
+
+  // The lock is taken before the state is read and sockets are bound.
+  if (!statefile.empty() && LockInstance(statefile + ".lock")) {
+    error_ = true;
+    return;
+  }
+
+  if (!statefile.empty() && queue_.OpenState(statefile)) {
+    MSS_FATAL_MESSAGE(("can not open state " + statefile).c_str());
+    error_ = true;
+    return;
+  }
+
   // Prepare hists for getaddrinfo.
   struct addrinfo hints;
   memset(&hints, 0, sizeof hints);
@@ -56,93 +82,358 @@ SchedulerServer::SchedulerServer(const std::string serversfile)
     return;
   }
 
-  // Just in case res == NULL.
-  sockfd_ = -1;
+  int count = shards > 0 ? shards : std::thread::hardware_concurrency();
+  shards_.resize(std::max(count, 1));
 
   // Iterate over list of address structures and try to bind socket
   // to any of them.
   struct addrinfo *p;
   for (p = res; p != NULL; p = p->ai_next) {
-    sockfd_ = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-    if (sockfd_ == -1) {
-      MSS_ERROR("socket", errno);
-      continue;
-    }
-
-    int val = 1;
-    if (setsockopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &val, sizeof val)) {
-      MSS_ERROR("setsockopt", errno);
-      close(sockfd_);
-      continue;
-    }
-
-    if (bind(sockfd_, p->ai_addr, p->ai_addrlen) == -1) {
-      MSS_ERROR("bind", errno);
-      close(sockfd_);
-      continue;
-    }
-
-    break;
+    if ((shards_[0].sockfd = OpenSocket(p)) != -1)
+      break;
   }
 
   if (p == NULL) {
     MSS_FATAL_MESSAGE("can not bind socket");
+    freeaddrinfo(res);
     error_ = true;
     return;
   }
+
+  // Other shards bind to the same address, without SO_REUSEPORT there is
+  // one shard.
+  for (size_t i = 1; i < shards_.size(); ++i) {
+    if ((shards_[i].sockfd = OpenSocket(p)) == -1) {
+      MSS_WARN_MESSAGE("can not bind more sockets, using less shards");
+      shards_.resize(i);
+      break;
+    }
+  }
   freeaddrinfo(res);
+
+  for (Shard &shard : shards_) {
+    shard.buf.resize(SCHEDULER_BATCH * (SCHEDULER_PACKET_SIZE + 1));
+    shard.in.resize(SCHEDULER_BATCH);
+    shard.iniov.resize(SCHEDULER_BATCH);
+    shard.addrs.resize(SCHEDULER_BATCH);
+    shard.out.resize(SCHEDULER_BATCH);
+    shard.outiov.resize(SCHEDULER_BATCH);
+    shard.replies.resize(SCHEDULER_BATCH);
+  }
   error_ = false;
 }
 
 SchedulerServer::~SchedulerServer() {
-  if (sockfd_ != -1)
-    close(sockfd_);
+  for (Shard &shard : shards_) {
+    if (shard.sockfd != -1)
+      close(shard.sockfd);
+  }
+
+  if (lockfd_ != -1)
+    close(lockfd_);
+}
+
+int SchedulerServer::LockInstance(const std::string &path) {
+  lockfd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lockfd_ == -1) {
+    MSS_ERROR(("open " + path).c_str(), errno);
+    return -1;
+  }
+
+  // The lock is released by the kernel when the process exits.
+  if (flock(lockfd_, LOCK_EX | LOCK_NB)) {
+    if (errno == EWOULDBLOCK) {
+      MSS_FATAL_MESSAGE(("another scheduler holds " + path).c_str());
+    } else {
+      MSS_ERROR(("flock " + path).c_str(), errno);
+    }
+    close(lockfd_);
+    lockfd_ = -1;
+    return -1;
+  }
+
+  char pid[32];
+  int length = snprintf(pid, sizeof(pid), "%d\n", getpid());
+  if (ftruncate(lockfd_, 0) || pwrite(lockfd_, pid, length, 0) != length)
+    MSS_WARN_MESSAGE(("can not write pid to " + path).c_str());
+  return 0;
+}
+
+int SchedulerServer::OpenSocket(const struct addrinfo *addr) {
+  int sockfd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  if (sockfd == -1) {
+    MSS_ERROR("socket", errno);
+    return -1;
+  }
+
+  int val = 1;
+  if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof val) ||
+      setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof val)) {
+    MSS_ERROR("setsockopt", errno);
+    close(sockfd);
+    return -1;
+  }
+
+  if (bind(sockfd, addr->ai_addr, addr->ai_addrlen) == -1) {
+    MSS_ERROR("bind", errno);
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
 }
 
 void SchedulerServer::Run() {
-  struct sockaddr_storage theiraddr;
+  for (size_t i = 1; i < shards_.size(); ++i)
+    shards_[i].thread = std::thread(&SchedulerServer::ShardLoop, this,
+                                    &shards_[i]);
+  ShardLoop(&shards_[0]);
+}
 
+void SchedulerServer::ShardLoop(Shard *shard) {
   while (1) {
-    // Commands consist of one-byte command and, possibly, domain name.
-    // Domain name length is no greater than 255
-    // See https://tools.ietf.org/html/rfc1035
-    // One byte is for '\0'.
-    char buf[257];
-    memset(buf, '\0', sizeof buf);
-
-    socklen_t salen;
-    if (recvfrom(sockfd_, buf, sizeof buf - 1, 0,
-        (struct sockaddr *)&theiraddr, &salen) == -1) {
-      MSS_ERROR("recvfrom", errno);
+    for (size_t i = 0; i < SCHEDULER_BATCH; ++i) {
+      // One byte is for '\0' after text commands.
+      shard->iniov[i].iov_base = &shard->buf[i * (SCHEDULER_PACKET_SIZE + 1)];
+      shard->iniov[i].iov_len = SCHEDULER_PACKET_SIZE;
+      memset(&shard->in[i].msg_hdr, 0, sizeof shard->in[i].msg_hdr);
+      shard->in[i].msg_hdr.msg_iov = &shard->iniov[i];
+      shard->in[i].msg_hdr.msg_iovlen = 1;
+      shard->in[i].msg_hdr.msg_name = &shard->addrs[i];
+      shard->in[i].msg_hdr.msg_namelen = sizeof shard->addrs[i];
+    }
+
+    // Wait for one datagram and take all which are already there.
+    int count = recvmmsg(shard->sockfd, &shard->in[0], SCHEDULER_BATCH,
+                         MSG_WAITFORONE, NULL);
+    if (count == -1) {
+      MSS_ERROR("recvmmsg", errno);
       continue;
     }
 
-    std::string cmd(buf);
+    size_t replies = 0;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      for (int i = 0; i < count; ++i) {
+        char *data = static_cast<char *>(shard->iniov[i].iov_base);
+        size_t size = shard->in[i].msg_len;
+        const struct sockaddr_storage &addr = shard->addrs[i];
+        socklen_t salen = shard->in[i].msg_hdr.msg_namelen;
+        std::string *reply = &shard->replies[replies];
 
-    std::size_t pos = cmd.find("\n");
-    if (pos != std::string::npos)
-      cmd.erase(pos);
+        bool has_reply;
+        if (SchedulerProtocol::IsMessage(data, size)) {
+          has_reply = HandleMessage(shard, data, size, addr, salen, reply);
+        } else {
+          data[size] = '\0';
+          has_reply = HandleCommand(shard, data, size, reply);
+        }
+        if (!has_reply)
+          continue;
 
-    if (cmd.empty())
-      continue;
+        shard->outiov[replies].iov_base = &(*reply)[0];
+        shard->outiov[replies].iov_len = reply->size();
+        memset(&shard->out[replies].msg_hdr, 0,
+               sizeof shard->out[replies].msg_hdr);
+        shard->out[replies].msg_hdr.msg_iov = &shard->outiov[replies];
+        shard->out[replies].msg_hdr.msg_iovlen = 1;
+        shard->out[replies].msg_hdr.msg_name = &shard->addrs[i];
+        shard->out[replies].msg_hdr.msg_namelen = salen;
+        ++replies;
+      }
+
+      // Save changes before replies are sent. A snapshot of all servers
+      // is copied here and written without the lock.
+      queue_.SyncState(&shard->snapshot);
+    }
 
-    std::string server = cmd.substr(1);
-    switch (cmd[0]) {
-    case 'G':
-      if (server.empty()) {
-        server = queue_.CmdGet();
-        if (!server.empty())
-          if (UNLIKELY(sendto(sockfd_, server.c_str(), server.size(), 0,
-                              (struct sockaddr *)&theiraddr, salen) == -1))
-            MSS_ERROR("sendto", errno);
-      } else {
-        queue_.CmdGet(server);
+    // Lost replies are retried by spiders.
+    for (size_t sent = 0; sent < replies; ) {
+      int result = sendmmsg(shard->sockfd, &shard->out[sent],
+                            replies - sent, 0);
+      if (UNLIKELY(result == -1)) {
+        MSS_ERROR("sendmmsg", errno);
+        break;
       }
-      break;
-    case 'R':
-      server = cmd.substr(1);
+      sent += result;
+    }
+
+    if (UNLIKELY(!shard->snapshot.empty())) {
+      int result = queue_.WriteSnapshot(shard->snapshot);
+      shard->snapshot.clear();
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      queue_.FinishSnapshot(result);
+    }
+  }
+}
+
+/**
+ * Check that the part of the string is a non-empty decimal number.
+ */
+static bool IsNumber(const std::string &str, const size_t begin,
+                     const size_t end) {
+  if (begin >= end)
+    return false;
+  for (size_t i = begin; i < end; ++i) {
+    if (str[i] < '0' || str[i] > '9')
+      return false;
+  }
+  return true;
+}
+
+bool SchedulerServer::HandleCommand(Shard *shard, const char *data,
+                                    size_t size, std::string *reply) {
+  // Commands consist of one-byte command and, possibly, name of a server
+  // or a work item split from it.
+  const char *end = static_cast<const char *>(memchr(data, '\n', size));
+  if (end != NULL)
+    size = end - data;
+
+  if (size == 0 || size > SCHEDULER_COMMAND_SIZE)
+    return false;
+
+  std::string &server = shard->name;
+  server.assign(data + 1, size - 1);
+  switch (data[0]) {
+  case 'G':
+    if (server.empty()) {
+      *reply = queue_.CmdGet();
+      return !reply->empty();
+    }
+    queue_.CmdGet(server);
+    return false;
+  case 'R': {
+    // Release may report the crawl: "R<server> <files> <changed>". Work
+    // items may have spaces, so the numbers are taken from the end.
+    long long files = 0, changed = 0;
+    std::size_t last = server.rfind(' ');
+    std::size_t pos = last == std::string::npos || last == 0 ?
+        std::string::npos : server.rfind(' ', last - 1);
+    if (pos != std::string::npos && IsNumber(server, pos + 1, last) &&
+        IsNumber(server, last + 1, server.size()) &&
+        sscanf(server.c_str() + pos, "%lld %lld", &files, &changed) == 2) {
+      server.erase(pos);
+      queue_.CmdRelease(server, files, changed);
+    } else {
       queue_.CmdRelease(server);
-      break;
     }
+    return false;
+  }
+  case 'S':
+    // Reply "+<item>" if the item is queued, "-<item>" if the spider has
+    // to crawl it itself. Neither can be a server name.
+    reply->assign(1, queue_.CmdSplit(server) ? '+' : '-');
+    reply->append(server);
+    return true;
+  }
+  return false;
+}
+
+bool SchedulerServer::HandleMessage(Shard *shard, const char *data,
+                                    const size_t size,
+                                    const struct sockaddr_storage &addr,
+                                    const socklen_t salen,
+                                    std::string *reply) {
+  SchedulerMessage &request = shard->request;
+  if (UNLIKELY(!SchedulerProtocol::Decode(data, size, &request))) {
+    MSS_WARN_MESSAGE("Malformed scheduler message");
+    return false;
+  }
+
+  // The reply was lost, send it again without executing the request twice.
+  // Replies to other requests of the spider may have been sent since then.
+  shard->key.assign(reinterpret_cast<const char *>(&addr), salen);
+  auto cached = shard->cache.find(shard->key);
+  if (cached != shard->cache.end()) {
+    for (const CachedReply &old : cached->second.window) {
+      if (old.used && old.seq == request.seq) {
+        *reply = old.data;
+        return true;
+      }
+    }
+  }
+
+  if (UNLIKELY(Execute(request, shard->key, &shard->reply))) {
+    MSS_WARN_MESSAGE("Unknown scheduler message");
+    return false;
+  }
+
+  time_t now = time(NULL);
+  if (cached == shard->cache.end()) {
+    // Forget spiders which didn't come for a long time.
+    if (shard->cache.size() >= SCHEDULER_MAX_CLIENTS) {
+      for (auto itr = shard->cache.begin(); itr != shard->cache.end(); ) {
+        if (itr->second.time + queue_.get_lease_ttl() < now)
+          itr = shard->cache.erase(itr);
+        else
+          ++itr;
+      }
+    }
+    cached = shard->cache.insert(
+        std::make_pair(shard->key, ClientReplies())).first;
   }
+
+  ClientReplies &client = cached->second;
+  CachedReply &slot = client.window[client.next];
+  client.next = (client.next + 1) % SCHEDULER_REPLY_WINDOW;
+  client.time = now;
+  slot.used = true;
+  slot.seq = request.seq;
+  SchedulerProtocol::Encode(shard->reply, &slot.data);
+  *reply = slot.data;
+  return true;
+}
+
+int SchedulerServer::Execute(const SchedulerMessage &request,
+                             const std::string &holder,
+                             SchedulerMessage *reply) {
+  reply->type = request.type;
+  reply->seq = request.seq;
+  reply->ttl = queue_.get_lease_ttl();
+  reply->value = 0;
+  reply->items.clear();
+
+  switch (request.type) {
+  case LeaseMessage: {
+    uint32_t count = std::min<uint32_t>(request.value, SCHEDULER_MAX_ITEMS);
+    while (reply->items.size() < count) {
+      std::string name = queue_.CmdLease(holder);
+      if (name.empty())
+        break;
+      reply->items.emplace_back();
+      reply->items.back().name.swap(name);
+    }
+
+    // Tell when a server becomes free so that the spider doesn't ask
+    // in vain.
+    if (reply->items.empty()) {
+      time_t wait = queue_.get_free_time() - time(NULL);
+      reply->value = std::max<time_t>(
+          1, std::min<time_t>(wait, SCHEDULER_MAX_RETRY_AFTER));
+    }
+    return 0;
+  }
+  case RenewMessage:
+    // A spider can't keep a lease which has expired or was given to
+    // another spider, it has to stop the crawl.
+    reply->items = request.items;
+    for (SchedulerItem &item : reply->items)
+      item.status = queue_.CmdRenew(item.name, holder);
+    return 0;
+  case ReleaseMessage:
+    for (const SchedulerItem &item : request.items) {
+      if (item.files < 0)
+        queue_.CmdRelease(item.name);
+      else
+        queue_.CmdRelease(item.name, item.files, item.changed);
+    }
+    return 0;
+  case SplitMessage:
+    reply->items = request.items;
+    for (SchedulerItem &item : reply->items)
+      item.status = queue_.CmdSplit(item.name);
+    return 0;
+  }
+
+  return -1;
 }
@@ -27,14 +27,32 @@
 #ifndef SCHEDULER_SCHEDULERSERVER_H_
 #define SCHEDULER_SCHEDULERSERVER_H_
 
+#include <sys/socket.h>
+#include <time.h>
+
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
-#include "scheduler/schedulerserver.h"
+#include "scheduler/protocol.h"
 #include "scheduler/serverqueue.h"
 #include "common-inl.h"
+#include "config.h"
 
 /**
  * Scheduler server, used to distribute jobs among spiders.
+ *
+ * Datagrams are received by several shards, each with its own socket bound
+ * to the same port with SO_REUSEPORT and its own thread. The kernel sends
+ * all datagrams of one spider to the same shard. A shard receives and sends
+ * datagrams in batches with recvmmsg() and sendmmsg() and takes the queue
+ * lock once per batch.
+ *
+ * SO_REUSEPORT would let a second scheduler bind the same port and take a
+ * part of spiders, so a scheduler with a state file holds an exclusive
+ * lock on "<statefile>.lock" and refuses to start if it is taken.
  */
 class SchedulerServer {
  public:
@@ -42,16 +60,20 @@ class SchedulerServer {
    * Constructor.
    *
    * @param serversfile Name of file with the list of servers.
+   * @param statefile Path prefix of state files, empty not to save state.
+   * @param shards Number of shards, 0 for one per core.
    */
-  explicit SchedulerServer(const std::string serversfile);
+  explicit SchedulerServer(const std::string serversfile,
+                           const std::string &statefile = "",
+                           const int shards = SCHEDULER_SHARDS);
 
   /**
-   * Destructor, closes socket.
+   * Destructor, closes sockets.
    */
   ~SchedulerServer();
 
   /**
-   * Start listening on socket and hand out jobs.
+   * Start listening on sockets and hand out jobs. Never returns.
    */
   void Run();
 
@@ -61,14 +83,136 @@ class SchedulerServer {
   bool is_error() const { return error_; }
 
  private:
+  /**
+   * Reply sent to a spider.
+   */
+  struct CachedReply {
+    bool used = false;
+    uint32_t seq = 0;
+    std::string data;
+  };
+
+  /**
+   * Last replies sent to a spider, the oldest one is replaced first.
+   */
+  struct ClientReplies {
+    time_t time = 0;
+    size_t next = 0;
+    CachedReply window[SCHEDULER_REPLY_WINDOW];
+  };
+
+  /**
+   * Socket with its thread and buffers, all reused between batches.
+   */
+  struct Shard {
+    int sockfd = -1;
+    std::thread thread;
+    std::vector<char> buf;
+    std::vector<struct mmsghdr> in;
+    std::vector<struct iovec> iniov;
+    std::vector<struct sockaddr_storage> addrs;
+    std::vector<struct mmsghdr> out;
+    std::vector<struct iovec> outiov;
+    std::vector<std::string> replies;
+    /**
+     * Last replies by spider address, to answer retried requests.
+     */
+    std::unordered_map<std::string, ClientReplies> cache;
+    std::string key;
+    std::string name;
+    SchedulerMessage request;
+    SchedulerMessage reply;
+    /**
+     * State of all servers to be written as a snapshot by this shard.
+     */
+    std::vector<StateLog::Record> snapshot;
+  };
+
+  /**
+   * Create a socket and bind it.
+   *
+   * @param addr Address to bind to.
+   *
+   * @return Socket on success, -1 otherwise.
+   */
+  static int OpenSocket(const struct addrinfo *addr);
+
+  /**
+   * Take the lock which only one scheduler can hold and write pid in it.
+   *
+   * @param path Path of the lock file.
+   *
+   * @return 0 on success, -1 if another scheduler holds the lock or on
+   * error.
+   */
+  int LockInstance(const std::string &path);
+
+  /**
+   * Main loop of a shard.
+   *
+   * @param shard The shard.
+   */
+  void ShardLoop(Shard *shard);
+
+  /**
+   * Handle a text command of the first protocol version. Must be called
+   * with queue_mutex_ locked.
+   *
+   * @param shard Shard which received the command.
+   * @param data Command, '\0'-terminated.
+   * @param size Size of the command.
+   * @param reply Where to store the reply.
+   *
+   * @return true if there is a reply, false otherwise.
+   */
+  bool HandleCommand(Shard *shard, const char *data, size_t size,
+                     std::string *reply);
+
+  /**
+   * Handle a binary message, see scheduler/protocol.h. Must be called
+   * with queue_mutex_ locked.
+   *
+   * @param shard Shard which received the message.
+   * @param data Received datagram.
+   * @param size Size of the datagram.
+   * @param addr Address of the spider.
+   * @param salen Size of the address.
+   * @param reply Where to store the reply.
+   *
+   * @return true if there is a reply, false otherwise.
+   */
+  bool HandleMessage(Shard *shard, const char *data, const size_t size,
+                     const struct sockaddr_storage &addr,
+                     const socklen_t salen, std::string *reply);
+
+  /**
+   * Execute a request and fill the reply.
+   *
+   * @param request Decoded request.
+   * @param holder Address of the spider, holder of the leases it takes.
+   * @param reply Where to store the reply.
+   *
+   * @return 0 on success, -1 if the request is unknown.
+   */
+  int Execute(const SchedulerMessage &request, const std::string &holder,
+              SchedulerMessage *reply);
+
   /**
    * Some queue to get servers from.
    */
   ServerQueue queue_;
   /**
-   * socket file descriptor
+   * Guards queue_.
+   */
+  std::mutex queue_mutex_;
+  /**
+   * Shards, the first one runs in the thread which called Run().
+   */
+  std::vector<Shard> shards_;
+  /**
+   * Descriptor of the locked file, -1 if there is none.
    */
-  int sockfd_;
+  int lockfd_;
   /**
    * If error occured.
    */
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SCHEDULER_SCHEDULINGPOLICY_H_
+#define SCHEDULER_SCHEDULINGPOLICY_H_
+
+#include <time.h>
+
+#include "common-inl.h"
+#include "config.h"
+
+/**
+ * What scheduler knows about a server.
+ */
+struct ServerStats {
+  /**
+   * Priority from servers file, greater is more important.
+   */
+  int priority = SCHEDULER_DEFAULT_PRIORITY;
+
+  /**
+   * Time when the last crawl finished, 0 if never.
+   */
+  time_t last_crawl = 0;
+
+  /**
+   * Share of files changed between crawls, from 0 to 1, moving average.
+   */
+  double change_rate = 0;
+
+  /**
+   * Duration of a crawl in seconds, moving average.
+   */
+  double cost = 0;
+};
+
+/**
+ * Decides the order in which free servers are given to spiders.
+ *
+ * A policy maps stats of a server to the time when the server should be
+ * crawled next. Free servers are given out in order of this time, even
+ * before it comes. The time must depend only on the stats, the queue
+ * recomputes it only when they change.
+ */
+class SchedulingPolicy {
+ public:
+  virtual ~SchedulingPolicy() {}
+
+  /**
+   * Get time when server should be crawled next.
+   *
+   * @param stats Stats of the server.
+   *
+   * @return Time of next crawl.
+   */
+  virtual time_t NextCrawl(const ServerStats &stats) const = 0;
+};
+
+/**
+ * All servers are equal, free servers are given out round-robin.
+ */
+class RoundRobinPolicy : public SchedulingPolicy {
+ public:
+  virtual time_t NextCrawl(const ServerStats &stats) const { return 0; }
+};
+
+/**
+ * Servers are crawled periodically, the period is shorter for servers with
+ * higher priority and change rate and longer for servers which take long
+ * to crawl:
+ *
+ *   period = interval * (1 + cost / interval) /
+ *            (priority * (change_rate + SCHEDULER_MIN_CHANGE_RATE))
+ *
+ * Servers never crawled come first, in order of priority.
+ */
+class FreshnessPolicy : public SchedulingPolicy {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param interval Base period between crawls in seconds.
+   */
+  explicit FreshnessPolicy(const time_t interval = SCHEDULER_CRAWL_INTERVAL)
+      : interval_(interval > 0 ? interval : 1) {}
+
+  virtual time_t NextCrawl(const ServerStats &stats) const;
+
+ private:
+  /**
+   * Base period between crawls in seconds.
+   */
+  time_t interval_;
+};
+
+#endif  // SCHEDULER_SCHEDULINGPOLICY_H_
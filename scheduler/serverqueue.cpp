@@ -26,22 +26,19 @@
 
 #include <stdio.h>
 
+#include <algorithm>
 #include <list>
 #include <string>
-#include <algorithm>
-#include <iterator>
+#include <vector>
 
 #include "scheduler/serverqueue.h"
 #include "common-inl.h"
+#include "config.h"
 
-ServerQueue::ServerQueue() {
-  servers_list_ = new(std::nothrow) std::list<Server>();
-  if (UNLIKELY(servers_list_ == NULL)) {
-    MSS_FATAL("servers_list_", ENOMEM);
-    return;
-  }
-
-  ilast_server_ = servers_list_->begin();
+ServerQueue::ServerQueue()
+    : policy_(new RoundRobinPolicy()),
+      first_ticket_(0),
+      last_ticket_(0) {
 }
 
 ServerQueue::ServerQueue(const std::string &servers_file) : ServerQueue() {
@@ -50,24 +47,51 @@ ServerQueue::ServerQueue(const std::string &servers_file) : ServerQueue() {
 }
 
 ServerQueue::~ServerQueue() {
-  if (servers_list_)
-    delete servers_list_;
 }
 
-void ServerQueue::AddServer(std::string server_name) {
+std::list<ServerQueue::Server> ServerQueue::get_servers_list() const {
+  std::vector<size_t> slots(heap_);
+  std::sort(slots.begin(), slots.end(), [this](size_t a, size_t b) {
+    return Before(a, b);
+  });
+
+  std::list<Server> servers;
+  for (size_t slot : slots)
+    servers.push_back(servers_[slot]);
+  return servers;
+}
+
+void ServerQueue::set_policy(std::unique_ptr<SchedulingPolicy> policy) {
+  policy_ = std::move(policy);
+  for (Server &server : servers_)
+    server.next_crawl_ = policy_->NextCrawl(server.stats_);
+
+  for (size_t index = heap_.size() / 2; index > 0; --index)
+    SiftDown(index - 1);
+}
+
+void ServerQueue::AddServer(std::string server_name, const int priority) {
   if (UNLIKELY(server_name.empty())) {
     return;  // Do nothing if an empty server name is passed.
   }
 
-  if (UNLIKELY(std::find(servers_list_->begin(), servers_list_->end(),
-      server_name) != servers_list_->end())) {
+  if (UNLIKELY(!slots_.insert(std::make_pair(server_name,
+                                             servers_.size())).second)) {
     MSS_WARN_MESSAGE(("Duplicated server: " + server_name).c_str());
-    return;  // Do nothing if server name is in servers_list_ yet.
+    return;  // Do nothing if server name is in the queue yet.
   }
 
-  // Add a new server before the head of the queue so that it will be
-  // returned by CmdGet() the next time
-  ilast_server_ = servers_list_->insert(ilast_server_, server_name);
+  // A new server goes before all free servers so that it will be returned
+  // by CmdGet() the next time.
+  servers_.push_back(Server(server_name));
+  Server &server = servers_.back();
+  server.stats_.priority = priority;
+  server.next_crawl_ = policy_->NextCrawl(server.stats_);
+  server.ticket_ = --first_ticket_;
+  server.heap_index_ = heap_.size();
+  heap_.push_back(servers_.size() - 1);
+  SiftUp(server.heap_index_);
+  SaveState(servers_.back());
 }
 
 int ServerQueue::ReadServersList(std::string servers_file) {
@@ -77,19 +101,18 @@ int ServerQueue::ReadServersList(std::string servers_file) {
     return -1;
   }
 
-  std::string temp;
   char *buf = NULL;
   size_t size = 0;
-  // Read lines from servers_file and put names servers names in servers_list_
+  // Domain name length is no greater than 255.
+  // See https://tools.ietf.org/html/rfc1035
+  char name[256];
+  // Read lines "name [priority]" from servers_file and add the servers.
   while (getline(&buf, &size, fin) != -1) {
-    temp.insert(0, buf);
-    // Deleting '\n' symbols from the end of the string
-    temp.erase(temp.end() - 1);
-    if (UNLIKELY(temp.empty())) {
+    int priority = SCHEDULER_DEFAULT_PRIORITY;
+    if (UNLIKELY(sscanf(buf, "%255s %d", name, &priority) < 1)) {
       continue;  // Do nothing if find an empty string.
     }
-    AddServer(temp);
-    temp.clear();
+    AddServer(name, priority);
   }
   free(buf);
   fclose(fin);
@@ -98,71 +121,264 @@ int ServerQueue::ReadServersList(std::string servers_file) {
 }
 
 std::string ServerQueue::CmdGet() {
-  if (UNLIKELY(servers_list_ == NULL || servers_list_->empty())) {
+  return CmdLease(std::string());
+}
+
+std::string ServerQueue::CmdLease(const std::string &holder) {
+  if (UNLIKELY(heap_.empty())) {
     MSS_FATAL("", ENOMEM);
     return "";  // list of servers is empty
   }
 
-  time_t current = time(NULL);
+  Server &server = servers_[heap_.front()];
+  if (FreeTime(server) > time(NULL))
+    return "";  // the earliest server is still busy
 
-  // Iterator pointing to the current head of the queue.
-  std::list<ServerQueue::Server>::iterator iprev_head = ilast_server_;
+  server.Refresh();
+  server.lease_start_ = server.get_timestamp();
+  server.holder_ = holder;
+  server.ticket_ = ++last_ticket_;
+  SiftDown(0);
+  SaveState(server);
+  return server.get_name();
+}
 
-  bool found = false;
-  do {
-    found = current - ilast_server_->get_timestamp() > kMaxWait;
-    if (found)
-      break;
-    if (UNLIKELY(++ilast_server_ == servers_list_->end())) {
-      // If the last server is in the end of the list,
-      // the next server to choose is from the beginning of the list.
-      ilast_server_ = servers_list_->begin();
-    }
-  } while (ilast_server_ != iprev_head);
+bool ServerQueue::CmdGet(const std::string &address) {
+  if (UNLIKELY(heap_.empty())) {
+    // List of servers is empty.
+    MSS_FATAL("", ENOMEM);
+    return false;
+  }
 
-  if (!found)
-    return "";
+  auto slot = slots_.find(address);
+  if (UNLIKELY(slot == slots_.end())) {
+    // Server with name address hasn't been found.
+    return false;
+  }
 
-  ilast_server_->Refresh();
+  Server &server = servers_[slot->second];
+  server.Refresh();
+  server.ticket_ = ++last_ticket_;
+  Update(slot->second);
+  return true;
+}
 
-  std::string last_server_name = ilast_server_->get_name();
+bool ServerQueue::CmdRenew(const std::string &address,
+                           const std::string &holder) {
+  auto slot = slots_.find(address);
+  if (UNLIKELY(slot == slots_.end()))
+    return false;
 
-  if (UNLIKELY(++ilast_server_ == servers_list_->end()))
-    ilast_server_ = servers_list_->begin();
+  // The server may have been released or given out again since the
+  // spider lost it.
+  Server &server = servers_[slot->second];
+  if (FreeTime(server) <= time(NULL) ||
+      (!server.holder_.empty() && server.holder_ != holder))
+    return false;
 
-  return last_server_name;
+  server.holder_ = holder;
+  server.Refresh();
+  server.ticket_ = ++last_ticket_;
+  Update(slot->second);
+  return true;
 }
 
-void ServerQueue::CmdGet(const std::string address) {
-  if (UNLIKELY(servers_list_ == NULL || servers_list_->empty())) {
+bool ServerQueue::CmdSplit(const std::string &item) {
+  std::size_t pos = item.find('/');
+  if (UNLIKELY(pos == std::string::npos || pos == 0 ||
+               pos + 1 == item.size() || item.size() > SCHEDULER_COMMAND_SIZE))
+    return false;  // not a part of a server or too long for a reply
+
+  if (slots_.count(item))
+    return true;  // already queued, e.g. by a previous crawl
+
+  auto root = slots_.find(item.substr(0, pos));
+  if (UNLIKELY(root == slots_.end()))
+    return false;  // server is unknown, let the spider crawl it all
+
+  AddServer(item, servers_[root->second].stats_.priority);
+  return true;
+}
+
+void ServerQueue::CmdRelease(const std::string &address) {
+  Release(address, -1, 0);
+}
+
+void ServerQueue::CmdRelease(const std::string &address, const int64_t files,
+                             const int64_t changed) {
+  Release(address, files, changed);
+}
+
+void ServerQueue::Release(const std::string &address, const int64_t files,
+                          const int64_t changed) {
+  if (UNLIKELY(heap_.empty())) {
     // List of servers is empty.
     MSS_FATAL("", ENOMEM);
     return;
   }
 
-  std::list<ServerQueue::Server>::iterator it =
-    std::find(servers_list_->begin(), servers_list_->end(), address);
-  if (UNLIKELY(it == servers_list_->end())) {
+  auto slot = slots_.find(address);
+  if (UNLIKELY(slot == slots_.end())) {
     // Server with name address hasn't been found.
     return;
   }
 
-  it->Refresh();
+  Server &server = servers_[slot->second];
+  time_t now = time(NULL);
+  ServerStats &stats = server.stats_;
+  if (server.lease_start_ != 0) {
+    double cost = now - server.lease_start_;
+    stats.cost = stats.last_crawl == 0 ? cost :
+        stats.cost + SCHEDULER_STATS_WEIGHT * (cost - stats.cost);
+    server.lease_start_ = 0;
+  }
+  server.holder_.clear();
+  if (files > 0) {
+    double rate = std::min(1.0, static_cast<double>(changed) / files);
+    stats.change_rate = stats.last_crawl == 0 ? rate :
+        stats.change_rate + SCHEDULER_STATS_WEIGHT * (rate - stats.change_rate);
+  }
+  stats.last_crawl = now;
+  server.next_crawl_ = policy_->NextCrawl(stats);
+
+  // Released server goes after all free servers.
+  server.Reset();
+  server.ticket_ = ++last_ticket_;
+  Update(slot->second);
+  SaveState(server);
 }
 
-void ServerQueue::CmdRelease(const std::string address) {
-  if (UNLIKELY(servers_list_ == NULL || servers_list_->empty())) {
-    // List of servers is empty.
-    MSS_FATAL("", ENOMEM);
+int ServerQueue::OpenState(const std::string &path) {
+  std::unique_ptr<StateLog> state(new StateLog(path));
+  if (state->Load([this](const StateLog::Record &record) {
+        RestoreState(record);
+      }))
+    return -1;
+
+  for (size_t index = heap_.size() / 2; index > 0; --index)
+    SiftDown(index - 1);
+
+  state_ = std::move(state);
+  return SyncState();
+}
+
+int ServerQueue::SyncState(std::vector<StateLog::Record> *snapshot) {
+  if (!state_)
+    return 0;
+
+  // A snapshot which is being written keeps the log growing.
+  if (state_->get_log_size() < SCHEDULER_SNAPSHOT_SIZE ||
+      state_->is_snapshotting())
+    return state_->Flush();
+
+  std::vector<StateLog::Record> records(servers_.size());
+  for (size_t slot = 0; slot < servers_.size(); ++slot)
+    MakeRecord(servers_[slot], &records[slot]);
+  // The caller tells a copied snapshot by records, an empty one is cheap
+  // to write right away.
+  if (snapshot == NULL || records.empty())
+    return state_->Snapshot(records);
+
+  if (UNLIKELY(state_->StartSnapshot()))
+    return -1;
+  snapshot->swap(records);
+  return 0;
+}
+
+void ServerQueue::SaveState(const Server &server) {
+  if (!state_)
     return;
+
+  StateLog::Record record;
+  MakeRecord(server, &record);
+  state_->Append(record);
+}
+
+void ServerQueue::MakeRecord(const Server &server, StateLog::Record *record) {
+  record->name = server.name_;
+  record->priority = server.stats_.priority;
+  record->last_crawl = server.stats_.last_crawl;
+  record->change_rate = server.stats_.change_rate;
+  record->cost = server.stats_.cost;
+  record->timestamp = server.timestamp_;
+  record->lease_start = server.lease_start_;
+  record->ticket = server.ticket_;
+}
+
+void ServerQueue::RestoreState(const StateLog::Record &record) {
+  auto slot = slots_.find(record.name);
+  if (slot == slots_.end()) {
+    // Servers removed from servers file are forgotten with their parts.
+    std::size_t pos = record.name.find('/');
+    if (pos == std::string::npos ||
+        !slots_.count(record.name.substr(0, pos)))
+      return;
+    AddServer(record.name, record.priority);
+    slot = slots_.find(record.name);
   }
 
-  std::list<Server>::iterator it =
-    std::find(servers_list_->begin(), servers_list_->end(), address);
-  if (UNLIKELY(it == servers_list_->end())) {
-    // Server with name address hasn't been found.
-    return;
+  // Priority of a server comes from servers file.
+  Server &server = servers_[slot->second];
+  if (record.name.find('/') != std::string::npos)
+    server.stats_.priority = record.priority;
+  server.stats_.last_crawl = record.last_crawl;
+  server.stats_.change_rate = record.change_rate;
+  server.stats_.cost = record.cost;
+  server.next_crawl_ = policy_->NextCrawl(server.stats_);
+  server.lease_start_ = record.lease_start;
+  // Keepalives are not saved, give the spider time to renew the lease.
+  server.timestamp_ = record.timestamp != 0 ? time(NULL) : 0;
+  server.ticket_ = record.ticket;
+  first_ticket_ = std::min(first_ticket_, server.ticket_);
+  last_ticket_ = std::max(last_ticket_, server.ticket_);
+}
+
+bool ServerQueue::Before(const size_t a, const size_t b) const {
+  const Server &first = servers_[a];
+  const Server &second = servers_[b];
+  time_t first_time = FreeTime(first);
+  time_t second_time = FreeTime(second);
+  if (first_time != second_time)
+    return first_time < second_time;
+  if (first.next_crawl_ != second.next_crawl_)
+    return first.next_crawl_ < second.next_crawl_;
+  return first.ticket_ < second.ticket_;
+}
+
+void ServerQueue::Update(const size_t slot) {
+  size_t index = servers_[slot].heap_index_;
+  SiftUp(index);
+  SiftDown(servers_[slot].heap_index_);
+}
+
+void ServerQueue::SiftUp(size_t index) {
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (!Before(heap_[index], heap_[parent]))
+      break;
+    Swap(index, parent);
+    index = parent;
+  }
+}
+
+void ServerQueue::SiftDown(size_t index) {
+  while (true) {
+    size_t smallest = index;
+    size_t left = 2 * index + 1;
+    size_t right = left + 1;
+    if (left < heap_.size() && Before(heap_[left], heap_[smallest]))
+      smallest = left;
+    if (right < heap_.size() && Before(heap_[right], heap_[smallest]))
+      smallest = right;
+    if (smallest == index)
+      break;
+    Swap(index, smallest);
+    index = smallest;
   }
+}
 
-  it->Reset();
+void ServerQueue::Swap(const size_t a, const size_t b) {
+  std::swap(heap_[a], heap_[b]);
+  servers_[heap_[a]].heap_index_ = a;
+  servers_[heap_[b]].heap_index_ = b;
 }
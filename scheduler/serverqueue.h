@@ -27,14 +27,28 @@
 #ifndef SCHEDULER_SERVERQUEUE_H_
 #define SCHEDULER_SERVERQUEUE_H_
 
+#include <stdint.h>
 #include <time.h>
 
-#include <iterator>
-#include <string>
 #include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "scheduler/schedulingpolicy.h"
+#include "scheduler/statelog.h"
 #include "common-inl.h"
 
+/**
+ * Queue of servers to be scanned by spiders.
+ *
+ * Servers are found by name with a hash map and kept in a binary min-heap
+ * ordered by the time when they become free, so every command takes
+ * O(log n) time. Free servers are given out in order of the next crawl time
+ * chosen by the scheduling policy, then in order of their tickets: a new
+ * server is put before all others, a released one after all others.
+ */
 class ServerQueue {
   /**
    * Represents server in the queue.
@@ -70,12 +84,19 @@ class ServerQueue {
      */
     void Reset() { set_timestamp(0); }
 
+    /**
+     * Getter for scheduling stats.
+     */
+    const ServerStats & get_stats() const { return stats_; }
+
     /**
      * Tell if two servers are equal.
      */
     bool operator==(Server val) { return get_name() == val.get_name(); }
 
    private:
+    friend class ServerQueue;
+
     /**
      * Server hostname or address.
      */
@@ -84,6 +105,31 @@ class ServerQueue {
      * Last time server was scanned.
      */
     time_t timestamp_;
+    /**
+     * Time when the current crawl started.
+     */
+    time_t lease_start_ = 0;
+    /**
+     * Address of the spider which holds the lease, empty if it is not
+     * known: the server was leased by a text command or before a restart.
+     */
+    std::string holder_;
+    /**
+     * Stats seen by scheduling policy.
+     */
+    ServerStats stats_;
+    /**
+     * Next crawl time chosen by scheduling policy.
+     */
+    time_t next_crawl_ = 0;
+    /**
+     * Order among servers which become free at the same time.
+     */
+    int64_t ticket_ = 0;
+    /**
+     * Position in the heap.
+     */
+    size_t heap_index_ = 0;
   };
 
  public:
@@ -106,18 +152,50 @@ class ServerQueue {
   ~ServerQueue();
 
   /**
-   * Get list of servers to be indexed.
+   * Get list of servers to be indexed, in order they will be given out.
    *
    * @return List of servers to be indexed.
    */
-  std::list<ServerQueue::Server> get_servers_list() const {
-    return *servers_list_;
+  std::list<ServerQueue::Server> get_servers_list() const;
+
+  /**
+   * Get number of servers in the queue.
+   *
+   * @return Number of servers.
+   */
+  size_t get_size() const { return servers_.size(); }
+
+  /**
+   * Get time for which a server stays leased without keepalive.
+   *
+   * @return Time in seconds.
+   */
+  time_t get_lease_ttl() const { return kMaxWait; }
+
+  /**
+   * Get time when the next server may be given out.
+   *
+   * @return Time, 0 if a server is free or the queue is empty.
+   */
+  time_t get_free_time() const {
+    return heap_.empty() ? 0 : FreeTime(servers_[heap_.front()]);
   }
 
+  /**
+   * Set scheduling policy, by default it is RoundRobinPolicy.
+   *
+   * @param policy New policy.
+   */
+  void set_policy(std::unique_ptr<SchedulingPolicy> policy);
+
   /**
    * Add a server to the list
+   *
+   * @param address Name of the server.
+   * @param priority Scheduling priority, greater is more important.
    */
-  void AddServer(std::string address);
+  void AddServer(std::string address,
+                 const int priority = SCHEDULER_DEFAULT_PRIORITY);
 
   /**
    * Get command handling, task query
@@ -126,16 +204,109 @@ class ServerQueue {
 
   /**
    * Get command handling, keepalive
+   *
+   * @return true if the server is in the queue, false otherwise.
+   */
+  bool CmdGet(const std::string &address);
+
+  /**
+   * Lease command handling: give out the next free server to a spider.
+   *
+   * @param holder Address of the spider, only it may renew the lease.
+   *
+   * @return Name of the server, empty if no server is free.
+   */
+  std::string CmdLease(const std::string &holder);
+
+  /**
+   * Renew command handling: keep the lease of a spider. A lease with no
+   * known holder is taken over by the first spider which renews it.
+   *
+   * @param address Name of the server.
+   * @param holder Address of the spider.
+   *
+   * @return true if the lease is renewed, false if the server is unknown,
+   *         the lease has expired or is held by another spider.
    */
-  void CmdGet(const std::string address);
+  bool CmdRenew(const std::string &address, const std::string &holder);
 
   /**
    * Release command handling
    */
-  void CmdRelease(const std::string address);
+  void CmdRelease(const std::string &address);
 
   /**
-    * Read servers list from servers file.
+   * Release command handling with a report of finished crawl.
+   *
+   * @param address Name of the server.
+   * @param files Number of files found on the server.
+   * @param changed Number of new or changed files.
+   */
+  void CmdRelease(const std::string &address, const int64_t files,
+                  const int64_t changed);
+
+  /**
+   * Split command handling: a spider hands back a share or a directory of
+   * the server it crawls, it is queued as a separate work item named
+   * "server/share/path" with priority of its server.
+   *
+   * @param item Name of the work item.
+   *
+   * @return true if the item is queued and should not be crawled as a part
+   *         of its parent, false otherwise.
+   */
+  bool CmdSplit(const std::string &item);
+
+  /**
+   * Restore state saved by previous runs and keep saving it. Saved servers
+   * which are not in the queue are added only if they are split from
+   * servers in the queue. Leases are kept for one more lease time to live,
+   * so that spiders can renew them.
+   *
+   * @param path Path prefix of state files.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int OpenState(const std::string &path);
+
+  /**
+   * Write changes to the state log, take a snapshot when the log grows
+   * too big. Does nothing if state is not open.
+   *
+   * @param snapshot Where to copy state of all servers when a snapshot is
+   *        due, so that the caller writes it with WriteSnapshot() without
+   *        the lock which guards the queue. NULL to write it right away.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int SyncState(std::vector<StateLog::Record> *snapshot = NULL);
+
+  /**
+   * Write the snapshot copied by SyncState(). Needs no lock, but only the
+   * caller which got the copy may call it.
+   *
+   * @param records State of all servers.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int WriteSnapshot(const std::vector<StateLog::Record> &records) {
+    return state_->WriteSnapshot(records);
+  }
+
+  /**
+   * Finish the snapshot written by WriteSnapshot() and start a new log.
+   *
+   * @param result Result of WriteSnapshot().
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int FinishSnapshot(const int result) {
+    return state_->FinishSnapshot(result);
+  }
+
+  /**
+    * Read servers list from servers file. Each line is a server name,
+    * optionally followed by its priority.
     *
     * @return 0 on success, -1 otherwise.
     */
@@ -143,14 +314,104 @@ class ServerQueue {
 
  private:
   /**
-   * list of the servers.
+   * Time when the server may be given out again.
+   *
+   * @param server Server.
+   *
+   * @return Time, 0 if the server is free.
+   */
+  time_t FreeTime(const Server &server) const {
+    return server.timestamp_ == 0 ? 0 : server.timestamp_ + kMaxWait + 1;
+  }
+
+  /**
+   * Whether server with slot a should be given out before server with
+   * slot b.
+   */
+  bool Before(const size_t a, const size_t b) const;
+
+  /**
+   * Finish crawl of a server.
+   *
+   * @param address Name of the server.
+   * @param files Number of files found, -1 if unknown.
+   * @param changed Number of new or changed files.
+   */
+  void Release(const std::string &address, const int64_t files,
+               const int64_t changed);
+
+  /**
+   * Save state of a server in the state log.
+   *
+   * @param server Server.
+   */
+  void SaveState(const Server &server);
+
+  /**
+   * Fill state log record of a server.
+   *
+   * @param server Server.
+   * @param record Where to store the record.
+   */
+  static void MakeRecord(const Server &server, StateLog::Record *record);
+
+  /**
+   * Restore state of a server from a state log record.
+   *
+   * @param record Record.
+   */
+  void RestoreState(const StateLog::Record &record);
+
+  /**
+   * Restore the heap after the key of server in slot changed.
+   *
+   * @param slot Index of server in servers_.
+   */
+  void Update(const size_t slot);
+
+  /**
+   * Move heap entry up or down to its place.
+   *
+   * @param index Index in heap_.
+   */
+  void SiftUp(size_t index);
+  void SiftDown(size_t index);
+
+  /**
+   * Swap two heap entries.
+   */
+  void Swap(const size_t a, const size_t b);
+
+  /**
+   * All servers, never removed.
+   */
+  std::vector<Server> servers_;
+
+  /**
+   * Slot in servers_ by server name.
+   */
+  std::unordered_map<std::string, size_t> slots_;
+
+  /**
+   * Slots of servers, min-heap by FreeTime() and ticket.
+   */
+  std::vector<size_t> heap_;
+
+  /**
+   * Scheduling policy.
+   */
+  std::unique_ptr<SchedulingPolicy> policy_;
+
+  /**
+   * State log, NULL if state is not saved.
    */
-  std::list<ServerQueue::Server> *servers_list_ = NULL;
+  std::unique_ptr<StateLog> state_;
 
   /**
-   * iterator pointing to the next server
+   * Tickets given to new and released servers.
    */
-  std::list<ServerQueue::Server>::iterator ilast_server_;
+  int64_t first_ticket_;
+  int64_t last_ticket_;
 
   /**
    * Maximum time between keepalive messages
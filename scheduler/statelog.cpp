@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "scheduler/statelog.h"
+#include "common-inl.h"
+#include "config.h"
+
+/**
+ * Magic numbers of the snapshot and the log, "USSN" and "USLG".
+ */
+static const uint32_t kSnapshotMagic = 0x5553534e;
+static const uint32_t kLogMagic = 0x55534c47;
+
+/**
+ * Size of the file header and of the record header.
+ */
+static const size_t kHeaderSize = 8;
+
+StateLog::StateLog(const std::string &path)
+    : snapshot_name_(path + ".snapshot"),
+      log_name_(path + ".log"),
+      log_fd_(-1),
+      log_size_(0),
+      generation_(0),
+      snapshotting_(false),
+      snapshot_error_(0),
+      error_(0) {
+}
+
+StateLog::~StateLog() {
+  if (log_fd_ != -1) {
+    Flush();
+    close(log_fd_);
+  }
+}
+
+int StateLog::Load(const std::function<void(const Record &)> &apply) {
+  uint32_t log_generation;
+  if (ReadFile(snapshot_name_, kSnapshotMagic, &generation_, 0, apply) < 0)
+    return -1;
+
+  ssize_t size = ReadFile(log_name_, kLogMagic, &log_generation, generation_,
+                          apply);
+  if (size < 0)
+    return -1;
+
+  // A log of an older snapshot or without header is started anew, a torn
+  // record at the end is cut off.
+  return OpenLog(size < static_cast<ssize_t>(kHeaderSize) ||
+                 log_generation != generation_, size);
+}
+
+void StateLog::Append(const Record &record) {
+  Encode(record, &buffer_);
+}
+
+int StateLog::Flush() {
+  if (buffer_.empty())
+    return 0;
+  if (UNLIKELY(log_fd_ == -1)) {
+    error_ = EBADF;
+    return -1;
+  }
+
+  for (size_t written = 0; written < buffer_.size(); ) {
+    ssize_t result = write(log_fd_, buffer_.data() + written,
+                           buffer_.size() - written);
+    if (UNLIKELY(result == -1)) {
+      if (errno == EINTR)
+        continue;
+      error_ = errno;
+      MSS_ERROR(("write " + log_name_).c_str(), error_);
+      return -1;
+    }
+    written += result;
+  }
+
+  if (SCHEDULER_STATE_SYNC && UNLIKELY(fdatasync(log_fd_) == -1)) {
+    error_ = errno;
+    MSS_ERROR(("fdatasync " + log_name_).c_str(), error_);
+  }
+
+  log_size_ += buffer_.size();
+  if (snapshotting_)
+    pending_.append(buffer_);
+  buffer_.clear();
+  return 0;
+}
+
+int StateLog::Snapshot(const std::vector<Record> &records) {
+  if (StartSnapshot())
+    return -1;
+  return FinishSnapshot(WriteSnapshot(records));
+}
+
+int StateLog::StartSnapshot() {
+  // Records before the snapshot are in the current log, so it stays valid
+  // if the snapshot isn't written.
+  if (UNLIKELY(Flush()))
+    return -1;
+  pending_.clear();
+  snapshotting_ = true;
+  return 0;
+}
+
+int StateLog::WriteSnapshot(const std::vector<Record> &records) {
+  std::string buf;
+  uint32_t header[2] = { kSnapshotMagic, generation_ + 1 };
+  buf.append(reinterpret_cast<const char *>(header), sizeof header);
+  for (const Record &record : records)
+    Encode(record, &buf);
+
+  // Replace the snapshot atomically, the old one stays valid until then.
+  std::string name = snapshot_name_ + ".tmp";
+  int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (UNLIKELY(fd == -1)) {
+    snapshot_error_ = errno;
+    MSS_ERROR(("open " + name).c_str(), snapshot_error_);
+    return -1;
+  }
+
+  size_t written = 0;
+  while (written < buf.size()) {
+    ssize_t result = write(fd, buf.data() + written, buf.size() - written);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (UNLIKELY(result == -1))
+      break;
+    written += result;
+  }
+
+  if (UNLIKELY(written < buf.size() || fsync(fd) == -1 ||
+               rename(name.c_str(), snapshot_name_.c_str()) == -1)) {
+    snapshot_error_ = errno;
+    MSS_ERROR(("snapshot " + name).c_str(), snapshot_error_);
+    close(fd);
+    unlink(name.c_str());
+    return -1;
+  }
+  close(fd);
+
+  // The rename itself is durable only when the directory is synced.
+  std::string::size_type slash = snapshot_name_.rfind('/');
+  std::string dir = slash == std::string::npos ? "." :
+                    snapshot_name_.substr(0, slash + 1);
+  fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (UNLIKELY(fd == -1 || fsync(fd) == -1)) {
+    snapshot_error_ = errno;
+    MSS_ERROR(("fsync " + dir).c_str(), snapshot_error_);
+  }
+  if (fd != -1)
+    close(fd);
+  return 0;
+}
+
+int StateLog::FinishSnapshot(const int result) {
+  snapshotting_ = false;
+  if (UNLIKELY(result)) {
+    error_ = snapshot_error_;
+    pending_.clear();
+    return -1;
+  }
+
+  // Records in the log before the snapshot are in it now, the ones after
+  // it go to the new log.
+  ++generation_;
+  buffer_.insert(0, pending_);
+  pending_.clear();
+  return OpenLog(true, 0);
+}
+
+ssize_t StateLog::ReadFile(const std::string &name, const uint32_t magic,
+                           uint32_t *generation,
+                           const uint32_t min_generation,
+                           const std::function<void(const Record &)> &apply) {
+  *generation = 0;
+
+  int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno == ENOENT)
+      return 0;
+    error_ = errno;
+    MSS_ERROR(("open " + name).c_str(), error_);
+    return -1;
+  }
+
+  struct stat st;
+  if (UNLIKELY(fstat(fd, &st) == -1)) {
+    error_ = errno;
+    MSS_ERROR(("fstat " + name).c_str(), error_);
+    close(fd);
+    return -1;
+  }
+
+  size_t size = st.st_size;
+  if (size < kHeaderSize) {
+    close(fd);
+    return 0;
+  }
+
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (UNLIKELY(map == MAP_FAILED)) {
+    error_ = errno;
+    MSS_ERROR(("mmap " + name).c_str(), error_);
+    return -1;
+  }
+  const char *data = static_cast<const char *>(map);
+
+  uint32_t header[2];
+  memcpy(header, data, sizeof header);
+  if (header[0] != magic) {
+    MSS_WARN_MESSAGE(("Not a scheduler state file: " + name).c_str());
+    munmap(map, size);
+    return 0;
+  }
+  *generation = header[1];
+
+  size_t pos = kHeaderSize;
+  Record record;
+  while (pos + kHeaderSize <= size) {
+    uint32_t checksum, length;
+    memcpy(&checksum, data + pos, sizeof checksum);
+    memcpy(&length, data + pos + 4, sizeof length);
+    const char *payload = data + pos + kHeaderSize;
+    if (length > size - pos - kHeaderSize ||
+        Crc32(payload, length) != checksum ||
+        !Decode(payload, length, &record)) {
+      MSS_WARN_MESSAGE(("Broken record in " + name).c_str());
+      break;
+    }
+
+    if (*generation >= min_generation)
+      apply(record);
+    pos += kHeaderSize + length;
+  }
+
+  munmap(map, size);
+  return pos;
+}
+
+void StateLog::Encode(const Record &record, std::string *buf) {
+  size_t offset = buf->size();
+  buf->resize(offset + kHeaderSize);
+
+  uint16_t name_size = record.name.size() > 0xffff ? 0xffff :
+                                                     record.name.size();
+  buf->append(reinterpret_cast<const char *>(&name_size), sizeof name_size);
+  buf->append(record.name, 0, name_size);
+  buf->append(reinterpret_cast<const char *>(&record.priority),
+              sizeof record.priority);
+  for (int64_t value : { record.last_crawl, record.timestamp,
+                         record.lease_start, record.ticket })
+    buf->append(reinterpret_cast<const char *>(&value), sizeof value);
+  for (double value : { record.change_rate, record.cost })
+    buf->append(reinterpret_cast<const char *>(&value), sizeof value);
+
+  uint32_t length = buf->size() - offset - kHeaderSize;
+  uint32_t checksum = Crc32(buf->data() + offset + kHeaderSize, length);
+  memcpy(&(*buf)[offset], &checksum, sizeof checksum);
+  memcpy(&(*buf)[offset + 4], &length, sizeof length);
+}
+
+bool StateLog::Decode(const char *data, const size_t size, Record *record) {
+  uint16_t name_size;
+  if (size < sizeof name_size)
+    return false;
+  memcpy(&name_size, data, sizeof name_size);
+  if (size != sizeof name_size + name_size + sizeof record->priority +
+              4 * sizeof(int64_t) + 2 * sizeof(double))
+    return false;
+
+  const char *pos = data + sizeof name_size;
+  record->name.assign(pos, name_size);
+  pos += name_size;
+  memcpy(&record->priority, pos, sizeof record->priority);
+  pos += sizeof record->priority;
+  for (int64_t *value : { &record->last_crawl, &record->timestamp,
+                          &record->lease_start, &record->ticket }) {
+    memcpy(value, pos, sizeof *value);
+    pos += sizeof *value;
+  }
+  for (double *value : { &record->change_rate, &record->cost }) {
+    memcpy(value, pos, sizeof *value);
+    pos += sizeof *value;
+  }
+  return true;
+}
+
+int StateLog::OpenLog(const bool truncate, const size_t size) {
+  if (log_fd_ != -1)
+    close(log_fd_);
+
+  log_fd_ = open(log_name_.c_str(),
+                 O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (UNLIKELY(log_fd_ == -1)) {
+    error_ = errno;
+    MSS_ERROR(("open " + log_name_).c_str(), error_);
+    return -1;
+  }
+
+  if (UNLIKELY(ftruncate(log_fd_, truncate ? 0 : size) == -1)) {
+    error_ = errno;
+    MSS_ERROR(("ftruncate " + log_name_).c_str(), error_);
+    return -1;
+  }
+
+  if (!truncate) {
+    log_size_ = size;
+    return 0;
+  }
+
+  uint32_t header[2] = { kLogMagic, generation_ };
+  log_size_ = 0;
+  buffer_.insert(0, reinterpret_cast<const char *>(header), sizeof header);
+  return Flush();
+}
+
+uint32_t StateLog::Crc32(const char *data, const size_t size) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> result(256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+        crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+      result[i] = crc;
+    }
+    return result;
+  }();
+
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < size; ++i)
+    crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffff;
+}
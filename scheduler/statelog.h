@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SCHEDULER_STATELOG_H_
+#define SCHEDULER_STATELOG_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Persistent state of scheduler: a snapshot of all servers and an
+ * append-only log of changes made after it.
+ *
+ * Both files start with a magic number and a generation, followed by
+ * records: uint32 checksum (CRC-32 of the rest), uint32 size of payload,
+ * payload. Every record is the full state of one server, so the last
+ * record of a server wins. A new snapshot gets the next generation and
+ * replaces the log, so a log of an older generation left by a crash is
+ * ignored. A torn record at the end of the log is cut off on load.
+ */
+class StateLog {
+ public:
+  /**
+   * State of one server.
+   */
+  struct Record {
+    std::string name;
+    int32_t priority = 0;
+    int64_t last_crawl = 0;
+    double change_rate = 0;
+    double cost = 0;
+    int64_t timestamp = 0;
+    int64_t lease_start = 0;
+    int64_t ticket = 0;
+  };
+
+  /**
+   * Constructor.
+   *
+   * @param path Path prefix, files are path.snapshot and path.log.
+   */
+  explicit StateLog(const std::string &path);
+
+  /**
+   * Destructor, writes buffered records and closes the log.
+   */
+  ~StateLog();
+
+  /**
+   * Read the snapshot and the log and open the log for appending.
+   *
+   * @param apply Function called for every record in order.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int Load(const std::function<void(const Record &)> &apply);
+
+  /**
+   * Add a record to the log. It is buffered until Flush().
+   *
+   * @param record State of a server.
+   */
+  void Append(const Record &record);
+
+  /**
+   * Write buffered records to the log.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int Flush();
+
+  /**
+   * Write a new snapshot and start an empty log.
+   *
+   * @param records State of all servers.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int Snapshot(const std::vector<Record> &records);
+
+  /**
+   * Start a snapshot of the state made by all records appended so far.
+   * The snapshot is written by WriteSnapshot(), which doesn't touch the
+   * log, so that it may run without the lock which guards the other
+   * calls. Records appended meanwhile are written to the current log and
+   * kept for the log of the new snapshot.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int StartSnapshot();
+
+  /**
+   * Write and sync a new snapshot, replace the old one and sync the
+   * directory. Only the caller of StartSnapshot() may call it.
+   *
+   * @param records State of all servers when the snapshot was started.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int WriteSnapshot(const std::vector<Record> &records);
+
+  /**
+   * Finish the snapshot: start the log of the new snapshot with records
+   * appended since it was started, or keep the current log if it wasn't
+   * written.
+   *
+   * @param result Result of WriteSnapshot().
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int FinishSnapshot(const int result);
+
+  /**
+   * Check whether a snapshot is started and not finished.
+   */
+  bool is_snapshotting() const { return snapshotting_; }
+
+  /**
+   * Get size of the log in bytes, including buffered records.
+   */
+  size_t get_log_size() const { return log_size_ + buffer_.size(); }
+
+  /**
+   * Get last occured error.
+   */
+  int get_error() const { return error_; }
+
+  /**
+   * Compute CRC-32 of data.
+   *
+   * @param data Data.
+   * @param size Size of data.
+   *
+   * @return Checksum.
+   */
+  static uint32_t Crc32(const char *data, const size_t size);
+
+ private:
+  /**
+   * Read records of a file.
+   *
+   * @param name File name.
+   * @param magic Expected magic number.
+   * @param generation Where to store generation of the file, 0 if the file
+   *        doesn't exist.
+   * @param apply Function called for every record.
+   * @param min_generation Records are applied only if generation of the
+   *        file is at least this.
+   *
+   * @return Size of the valid part of the file, -1 on error.
+   */
+  ssize_t ReadFile(const std::string &name, const uint32_t magic,
+                   uint32_t *generation, const uint32_t min_generation,
+                   const std::function<void(const Record &)> &apply);
+
+  /**
+   * Append encoded record to the buffer.
+   */
+  static void Encode(const Record &record, std::string *buf);
+
+  /**
+   * Decode record payload.
+   *
+   * @return true on success, false if the payload is malformed.
+   */
+  static bool Decode(const char *data, const size_t size, Record *record);
+
+  /**
+   * Open the log for appending, create it if needed.
+   *
+   * @param truncate Whether to start an empty log.
+   * @param size Size of the valid part of the log.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int OpenLog(const bool truncate, const size_t size);
+
+  std::string snapshot_name_;
+  std::string log_name_;
+  int log_fd_;
+  size_t log_size_;
+  uint32_t generation_;
+  std::string buffer_;
+  /**
+   * Records flushed to the current log since the snapshot was started.
+   */
+  std::string pending_;
+  bool snapshotting_;
+  /**
+   * Error of WriteSnapshot(), error_ belongs to callers holding the lock.
+   */
+  int snapshot_error_;
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(StateLog);
+};
+
+#endif  // SCHEDULER_STATELOG_H_
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <signal.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "common-inl.h"
+#include "config.h"
+#include "searchd/searchserver.h"
+
+int main() {
+  // Read config from database
+  std::string name, server, user, password;
+  if (UNLIKELY(read_database_config(&name, &server, &user, &password,
+                                    "../" DATABASE_CONFIG))) {
+    MSS_DEBUG_MESSAGE("failed");
+    return 1;
+  }
+
+  // Every worker and the name indexer query the data base with their own
+  // connections.
+  if (!DatabaseEntity::ConnectToServer(name, server, user, password, false,
+                                       SEARCHD_WORKERS + 2)) {
+    MSS_FATAL_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    return 1;
+  }
+
+  // Clients may disconnect while responses are written.
+  signal(SIGPIPE, SIG_IGN);
+
+  SearchServer searchd(atoi(SEARCHDPORT), SEARCHD_WORKERS,
+                       SEARCHD_NAME_INDEX_SEC);
+  if (searchd.get_error()) {
+    MSS_DEBUG_ERROR("SearchServer", searchd.get_error());
+    return 1;
+  }
+
+  return searchd.Run() ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/types.h>
+
+#include <string>
+
+#include "searchd/protocol.h"
+
+void SearchProtocol::EncodeRequest(const SearchRequest &request,
+                                   std::string *buf) {
+  size_t offset = buf->size();
+  AppendUint32(0, buf);
+  AppendUint32(request.id, buf);
+  buf->push_back(static_cast<char>(request.type));
+  AppendUint32(request.offset, buf);
+  AppendUint32(request.limit, buf);
+  AppendString(request.query, buf);
+  AppendString(request.value, buf);
+  FinishFrame(offset, buf);
+}
+
+ssize_t SearchProtocol::DecodeRequest(const std::string &buf,
+                                      const size_t begin,
+                                      const size_t max_size,
+                                      SearchRequest *request) {
+  size_t pos = begin;
+  uint32_t length;
+  if (!ReadUint32(buf, buf.size(), &pos, &length))
+    return 0;
+
+  if (length + 4 > max_size || length + 4 < SEARCH_HEADER_SIZE)
+    return -1;
+  if (buf.size() - begin < length + 4)
+    return 0;
+
+  size_t end = begin + length + 4;
+  if (!ReadUint32(buf, end, &pos, &request->id))
+    return -1;
+  request->type = static_cast<uint8_t>(buf[pos++]);
+
+  if (!ReadUint32(buf, end, &pos, &request->offset) ||
+      !ReadUint32(buf, end, &pos, &request->limit) ||
+      !ReadString(buf, end, &pos, &request->query) ||
+      !ReadString(buf, end, &pos, &request->value))
+    return -1;
+
+  return length + 4;
+}
+
+size_t SearchProtocol::StartFrame(const uint32_t id,
+                                  const SearchResponseStatus status,
+                                  std::string *buf) {
+  size_t offset = buf->size();
+  AppendUint32(0, buf);
+  AppendUint32(id, buf);
+  buf->push_back(static_cast<char>(status));
+  return offset;
+}
+
+void SearchProtocol::FinishFrame(const size_t offset, std::string *buf) {
+  uint32_t length = buf->size() - offset - 4;
+  for (int i = 0; i < 4; ++i)
+    (*buf)[offset + i] = static_cast<char>(length >> (24 - 8 * i));
+}
+
+void SearchProtocol::AppendUint32(const uint32_t value, std::string *buf) {
+  for (int i = 24; i >= 0; i -= 8)
+    buf->push_back(static_cast<char>(value >> i));
+}
+
+void SearchProtocol::AppendUint64(const uint64_t value, std::string *buf) {
+  AppendUint32(value >> 32, buf);
+  AppendUint32(value, buf);
+}
+
+void SearchProtocol::AppendString(const std::string &value,
+                                  std::string *buf) {
+  size_t size = value.size() > 0xffff ? 0xffff : value.size();
+  buf->push_back(static_cast<char>(size >> 8));
+  buf->push_back(static_cast<char>(size));
+  buf->append(value, 0, size);
+}
+
+bool SearchProtocol::ReadUint32(const std::string &buf, size_t end,
+                                size_t *pos, uint32_t *value) {
+  if (*pos + 4 > end)
+    return false;
+
+  *value = 0;
+  for (int i = 0; i < 4; ++i)
+    *value = (*value << 8) | static_cast<uint8_t>(buf[(*pos)++]);
+  return true;
+}
+
+bool SearchProtocol::ReadUint64(const std::string &buf, size_t end,
+                                size_t *pos, uint64_t *value) {
+  uint32_t high, low;
+  if (!ReadUint32(buf, end, pos, &high) || !ReadUint32(buf, end, pos, &low))
+    return false;
+
+  *value = (static_cast<uint64_t>(high) << 32) | low;
+  return true;
+}
+
+bool SearchProtocol::ReadString(const std::string &buf, size_t end,
+                                size_t *pos, std::string *value) {
+  if (*pos + 2 > end)
+    return false;
+
+  size_t size = (static_cast<uint8_t>(buf[*pos]) << 8) |
+                static_cast<uint8_t>(buf[*pos + 1]);
+  *pos += 2;
+  if (*pos + size > end)
+    return false;
+
+  value->assign(buf, *pos, size);
+  *pos += size;
+  return true;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SEARCHD_PROTOCOL_H_
+#define SEARCHD_PROTOCOL_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+/*
+ * Every message is a frame:
+ *   uint32 length of the rest of the frame
+ *   uint32 request id, chosen by the client
+ *   uint8  request type or response status
+ *   payload
+ * All integers are in network byte order, strings are uint16 length followed
+ * by bytes.
+ *
+ * Request payload:
+ *   uint32 offset - number of results to skip
+ *   uint32 limit  - maximum number of results, 0 for all
+ *   string query  - name, server or attribute name
+ *   string value  - attribute value, empty for other requests
+ *
+ * Response payload (PageStatus, LastPageStatus):
+ *   uint32 count of entries, each entry is
+ *     uint32 id, string name, string path, string server, uint64 timestamp
+ * Response payload (ErrorStatus):
+ *   string message
+ *
+ * Requests may be pipelined. Their responses carry the id of the request and
+ * may come in any order, but pages of one response come in order and end
+ * with LastPageStatus. Results are streamed from the data base, so an error
+ * may come after some pages instead of the last page.
+ */
+
+/**
+ * Size of length, id and type fields.
+ */
+#define SEARCH_HEADER_SIZE 9
+
+/**
+ * Types of requests.
+ */
+enum SearchRequestType {
+  FindByNameRequest = 1,
+  GetByServerRequest,
+  GetByAttributeRequest
+};
+
+/**
+ * Statuses of responses.
+ */
+enum SearchResponseStatus {
+  PageStatus = 0,
+  LastPageStatus,
+  ErrorStatus
+};
+
+/**
+ * Decoded request.
+ */
+struct SearchRequest {
+  uint32_t id;
+  uint8_t type;
+  uint32_t offset;
+  uint32_t limit;
+  std::string query;
+  std::string value;
+};
+
+/**
+ * Encoding and decoding of frames.
+ */
+class SearchProtocol {
+ public:
+  /**
+   * Append an encoded request frame to the buffer.
+   *
+   * @param request Request to encode.
+   * @param buf Where to append the frame.
+   */
+  static void EncodeRequest(const SearchRequest &request, std::string *buf);
+
+  /**
+   * Decode a request frame which starts at the position in the buffer.
+   *
+   * @param buf Buffer with received data.
+   * @param begin Position of the frame in the buffer.
+   * @param max_size Maximum allowed frame size.
+   * @param request Where to store the request.
+   *
+   * @return Size of the frame if it is complete, 0 if more data is needed,
+   * -1 if the frame is malformed or too big.
+   */
+  static ssize_t DecodeRequest(const std::string &buf, const size_t begin,
+                               const size_t max_size, SearchRequest *request);
+
+  /**
+   * Start a response frame. The length is filled by FinishFrame().
+   *
+   * @param id Id of the request.
+   * @param status Status of the response.
+   * @param buf Where to append the frame.
+   *
+   * @return Offset of the frame in buf.
+   */
+  static size_t StartFrame(const uint32_t id, const SearchResponseStatus status,
+                           std::string *buf);
+
+  /**
+   * Write the length of a frame started by StartFrame().
+   *
+   * @param offset Offset of the frame in buf.
+   * @param buf Buffer with the frame at its end.
+   */
+  static void FinishFrame(const size_t offset, std::string *buf);
+
+  /**
+   * Append a 32-bit integer.
+   */
+  static void AppendUint32(const uint32_t value, std::string *buf);
+
+  /**
+   * Append a 64-bit integer.
+   */
+  static void AppendUint64(const uint64_t value, std::string *buf);
+
+  /**
+   * Append a string, it is truncated to 65535 bytes.
+   */
+  static void AppendString(const std::string &value, std::string *buf);
+
+  /**
+   * Read a 32-bit integer at pos and move pos after it.
+   *
+   * @return false if the buffer is too short, true otherwise.
+   */
+  static bool ReadUint32(const std::string &buf, size_t end, size_t *pos,
+                         uint32_t *value);
+
+  /**
+   * Read a 64-bit integer at pos and move pos after it.
+   *
+   * @return false if the buffer is too short, true otherwise.
+   */
+  static bool ReadUint64(const std::string &buf, size_t end, size_t *pos,
+                         uint64_t *value);
+
+  /**
+   * Read a string at pos and move pos after it.
+   *
+   * @return false if the buffer is too short, true otherwise.
+   */
+  static bool ReadString(const std::string &buf, size_t end, size_t *pos,
+                         std::string *value);
+};
+
+#endif  // SEARCHD_PROTOCOL_H_
@@ -0,0 +1,4 @@
+TEMPLATE = app
+SOURCES += searchserver.cpp protocol.cpp main.cpp
+HEADERS += searchserver.h protocol.h
+OTHER_FILES += Makefile
@@ -0,0 +1,625 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "data-storage/trigramindex.h"
+#include "searchd/searchserver.h"
+
+SearchServer::SearchServer(const int port, const int workers,
+                           const int index_period)
+    : listener_(NULL),
+      epoll_fd_(-1),
+      event_fd_(-1),
+      index_period_(index_period),
+      stop_(false),
+      error_(0) {
+  SocketAddress address("0.0.0.0", port);
+  listener_ = new(std::nothrow) TCPListener(&address, SEARCHD_BACKLOG);
+  if (UNLIKELY(listener_ == NULL)) {
+    error_ = ENOMEM;
+    MSS_FATAL("listener_", error_);
+    return;
+  }
+  if (UNLIKELY(listener_->get_state() != AbstractSocket::ListeningState)) {
+    error_ = listener_->get_error();
+    MSS_FATAL("TCPListener", error_);
+    return;
+  }
+
+  // Accept() must not block the loop when a client has gone.
+  int flags = fcntl(listener_->get_descriptor(), F_GETFL, NULL);
+  if (UNLIKELY(flags < 0 || fcntl(listener_->get_descriptor(), F_SETFL,
+                                  flags | O_NONBLOCK) < 0)) {
+    error_ = errno;
+    MSS_FATAL("fcntl", error_);
+    return;
+  }
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (UNLIKELY(epoll_fd_ < 0)) {
+    error_ = errno;
+    MSS_FATAL("epoll_create1", error_);
+    return;
+  }
+
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (UNLIKELY(event_fd_ < 0)) {
+    error_ = errno;
+    MSS_FATAL("eventfd", error_);
+    return;
+  }
+
+  if (UNLIKELY(Watch(EPOLL_CTL_ADD, listener_->get_descriptor(), EPOLLIN) ||
+               Watch(EPOLL_CTL_ADD, event_fd_, EPOLLIN)))
+    return;
+
+  for (int i = 0; i < workers; ++i)
+    workers_.push_back(std::thread(&SearchServer::WorkerLoop, this));
+
+  // Names are searched by a scan until the first index is built.
+  if (index_period_ > 0)
+    indexer_ = std::thread(&SearchServer::IndexerLoop, this);
+}
+
+SearchServer::~SearchServer() {
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    stop_ = true;
+  }
+  jobs_cv_.notify_all();
+  for (std::thread &worker : workers_)
+    worker.join();
+
+  // Waits for the index being built.
+  if (indexer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(indexer_mutex_);
+      stop_ = true;
+    }
+    indexer_cv_.notify_all();
+    indexer_.join();
+  }
+
+  while (!connections_.empty())
+    Close(connections_.begin()->second);
+
+  if (event_fd_ >= 0)
+    close(event_fd_);
+  if (epoll_fd_ >= 0)
+    close(epoll_fd_);
+  if (listener_ != NULL)
+    delete listener_;
+}
+
+int SearchServer::Run() {
+  struct epoll_event events[SEARCHD_EVENTS];
+
+  while (!stop_) {
+    int count = epoll_wait(epoll_fd_, events, SEARCHD_EVENTS, -1);
+    if (UNLIKELY(count < 0)) {
+      if (errno == EINTR)
+        continue;
+
+      error_ = errno;
+      MSS_ERROR("epoll_wait", error_);
+      return -1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      int fd = events[i].data.fd;
+
+      if (fd == listener_->get_descriptor()) {
+        Accept();
+      } else if (fd == event_fd_) {
+        eventfd_t value;
+        eventfd_read(event_fd_, &value);
+
+        std::vector<std::shared_ptr<Connection> > ready;
+        {
+          std::lock_guard<std::mutex> lock(ready_mutex_);
+          ready.swap(ready_);
+        }
+        for (const auto &connection : ready)
+          Write(connection);
+      } else {
+        auto connection = connections_.find(fd);
+        if (connection == connections_.end())
+          continue;  // Closed by a previous event.
+
+        // Keep the connection alive while it is handled.
+        std::shared_ptr<Connection> current = connection->second;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          Close(current);
+          continue;
+        }
+        if (events[i].events & EPOLLIN)
+          Read(current);
+        if (events[i].events & EPOLLOUT)
+          Write(current);
+      }
+    }
+  }
+
+  return 0;
+}
+
+void SearchServer::Stop() {
+  stop_ = true;
+  Wake();
+}
+
+void SearchServer::IndexerLoop() {
+  std::unique_lock<std::mutex> lock(indexer_mutex_);
+  while (!stop_) {
+    lock.unlock();
+    // The old index serves queries while the new one is built.
+    std::shared_ptr<TrigramIndex> index = TrigramIndex::Load();
+    if (LIKELY(index != nullptr)) {
+      FileEntry::set_name_index(index);
+      char message[64];
+      snprintf(message, sizeof(message), "Name index: %zu files",
+               index->get_size());
+      MSS_INFO_MESSAGE(message);
+    } else {
+      MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    }
+    index.reset();
+
+    lock.lock();
+    indexer_cv_.wait_for(lock, std::chrono::seconds(index_period_),
+                         [this] { return stop_.load(); });
+  }
+}
+
+void SearchServer::Accept() {
+  while (true) {
+    DataSocket *socket = listener_->AcceptNoWait();
+    if (socket == NULL)
+      return;  // No more pending connections or an error.
+
+    int fd = socket->get_descriptor();
+    int flags = fcntl(fd, F_GETFL, NULL);
+    if (UNLIKELY(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+      MSS_ERROR("fcntl", errno);
+      delete socket;
+      continue;
+    }
+
+    std::shared_ptr<Connection> connection(new(std::nothrow) Connection());
+    if (UNLIKELY(!connection)) {
+      MSS_ERROR("Connection", ENOMEM);
+      delete socket;
+      continue;
+    }
+    connection->socket = socket;
+    connection->jobs = 0;
+    connection->reading = true;
+    connection->writing = false;
+    connection->closed = false;
+
+    if (UNLIKELY(Watch(EPOLL_CTL_ADD, fd, EPOLLIN | EPOLLRDHUP))) {
+      delete socket;
+      continue;
+    }
+
+    connections_[fd] = connection;
+  }
+}
+
+void SearchServer::Read(const std::shared_ptr<Connection> &connection) {
+  char buf[SEARCHD_READ_SIZE];
+
+  // Requests received before the client shut down its side are answered.
+  bool finished = false;
+  while (true) {
+    size_t count = connection->socket->ReadData(buf, sizeof(buf));
+    if (count == 0) {
+      finished = true;
+      break;
+    }
+    if (count == static_cast<size_t>(-1)) {
+      if (connection->socket->get_error() == EAGAIN ||
+          connection->socket->get_error() == EWOULDBLOCK)
+        break;
+
+      Close(connection);
+      return;
+    }
+
+    connection->input.append(buf, count);
+  }
+
+  // Queue every complete request.
+  size_t consumed = 0;
+  std::vector<std::shared_ptr<Job> > jobs;
+  while (true) {
+    std::shared_ptr<Job> job(new(std::nothrow) Job());
+    if (UNLIKELY(!job)) {
+      MSS_ERROR("Job", ENOMEM);
+      Close(connection);
+      return;
+    }
+    ssize_t size = SearchProtocol::DecodeRequest(
+        connection->input, consumed, SEARCHD_MAX_REQUEST, &job->request);
+    if (size == 0)
+      break;
+    if (UNLIKELY(size < 0)) {
+      MSS_WARN_MESSAGE("Malformed search request");
+      Close(connection);
+      return;
+    }
+
+    job->connection = connection;
+    job->found = 0;
+    job->last_id = 0;
+    jobs.push_back(job);
+    consumed += size;
+  }
+  connection->input.erase(0, consumed);
+
+  bool idle;
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->jobs += jobs.size();
+    if (finished) {
+      connection->reading = false;
+      // Nothing is read anymore, the hang up would be reported forever.
+      int fd = connection->socket->get_descriptor();
+      Watch(EPOLL_CTL_MOD, fd, connection->writing ? EPOLLOUT : 0);
+    }
+    idle = connection->jobs == 0 && connection->output.empty();
+  }
+
+  if (finished && idle) {
+    Close(connection);
+    return;
+  }
+
+  if (!jobs.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex_);
+      jobs_.insert(jobs_.end(), jobs.begin(), jobs.end());
+    }
+    jobs_cv_.notify_all();
+  }
+}
+
+void SearchServer::Write(const std::shared_ptr<Connection> &connection) {
+  std::vector<std::shared_ptr<Job> > resumed;
+  bool done;
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    if (connection->closed)
+      return;
+
+    size_t sent = 0;
+    bool blocked = false;
+    while (sent < connection->output.size()) {
+      size_t count = connection->socket->WriteData(
+          &connection->output[sent], connection->output.size() - sent);
+      if (count == static_cast<size_t>(-1)) {
+        if (connection->socket->get_error() != EAGAIN &&
+            connection->socket->get_error() != EWOULDBLOCK) {
+          // The loop will see EPOLLERR or EPOLLHUP and close it.
+          connection->output.clear();
+          return;
+        }
+
+        blocked = true;
+        break;
+      }
+      sent += count;
+    }
+    connection->output.erase(0, sent);
+
+    // Wait for the socket to become writable only while something is left.
+    if (blocked != connection->writing) {
+      int fd = connection->socket->get_descriptor();
+      uint32_t events = (connection->reading ? EPOLLIN | EPOLLRDHUP : 0) |
+                        (blocked ? EPOLLOUT : 0);
+      if (LIKELY(!Watch(EPOLL_CTL_MOD, fd, events)))
+        connection->writing = blocked;
+    }
+
+    if (connection->output.size() < SEARCHD_MAX_OUTPUT)
+      resumed.swap(connection->parked);
+
+    // A half closed connection is closed when everything is sent.
+    done = !connection->reading && connection->jobs == 0 &&
+           connection->output.empty();
+  }
+
+  if (done) {
+    Close(connection);
+    return;
+  }
+
+  if (!resumed.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex_);
+      jobs_.insert(jobs_.end(), resumed.begin(), resumed.end());
+    }
+    jobs_cv_.notify_all();
+  }
+}
+
+void SearchServer::Close(const std::shared_ptr<Connection> &connection) {
+  // The reference may point into connections_.
+  std::shared_ptr<Connection> current(connection);
+  int fd = current->socket->get_descriptor();
+  Watch(EPOLL_CTL_DEL, fd, 0);
+  connections_.erase(fd);
+
+  std::lock_guard<std::mutex> lock(current->mutex);
+  current->closed = true;
+  current->output.clear();
+  // Parked jobs refer to the connection.
+  current->parked.clear();
+  delete current->socket;
+  current->socket = NULL;
+}
+
+void SearchServer::WorkerLoop() {
+  while (true) {
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex_);
+      jobs_cv_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+      if (stop_)
+        return;
+
+      job = jobs_.front();
+      jobs_.pop_front();
+    }
+
+    Execute(job);
+  }
+}
+
+void SearchServer::Execute(const std::shared_ptr<Job> &job) {
+  const SearchRequest &request = job->request;
+  {
+    std::lock_guard<std::mutex> lock(job->connection->mutex);
+    if (job->connection->closed) {
+      --job->connection->jobs;
+      return;
+    }
+  }
+
+  // Slices are made of whole pages, so only the last page may be partial.
+  uint32_t count = SEARCHD_SLICE_SIZE;
+  if (request.limit > 0)
+    count = std::min(count, request.limit - job->found);
+
+  // A full page is queued as soon as the next file is found. An empty
+  // result is one empty last page.
+  uint32_t found = 0;
+  bool closed = false;
+  std::string error;
+  int result = Find(job.get(), count, [&](const FileEntry &file) {
+    if (job->page.size() == SEARCHD_PAGE_SIZE) {
+      if (UNLIKELY(SendPage(*job, job->page, PageStatus))) {
+        closed = true;
+        return false;
+      }
+      job->page.clear();
+    }
+    job->page.push_back(file);
+    job->last_id = file.get_id();
+    ++found;
+    return true;
+  }, &error);
+  job->found += found;
+
+  if (closed) {
+    Finish(job);
+    return;
+  }
+
+  if (result) {
+    std::string frames;
+    size_t offset = SearchProtocol::StartFrame(request.id, ErrorStatus,
+                                               &frames);
+    SearchProtocol::AppendString(error, &frames);
+    SearchProtocol::FinishFrame(offset, &frames);
+    Send(job->connection, frames);
+    Finish(job);
+    return;
+  }
+
+  // A short slice is the end of the result.
+  if (found == count && job->found != request.limit) {
+    Resume(job);
+    return;
+  }
+
+  SendPage(*job, job->page, LastPageStatus);
+  Finish(job);
+}
+
+int SearchServer::Find(Job *job, const uint32_t count,
+                       const FileEntry::Visitor &visitor,
+                       std::string *error) {
+  const SearchRequest &request = job->request;
+  // The first slice skips the offset, next ones start after the last file.
+  uint32_t offset = job->found == 0 ? request.offset : 0;
+  bool found = false;
+
+  switch (request.type) {
+    case FindByNameRequest: {
+      found = FileEntry::FindEachByName(request.query, visitor, offset,
+                                        count, job->last_id);
+      break;
+    }
+    case GetByServerRequest: {
+      found = FileEntry::GetEachByServer(request.query, visitor, offset,
+                                         count, job->last_id);
+      break;
+    }
+    case GetByAttributeRequest: {
+      // Parameters are not streamed, they are kept for the next slices.
+      if (!job->params) {
+        auto attr = FileAttribute::GetByName(request.query);
+        if (!attr) {
+          error->assign("Unknown attribute " + request.query);
+          return -1;
+        }
+
+        job->params = FileParameter::GetByValue(request.value,
+                                                attr->get_id());
+        if (!job->params) {
+          error->assign(DatabaseEntity::get_db_error());
+          return -1;
+        }
+      }
+
+      const auto &params = *job->params;
+      size_t begin = std::min<size_t>(
+          params.size(), static_cast<uint64_t>(request.offset) + job->found);
+      size_t end = std::min<size_t>(params.size(), begin + count);
+      for (size_t i = begin; i < end; ++i) {
+        if (!visitor(*params[i]->get_file()))
+          break;
+      }
+      return 0;
+    }
+    default: {
+      error->assign("Unknown request type");
+      return -1;
+    }
+  }
+
+  if (!found) {
+    error->assign(DatabaseEntity::get_db_error());
+    return -1;
+  }
+  return 0;
+}
+
+void SearchServer::Resume(const std::shared_ptr<Job> &job) {
+  {
+    std::lock_guard<std::mutex> lock(job->connection->mutex);
+    if (job->connection->closed) {
+      --job->connection->jobs;
+      return;
+    }
+
+    // Write() queues it again when the client has read enough.
+    if (job->connection->output.size() >= SEARCHD_MAX_OUTPUT) {
+      job->connection->parked.push_back(job);
+      return;
+    }
+  }
+
+  // Jobs of other clients run before the next slice.
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    jobs_.push_back(job);
+  }
+  jobs_cv_.notify_one();
+}
+
+void SearchServer::Finish(const std::shared_ptr<Job> &job) {
+  {
+    std::lock_guard<std::mutex> lock(job->connection->mutex);
+    if (--job->connection->jobs > 0 || job->connection->reading)
+      return;
+  }
+
+  // The event loop closes the connection after the output is sent.
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    ready_.push_back(job->connection);
+  }
+  Wake();
+}
+
+int SearchServer::SendPage(const Job &job,
+                           const std::vector<FileEntry> &files,
+                           const SearchResponseStatus status) {
+  std::string frames;
+  size_t offset = SearchProtocol::StartFrame(job.request.id, status, &frames);
+  SearchProtocol::AppendUint32(files.size(), &frames);
+  for (const FileEntry &file : files) {
+    SearchProtocol::AppendUint32(file.get_id(), &frames);
+    SearchProtocol::AppendString(file.get_name(), &frames);
+    SearchProtocol::AppendString(file.get_file_path(), &frames);
+    SearchProtocol::AppendString(file.get_server_name(), &frames);
+    SearchProtocol::AppendUint64(file.get_timestamp(), &frames);
+  }
+  SearchProtocol::FinishFrame(offset, &frames);
+  return Send(job.connection, frames);
+}
+
+int SearchServer::Send(const std::shared_ptr<Connection> &connection,
+                       const std::string &frames) {
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    if (connection->closed)
+      return -1;
+
+    connection->output.append(frames);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    ready_.push_back(connection);
+  }
+  Wake();
+  return 0;
+}
+
+void SearchServer::Wake() {
+  if (UNLIKELY(eventfd_write(event_fd_, 1) < 0))
+    MSS_ERROR("eventfd_write", errno);
+}
+
+int SearchServer::Watch(const int op, const int fd, const uint32_t events) {
+  struct epoll_event event;
+  event.events = events;
+  event.data.fd = fd;
+
+  if (UNLIKELY(epoll_ctl(epoll_fd_, op, fd, &event) < 0)) {
+    error_ = errno;
+    MSS_ERROR("epoll_ctl", error_);
+    return -1;
+  }
+
+  return 0;
+}
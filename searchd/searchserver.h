@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SEARCHD_SEARCHSERVER_H_
+#define SEARCHD_SEARCHSERVER_H_
+
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common-inl.h"
+#include "cppsockets/tcplistener.h"
+#include "data-storage/entities.h"
+#include "searchd/protocol.h"
+
+/**
+ * Server which answers search queries of clients.
+ *
+ * One thread runs an epoll loop: it accepts connections, reads and decodes
+ * requests and writes responses. Requests are executed by a fixed pool of
+ * worker threads, which encode results in pages and queue them for the loop
+ * to send. A client may send many requests without waiting for responses.
+ * Long results are found in slices of SEARCHD_SLICE_SIZE files, so workers
+ * take turns between requests, and a request of a client which doesn't
+ * read its responses waits without holding a worker.
+ * Another thread periodically rebuilds the index of file names which is
+ * used by name queries.
+ */
+class SearchServer {
+ public:
+  /**
+   * Constructor which starts listening and starts the workers.
+   *
+   * @param port Port to listen, in host byte order. 0 to choose any.
+   * @param workers Number of worker threads.
+   * @param index_period Period of rebuilding the name index in seconds, 0
+   * to search names without the index.
+   */
+  SearchServer(const int port, const int workers,
+               const int index_period = 0);
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Destructor, stops the workers and closes all connections.
+   */
+  ~SearchServer();
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+  /**
+   * Serve clients until Stop() is called.
+   *
+   * @return 0 if stopped, -1 on error.
+   */
+  int Run();
+
+  /**
+   * Make Run() return. Thread safe.
+   */
+  void Stop();
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Get last occured error.
+   *
+   * @return Last occured error.
+   */
+  inline int get_error() const { return error_; }
+
+  /**
+   * Get listened port.
+   *
+   * @return Port in host byte order.
+   */
+  inline int get_port() const { return ntohs(listener_->get_local_port()); }
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+ private:
+  struct Job;
+
+  /**
+   * State of one client connection.
+   */
+  struct Connection {
+    /**
+     * Socket of the connection, used only by the event loop.
+     */
+    DataSocket *socket;
+
+    /**
+     * Received data which is not decoded yet, used only by the event loop.
+     */
+    std::string input;
+
+    /**
+     * Protects output, parked, jobs, reading, writing and closed.
+     */
+    std::mutex mutex;
+
+    /**
+     * Encoded responses waiting to be sent, at most SEARCHD_MAX_OUTPUT bytes
+     * and one more slice of every request.
+     */
+    std::string output;
+
+    /**
+     * Unfinished requests which wait for the output to be sent.
+     */
+    std::vector<std::shared_ptr<Job> > parked;
+
+    /**
+     * Number of received requests which are not finished yet.
+     */
+    size_t jobs;
+
+    /**
+     * Cleared when the client has shut down its side, the connection is
+     * closed after the responses are sent.
+     */
+    bool reading;
+
+    /**
+     * Whether the socket is watched for EPOLLOUT.
+     */
+    bool writing;
+
+    /**
+     * Set when the connection is closed, responses are dropped then.
+     */
+    bool closed;
+  };
+
+  /**
+   * Request waiting for a worker and the point where it was left.
+   */
+  struct Job {
+    std::shared_ptr<Connection> connection;
+    SearchRequest request;
+
+    /**
+     * Number of files found so far.
+     */
+    uint32_t found;
+
+    /**
+     * Id of the last found file, the next slice starts after it.
+     */
+    int last_id;
+
+    /**
+     * Found files which are not sent yet. A full page is sent only when
+     * the next file is found, so the last page is empty only if nothing is
+     * found.
+     */
+    std::vector<FileEntry> page;
+
+    /**
+     * Parameters found by an attribute request, fetched by the first slice.
+     */
+    std::shared_ptr<std::vector<std::shared_ptr<FileParameter> > > params;
+  };
+
+  /**
+   * Accept all pending connections.
+   */
+  void Accept();
+
+  /**
+   * Read data from the connection and queue decoded requests. Requests
+   * received before the client shut down its side are still answered.
+   *
+   * @param connection Connection to read from.
+   */
+  void Read(const std::shared_ptr<Connection> &connection);
+
+  /**
+   * Send as much of queued responses as the socket accepts.
+   *
+   * @param connection Connection to write to.
+   */
+  void Write(const std::shared_ptr<Connection> &connection);
+
+  /**
+   * Forget the connection and close its socket.
+   *
+   * @param connection Connection to close.
+   */
+  void Close(const std::shared_ptr<Connection> &connection);
+
+  /**
+   * Main loop of worker threads.
+   */
+  void WorkerLoop();
+
+  /**
+   * Main loop of the indexer thread: build the name index, install it and
+   * wait for the next period.
+   */
+  void IndexerLoop();
+
+  /**
+   * Execute the next slice of the request and send its full pages. The job
+   * is queued again or parked unless the request is finished.
+   *
+   * @param job Request, its connection and progress.
+   */
+  void Execute(const std::shared_ptr<Job> &job);
+
+  /**
+   * Find the next slice of files for the job. Files found by name or
+   * server are streamed from the data base, which stops after the last
+   * needed row.
+   *
+   * @param job Job to continue.
+   * @param count Maximum number of files.
+   * @param visitor Function called for every found file, returns false to
+   * stop.
+   * @param error Where to store error message.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int Find(Job *job, const uint32_t count, const FileEntry::Visitor &visitor,
+           std::string *error);
+
+  /**
+   * Queue the unfinished job for the next slice, or park it while the
+   * client has SEARCHD_MAX_OUTPUT bytes to read.
+   *
+   * @param job Job to continue.
+   */
+  void Resume(const std::shared_ptr<Job> &job);
+
+  /**
+   * Account the finished job, the event loop closes a half closed
+   * connection after its last job is finished.
+   *
+   * @param job Finished job.
+   */
+  void Finish(const std::shared_ptr<Job> &job);
+
+  /**
+   * Encode page of files and queue it to the connection.
+   *
+   * @param job Job the page belongs to.
+   * @param files Files of the page.
+   * @param status PageStatus or LastPageStatus.
+   *
+   * @return 0 on success, -1 if the connection is closed.
+   */
+  int SendPage(const Job &job, const std::vector<FileEntry> &files,
+               const SearchResponseStatus status);
+
+  /**
+   * Queue encoded frames to the connection and wake up the event loop.
+   * Called by workers.
+   *
+   * @param connection Connection to send to.
+   * @param frames Encoded frames.
+   *
+   * @return 0 on success, -1 if the connection is closed.
+   */
+  int Send(const std::shared_ptr<Connection> &connection,
+           const std::string &frames);
+
+  /**
+   * Wake up the event loop.
+   */
+  void Wake();
+
+  /**
+   * Add, modify or remove a descriptor in the epoll set.
+   *
+   * @param op EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL.
+   * @param fd Descriptor.
+   * @param events Events to wait for.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int Watch(const int op, const int fd, const uint32_t events);
+
+  /**
+   * Socket which accepts connections.
+   */
+  TCPListener *listener_;
+
+  /**
+   * Epoll instance of the event loop.
+   */
+  int epoll_fd_;
+
+  /**
+   * Eventfd which wakes up the event loop.
+   */
+  int event_fd_;
+
+  /**
+   * Connections by socket descriptor, used only by the event loop.
+   */
+  std::unordered_map<int, std::shared_ptr<Connection> > connections_;
+
+  /**
+   * Worker threads.
+   */
+  std::vector<std::thread> workers_;
+
+  /**
+   * Thread which rebuilds the name index, runs if index_period_ is set.
+   */
+  std::thread indexer_;
+
+  /**
+   * Period of rebuilding the name index in seconds.
+   */
+  int index_period_;
+
+  /**
+   * Protects stop_ for the indexer thread.
+   */
+  std::mutex indexer_mutex_;
+
+  /**
+   * Signaled when the server is destroyed.
+   */
+  std::condition_variable indexer_cv_;
+
+  /**
+   * Protects jobs_.
+   */
+  std::mutex jobs_mutex_;
+
+  /**
+   * Workers wait here for jobs.
+   */
+  std::condition_variable jobs_cv_;
+
+  /**
+   * Requests waiting for workers.
+   */
+  std::deque<std::shared_ptr<Job> > jobs_;
+
+  /**
+   * Protects ready_.
+   */
+  std::mutex ready_mutex_;
+
+  /**
+   * Connections which got new responses to send.
+   */
+  std::vector<std::shared_ptr<Connection> > ready_;
+
+  /**
+   * Set when the server should stop.
+   */
+  std::atomic<bool> stop_;
+
+  /**
+   * Last occured error.
+   */
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(SearchServer);
+};
+
+#endif  // SEARCHD_SEARCHSERVER_H_
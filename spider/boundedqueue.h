@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_BOUNDEDQUEUE_H_
+#define SPIDER_BOUNDEDQUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include "common-inl.h"
+
+/**
+ * Blocking FIFO queue with limited capacity, used to pass work between
+ * threads. Push() blocks while the queue is full, Pop() blocks while it is
+ * empty.
+ */
+template <class T> class BoundedQueue {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param capacity Maximum number of elements in the queue.
+   */
+  explicit BoundedQueue(const size_t capacity) : capacity_(capacity) {}
+
+  /**
+   * Put an element at the end of the queue, wait while the queue is full.
+   *
+   * @param value Element to be added.
+   */
+  void Push(const T &value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return queue_.size() < capacity_; });
+    queue_.push_back(value);
+    not_empty_.notify_one();
+  }
+
+  /**
+   * Take an element from the beginning of the queue, wait while the queue is
+   * empty.
+   *
+   * @return The element.
+   */
+  T Pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return !queue_.empty(); });
+    T value = queue_.front();
+    queue_.pop_front();
+    not_full_.notify_one();
+    return value;
+  }
+
+  /**
+   * Get number of elements in the queue.
+   *
+   * @return Number of elements in the queue.
+   */
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+ private:
+  /**
+   * Maximum number of elements in the queue.
+   */
+  const size_t capacity_;
+
+  /**
+   * The elements.
+   */
+  std::deque<T> queue_;
+
+  /**
+   * Protects queue_.
+   */
+  std::mutex mutex_;
+
+  /**
+   * Signaled when an element is taken.
+   */
+  std::condition_variable not_full_;
+
+  /**
+   * Signaled when an element is added.
+   */
+  std::condition_variable not_empty_;
+
+  DISALLOW_COPY_AND_ASSIGN(BoundedQueue);
+};
+
+#endif  // SPIDER_BOUNDEDQUEUE_H_
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "spider/contenthash.h"
+
+static const uint64_t kPrime1 = 0x9e3779b185ebca87ULL;
+static const uint64_t kPrime2 = 0xc2b2ae3d27d4eb4fULL;
+static const uint64_t kPrime3 = 0x165667b19e3779f9ULL;
+static const uint64_t kPrime4 = 0x85ebca77c2b2ae63ULL;
+static const uint64_t kPrime5 = 0x27d4eb2f165667c5ULL;
+
+static inline uint64_t RotateLeft(const uint64_t value, const int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Read little endian number regardless of alignment and byte order.
+ */
+static inline uint64_t Read64(const unsigned char *data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+static inline uint32_t Read32(const unsigned char *data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+
+static inline uint64_t Round(uint64_t lane, const uint64_t input) {
+  lane += input * kPrime2;
+  lane = RotateLeft(lane, 31);
+  return lane * kPrime1;
+}
+
+static inline uint64_t MergeRound(uint64_t hash, const uint64_t lane) {
+  hash ^= Round(0, lane);
+  return hash * kPrime1 + kPrime4;
+}
+
+void ContentHash::Reset(const uint64_t seed) {
+  seed_ = seed;
+  lanes_[0] = seed + kPrime1 + kPrime2;
+  lanes_[1] = seed + kPrime2;
+  lanes_[2] = seed;
+  lanes_[3] = seed - kPrime1;
+  total_ = 0;
+  buffered_ = 0;
+}
+
+void ContentHash::Update(const void *data, const size_t size) {
+  const unsigned char *input = static_cast<const unsigned char *>(data);
+  const unsigned char *end = input + size;
+  total_ += size;
+
+  // Complete the stripe left from the previous call.
+  if (buffered_) {
+    size_t count = std::min(size, sizeof(stripe_) - buffered_);
+    memcpy(stripe_ + buffered_, input, count);
+    buffered_ += count;
+    input += count;
+    if (buffered_ < sizeof(stripe_))
+      return;
+
+    for (int i = 0; i < 4; ++i)
+      lanes_[i] = Round(lanes_[i], Read64(stripe_ + 8 * i));
+    buffered_ = 0;
+  }
+
+  for (; end - input >= 32; input += 32) {
+    lanes_[0] = Round(lanes_[0], Read64(input));
+    lanes_[1] = Round(lanes_[1], Read64(input + 8));
+    lanes_[2] = Round(lanes_[2], Read64(input + 16));
+    lanes_[3] = Round(lanes_[3], Read64(input + 24));
+  }
+
+  buffered_ = end - input;
+  memcpy(stripe_, input, buffered_);
+}
+
+uint64_t ContentHash::Digest() const {
+  uint64_t hash;
+  if (total_ >= 32) {
+    hash = RotateLeft(lanes_[0], 1) + RotateLeft(lanes_[1], 7) +
+           RotateLeft(lanes_[2], 12) + RotateLeft(lanes_[3], 18);
+    for (int i = 0; i < 4; ++i)
+      hash = MergeRound(hash, lanes_[i]);
+  } else {
+    hash = seed_ + kPrime5;
+  }
+  hash += total_;
+
+  const unsigned char *input = stripe_;
+  const unsigned char *end = stripe_ + buffered_;
+  for (; end - input >= 8; input += 8) {
+    hash ^= Round(0, Read64(input));
+    hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+  }
+  if (end - input >= 4) {
+    hash ^= Read32(input) * kPrime1;
+    hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+    input += 4;
+  }
+  for (; input < end; ++input) {
+    hash ^= *input * kPrime5;
+    hash = RotateLeft(hash, 11) * kPrime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+uint64_t ContentHash::Hash(const void *data, const size_t size,
+                           const uint64_t seed) {
+  ContentHash hash(seed);
+  hash.Update(data, size);
+  return hash.Digest();
+}
+
+std::string ContentHash::ToHex(const uint64_t hash) {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx",
+           static_cast<unsigned long long>(hash));  // NOLINT
+  return std::string(buf, 16);
+}
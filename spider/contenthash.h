@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_CONTENTHASH_H_
+#define SPIDER_CONTENTHASH_H_
+
+#include <cstdint>
+#include <string>
+
+#include "common-inl.h"
+
+/**
+ * Streaming 64-bit non-cryptographic hash of file contents, XXH64 by Yann
+ * Collet. Data may be passed in pieces of any size, the digest doesn't
+ * depend on how it is split.
+ *
+ * It is fast enough to be limited by the network even for full reads and
+ * collisions are rare enough for duplicate detection, but it must not be
+ * used where the data may be crafted against it.
+ */
+class ContentHash {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param seed Seed of the hash.
+   */
+  explicit ContentHash(const uint64_t seed = 0) { Reset(seed); }
+
+  /**
+   * Start a new hash.
+   *
+   * @param seed Seed of the hash.
+   */
+  void Reset(const uint64_t seed = 0);
+
+  /**
+   * Add data to the hash.
+   *
+   * @param data The data.
+   * @param size Length of the data.
+   */
+  void Update(const void *data, const size_t size);
+
+  /**
+   * Get hash of all added data. More data may be added after it.
+   *
+   * @return The hash.
+   */
+  uint64_t Digest() const;
+
+  /**
+   * Hash the data at once.
+   *
+   * @param data The data.
+   * @param size Length of the data.
+   * @param seed Seed of the hash.
+   *
+   * @return The hash.
+   */
+  static uint64_t Hash(const void *data, const size_t size,
+                       const uint64_t seed = 0);
+
+  /**
+   * Format the hash as 16 lower case hexadecimal digits.
+   *
+   * @param hash The hash.
+   *
+   * @return Formatted hash.
+   */
+  static std::string ToHex(const uint64_t hash);
+
+ private:
+  /**
+   * Accumulators of the four lanes.
+   */
+  uint64_t lanes_[4];
+
+  /**
+   * Seed of the hash.
+   */
+  uint64_t seed_;
+
+  /**
+   * Number of added bytes.
+   */
+  uint64_t total_;
+
+  /**
+   * Tail of added data which doesn't fill a stripe yet.
+   */
+  unsigned char stripe_[32];
+
+  /**
+   * Used length of stripe_.
+   */
+  size_t buffered_;
+
+  DISALLOW_COPY_AND_ASSIGN(ContentHash);
+};
+
+#endif  // SPIDER_CONTENTHASH_H_
@@ -0,0 +1,604 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <libsmbclient.h>
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/crawlbackend.h"
+
+/**
+ * Record returned by getdents64(), glibc doesn't declare it.
+ */
+struct linux_dirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;  // NOLINT(runtime/int)
+  unsigned char d_type;
+  char d_name[];
+};
+
+static void guest_auth_smbc_get_data(SMBCCTX *context,
+                                     const char *server, const char *share,
+                                     char *workgroup, int wgmaxlen,
+                                     char *username, int unmaxlen,
+                                     char *password, int pwmaxlen) {
+  strncpy(username, "Guest", unmaxlen - 1);
+  strncpy(password, "", pwmaxlen - 1);
+  strncpy(workgroup, "", wgmaxlen - 1);
+}
+
+CrawlBackend *CrawlBackend::Create(const std::string &scheme,
+                                   const MountTable &mounts) {
+  CrawlBackend *backend = NULL;
+  if (scheme == "smb") {
+    backend = new(std::nothrow) SmbBackend();
+  } else if (scheme == "file") {
+    backend = new(std::nothrow) LocalBackend(mounts);
+  } else {
+    MSS_ERROR_MESSAGE(("Unsupported scheme " + scheme).c_str());
+    errno = EPROTONOSUPPORT;
+    return NULL;
+  }
+
+  if (UNLIKELY(backend == NULL)) {
+    errno = ENOMEM;
+    MSS_FATAL("backend", errno);
+    return NULL;
+  }
+
+  if (UNLIKELY(backend->get_error())) {
+    errno = backend->get_error();
+    delete backend;
+    return NULL;
+  }
+
+  return backend;
+}
+
+CrawlBackend::CrawlBackend()
+    : buffer_(DIRENTS_SIZE),
+      error_(0) {
+}
+
+int CrawlBackend::ReadDir(const std::string &dir, const bool stat_files,
+                          std::vector<CrawlEntry> *entries) {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+
+  stats_ = ReadDirStats();
+  int result = ReadEntries(dir, stat_files, entries);
+  stats_.entries = entries->size();
+  stats_.usec = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - start).count();
+  return result;
+}
+
+int CrawlBackend::ReadSamples(const std::string &path, const size_t block,
+                              const size_t count, int64_t *size,
+                              const BlockHandler &handler) {
+  if (UNLIKELY(OpenFile(path, size)))
+    return -1;
+
+  if (block_.size() < block)
+    block_.resize(block);
+
+  // Read the whole file while blocks are not shorter than requested, the
+  // file may grow after it is opened.
+  bool whole = count == 0 || *size <= static_cast<int64_t>(count * block);
+  for (size_t i = 0; whole || i < count; ++i) {
+    int64_t offset = i * block;
+    if (!whole) {
+      offset = count > 1 ?
+          (*size - static_cast<int64_t>(block)) * i / (count - 1) : 0;
+    }
+
+    ssize_t done = ReadFileAt(offset, block_.data(), block);
+    if (UNLIKELY(done < 0)) {
+      CloseFile();
+      return -1;
+    }
+
+    if (done > 0)
+      handler(block_.data(), done);
+    if (static_cast<size_t>(done) < block)
+      break;  // End of the file.
+  }
+
+  CloseFile();
+  return 0;
+}
+
+void CrawlBackend::set_buffer_size(const size_t size) {
+  // Shrink the memory too, a worker may keep the buffer for a long time.
+  std::vector<char>(std::max<size_t>(size, DIRENTS_MIN_SIZE)).swap(buffer_);
+}
+
+std::string CrawlBackend::Scheme(const std::string &url) {
+  size_t pos = url.find("://");
+  if (pos == std::string::npos)
+    return std::string();
+  return url.substr(0, pos);
+}
+
+size_t CrawlBackend::ServerOffset(const std::string &url) {
+  size_t pos = url.find("://");
+  return pos == std::string::npos ? 0 : pos + 3;
+}
+
+SmbBackend::SmbBackend()
+    : file_(NULL) {
+  context_ = smbc_new_context();
+  if (UNLIKELY(context_ == NULL)) {
+    error_ = errno;
+    MSS_ERROR("smbc_new_context", error_);
+    return;
+  }
+
+  smbc_setFunctionAuthDataWithContext(context_, guest_auth_smbc_get_data);
+
+  if (UNLIKELY(smbc_init_context(context_) == NULL)) {
+    error_ = errno;
+    MSS_ERROR("smbc_init_context", error_);
+    smbc_free_context(context_, 0);
+    context_ = NULL;
+  }
+}
+
+SmbBackend::~SmbBackend() {
+  if (context_ != NULL && smbc_free_context(context_, 1))
+    MSS_ERROR("smbc_free_context", errno);
+}
+
+int SmbBackend::ReadEntries(const std::string &dir, const bool stat_files,
+                            std::vector<CrawlEntry> *entries) {
+  entries->clear();
+  int dirc = 0, dsize = 0;
+  char *dirp = NULL;
+
+  // Open given smb directory.
+  SMBCFILE *directory = smbc_getFunctionOpendir(context_)(context_,
+                                                          dir.c_str());
+  if (UNLIKELY(directory == NULL)) {
+    error_ = errno;
+    MSS_ERROR(("smbc_opendir " + dir).c_str(), error_);
+    return -1;
+  }
+
+  smbc_getdents_fn getdents = smbc_getFunctionGetdents(context_);
+  int result = 0;
+
+  // Getting content of the directory.
+  // getdents() returns the readen size.
+  // When no more content in the directory getdents() returns 0.
+  while (true) {
+    dirp = buffer_.data();
+
+    // Get dir content which can placed in the buffer.
+    ++stats_.calls;
+    if (UNLIKELY((dirc = getdents(context_, directory,
+                                  (struct smbc_dirent *)dirp,
+                                  buffer_.size())) < 0)) {
+      error_ = errno;
+      MSS_ERROR(("smbc_getdents " + dir).c_str(), error_);
+      result = -1;
+      break;
+    }
+
+    // Break the cycle if no more content in this directory.
+    if (dirc == 0)
+      break;
+
+    while (dirc > 0) {
+      struct smbc_dirent *dirent = (struct smbc_dirent *)dirp;
+      dsize = dirent->dirlen;
+
+      // Ignoring "." and ".."
+      if ((strcmp(dirent->name, ".") == 0) ||
+          (strcmp(dirent->name, "..") == 0)) {
+        dirp += dsize;  // Promote pointer
+        dirc -= dsize;  // Decrease size
+        continue;
+      }
+
+      switch (dirent->smbc_type) {
+        case SMBC_WORKGROUP:
+        case SMBC_SERVER:
+        case SMBC_FILE_SHARE:
+        case SMBC_DIR: {
+          entries->push_back(CrawlEntry());
+          entries->back().name = dirent->name;
+          entries->back().is_dir = true;
+          break;
+        }
+        case SMBC_FILE: {
+          entries->push_back(CrawlEntry());
+          entries->back().name = dirent->name;
+          break;
+        }
+        case SMBC_PRINTER_SHARE:
+        case SMBC_COMMS_SHARE:
+        case SMBC_IPC_SHARE:
+        case SMBC_LINK: {
+          // Do nothing
+          break;
+        }
+        default: {
+          MSS_FATAL_MESSAGE("Unknown smb entry type");
+          assert(0);  // This can't happen
+        }
+      }
+
+      dirp += dsize;  // Promote pointer
+      dirc -= dsize;  // Decrease size
+    }
+  }
+
+  // Close given smb directory
+  if (UNLIKELY(smbc_getFunctionClosedir(context_)(context_, directory) < 0)) {
+    error_ = errno;
+    MSS_ERROR(("smbc_closedir " + dir).c_str(), error_);
+  }
+
+  // getdents() doesn't return size and modification time, so it costs one
+  // more request per file. A file which can't be stated is reported anyway,
+  // it will be treated as changed.
+  if (stat_files) {
+    smbc_stat_fn stat = smbc_getFunctionStat(context_);
+    struct stat st;
+    std::string path;
+    for (CrawlEntry &entry : *entries) {
+      if (entry.is_dir)
+        continue;
+
+      path = dir + "/" + entry.name;
+      if (LIKELY(stat(context_, path.c_str(), &st) == 0)) {
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtime;
+      } else {
+        MSS_ERROR(("smbc_stat " + path).c_str(), errno);
+      }
+    }
+  }
+
+  return result;
+}
+
+ssize_t SmbBackend::ReadHeader(const std::string &path, char *buf,
+                               const size_t size) {
+  smbc_close_fn smb_close = smbc_getFunctionClose(context_);
+  SMBCFILE *smb_fd = smbc_getFunctionOpen(context_)(context_, path.c_str(),
+                                                     O_RDONLY, 0);
+  if (UNLIKELY(smb_fd == NULL)) {
+    error_ = errno;
+    if (error_ != EISDIR)
+      MSS_ERROR(("smbc_open " + path).c_str(), error_);
+    return -1;
+  }
+
+  // smbc_read() may return less than requested.
+  smbc_read_fn smb_read = smbc_getFunctionRead(context_);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t count = smb_read(context_, smb_fd, buf + done, size - done);
+    if (UNLIKELY(count < 0)) {
+      error_ = errno;
+      MSS_ERROR(("smbc_read " + path).c_str(), error_);
+      if (UNLIKELY(smb_close(context_, smb_fd)))
+        MSS_ERROR("smbc_close", errno);
+      return -1;
+    }
+
+    if (count == 0)
+      break;  // File is shorter than the header.
+
+    done += count;
+  }
+
+  if (UNLIKELY(smb_close(context_, smb_fd))) {
+    error_ = errno;
+    MSS_ERROR("smbc_close", error_);
+  }
+
+  return done;
+}
+
+int SmbBackend::OpenFile(const std::string &path, int64_t *size) {
+  file_ = smbc_getFunctionOpen(context_)(context_, path.c_str(), O_RDONLY, 0);
+  if (UNLIKELY(file_ == NULL)) {
+    error_ = errno;
+    if (error_ != EISDIR)
+      MSS_ERROR(("smbc_open " + path).c_str(), error_);
+    return -1;
+  }
+  file_path_ = path;
+
+  struct stat st;
+  if (UNLIKELY(smbc_getFunctionFstat(context_)(context_, file_, &st))) {
+    error_ = errno;
+    MSS_ERROR(("smbc_fstat " + path).c_str(), error_);
+    CloseFile();
+    return -1;
+  }
+  *size = st.st_size;
+  return 0;
+}
+
+ssize_t SmbBackend::ReadFileAt(const int64_t offset, char *buf,
+                               const size_t size) {
+  if (UNLIKELY(smbc_getFunctionLseek(context_)(context_, file_, offset,
+                                               SEEK_SET) < 0)) {
+    error_ = errno;
+    MSS_ERROR(("smbc_lseek " + file_path_).c_str(), error_);
+    return -1;
+  }
+
+  // smbc_read() may return less than requested.
+  smbc_read_fn smb_read = smbc_getFunctionRead(context_);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t count = smb_read(context_, file_, buf + done, size - done);
+    if (UNLIKELY(count < 0)) {
+      error_ = errno;
+      MSS_ERROR(("smbc_read " + file_path_).c_str(), error_);
+      return -1;
+    }
+
+    if (count == 0)
+      break;
+
+    done += count;
+  }
+  return done;
+}
+
+void SmbBackend::CloseFile() {
+  if (file_ == NULL)
+    return;
+
+  if (UNLIKELY(smbc_getFunctionClose(context_)(context_, file_))) {
+    error_ = errno;
+    MSS_ERROR("smbc_close", error_);
+  }
+  file_ = NULL;
+}
+
+LocalBackend::LocalBackend(const MountTable &mounts)
+    : mounts_(mounts),
+      fd_(-1) {
+}
+
+int LocalBackend::LocalPath(const std::string &url, std::string *path) {
+  size_t server = ServerOffset(url);
+  if (server < url.size() && url[server] == '/') {
+    path->assign(url, server, std::string::npos);
+    return 0;
+  }
+
+  size_t end = url.find('/', server);
+  auto mount = mounts_.find(url.substr(server, end - server));
+  if (UNLIKELY(mount == mounts_.end())) {
+    error_ = ENOENT;
+    MSS_ERROR_MESSAGE(("Server is not mounted: " + url).c_str());
+    return -1;
+  }
+
+  path->assign(mount->second);
+  if (end != std::string::npos)
+    path->append(url, end, std::string::npos);
+  return 0;
+}
+
+int LocalBackend::ReadEntries(const std::string &dir, const bool stat_files,
+                              std::vector<CrawlEntry> *entries) {
+  entries->clear();
+
+  std::string path;
+  if (UNLIKELY(LocalPath(dir, &path)))
+    return -1;
+
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (UNLIKELY(fd < 0)) {
+    error_ = errno;
+    MSS_ERROR(("open " + path).c_str(), error_);
+    return -1;
+  }
+
+  int result = 0;
+  while (true) {
+    ++stats_.calls;
+    long count = syscall(SYS_getdents64, fd, buffer_.data(),  // NOLINT
+                         buffer_.size());
+    if (UNLIKELY(count < 0)) {
+      error_ = errno;
+      MSS_ERROR(("getdents64 " + path).c_str(), error_);
+      result = -1;
+      break;
+    }
+
+    if (count == 0)
+      break;
+
+    for (long pos = 0; pos < count;) {  // NOLINT(runtime/int)
+      struct linux_dirent64 *dirent =
+          reinterpret_cast<struct linux_dirent64 *>(&buffer_[pos]);
+      pos += dirent->d_reclen;
+
+      const char *name = dirent->d_name;
+      if (name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        continue;
+
+      unsigned char type = dirent->d_type;
+      bool need_stat = type == DT_UNKNOWN || (stat_files && type == DT_REG);
+      struct statx st;
+      if (need_stat) {
+        // Symbolic links are not followed, like smb links they are skipped.
+        if (UNLIKELY(statx(fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT |
+                           AT_STATX_DONT_SYNC,
+                           STATX_TYPE | STATX_SIZE | STATX_MTIME, &st))) {
+          MSS_ERROR(("statx " + path + "/" + name).c_str(), errno);
+          if (type == DT_UNKNOWN)
+            continue;
+          need_stat = false;
+        } else if (type == DT_UNKNOWN) {
+          type = IFTODT(st.stx_mode);
+        }
+      }
+
+      if (type != DT_DIR && type != DT_REG)
+        continue;
+
+      entries->push_back(CrawlEntry());
+      CrawlEntry &entry = entries->back();
+      entry.name = name;
+      entry.is_dir = type == DT_DIR;
+      if (need_stat && stat_files && !entry.is_dir) {
+        entry.size = st.stx_size;
+        entry.mtime = st.stx_mtime.tv_sec;
+      }
+    }
+  }
+
+  if (UNLIKELY(close(fd))) {
+    error_ = errno;
+    MSS_ERROR(("close " + path).c_str(), error_);
+  }
+
+  return result;
+}
+
+ssize_t LocalBackend::ReadHeader(const std::string &url, char *buf,
+                                 const size_t size) {
+  std::string path;
+  if (UNLIKELY(LocalPath(url, &path)))
+    return -1;
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (UNLIKELY(fd < 0)) {
+    error_ = errno;
+    MSS_ERROR(("open " + path).c_str(), error_);
+    return -1;
+  }
+
+  size_t done = 0;
+  while (done < size) {
+    ssize_t count = pread(fd, buf + done, size - done, done);
+    if (UNLIKELY(count < 0)) {
+      if (errno == EINTR)
+        continue;
+      error_ = errno;
+      if (error_ != EISDIR)
+        MSS_ERROR(("pread " + path).c_str(), error_);
+      close(fd);
+      return -1;
+    }
+
+    if (count == 0)
+      break;  // File is shorter than the header.
+
+    done += count;
+  }
+
+  if (UNLIKELY(close(fd))) {
+    error_ = errno;
+    MSS_ERROR(("close " + path).c_str(), error_);
+  }
+
+  return done;
+}
+
+int LocalBackend::OpenFile(const std::string &url, int64_t *size) {
+  if (UNLIKELY(LocalPath(url, &file_path_)))
+    return -1;
+
+  fd_ = open(file_path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (UNLIKELY(fd_ < 0)) {
+    error_ = errno;
+    MSS_ERROR(("open " + file_path_).c_str(), error_);
+    return -1;
+  }
+
+  struct stat st;
+  if (UNLIKELY(fstat(fd_, &st))) {
+    error_ = errno;
+    MSS_ERROR(("fstat " + file_path_).c_str(), error_);
+    CloseFile();
+    return -1;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    error_ = EISDIR;
+    CloseFile();
+    return -1;
+  }
+
+  *size = st.st_size;
+  return 0;
+}
+
+ssize_t LocalBackend::ReadFileAt(const int64_t offset, char *buf,
+                                 const size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t count = pread(fd_, buf + done, size - done, offset + done);
+    if (UNLIKELY(count < 0)) {
+      if (errno == EINTR)
+        continue;
+      error_ = errno;
+      MSS_ERROR(("pread " + file_path_).c_str(), error_);
+      return -1;
+    }
+
+    if (count == 0)
+      break;
+
+    done += count;
+  }
+  return done;
+}
+
+void LocalBackend::CloseFile() {
+  if (fd_ < 0)
+    return;
+
+  if (UNLIKELY(close(fd_))) {
+    error_ = errno;
+    MSS_ERROR(("close " + file_path_).c_str(), error_);
+  }
+  fd_ = -1;
+}
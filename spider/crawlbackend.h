@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_CRAWLBACKEND_H_
+#define SPIDER_CRAWLBACKEND_H_
+
+#include <libsmbclient.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Entry of a directory read by a crawl backend.
+ */
+struct CrawlEntry {
+  /**
+   * Name of the entry without the directory.
+   */
+  std::string name;
+
+  /**
+   * Whether the entry should be scanned as a directory: directories, and
+   * shares, servers and workgroups of smb.
+   */
+  bool is_dir = false;
+
+  /**
+   * Size of the file in bytes, -1 if it is unknown.
+   */
+  int64_t size = -1;
+
+  /**
+   * Time of last modification, 0 if it is unknown.
+   */
+  time_t mtime = 0;
+};
+
+/**
+ * Cost of reading one directory.
+ */
+struct ReadDirStats {
+  /**
+   * Number of returned entries.
+   */
+  size_t entries = 0;
+
+  /**
+   * Number of getdents calls, each one is a round trip for smb.
+   */
+  size_t calls = 0;
+
+  /**
+   * Time spent in ReadDir(), microseconds.
+   */
+  int64_t usec = 0;
+};
+
+/**
+ * Access to files of one kind of URLs. Every URL is "scheme://server/path",
+ * the scheme selects the backend.
+ *
+ * Objects are not thread safe, every thread creates its own.
+ */
+class CrawlBackend {
+ public:
+  /**
+   * Function which creates a backend for URLs of the scheme, returns NULL
+   * if the scheme is not supported.
+   */
+  typedef std::function<CrawlBackend *(const std::string &scheme)> Factory;
+
+  /**
+   * Local directories where servers are mounted, key is server name.
+   */
+  typedef std::unordered_map<std::string, std::string> MountTable;
+
+  /**
+   * Function which receives blocks of a file read by ReadSamples().
+   */
+  typedef std::function<void(const char *data, const size_t size)>
+      BlockHandler;
+
+  virtual ~CrawlBackend() {}
+
+  /**
+   * Read all entries of the directory except "." and "..". Entries which are
+   * neither files nor directories are skipped. Cost of the call is saved in
+   * get_stats().
+   *
+   * @param dir URL of the directory.
+   * @param stat_files Whether to get size and modification time of files.
+   * @param entries Where to store entries, old ones are removed.
+   *
+   * @return 0 on success, -1 otherwise. Entries read before an error are
+   * kept.
+   */
+  int ReadDir(const std::string &dir, const bool stat_files,
+              std::vector<CrawlEntry> *entries);
+
+  /**
+   * Read the beginning of the file.
+   *
+   * @param path URL of the file.
+   * @param buf Where to store the data.
+   * @param size Number of bytes to read.
+   *
+   * @return Number of read bytes, less than size only if the file is
+   * shorter, -1 on error. The error is EISDIR for directories.
+   */
+  virtual ssize_t ReadHeader(const std::string &path, char *buf,
+                             const size_t size) = 0;
+
+  /**
+   * Read evenly spread blocks of the file: the first one at the beginning,
+   * the last one at the end and the rest in between. The file is opened
+   * once and every block takes one read, so a huge file costs the same as
+   * a small one. Files not longer than count blocks are read whole.
+   *
+   * @param path URL of the file.
+   * @param block Size of a block.
+   * @param count Number of blocks, 0 to read the whole file.
+   * @param size Where to store size of the file.
+   * @param handler Function which receives blocks in order of offsets.
+   *
+   * @return 0 on success, -1 otherwise. The error is EISDIR for
+   * directories.
+   */
+  int ReadSamples(const std::string &path, const size_t block,
+                  const size_t count, int64_t *size,
+                  const BlockHandler &handler);
+
+  /**
+   * Create a backend for the scheme: SmbBackend for "smb", LocalBackend
+   * for "file".
+   *
+   * @param scheme Scheme of URLs.
+   * @param mounts Directories where servers are mounted.
+   *
+   * @return New backend or NULL on error.
+   */
+  static CrawlBackend *Create(const std::string &scheme,
+                              const MountTable &mounts = MountTable());
+
+  /**
+   * Get scheme of the URL.
+   *
+   * @param url URL.
+   *
+   * @return Scheme, empty string if there is none.
+   */
+  static std::string Scheme(const std::string &url);
+
+  /**
+   * Get position of the server name in the URL, after "scheme://".
+   *
+   * @param url URL.
+   *
+   * @return Position of the server name.
+   */
+  static size_t ServerOffset(const std::string &url);
+
+  /**
+   * Set size of the buffer for directory entries. Bigger buffer means less
+   * getdents calls for wide directories.
+   *
+   * @param size Size in bytes, at least DIRENTS_MIN_SIZE.
+   */
+  void set_buffer_size(const size_t size);
+
+  /**
+   * Get size of the buffer for directory entries.
+   *
+   * @return Size in bytes.
+   */
+  inline size_t get_buffer_size() const { return buffer_.size(); }
+
+  /**
+   * Get cost of the last ReadDir() call.
+   *
+   * @return Statistics of the last directory.
+   */
+  inline const ReadDirStats &get_stats() const { return stats_; }
+
+  /**
+   * Get last occured error.
+   *
+   * @return Last occured error.
+   */
+  inline int get_error() const { return error_; }
+
+ protected:
+  CrawlBackend();
+
+  /**
+   * Read the directory, implementation of ReadDir(). Must count getdents
+   * calls in stats_.calls.
+   */
+  virtual int ReadEntries(const std::string &dir, const bool stat_files,
+                          std::vector<CrawlEntry> *entries) = 0;
+
+  /**
+   * Open the file for ReadFileAt(), only one file is open at a time.
+   *
+   * @param path URL of the file.
+   * @param size Where to store size of the file.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  virtual int OpenFile(const std::string &path, int64_t *size) = 0;
+
+  /**
+   * Read from the open file.
+   *
+   * @param offset Position in the file.
+   * @param buf Where to store the data.
+   * @param size Number of bytes to read.
+   *
+   * @return Number of read bytes, less than size only at the end of the
+   * file, -1 on error.
+   */
+  virtual ssize_t ReadFileAt(const int64_t offset, char *buf,
+                             const size_t size) = 0;
+
+  /**
+   * Close the open file.
+   */
+  virtual void CloseFile() = 0;
+
+  /**
+   * Buffer for directory entries, reused for every directory.
+   */
+  std::vector<char> buffer_;
+
+  /**
+   * Buffer for blocks of ReadSamples(), reused for every file.
+   */
+  std::vector<char> block_;
+
+  /**
+   * Cost of the current or last ReadDir() call.
+   */
+  ReadDirStats stats_;
+
+  /**
+   * Last occured error.
+   */
+  int error_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CrawlBackend);
+};
+
+/**
+ * Backend for "smb://" URLs, works through its own libsmbclient context
+ * with guest authentication.
+ */
+class SmbBackend : public CrawlBackend {
+ public:
+  /**
+   * Constructor which creates the context, check get_error() after it.
+   */
+  SmbBackend();
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Destructor, frees the context.
+   */
+  virtual ~SmbBackend();
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+  virtual ssize_t ReadHeader(const std::string &path, char *buf,
+                             const size_t size);
+
+ protected:
+  virtual int ReadEntries(const std::string &dir, const bool stat_files,
+                          std::vector<CrawlEntry> *entries);
+
+  virtual int OpenFile(const std::string &path, int64_t *size);
+
+  virtual ssize_t ReadFileAt(const int64_t offset, char *buf,
+                             const size_t size);
+
+  virtual void CloseFile();
+
+ private:
+  /**
+   * Context used for all smb calls.
+   */
+  SMBCCTX *context_;
+
+  /**
+   * File opened by OpenFile(), NULL if there is none.
+   */
+  SMBCFILE *file_;
+
+  /**
+   * URL of file_ for error messages.
+   */
+  std::string file_path_;
+};
+
+/**
+ * Backend for "file://" URLs of servers mounted in local directories, for
+ * example NAS volumes mounted by NFS. "file://server/path" is path in the
+ * mount point of the server, "file:///path" is a local path.
+ *
+ * Directories are read with getdents64() in large chunks and files are
+ * stated relative to the directory descriptor with statx(), so a directory
+ * costs a few system calls and no path lookups.
+ */
+class LocalBackend : public CrawlBackend {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param mounts Directories where servers are mounted.
+   */
+  explicit LocalBackend(const MountTable &mounts = MountTable());
+
+  virtual ssize_t ReadHeader(const std::string &path, char *buf,
+                             const size_t size);
+
+ protected:
+  virtual int ReadEntries(const std::string &dir, const bool stat_files,
+                          std::vector<CrawlEntry> *entries);
+
+  virtual int OpenFile(const std::string &path, int64_t *size);
+
+  virtual ssize_t ReadFileAt(const int64_t offset, char *buf,
+                             const size_t size);
+
+  virtual void CloseFile();
+
+ private:
+  /**
+   * Convert URL to a local path.
+   *
+   * @param url URL of the file.
+   * @param path Where to store the path.
+   *
+   * @return 0 on success, -1 if the server is not mounted.
+   */
+  int LocalPath(const std::string &url, std::string *path);
+
+  /**
+   * Directories where servers are mounted.
+   */
+  MountTable mounts_;
+
+  /**
+   * Descriptor of file opened by OpenFile(), -1 if there is none.
+   */
+  int fd_;
+
+  /**
+   * Local path of fd_ for error messages.
+   */
+  std::string file_path_;
+};
+
+#endif  // SPIDER_CRAWLBACKEND_H_
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/crawler.h"
+
+Crawler::Crawler(const int threads, const FileHandler &handler,
+                 const bool stat_files,
+                 const CrawlBackend::Factory &factory)
+    : handler_(handler),
+      factory_(factory),
+      stat_files_(stat_files),
+      pending_(0),
+      queued_(0),
+      failed_(0),
+      cancel_(NULL),
+      slow_dir_usec_(SLOW_DIR_MS * 1000LL),
+      dirs_(0),
+      entries_(0),
+      calls_(0),
+      usec_(0),
+      stop_(false),
+      ready_(false),
+      error_(0) {
+  for (int i = 0; i < threads; ++i) {
+    Worker *worker = new(std::nothrow) Worker();
+    if (UNLIKELY(worker == NULL)) {
+      error_ = ENOMEM;
+      MSS_FATAL("worker", error_);
+      // No thread is started, Scan() refuses to work without workers.
+      for (Worker *created : workers_)
+        delete created;
+      workers_.clear();
+      return;
+    }
+
+    workers_.push_back(worker);
+  }
+
+  if (!factory_) {
+    factory_ = [](const std::string &scheme) {
+      return CrawlBackend::Create(scheme);
+    };
+  }
+
+  // Start threads only when all the deques exist, they steal from each other.
+  for (size_t i = 0; i < workers_.size(); ++i)
+    workers_[i]->thread = std::thread(&Crawler::WorkerLoop, this, i);
+  ready_ = !workers_.empty();
+}
+
+Crawler::~Crawler() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    stop_ = true;
+  }
+  idle_cv_.notify_all();
+
+  for (Worker *worker : workers_) {
+    if (worker->thread.joinable())
+      worker->thread.join();
+    delete worker->backend;
+    delete worker;
+  }
+}
+
+int Crawler::Scan(const std::string &dir, const std::atomic<bool> *cancel) {
+  if (UNLIKELY(workers_.empty())) {
+    MSS_ERROR_MESSAGE("No workers to scan with.");
+    error_ = EINVAL;
+    return -1;
+  }
+
+  // Directories which failed during the previous scan don't affect this
+  // one.
+  error_ = 0;
+  failed_ = 0;
+  dirs_ = 0;
+  entries_ = 0;
+  calls_ = 0;
+  usec_ = 0;
+  cancel_ = cancel;
+  PushDir(0, dir);
+
+  std::unique_lock<std::mutex> lock(idle_mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+
+  return failed_ ? -1 : 0;
+}
+
+ReadDirStats Crawler::get_stats() const {
+  ReadDirStats stats;
+  stats.entries = entries_;
+  stats.calls = calls_;
+  stats.usec = usec_;
+  return stats;
+}
+
+void Crawler::WorkerLoop(const size_t id) {
+  std::string dir;
+
+  while (true) {
+    if (!PopDir(id, &dir)) {
+      std::unique_lock<std::mutex> lock(idle_mutex_);
+      idle_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      if (stop_)
+        return;
+      continue;
+    }
+
+    if (UNLIKELY(ScanDir(id, dir)))
+      ++failed_;
+
+    // Subdirectories were counted in pending_ before this one is uncounted,
+    // so zero really means that the whole tree is done.
+    if (--pending_ == 0) {
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+      done_cv_.notify_all();
+    }
+  }
+}
+
+bool Crawler::PopDir(const size_t id, std::string *dir) {
+  {
+    Worker *self = workers_[id];
+    std::lock_guard<std::mutex> lock(self->mutex);
+    if (!self->dirs.empty()) {
+      dir->swap(self->dirs.back());
+      self->dirs.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+
+  // Own deque is empty, try to steal.
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    Worker *victim = workers_[(id + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim->mutex);
+    if (!victim->dirs.empty()) {
+      dir->swap(victim->dirs.front());
+      victim->dirs.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void Crawler::PushDir(const size_t id, const std::string &dir) {
+  ++pending_;
+  {
+    Worker *self = workers_[id];
+    std::lock_guard<std::mutex> lock(self->mutex);
+    self->dirs.push_back(dir);
+  }
+  ++queued_;
+
+  // Take the mutex so that a worker between checking queued_ and going to
+  // sleep can't miss the notification.
+  std::lock_guard<std::mutex> lock(idle_mutex_);
+  idle_cv_.notify_one();
+}
+
+int Crawler::ScanDir(const size_t id, const std::string &dir) {
+  Worker *worker = workers_[id];
+  if (UNLIKELY(cancel_ != NULL && *cancel_)) {
+    error_ = ECANCELED;
+    return -1;
+  }
+
+  std::string scheme = CrawlBackend::Scheme(dir);
+  if (worker->backend == NULL || worker->scheme != scheme) {
+    delete worker->backend;
+    worker->backend = factory_(scheme);
+    if (UNLIKELY(worker->backend == NULL)) {
+      error_ = errno;
+      MSS_ERROR(("CrawlBackend " + dir).c_str(), error_);
+      return -1;
+    }
+    worker->scheme = scheme;
+  }
+
+  // Entries read before an error are handed out anyway.
+  int result = 0;
+  if (UNLIKELY(worker->backend->ReadDir(dir, stat_files_, &worker->entries))) {
+    error_ = worker->backend->get_error();
+    result = -1;
+  }
+
+  const ReadDirStats &stats = worker->backend->get_stats();
+  ++dirs_;
+  entries_ += stats.entries;
+  calls_ += stats.calls;
+  usec_ += stats.usec;
+  if (UNLIKELY(slow_dir_usec_ >= 0 && stats.usec > slow_dir_usec_)) {
+    char message[128];
+    snprintf(message, sizeof(message), ": %zu entries, %zu calls, %lld ms",
+             stats.entries, stats.calls,
+             static_cast<long long>(stats.usec / 1000));  // NOLINT
+    MSS_INFO_MESSAGE(("Slow directory " + dir + message).c_str());
+  }
+
+  // Files are handed out as one batch, their URLs are never built here.
+  if (!worker->entries.empty())
+    handler_(dir, worker->entries);
+
+  // Subdirectories are queued after the listing, when the filter has seen
+  // all of them.
+  std::vector<std::string> subdirs;
+  for (const CrawlEntry &entry : worker->entries) {
+    if (entry.is_dir)
+      subdirs.push_back(dir + "/" + entry.name);
+  }
+
+  if (filter_ && !subdirs.empty())
+    filter_(dir, &subdirs);
+  for (const std::string &subdir : subdirs)
+    PushDir(id, subdir);
+
+  return result;
+}
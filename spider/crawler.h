@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_CRAWLER_H_
+#define SPIDER_CRAWLER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common-inl.h"
+#include "spider/crawlbackend.h"
+
+/**
+ * Pool of threads which walk directory trees.
+ *
+ * Every worker owns a deque of directories waiting to be scanned and its
+ * own crawl backend for the scheme of the directories, so entry buffers are
+ * reused from directory to directory. A worker takes directories from the
+ * back of its own deque (depth-first, so its working set stays small) and,
+ * when the deque is empty, steals from the front of the other workers'
+ * deques, where the biggest unexplored subtrees are. Directories are never
+ * scanned recursively, so the depth of a tree doesn't affect the stack.
+ */
+class Crawler {
+ public:
+  /**
+   * Function which is called once for every read directory with all its
+   * entries, subdirectories among them have is_dir set. Called concurrently
+   * from the worker threads.
+   */
+  typedef std::function<void(const std::string &dir,
+                             const std::vector<CrawlEntry> &entries)>
+      FileHandler;
+
+  /**
+   * Function which is called with the subdirectories found in a directory
+   * before they are queued, it may remove the ones which must not be
+   * scanned. Called concurrently from the worker threads.
+   */
+  typedef std::function<void(const std::string &dir,
+                             std::vector<std::string> *subdirs)> DirFilter;
+
+  /**
+   * Constructor which starts the workers.
+   *
+   * @param threads Number of worker threads.
+   * @param handler Function to call for every read directory.
+   * @param stat_files Whether to get size and modification time of files.
+   * smb getdents() doesn't return them, so it costs one more request per
+   * file.
+   * @param factory Function to create backends of the workers, empty to
+   * use CrawlBackend::Create() without mount points.
+   */
+  Crawler(const int threads, const FileHandler &handler,
+          const bool stat_files = false,
+          const CrawlBackend::Factory &factory = CrawlBackend::Factory());
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Destructor, stops and joins all workers.
+   */
+  ~Crawler();
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+  /**
+   * Scan the directory and all its subdirectories. Blocks until the whole
+   * tree is scanned.
+   *
+   * @param dir URL of the directory.
+   * @param cancel Flag set by another thread when the scan should stop,
+   * the rest of the tree is dropped without reading. NULL if the scan
+   * can't be cancelled.
+   *
+   * @return 0 if every directory was scanned, -1 otherwise.
+   */
+  int Scan(const std::string &dir,
+           const std::atomic<bool> *cancel = NULL);
+
+  /**
+   * Set function to filter subdirectories, must not be called during Scan().
+   *
+   * @param filter New filter, empty to scan every subdirectory.
+   */
+  void set_dir_filter(const DirFilter &filter) { filter_ = filter; }
+
+  /**
+   * Set time after which reading of a directory is logged as slow, must not
+   * be called during Scan().
+   *
+   * @param msec Time in milliseconds, negative to log nothing.
+   */
+  void set_slow_dir_ms(const int msec) { slow_dir_usec_ = msec * 1000LL; }
+
+  /**
+   * Get total cost of reading directories during the last Scan().
+   *
+   * @return Sum of statistics of all read directories.
+   */
+  ReadDirStats get_stats() const;
+
+  /**
+   * Get number of directories read during the last Scan().
+   *
+   * @return Number of directories.
+   */
+  inline size_t get_dirs() const { return dirs_; }
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Get last occured error. Errors of directories are reset by every
+   * Scan().
+   *
+   * @return Last occured error.
+   */
+  inline int get_error() const { return error_; }
+
+  /**
+   * Check whether all workers were started by the constructor.
+   *
+   * @return true if the crawler can scan, false otherwise.
+   */
+  inline bool is_ready() const { return ready_; }
+
+  /**
+   * Get number of worker threads.
+   *
+   * @return Number of worker threads.
+   */
+  inline int get_threads() const { return workers_.size(); }
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+ private:
+  /**
+   * State owned by one worker thread.
+   */
+  struct Worker {
+    /**
+     * Protects dirs, the owner and thieves both take it.
+     */
+    std::mutex mutex;
+
+    /**
+     * Directories waiting to be scanned.
+     */
+    std::deque<std::string> dirs;
+
+    /**
+     * Backend used for all calls of this worker, NULL before the first
+     * directory.
+     */
+    CrawlBackend *backend = NULL;
+
+    /**
+     * Scheme of URLs the backend works with.
+     */
+    std::string scheme;
+
+    /**
+     * Entries of the directory being scanned, reused for every directory.
+     */
+    std::vector<CrawlEntry> entries;
+
+    /**
+     * The thread itself.
+     */
+    std::thread thread;
+  };
+
+  /**
+   * Main loop of the worker thread.
+   *
+   * @param id Index of the worker in workers_.
+   */
+  void WorkerLoop(const size_t id);
+
+  /**
+   * Get next directory to scan: from the back of own deque or from the front
+   * of another worker's deque.
+   *
+   * @param id Index of the worker in workers_.
+   * @param dir Where to store the directory.
+   *
+   * @return true if a directory was found, false otherwise.
+   */
+  bool PopDir(const size_t id, std::string *dir);
+
+  /**
+   * Put a directory in the worker's deque and wake up an idle worker.
+   *
+   * @param id Index of the worker in workers_.
+   * @param dir Name of the directory.
+   */
+  void PushDir(const size_t id, const std::string &dir);
+
+  /**
+   * Read one directory, queue its subdirectories and hand out its files.
+   *
+   * @param id Index of the worker in workers_.
+   * @param dir URL of the directory.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int ScanDir(const size_t id, const std::string &dir);
+
+  /**
+   * The workers.
+   */
+  std::vector<Worker *> workers_;
+
+  /**
+   * Function to call for every read directory.
+   */
+  FileHandler handler_;
+
+  /**
+   * Function to filter subdirectories, may be empty.
+   */
+  DirFilter filter_;
+
+  /**
+   * Function to create backends of the workers.
+   */
+  CrawlBackend::Factory factory_;
+
+  /**
+   * Whether to get size and modification time of found files.
+   */
+  const bool stat_files_;
+
+  /**
+   * Directories which are queued or being scanned right now. The scan is
+   * finished when it drops to zero.
+   */
+  std::atomic<long> pending_;
+
+  /**
+   * Directories which are queued in deques.
+   */
+  std::atomic<long> queued_;
+
+  /**
+   * Directories which could not be scanned during current Scan().
+   */
+  std::atomic<long> failed_;
+
+  /**
+   * Cancel flag of current Scan(), may be NULL.
+   */
+  const std::atomic<bool> *cancel_;
+
+  /**
+   * Reading of a directory which takes longer is logged, microseconds.
+   */
+  int64_t slow_dir_usec_;
+
+  /**
+   * Directories read during current Scan().
+   */
+  std::atomic<size_t> dirs_;
+
+  /**
+   * Entries returned by backends during current Scan().
+   */
+  std::atomic<size_t> entries_;
+
+  /**
+   * getdents calls made during current Scan().
+   */
+  std::atomic<size_t> calls_;
+
+  /**
+   * Time spent reading directories during current Scan(), summed over
+   * workers, microseconds.
+   */
+  std::atomic<int64_t> usec_;
+
+  /**
+   * Guards idle_cv_ and done_cv_.
+   */
+  std::mutex idle_mutex_;
+
+  /**
+   * Idle workers wait here for new directories.
+   */
+  std::condition_variable idle_cv_;
+
+  /**
+   * Scan() waits here for pending_ to drop to zero.
+   */
+  std::condition_variable done_cv_;
+
+  /**
+   * Set when workers should exit.
+   */
+  bool stop_;
+
+  /**
+   * Set when the constructor has started all workers.
+   */
+  bool ready_;
+
+  /**
+   * Last occured error.
+   */
+  std::atomic<int> error_;
+
+  DISALLOW_COPY_AND_ASSIGN(Crawler);
+};
+
+#endif  // SPIDER_CRAWLER_H_
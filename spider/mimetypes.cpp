@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ctype.h>
+#include <string.h>
+
+#include <string>
+
+#include "spider/mimetypes.h"
+
+// Every extension becomes a case label, so the compiler rejects the table if
+// two extensions have the same hash, i.e. the hash is perfect on the table.
+// The extension itself is still compared because unknown ones may collide
+// with known.
+#define MIME_EXTENSION(ext, type) \
+  case ExtensionHash(ext): return strcmp(extension, ext) ? NULL : type
+
+/**
+ * Look up the table.
+ *
+ * @param extension Extension in lower case.
+ *
+ * @return MIME type on success, NULL otherwise.
+ */
+static const char *LookupExtension(const char *extension) {
+  switch (ExtensionHash(extension)) {
+    // Documents.
+    MIME_EXTENSION("pdf", "application/pdf");
+    MIME_EXTENSION("djvu", "image/vnd.djvu");
+    MIME_EXTENSION("ps", "application/postscript");
+    MIME_EXTENSION("rtf", "text/rtf");
+    MIME_EXTENSION("doc", "application/msword");
+    MIME_EXTENSION("xls", "application/vnd.ms-excel");
+    MIME_EXTENSION("ppt", "application/vnd.ms-powerpoint");
+    MIME_EXTENSION("docx", "application/vnd.openxmlformats-officedocument."
+                           "wordprocessingml.document");
+    MIME_EXTENSION("xlsx", "application/vnd.openxmlformats-officedocument."
+                           "spreadsheetml.sheet");
+    MIME_EXTENSION("pptx", "application/vnd.openxmlformats-officedocument."
+                           "presentationml.presentation");
+    MIME_EXTENSION("odt", "application/vnd.oasis.opendocument.text");
+    MIME_EXTENSION("ods", "application/vnd.oasis.opendocument.spreadsheet");
+    MIME_EXTENSION("odp", "application/vnd.oasis.opendocument.presentation");
+    MIME_EXTENSION("fb2", "text/xml");
+    MIME_EXTENSION("html", "text/html");
+    MIME_EXTENSION("htm", "text/html");
+    MIME_EXTENSION("tex", "text/x-tex");
+
+    // Images.
+    MIME_EXTENSION("jpg", "image/jpeg");
+    MIME_EXTENSION("jpeg", "image/jpeg");
+    MIME_EXTENSION("png", "image/png");
+    MIME_EXTENSION("gif", "image/gif");
+    MIME_EXTENSION("bmp", "image/x-ms-bmp");
+    MIME_EXTENSION("tif", "image/tiff");
+    MIME_EXTENSION("tiff", "image/tiff");
+    MIME_EXTENSION("svg", "image/svg+xml");
+    MIME_EXTENSION("psd", "image/vnd.adobe.photoshop");
+
+    // Audio.
+    MIME_EXTENSION("mp3", "audio/mpeg");
+    MIME_EXTENSION("flac", "audio/x-flac");
+    MIME_EXTENSION("wav", "audio/x-wav");
+    MIME_EXTENSION("ogg", "audio/ogg");
+    MIME_EXTENSION("wma", "video/x-ms-asf");
+    MIME_EXTENSION("ape", "audio/x-ape");
+
+    // Video.
+    MIME_EXTENSION("avi", "video/x-msvideo");
+    MIME_EXTENSION("mkv", "video/x-matroska");
+    MIME_EXTENSION("mp4", "video/mp4");
+    MIME_EXTENSION("m4v", "video/mp4");
+    MIME_EXTENSION("mpg", "video/mpeg");
+    MIME_EXTENSION("mpeg", "video/mpeg");
+    MIME_EXTENSION("wmv", "video/x-ms-asf");
+    MIME_EXTENSION("flv", "video/x-flv");
+    MIME_EXTENSION("mov", "video/quicktime");
+    MIME_EXTENSION("vob", "video/mpeg");
+
+    // Archives and disk images.
+    MIME_EXTENSION("zip", "application/zip");
+    MIME_EXTENSION("rar", "application/x-rar");
+    MIME_EXTENSION("7z", "application/x-7z-compressed");
+    MIME_EXTENSION("gz", "application/gzip");
+    MIME_EXTENSION("tgz", "application/gzip");
+    MIME_EXTENSION("bz2", "application/x-bzip2");
+    MIME_EXTENSION("xz", "application/x-xz");
+    MIME_EXTENSION("tar", "application/x-tar");
+    MIME_EXTENSION("iso", "application/x-iso9660-image");
+
+    // Executables.
+    MIME_EXTENSION("exe", "application/x-dosexec");
+    MIME_EXTENSION("dll", "application/x-dosexec");
+    MIME_EXTENSION("msi", "application/x-msi");
+
+    default:
+      return NULL;
+  }
+}
+
+#undef MIME_EXTENSION
+
+const char *MimeTypeByExtension(const std::string &path) {
+  size_t dot = path.rfind('.');
+  size_t slash = path.rfind('/');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash))
+    return NULL;  // No extension.
+
+  size_t length = path.size() - dot - 1;
+  if (length == 0 || length > MIME_EXTENSION_MAX)
+    return NULL;  // Too long to be in the table.
+
+  char extension[MIME_EXTENSION_MAX + 1];
+  for (size_t i = 0; i < length; ++i)
+    extension[i] = tolower(static_cast<unsigned char>(path[dot + 1 + i]));
+  extension[length] = '\0';
+
+  return LookupExtension(extension);
+}
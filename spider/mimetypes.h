@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_MIMETYPES_H_
+#define SPIDER_MIMETYPES_H_
+
+#include <stdint.h>
+
+#include <string>
+
+/**
+ * Maximum length of an extension which can be found in the table.
+ */
+#define MIME_EXTENSION_MAX 8
+
+/**
+ * FNV-1a hash of a null terminated string, can be computed at compile time.
+ *
+ * @param str String to be hashed.
+ * @param hash Hash of the previous characters.
+ *
+ * @return Hash of the string.
+ */
+constexpr uint32_t ExtensionHash(const char *str,
+                                 const uint32_t hash = 2166136261u) {
+  return *str ? ExtensionHash(str + 1, (hash ^ static_cast<uint8_t>(*str)) *
+                                       16777619u)
+              : hash;
+}
+
+/**
+ * Find MIME type of a file by its extension without reading the file.
+ *
+ * Only extensions which unambiguously define the content are known, for
+ * others the file header should be checked.
+ *
+ * @param path Name of or path to the file.
+ *
+ * @return MIME type on success, NULL if the extension is unknown.
+ */
+const char *MimeTypeByExtension(const std::string &path);
+
+#endif  // SPIDER_MIMETYPES_H_
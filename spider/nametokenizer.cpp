@@ -0,0 +1,1329 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "spider/nametokenizer.h"
+
+/**
+ * Classes of characters which drive splitting.
+ */
+enum CharClass {
+  kSeparator = 0,
+  kLower,
+  kUpper,
+  kDigit,
+  kLetter  // Letter without case.
+};
+
+/**
+ * Latin transliterations of lower case Cyrillic letters from U+0430 to
+ * U+045F.
+ */
+static const char *kCyrillicLatin[] = {
+  "a", "b", "v", "g", "d", "e", "zh", "z", "i", "y", "k", "l", "m", "n",
+  "o", "p", "r", "s", "t", "u", "f", "kh", "ts", "ch", "sh", "shch", "",
+  "y", "", "e", "yu", "ya",
+  "e", "e", "dj", "g", "ye", "dz", "i", "yi", "j", "lj", "nj", "c", "k",
+  "i", "u", "dz"
+};
+
+/**
+ * Latin transliterations of lower case Latin-1 letters from U+00DF to
+ * U+00FF.
+ */
+static const char *kLatin1Latin[] = {
+  "ss", "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i",
+  "i", "i", "i", "d", "n", "o", "o", "o", "o", "o", "", "o", "u", "u", "u",
+  "u", "y", "th", "y"
+};
+
+/**
+ * Ranges of letters which go in pairs of upper and lower case, the upper
+ * case letter is the first one of a pair.
+ */
+static const struct {
+  uint32_t first;
+  uint32_t last;
+} kCasePairs[] = {
+  {0x100, 0x12f}, {0x132, 0x137}, {0x139, 0x148}, {0x14a, 0x177},
+  {0x179, 0x17e}, {0x182, 0x185}, {0x1a0, 0x1a5}, {0x1b3, 0x1b6},
+  {0x1cd, 0x1dc}, {0x1de, 0x1ef}, {0x1f8, 0x21f}, {0x222, 0x233},
+  {0x246, 0x24f}, {0x370, 0x373}, {0x3d8, 0x3ef}, {0x460, 0x481},
+  {0x48a, 0x4bf}, {0x4c1, 0x4ce}, {0x4d0, 0x52f}, {0x1e00, 0x1e95},
+  {0x1ea0, 0x1eff}
+};
+
+/**
+ * Canonical compositions of a letter and a combining mark from U+0300 to
+ * U+036F into a letter below U+2000, generated from Unicode 14.0 data.
+ * Sorted by composed letters.
+ */
+static const struct Composition {
+  uint16_t composed;
+  uint16_t letter;
+  uint8_t mark;  // Offset from U+0300.
+} kCompositions[] = {
+  {0xc0, 0x41, 0x0}, {0xc1, 0x41, 0x1}, {0xc2, 0x41, 0x2}, {0xc3, 0x41, 0x3},
+  {0xc4, 0x41, 0x8}, {0xc5, 0x41, 0xa}, {0xc7, 0x43, 0x27}, {0xc8, 0x45, 0x0},
+  {0xc9, 0x45, 0x1}, {0xca, 0x45, 0x2}, {0xcb, 0x45, 0x8}, {0xcc, 0x49, 0x0},
+  {0xcd, 0x49, 0x1}, {0xce, 0x49, 0x2}, {0xcf, 0x49, 0x8}, {0xd1, 0x4e, 0x3},
+  {0xd2, 0x4f, 0x0}, {0xd3, 0x4f, 0x1}, {0xd4, 0x4f, 0x2}, {0xd5, 0x4f, 0x3},
+  {0xd6, 0x4f, 0x8}, {0xd9, 0x55, 0x0}, {0xda, 0x55, 0x1}, {0xdb, 0x55, 0x2},
+  {0xdc, 0x55, 0x8}, {0xdd, 0x59, 0x1}, {0xe0, 0x61, 0x0}, {0xe1, 0x61, 0x1},
+  {0xe2, 0x61, 0x2}, {0xe3, 0x61, 0x3}, {0xe4, 0x61, 0x8}, {0xe5, 0x61, 0xa},
+  {0xe7, 0x63, 0x27}, {0xe8, 0x65, 0x0}, {0xe9, 0x65, 0x1}, {0xea, 0x65, 0x2},
+  {0xeb, 0x65, 0x8}, {0xec, 0x69, 0x0}, {0xed, 0x69, 0x1}, {0xee, 0x69, 0x2},
+  {0xef, 0x69, 0x8}, {0xf1, 0x6e, 0x3}, {0xf2, 0x6f, 0x0}, {0xf3, 0x6f, 0x1},
+  {0xf4, 0x6f, 0x2}, {0xf5, 0x6f, 0x3}, {0xf6, 0x6f, 0x8}, {0xf9, 0x75, 0x0},
+  {0xfa, 0x75, 0x1}, {0xfb, 0x75, 0x2}, {0xfc, 0x75, 0x8}, {0xfd, 0x79, 0x1},
+  {0xff, 0x79, 0x8}, {0x100, 0x41, 0x4}, {0x101, 0x61, 0x4},
+  {0x102, 0x41, 0x6}, {0x103, 0x61, 0x6}, {0x104, 0x41, 0x28},
+  {0x105, 0x61, 0x28}, {0x106, 0x43, 0x1}, {0x107, 0x63, 0x1},
+  {0x108, 0x43, 0x2}, {0x109, 0x63, 0x2}, {0x10a, 0x43, 0x7},
+  {0x10b, 0x63, 0x7}, {0x10c, 0x43, 0xc}, {0x10d, 0x63, 0xc},
+  {0x10e, 0x44, 0xc}, {0x10f, 0x64, 0xc}, {0x112, 0x45, 0x4},
+  {0x113, 0x65, 0x4}, {0x114, 0x45, 0x6}, {0x115, 0x65, 0x6},
+  {0x116, 0x45, 0x7}, {0x117, 0x65, 0x7}, {0x118, 0x45, 0x28},
+  {0x119, 0x65, 0x28}, {0x11a, 0x45, 0xc}, {0x11b, 0x65, 0xc},
+  {0x11c, 0x47, 0x2}, {0x11d, 0x67, 0x2}, {0x11e, 0x47, 0x6},
+  {0x11f, 0x67, 0x6}, {0x120, 0x47, 0x7}, {0x121, 0x67, 0x7},
+  {0x122, 0x47, 0x27}, {0x123, 0x67, 0x27}, {0x124, 0x48, 0x2},
+  {0x125, 0x68, 0x2}, {0x128, 0x49, 0x3}, {0x129, 0x69, 0x3},
+  {0x12a, 0x49, 0x4}, {0x12b, 0x69, 0x4}, {0x12c, 0x49, 0x6},
+  {0x12d, 0x69, 0x6}, {0x12e, 0x49, 0x28}, {0x12f, 0x69, 0x28},
+  {0x130, 0x49, 0x7}, {0x134, 0x4a, 0x2}, {0x135, 0x6a, 0x2},
+  {0x136, 0x4b, 0x27}, {0x137, 0x6b, 0x27}, {0x139, 0x4c, 0x1},
+  {0x13a, 0x6c, 0x1}, {0x13b, 0x4c, 0x27}, {0x13c, 0x6c, 0x27},
+  {0x13d, 0x4c, 0xc}, {0x13e, 0x6c, 0xc}, {0x143, 0x4e, 0x1},
+  {0x144, 0x6e, 0x1}, {0x145, 0x4e, 0x27}, {0x146, 0x6e, 0x27},
+  {0x147, 0x4e, 0xc}, {0x148, 0x6e, 0xc}, {0x14c, 0x4f, 0x4},
+  {0x14d, 0x6f, 0x4}, {0x14e, 0x4f, 0x6}, {0x14f, 0x6f, 0x6},
+  {0x150, 0x4f, 0xb}, {0x151, 0x6f, 0xb}, {0x154, 0x52, 0x1},
+  {0x155, 0x72, 0x1}, {0x156, 0x52, 0x27}, {0x157, 0x72, 0x27},
+  {0x158, 0x52, 0xc}, {0x159, 0x72, 0xc}, {0x15a, 0x53, 0x1},
+  {0x15b, 0x73, 0x1}, {0x15c, 0x53, 0x2}, {0x15d, 0x73, 0x2},
+  {0x15e, 0x53, 0x27}, {0x15f, 0x73, 0x27}, {0x160, 0x53, 0xc},
+  {0x161, 0x73, 0xc}, {0x162, 0x54, 0x27}, {0x163, 0x74, 0x27},
+  {0x164, 0x54, 0xc}, {0x165, 0x74, 0xc}, {0x168, 0x55, 0x3},
+  {0x169, 0x75, 0x3}, {0x16a, 0x55, 0x4}, {0x16b, 0x75, 0x4},
+  {0x16c, 0x55, 0x6}, {0x16d, 0x75, 0x6}, {0x16e, 0x55, 0xa},
+  {0x16f, 0x75, 0xa}, {0x170, 0x55, 0xb}, {0x171, 0x75, 0xb},
+  {0x172, 0x55, 0x28}, {0x173, 0x75, 0x28}, {0x174, 0x57, 0x2},
+  {0x175, 0x77, 0x2}, {0x176, 0x59, 0x2}, {0x177, 0x79, 0x2},
+  {0x178, 0x59, 0x8}, {0x179, 0x5a, 0x1}, {0x17a, 0x7a, 0x1},
+  {0x17b, 0x5a, 0x7}, {0x17c, 0x7a, 0x7}, {0x17d, 0x5a, 0xc},
+  {0x17e, 0x7a, 0xc}, {0x1a0, 0x4f, 0x1b}, {0x1a1, 0x6f, 0x1b},
+  {0x1af, 0x55, 0x1b}, {0x1b0, 0x75, 0x1b}, {0x1cd, 0x41, 0xc},
+  {0x1ce, 0x61, 0xc}, {0x1cf, 0x49, 0xc}, {0x1d0, 0x69, 0xc},
+  {0x1d1, 0x4f, 0xc}, {0x1d2, 0x6f, 0xc}, {0x1d3, 0x55, 0xc},
+  {0x1d4, 0x75, 0xc}, {0x1d5, 0xdc, 0x4}, {0x1d6, 0xfc, 0x4},
+  {0x1d7, 0xdc, 0x1}, {0x1d8, 0xfc, 0x1}, {0x1d9, 0xdc, 0xc},
+  {0x1da, 0xfc, 0xc}, {0x1db, 0xdc, 0x0}, {0x1dc, 0xfc, 0x0},
+  {0x1de, 0xc4, 0x4}, {0x1df, 0xe4, 0x4}, {0x1e0, 0x226, 0x4},
+  {0x1e1, 0x227, 0x4}, {0x1e2, 0xc6, 0x4}, {0x1e3, 0xe6, 0x4},
+  {0x1e6, 0x47, 0xc}, {0x1e7, 0x67, 0xc}, {0x1e8, 0x4b, 0xc},
+  {0x1e9, 0x6b, 0xc}, {0x1ea, 0x4f, 0x28}, {0x1eb, 0x6f, 0x28},
+  {0x1ec, 0x1ea, 0x4}, {0x1ed, 0x1eb, 0x4}, {0x1ee, 0x1b7, 0xc},
+  {0x1ef, 0x292, 0xc}, {0x1f0, 0x6a, 0xc}, {0x1f4, 0x47, 0x1},
+  {0x1f5, 0x67, 0x1}, {0x1f8, 0x4e, 0x0}, {0x1f9, 0x6e, 0x0},
+  {0x1fa, 0xc5, 0x1}, {0x1fb, 0xe5, 0x1}, {0x1fc, 0xc6, 0x1},
+  {0x1fd, 0xe6, 0x1}, {0x1fe, 0xd8, 0x1}, {0x1ff, 0xf8, 0x1},
+  {0x200, 0x41, 0xf}, {0x201, 0x61, 0xf}, {0x202, 0x41, 0x11},
+  {0x203, 0x61, 0x11}, {0x204, 0x45, 0xf}, {0x205, 0x65, 0xf},
+  {0x206, 0x45, 0x11}, {0x207, 0x65, 0x11}, {0x208, 0x49, 0xf},
+  {0x209, 0x69, 0xf}, {0x20a, 0x49, 0x11}, {0x20b, 0x69, 0x11},
+  {0x20c, 0x4f, 0xf}, {0x20d, 0x6f, 0xf}, {0x20e, 0x4f, 0x11},
+  {0x20f, 0x6f, 0x11}, {0x210, 0x52, 0xf}, {0x211, 0x72, 0xf},
+  {0x212, 0x52, 0x11}, {0x213, 0x72, 0x11}, {0x214, 0x55, 0xf},
+  {0x215, 0x75, 0xf}, {0x216, 0x55, 0x11}, {0x217, 0x75, 0x11},
+  {0x218, 0x53, 0x26}, {0x219, 0x73, 0x26}, {0x21a, 0x54, 0x26},
+  {0x21b, 0x74, 0x26}, {0x21e, 0x48, 0xc}, {0x21f, 0x68, 0xc},
+  {0x226, 0x41, 0x7}, {0x227, 0x61, 0x7}, {0x228, 0x45, 0x27},
+  {0x229, 0x65, 0x27}, {0x22a, 0xd6, 0x4}, {0x22b, 0xf6, 0x4},
+  {0x22c, 0xd5, 0x4}, {0x22d, 0xf5, 0x4}, {0x22e, 0x4f, 0x7},
+  {0x22f, 0x6f, 0x7}, {0x230, 0x22e, 0x4}, {0x231, 0x22f, 0x4},
+  {0x232, 0x59, 0x4}, {0x233, 0x79, 0x4}, {0x385, 0xa8, 0x1},
+  {0x386, 0x391, 0x1}, {0x388, 0x395, 0x1}, {0x389, 0x397, 0x1},
+  {0x38a, 0x399, 0x1}, {0x38c, 0x39f, 0x1}, {0x38e, 0x3a5, 0x1},
+  {0x38f, 0x3a9, 0x1}, {0x390, 0x3ca, 0x1}, {0x3aa, 0x399, 0x8},
+  {0x3ab, 0x3a5, 0x8}, {0x3ac, 0x3b1, 0x1}, {0x3ad, 0x3b5, 0x1},
+  {0x3ae, 0x3b7, 0x1}, {0x3af, 0x3b9, 0x1}, {0x3b0, 0x3cb, 0x1},
+  {0x3ca, 0x3b9, 0x8}, {0x3cb, 0x3c5, 0x8}, {0x3cc, 0x3bf, 0x1},
+  {0x3cd, 0x3c5, 0x1}, {0x3ce, 0x3c9, 0x1}, {0x3d3, 0x3d2, 0x1},
+  {0x3d4, 0x3d2, 0x8}, {0x400, 0x415, 0x0}, {0x401, 0x415, 0x8},
+  {0x403, 0x413, 0x1}, {0x407, 0x406, 0x8}, {0x40c, 0x41a, 0x1},
+  {0x40d, 0x418, 0x0}, {0x40e, 0x423, 0x6}, {0x419, 0x418, 0x6},
+  {0x439, 0x438, 0x6}, {0x450, 0x435, 0x0}, {0x451, 0x435, 0x8},
+  {0x453, 0x433, 0x1}, {0x457, 0x456, 0x8}, {0x45c, 0x43a, 0x1},
+  {0x45d, 0x438, 0x0}, {0x45e, 0x443, 0x6}, {0x476, 0x474, 0xf},
+  {0x477, 0x475, 0xf}, {0x4c1, 0x416, 0x6}, {0x4c2, 0x436, 0x6},
+  {0x4d0, 0x410, 0x6}, {0x4d1, 0x430, 0x6}, {0x4d2, 0x410, 0x8},
+  {0x4d3, 0x430, 0x8}, {0x4d6, 0x415, 0x6}, {0x4d7, 0x435, 0x6},
+  {0x4da, 0x4d8, 0x8}, {0x4db, 0x4d9, 0x8}, {0x4dc, 0x416, 0x8},
+  {0x4dd, 0x436, 0x8}, {0x4de, 0x417, 0x8}, {0x4df, 0x437, 0x8},
+  {0x4e2, 0x418, 0x4}, {0x4e3, 0x438, 0x4}, {0x4e4, 0x418, 0x8},
+  {0x4e5, 0x438, 0x8}, {0x4e6, 0x41e, 0x8}, {0x4e7, 0x43e, 0x8},
+  {0x4ea, 0x4e8, 0x8}, {0x4eb, 0x4e9, 0x8}, {0x4ec, 0x42d, 0x8},
+  {0x4ed, 0x44d, 0x8}, {0x4ee, 0x423, 0x4}, {0x4ef, 0x443, 0x4},
+  {0x4f0, 0x423, 0x8}, {0x4f1, 0x443, 0x8}, {0x4f2, 0x423, 0xb},
+  {0x4f3, 0x443, 0xb}, {0x4f4, 0x427, 0x8}, {0x4f5, 0x447, 0x8},
+  {0x4f8, 0x42b, 0x8}, {0x4f9, 0x44b, 0x8}, {0x1e00, 0x41, 0x25},
+  {0x1e01, 0x61, 0x25}, {0x1e02, 0x42, 0x7}, {0x1e03, 0x62, 0x7},
+  {0x1e04, 0x42, 0x23}, {0x1e05, 0x62, 0x23}, {0x1e06, 0x42, 0x31},
+  {0x1e07, 0x62, 0x31}, {0x1e08, 0xc7, 0x1}, {0x1e09, 0xe7, 0x1},
+  {0x1e0a, 0x44, 0x7}, {0x1e0b, 0x64, 0x7}, {0x1e0c, 0x44, 0x23},
+  {0x1e0d, 0x64, 0x23}, {0x1e0e, 0x44, 0x31}, {0x1e0f, 0x64, 0x31},
+  {0x1e10, 0x44, 0x27}, {0x1e11, 0x64, 0x27}, {0x1e12, 0x44, 0x2d},
+  {0x1e13, 0x64, 0x2d}, {0x1e14, 0x112, 0x0}, {0x1e15, 0x113, 0x0},
+  {0x1e16, 0x112, 0x1}, {0x1e17, 0x113, 0x1}, {0x1e18, 0x45, 0x2d},
+  {0x1e19, 0x65, 0x2d}, {0x1e1a, 0x45, 0x30}, {0x1e1b, 0x65, 0x30},
+  {0x1e1c, 0x228, 0x6}, {0x1e1d, 0x229, 0x6}, {0x1e1e, 0x46, 0x7},
+  {0x1e1f, 0x66, 0x7}, {0x1e20, 0x47, 0x4}, {0x1e21, 0x67, 0x4},
+  {0x1e22, 0x48, 0x7}, {0x1e23, 0x68, 0x7}, {0x1e24, 0x48, 0x23},
+  {0x1e25, 0x68, 0x23}, {0x1e26, 0x48, 0x8}, {0x1e27, 0x68, 0x8},
+  {0x1e28, 0x48, 0x27}, {0x1e29, 0x68, 0x27}, {0x1e2a, 0x48, 0x2e},
+  {0x1e2b, 0x68, 0x2e}, {0x1e2c, 0x49, 0x30}, {0x1e2d, 0x69, 0x30},
+  {0x1e2e, 0xcf, 0x1}, {0x1e2f, 0xef, 0x1}, {0x1e30, 0x4b, 0x1},
+  {0x1e31, 0x6b, 0x1}, {0x1e32, 0x4b, 0x23}, {0x1e33, 0x6b, 0x23},
+  {0x1e34, 0x4b, 0x31}, {0x1e35, 0x6b, 0x31}, {0x1e36, 0x4c, 0x23},
+  {0x1e37, 0x6c, 0x23}, {0x1e38, 0x1e36, 0x4}, {0x1e39, 0x1e37, 0x4},
+  {0x1e3a, 0x4c, 0x31}, {0x1e3b, 0x6c, 0x31}, {0x1e3c, 0x4c, 0x2d},
+  {0x1e3d, 0x6c, 0x2d}, {0x1e3e, 0x4d, 0x1}, {0x1e3f, 0x6d, 0x1},
+  {0x1e40, 0x4d, 0x7}, {0x1e41, 0x6d, 0x7}, {0x1e42, 0x4d, 0x23},
+  {0x1e43, 0x6d, 0x23}, {0x1e44, 0x4e, 0x7}, {0x1e45, 0x6e, 0x7},
+  {0x1e46, 0x4e, 0x23}, {0x1e47, 0x6e, 0x23}, {0x1e48, 0x4e, 0x31},
+  {0x1e49, 0x6e, 0x31}, {0x1e4a, 0x4e, 0x2d}, {0x1e4b, 0x6e, 0x2d},
+  {0x1e4c, 0xd5, 0x1}, {0x1e4d, 0xf5, 0x1}, {0x1e4e, 0xd5, 0x8},
+  {0x1e4f, 0xf5, 0x8}, {0x1e50, 0x14c, 0x0}, {0x1e51, 0x14d, 0x0},
+  {0x1e52, 0x14c, 0x1}, {0x1e53, 0x14d, 0x1}, {0x1e54, 0x50, 0x1},
+  {0x1e55, 0x70, 0x1}, {0x1e56, 0x50, 0x7}, {0x1e57, 0x70, 0x7},
+  {0x1e58, 0x52, 0x7}, {0x1e59, 0x72, 0x7}, {0x1e5a, 0x52, 0x23},
+  {0x1e5b, 0x72, 0x23}, {0x1e5c, 0x1e5a, 0x4}, {0x1e5d, 0x1e5b, 0x4},
+  {0x1e5e, 0x52, 0x31}, {0x1e5f, 0x72, 0x31}, {0x1e60, 0x53, 0x7},
+  {0x1e61, 0x73, 0x7}, {0x1e62, 0x53, 0x23}, {0x1e63, 0x73, 0x23},
+  {0x1e64, 0x15a, 0x7}, {0x1e65, 0x15b, 0x7}, {0x1e66, 0x160, 0x7},
+  {0x1e67, 0x161, 0x7}, {0x1e68, 0x1e62, 0x7}, {0x1e69, 0x1e63, 0x7},
+  {0x1e6a, 0x54, 0x7}, {0x1e6b, 0x74, 0x7}, {0x1e6c, 0x54, 0x23},
+  {0x1e6d, 0x74, 0x23}, {0x1e6e, 0x54, 0x31}, {0x1e6f, 0x74, 0x31},
+  {0x1e70, 0x54, 0x2d}, {0x1e71, 0x74, 0x2d}, {0x1e72, 0x55, 0x24},
+  {0x1e73, 0x75, 0x24}, {0x1e74, 0x55, 0x30}, {0x1e75, 0x75, 0x30},
+  {0x1e76, 0x55, 0x2d}, {0x1e77, 0x75, 0x2d}, {0x1e78, 0x168, 0x1},
+  {0x1e79, 0x169, 0x1}, {0x1e7a, 0x16a, 0x8}, {0x1e7b, 0x16b, 0x8},
+  {0x1e7c, 0x56, 0x3}, {0x1e7d, 0x76, 0x3}, {0x1e7e, 0x56, 0x23},
+  {0x1e7f, 0x76, 0x23}, {0x1e80, 0x57, 0x0}, {0x1e81, 0x77, 0x0},
+  {0x1e82, 0x57, 0x1}, {0x1e83, 0x77, 0x1}, {0x1e84, 0x57, 0x8},
+  {0x1e85, 0x77, 0x8}, {0x1e86, 0x57, 0x7}, {0x1e87, 0x77, 0x7},
+  {0x1e88, 0x57, 0x23}, {0x1e89, 0x77, 0x23}, {0x1e8a, 0x58, 0x7},
+  {0x1e8b, 0x78, 0x7}, {0x1e8c, 0x58, 0x8}, {0x1e8d, 0x78, 0x8},
+  {0x1e8e, 0x59, 0x7}, {0x1e8f, 0x79, 0x7}, {0x1e90, 0x5a, 0x2},
+  {0x1e91, 0x7a, 0x2}, {0x1e92, 0x5a, 0x23}, {0x1e93, 0x7a, 0x23},
+  {0x1e94, 0x5a, 0x31}, {0x1e95, 0x7a, 0x31}, {0x1e96, 0x68, 0x31},
+  {0x1e97, 0x74, 0x8}, {0x1e98, 0x77, 0xa}, {0x1e99, 0x79, 0xa},
+  {0x1e9b, 0x17f, 0x7}, {0x1ea0, 0x41, 0x23}, {0x1ea1, 0x61, 0x23},
+  {0x1ea2, 0x41, 0x9}, {0x1ea3, 0x61, 0x9}, {0x1ea4, 0xc2, 0x1},
+  {0x1ea5, 0xe2, 0x1}, {0x1ea6, 0xc2, 0x0}, {0x1ea7, 0xe2, 0x0},
+  {0x1ea8, 0xc2, 0x9}, {0x1ea9, 0xe2, 0x9}, {0x1eaa, 0xc2, 0x3},
+  {0x1eab, 0xe2, 0x3}, {0x1eac, 0x1ea0, 0x2}, {0x1ead, 0x1ea1, 0x2},
+  {0x1eae, 0x102, 0x1}, {0x1eaf, 0x103, 0x1}, {0x1eb0, 0x102, 0x0},
+  {0x1eb1, 0x103, 0x0}, {0x1eb2, 0x102, 0x9}, {0x1eb3, 0x103, 0x9},
+  {0x1eb4, 0x102, 0x3}, {0x1eb5, 0x103, 0x3}, {0x1eb6, 0x1ea0, 0x6},
+  {0x1eb7, 0x1ea1, 0x6}, {0x1eb8, 0x45, 0x23}, {0x1eb9, 0x65, 0x23},
+  {0x1eba, 0x45, 0x9}, {0x1ebb, 0x65, 0x9}, {0x1ebc, 0x45, 0x3},
+  {0x1ebd, 0x65, 0x3}, {0x1ebe, 0xca, 0x1}, {0x1ebf, 0xea, 0x1},
+  {0x1ec0, 0xca, 0x0}, {0x1ec1, 0xea, 0x0}, {0x1ec2, 0xca, 0x9},
+  {0x1ec3, 0xea, 0x9}, {0x1ec4, 0xca, 0x3}, {0x1ec5, 0xea, 0x3},
+  {0x1ec6, 0x1eb8, 0x2}, {0x1ec7, 0x1eb9, 0x2}, {0x1ec8, 0x49, 0x9},
+  {0x1ec9, 0x69, 0x9}, {0x1eca, 0x49, 0x23}, {0x1ecb, 0x69, 0x23},
+  {0x1ecc, 0x4f, 0x23}, {0x1ecd, 0x6f, 0x23}, {0x1ece, 0x4f, 0x9},
+  {0x1ecf, 0x6f, 0x9}, {0x1ed0, 0xd4, 0x1}, {0x1ed1, 0xf4, 0x1},
+  {0x1ed2, 0xd4, 0x0}, {0x1ed3, 0xf4, 0x0}, {0x1ed4, 0xd4, 0x9},
+  {0x1ed5, 0xf4, 0x9}, {0x1ed6, 0xd4, 0x3}, {0x1ed7, 0xf4, 0x3},
+  {0x1ed8, 0x1ecc, 0x2}, {0x1ed9, 0x1ecd, 0x2}, {0x1eda, 0x1a0, 0x1},
+  {0x1edb, 0x1a1, 0x1}, {0x1edc, 0x1a0, 0x0}, {0x1edd, 0x1a1, 0x0},
+  {0x1ede, 0x1a0, 0x9}, {0x1edf, 0x1a1, 0x9}, {0x1ee0, 0x1a0, 0x3},
+  {0x1ee1, 0x1a1, 0x3}, {0x1ee2, 0x1a0, 0x23}, {0x1ee3, 0x1a1, 0x23},
+  {0x1ee4, 0x55, 0x23}, {0x1ee5, 0x75, 0x23}, {0x1ee6, 0x55, 0x9},
+  {0x1ee7, 0x75, 0x9}, {0x1ee8, 0x1af, 0x1}, {0x1ee9, 0x1b0, 0x1},
+  {0x1eea, 0x1af, 0x0}, {0x1eeb, 0x1b0, 0x0}, {0x1eec, 0x1af, 0x9},
+  {0x1eed, 0x1b0, 0x9}, {0x1eee, 0x1af, 0x3}, {0x1eef, 0x1b0, 0x3},
+  {0x1ef0, 0x1af, 0x23}, {0x1ef1, 0x1b0, 0x23}, {0x1ef2, 0x59, 0x0},
+  {0x1ef3, 0x79, 0x0}, {0x1ef4, 0x59, 0x23}, {0x1ef5, 0x79, 0x23},
+  {0x1ef6, 0x59, 0x9}, {0x1ef7, 0x79, 0x9}, {0x1ef8, 0x59, 0x3},
+  {0x1ef9, 0x79, 0x3}, {0x1f00, 0x3b1, 0x13}, {0x1f01, 0x3b1, 0x14},
+  {0x1f02, 0x1f00, 0x0}, {0x1f03, 0x1f01, 0x0}, {0x1f04, 0x1f00, 0x1},
+  {0x1f05, 0x1f01, 0x1}, {0x1f06, 0x1f00, 0x42}, {0x1f07, 0x1f01, 0x42},
+  {0x1f08, 0x391, 0x13}, {0x1f09, 0x391, 0x14}, {0x1f0a, 0x1f08, 0x0},
+  {0x1f0b, 0x1f09, 0x0}, {0x1f0c, 0x1f08, 0x1}, {0x1f0d, 0x1f09, 0x1},
+  {0x1f0e, 0x1f08, 0x42}, {0x1f0f, 0x1f09, 0x42}, {0x1f10, 0x3b5, 0x13},
+  {0x1f11, 0x3b5, 0x14}, {0x1f12, 0x1f10, 0x0}, {0x1f13, 0x1f11, 0x0},
+  {0x1f14, 0x1f10, 0x1}, {0x1f15, 0x1f11, 0x1}, {0x1f18, 0x395, 0x13},
+  {0x1f19, 0x395, 0x14}, {0x1f1a, 0x1f18, 0x0}, {0x1f1b, 0x1f19, 0x0},
+  {0x1f1c, 0x1f18, 0x1}, {0x1f1d, 0x1f19, 0x1}, {0x1f20, 0x3b7, 0x13},
+  {0x1f21, 0x3b7, 0x14}, {0x1f22, 0x1f20, 0x0}, {0x1f23, 0x1f21, 0x0},
+  {0x1f24, 0x1f20, 0x1}, {0x1f25, 0x1f21, 0x1}, {0x1f26, 0x1f20, 0x42},
+  {0x1f27, 0x1f21, 0x42}, {0x1f28, 0x397, 0x13}, {0x1f29, 0x397, 0x14},
+  {0x1f2a, 0x1f28, 0x0}, {0x1f2b, 0x1f29, 0x0}, {0x1f2c, 0x1f28, 0x1},
+  {0x1f2d, 0x1f29, 0x1}, {0x1f2e, 0x1f28, 0x42}, {0x1f2f, 0x1f29, 0x42},
+  {0x1f30, 0x3b9, 0x13}, {0x1f31, 0x3b9, 0x14}, {0x1f32, 0x1f30, 0x0},
+  {0x1f33, 0x1f31, 0x0}, {0x1f34, 0x1f30, 0x1}, {0x1f35, 0x1f31, 0x1},
+  {0x1f36, 0x1f30, 0x42}, {0x1f37, 0x1f31, 0x42}, {0x1f38, 0x399, 0x13},
+  {0x1f39, 0x399, 0x14}, {0x1f3a, 0x1f38, 0x0}, {0x1f3b, 0x1f39, 0x0},
+  {0x1f3c, 0x1f38, 0x1}, {0x1f3d, 0x1f39, 0x1}, {0x1f3e, 0x1f38, 0x42},
+  {0x1f3f, 0x1f39, 0x42}, {0x1f40, 0x3bf, 0x13}, {0x1f41, 0x3bf, 0x14},
+  {0x1f42, 0x1f40, 0x0}, {0x1f43, 0x1f41, 0x0}, {0x1f44, 0x1f40, 0x1},
+  {0x1f45, 0x1f41, 0x1}, {0x1f48, 0x39f, 0x13}, {0x1f49, 0x39f, 0x14},
+  {0x1f4a, 0x1f48, 0x0}, {0x1f4b, 0x1f49, 0x0}, {0x1f4c, 0x1f48, 0x1},
+  {0x1f4d, 0x1f49, 0x1}, {0x1f50, 0x3c5, 0x13}, {0x1f51, 0x3c5, 0x14},
+  {0x1f52, 0x1f50, 0x0}, {0x1f53, 0x1f51, 0x0}, {0x1f54, 0x1f50, 0x1},
+  {0x1f55, 0x1f51, 0x1}, {0x1f56, 0x1f50, 0x42}, {0x1f57, 0x1f51, 0x42},
+  {0x1f59, 0x3a5, 0x14}, {0x1f5b, 0x1f59, 0x0}, {0x1f5d, 0x1f59, 0x1},
+  {0x1f5f, 0x1f59, 0x42}, {0x1f60, 0x3c9, 0x13}, {0x1f61, 0x3c9, 0x14},
+  {0x1f62, 0x1f60, 0x0}, {0x1f63, 0x1f61, 0x0}, {0x1f64, 0x1f60, 0x1},
+  {0x1f65, 0x1f61, 0x1}, {0x1f66, 0x1f60, 0x42}, {0x1f67, 0x1f61, 0x42},
+  {0x1f68, 0x3a9, 0x13}, {0x1f69, 0x3a9, 0x14}, {0x1f6a, 0x1f68, 0x0},
+  {0x1f6b, 0x1f69, 0x0}, {0x1f6c, 0x1f68, 0x1}, {0x1f6d, 0x1f69, 0x1},
+  {0x1f6e, 0x1f68, 0x42}, {0x1f6f, 0x1f69, 0x42}, {0x1f70, 0x3b1, 0x0},
+  {0x1f72, 0x3b5, 0x0}, {0x1f74, 0x3b7, 0x0}, {0x1f76, 0x3b9, 0x0},
+  {0x1f78, 0x3bf, 0x0}, {0x1f7a, 0x3c5, 0x0}, {0x1f7c, 0x3c9, 0x0},
+  {0x1f80, 0x1f00, 0x45}, {0x1f81, 0x1f01, 0x45}, {0x1f82, 0x1f02, 0x45},
+  {0x1f83, 0x1f03, 0x45}, {0x1f84, 0x1f04, 0x45}, {0x1f85, 0x1f05, 0x45},
+  {0x1f86, 0x1f06, 0x45}, {0x1f87, 0x1f07, 0x45}, {0x1f88, 0x1f08, 0x45},
+  {0x1f89, 0x1f09, 0x45}, {0x1f8a, 0x1f0a, 0x45}, {0x1f8b, 0x1f0b, 0x45},
+  {0x1f8c, 0x1f0c, 0x45}, {0x1f8d, 0x1f0d, 0x45}, {0x1f8e, 0x1f0e, 0x45},
+  {0x1f8f, 0x1f0f, 0x45}, {0x1f90, 0x1f20, 0x45}, {0x1f91, 0x1f21, 0x45},
+  {0x1f92, 0x1f22, 0x45}, {0x1f93, 0x1f23, 0x45}, {0x1f94, 0x1f24, 0x45},
+  {0x1f95, 0x1f25, 0x45}, {0x1f96, 0x1f26, 0x45}, {0x1f97, 0x1f27, 0x45},
+  {0x1f98, 0x1f28, 0x45}, {0x1f99, 0x1f29, 0x45}, {0x1f9a, 0x1f2a, 0x45},
+  {0x1f9b, 0x1f2b, 0x45}, {0x1f9c, 0x1f2c, 0x45}, {0x1f9d, 0x1f2d, 0x45},
+  {0x1f9e, 0x1f2e, 0x45}, {0x1f9f, 0x1f2f, 0x45}, {0x1fa0, 0x1f60, 0x45},
+  {0x1fa1, 0x1f61, 0x45}, {0x1fa2, 0x1f62, 0x45}, {0x1fa3, 0x1f63, 0x45},
+  {0x1fa4, 0x1f64, 0x45}, {0x1fa5, 0x1f65, 0x45}, {0x1fa6, 0x1f66, 0x45},
+  {0x1fa7, 0x1f67, 0x45}, {0x1fa8, 0x1f68, 0x45}, {0x1fa9, 0x1f69, 0x45},
+  {0x1faa, 0x1f6a, 0x45}, {0x1fab, 0x1f6b, 0x45}, {0x1fac, 0x1f6c, 0x45},
+  {0x1fad, 0x1f6d, 0x45}, {0x1fae, 0x1f6e, 0x45}, {0x1faf, 0x1f6f, 0x45},
+  {0x1fb0, 0x3b1, 0x6}, {0x1fb1, 0x3b1, 0x4}, {0x1fb2, 0x1f70, 0x45},
+  {0x1fb3, 0x3b1, 0x45}, {0x1fb4, 0x3ac, 0x45}, {0x1fb6, 0x3b1, 0x42},
+  {0x1fb7, 0x1fb6, 0x45}, {0x1fb8, 0x391, 0x6}, {0x1fb9, 0x391, 0x4},
+  {0x1fba, 0x391, 0x0}, {0x1fbc, 0x391, 0x45}, {0x1fc1, 0xa8, 0x42},
+  {0x1fc2, 0x1f74, 0x45}, {0x1fc3, 0x3b7, 0x45}, {0x1fc4, 0x3ae, 0x45},
+  {0x1fc6, 0x3b7, 0x42}, {0x1fc7, 0x1fc6, 0x45}, {0x1fc8, 0x395, 0x0},
+  {0x1fca, 0x397, 0x0}, {0x1fcc, 0x397, 0x45}, {0x1fcd, 0x1fbf, 0x0},
+  {0x1fce, 0x1fbf, 0x1}, {0x1fcf, 0x1fbf, 0x42}, {0x1fd0, 0x3b9, 0x6},
+  {0x1fd1, 0x3b9, 0x4}, {0x1fd2, 0x3ca, 0x0}, {0x1fd6, 0x3b9, 0x42},
+  {0x1fd7, 0x3ca, 0x42}, {0x1fd8, 0x399, 0x6}, {0x1fd9, 0x399, 0x4},
+  {0x1fda, 0x399, 0x0}, {0x1fdd, 0x1ffe, 0x0}, {0x1fde, 0x1ffe, 0x1},
+  {0x1fdf, 0x1ffe, 0x42}, {0x1fe0, 0x3c5, 0x6}, {0x1fe1, 0x3c5, 0x4},
+  {0x1fe2, 0x3cb, 0x0}, {0x1fe4, 0x3c1, 0x13}, {0x1fe5, 0x3c1, 0x14},
+  {0x1fe6, 0x3c5, 0x42}, {0x1fe7, 0x3cb, 0x42}, {0x1fe8, 0x3a5, 0x6},
+  {0x1fe9, 0x3a5, 0x4}, {0x1fea, 0x3a5, 0x0}, {0x1fec, 0x3a1, 0x14},
+  {0x1fed, 0xa8, 0x0}, {0x1ff2, 0x1f7c, 0x45}, {0x1ff3, 0x3c9, 0x45},
+  {0x1ff4, 0x3ce, 0x45}, {0x1ff6, 0x3c9, 0x42}, {0x1ff7, 0x1ff6, 0x45},
+  {0x1ff8, 0x39f, 0x0}, {0x1ffa, 0x3a9, 0x0}, {0x1ffc, 0x3a9, 0x45}
+};
+
+static const size_t kCompositionCount =
+    sizeof(kCompositions) / sizeof(kCompositions[0]);
+
+/**
+ * Canonical combining classes of marks from U+0300 to U+036F.
+ */
+static const uint8_t kCombiningClass[] = {
+  230, 230, 230, 230, 230, 230, 230, 230, 230, 230, 230, 230, 230, 230, 230,
+  230, 230, 230, 230, 230, 230, 232, 220, 220, 220, 220, 232, 216, 220, 220,
+  220, 220, 220, 202, 202, 220, 220, 220, 220, 202, 202, 220, 220, 220, 220,
+  220, 220, 220, 220, 220, 220, 220, 1, 1, 1, 1, 1, 220, 220, 220, 220, 230,
+  230, 230, 230, 230, 230, 230, 230, 240, 230, 220, 220, 220, 230, 230, 230,
+  220, 220, 0, 230, 230, 230, 220, 220, 220, 220, 230, 232, 220, 220, 230, 233,
+  234, 234, 233, 234, 234, 233, 230, 230, 230, 230, 230, 230, 230, 230, 230,
+  230, 230, 230, 230
+};
+
+/**
+ * Maximum number of marks composed with one letter, the rest are dropped.
+ */
+static const size_t kMaxMarks = 8;
+
+/**
+ * Transliteration length of letters which have none.
+ */
+static const uint8_t kNoLatin = 0xff;
+
+/**
+ * Characters below it are described by kChars, the rest are computed.
+ */
+static const uint32_t kTableSize = 0x500;
+
+/**
+ * Everything the tokenizer needs to know about a character.
+ */
+struct CharInfo {
+  /**
+   * Case-folded character.
+   */
+  uint32_t folded;
+
+  /**
+   * One of CharClass.
+   */
+  uint8_t cls;
+
+  /**
+   * Length of latin, kNoLatin if there is no transliteration.
+   */
+  uint8_t latin_length;
+
+  /**
+   * Length of utf8.
+   */
+  uint8_t utf8_length;
+
+  /**
+   * Latin transliteration of the folded character, not terminated.
+   */
+  char latin[4];
+
+  /**
+   * The folded character in UTF-8, not terminated.
+   */
+  char utf8[4];
+};
+
+static inline bool IsMark(const uint32_t c) {
+  return c >= 0x300 && c < 0x370;
+}
+
+/**
+ * Find the pair of upper and lower case letters of the character.
+ *
+ * @return Upper case letter of the pair, 0 if there is none.
+ */
+static uint32_t CasePair(const uint32_t c) {
+  for (const auto &range : kCasePairs) {
+    if (c >= range.first && c <= range.last)
+      return c - ((c - range.first) & 1);
+  }
+  return 0;
+}
+
+static int ClassOf(const uint32_t c) {
+  if (c < 0x80) {
+    if (c >= 'a' && c <= 'z')
+      return kLower;
+    if (c >= 'A' && c <= 'Z')
+      return kUpper;
+    if (c >= '0' && c <= '9')
+      return kDigit;
+    return kSeparator;
+  }
+  if (c < 0xc0)
+    return kSeparator;  // Latin-1 punctuation and no-break space.
+  if (c <= 0xff) {
+    if (c == 0xd7 || c == 0xf7)
+      return kSeparator;  // Multiplication and division signs.
+    return c < 0xdf ? kUpper : kLower;
+  }
+  if (c >= 0x400 && c < 0x430)
+    return kUpper;
+  if (c >= 0x430 && c < 0x460)
+    return kLower;
+  if (c == 0x386 || (c >= 0x388 && c < 0x3ac && c != 0x38b && c != 0x38d &&
+                     c != 0x390 && c != 0x3a2))
+    return kUpper;
+  if (c >= 0x3ac && c < 0x3cf)
+    return kLower;
+  if (c == 0x178)
+    return kUpper;  // Ÿ, its pair ÿ is in Latin-1.
+  uint32_t pair = CasePair(c);
+  if (pair)
+    return c == pair ? kUpper : kLower;
+  if ((c >= 0x2000 && c < 0x2070) || (c >= 0x3000 && c < 0x3040) ||
+      c == 0xfffd)
+    return kSeparator;  // General and CJK punctuation, broken bytes.
+  return kLetter;
+}
+
+static uint32_t Fold(const uint32_t c) {
+  if (c < 0x80)
+    return c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+  if (c >= 0xc0 && c < 0xdf && c != 0xd7)
+    return c + 0x20;
+  if (c < 0x100)
+    return c;
+  if (c >= 0x400 && c < 0x410)
+    return c + 0x50;
+  if (c >= 0x410 && c < 0x430)
+    return c + 0x20;
+  if (c >= 0x391 && c < 0x3ac && c != 0x3a2)
+    return c + 0x20;
+  switch (c) {
+    case 0x130: return 'i';    // İ
+    case 0x178: return 0xff;   // Ÿ
+    case 0x386: return 0x3ac;  // Ά
+    case 0x388: return 0x3ad;  // Έ
+    case 0x389: return 0x3ae;  // Ή
+    case 0x38a: return 0x3af;  // Ί
+    case 0x38c: return 0x3cc;  // Ό
+    case 0x38e: return 0x3cd;  // Ύ
+    case 0x38f: return 0x3ce;  // Ώ
+  }
+  return CasePair(c) == c ? c + 1 : c;
+}
+
+/**
+ * Find how the letter is composed.
+ *
+ * @return Composition or NULL if the letter is not composed.
+ */
+static const Composition *Decompose(const uint32_t c) {
+  const Composition *end = kCompositions + kCompositionCount;
+  const Composition *found = std::lower_bound(
+      kCompositions, end, c,
+      [](const Composition &item, const uint32_t key) {
+        return item.composed < key;
+      });
+  return found != end && found->composed == c ? found : NULL;
+}
+
+/**
+ * Compositions in order of letters and marks.
+ */
+static const struct CompositionOrder {
+  uint16_t of[kCompositionCount];
+
+  CompositionOrder() {
+    for (size_t i = 0; i < kCompositionCount; ++i)
+      of[i] = i;
+    std::sort(of, of + kCompositionCount, [](uint16_t a, uint16_t b) {
+      return Key(kCompositions[a].letter, kCompositions[a].mark) <
+             Key(kCompositions[b].letter, kCompositions[b].mark);
+    });
+  }
+
+  static inline uint32_t Key(const uint32_t letter, const uint32_t mark) {
+    return (letter << 8) | mark;
+  }
+} kCompositionOrder;
+
+/**
+ * Compose a letter with a combining mark.
+ *
+ * @return Precomposed letter, 0 if there is none.
+ */
+static uint32_t Compose(const uint32_t letter, const uint32_t mark) {
+  if (letter >= 0x2000)
+    return 0;
+
+  uint32_t key = CompositionOrder::Key(letter, mark - 0x300);
+  const uint16_t *end = kCompositionOrder.of + kCompositionCount;
+  const uint16_t *found = std::lower_bound(
+      kCompositionOrder.of, end, key, [](uint16_t item, const uint32_t key) {
+        return CompositionOrder::Key(kCompositions[item].letter,
+                                     kCompositions[item].mark) < key;
+      });
+  if (found == end || kCompositions[*found].letter != letter ||
+      kCompositions[*found].mark != mark - 0x300)
+    return 0;
+  return kCompositions[*found].composed;
+}
+
+/**
+ * Get Latin transliteration of a case-folded letter. Composed letters are
+ * transliterated as the letter without marks.
+ *
+ * @param folded The letter.
+ * @param info Where to store the transliteration and its length.
+ *
+ * @return true if the letter has transliteration, false otherwise.
+ */
+static bool LatinOf(const uint32_t folded, CharInfo *info) {
+  const char *latin = NULL;
+  if (folded < 0x80) {
+    info->latin[0] = folded;
+    info->latin_length = 1;
+    return true;
+  } else if (folded >= 0x430 && folded < 0x460) {
+    latin = kCyrillicLatin[folded - 0x430];
+  } else if (folded >= 0xdf && folded <= 0xff) {
+    latin = kLatin1Latin[folded - 0xdf];
+  } else if (folded == 0x491) {
+    latin = "g";
+  } else {
+    const Composition *composition = Decompose(folded);
+    return composition != NULL && LatinOf(Fold(composition->letter), info);
+  }
+
+  info->latin_length = strlen(latin);
+  memcpy(info->latin, latin, info->latin_length);
+  return true;
+}
+
+/**
+ * Encode the character in UTF-8.
+ *
+ * @return Number of written bytes.
+ */
+static inline size_t Encode(const uint32_t c, char *out) {
+  if (c < 0x80) {
+    out[0] = c;
+    return 1;
+  } else if (c < 0x800) {
+    out[0] = 0xc0 | (c >> 6);
+    out[1] = 0x80 | (c & 0x3f);
+    return 2;
+  } else if (c < 0x10000) {
+    out[0] = 0xe0 | (c >> 12);
+    out[1] = 0x80 | ((c >> 6) & 0x3f);
+    out[2] = 0x80 | (c & 0x3f);
+    return 3;
+  }
+  out[0] = 0xf0 | (c >> 18);
+  out[1] = 0x80 | ((c >> 12) & 0x3f);
+  out[2] = 0x80 | ((c >> 6) & 0x3f);
+  out[3] = 0x80 | (c & 0x3f);
+  return 4;
+}
+
+static void Describe(const uint32_t c, CharInfo *info) {
+  info->folded = Fold(c);
+  info->cls = ClassOf(c);
+  info->utf8_length = Encode(info->folded, info->utf8);
+  if (!LatinOf(info->folded, info))
+    info->latin_length = kNoLatin;
+}
+
+/**
+ * Descriptions of ASCII, Latin-1, Latin Extended, Greek and Cyrillic
+ * characters.
+ */
+static const struct CharTable {
+  CharInfo of[kTableSize];
+
+  CharTable() {
+    for (uint32_t c = 0; c < kTableSize; ++c)
+      Describe(c, &of[c]);
+  }
+} kChars;
+
+/**
+ * Classes of up to 64 bytes of a name, bit i stands for byte i.
+ */
+struct BlockMasks {
+  uint64_t upper;
+  uint64_t lower;
+  uint64_t digit;
+  uint64_t high;    // Bytes which are not ASCII.
+  uint64_t lead;    // First bytes of two byte characters from kChars.
+  uint64_t follow;  // Continuation bytes.
+};
+
+#ifdef __SSE2__
+/**
+ * Load less than 16 bytes at the end of a name padded with zeros. The block
+ * is put together in registers, it is not read back from memory which has
+ * just been written.
+ */
+static inline __m128i LoadTail(const char *data, const size_t size) {
+  uint64_t low, high = 0;
+  if (size >= 8) {
+    memcpy(&low, data, 8);
+    memcpy(&high, data + size - 8, 8);
+    high = size > 8 ? high >> ((16 - size) * 8) : 0;
+  } else if (size >= 4) {
+    uint32_t first, last;
+    memcpy(&first, data, 4);
+    memcpy(&last, data + size - 4, 4);
+    low = first | (static_cast<uint64_t>(last) << ((size - 4) * 8));
+  } else {
+    low = static_cast<uint8_t>(data[0]) |
+          (static_cast<uint64_t>(static_cast<uint8_t>(data[size / 2]))
+           << (size / 2 * 8)) |
+          (static_cast<uint64_t>(static_cast<uint8_t>(data[size - 1]))
+           << ((size - 1) * 8));
+  }
+  return _mm_set_epi64x(high, low);
+}
+
+/**
+ * Find bytes from first to last, inclusive.
+ *
+ * @return 0xff in bytes which are in the range, 0 in others.
+ */
+static inline __m128i InRange(const __m128i bytes, const uint8_t first,
+                              const uint8_t last) {
+  // Bytes are compared as signed, the range is moved to the lowest values.
+  __m128i shifted =
+      _mm_add_epi8(bytes, _mm_set1_epi8(static_cast<char>(0x80 - first)));
+  return _mm_cmplt_epi8(
+      shifted, _mm_set1_epi8(static_cast<char>(0x80 + last - first + 1)));
+}
+
+static inline uint64_t Mask(const __m128i bytes) {
+  return _mm_movemask_epi8(bytes);
+}
+
+/**
+ * Classify and case-fold ASCII bytes of up to 64 bytes of a name, in blocks
+ * of 16 bytes. Bytes after the name are read as zeros, which are
+ * separators.
+ *
+ * @param data Bytes of a name.
+ * @param size Number of bytes left in the name.
+ * @param folded Where to store the bytes, whole blocks.
+ * @param masks Where to store classes of the bytes.
+ */
+static inline void ScanBlocks(const char *data, const size_t size,
+                              char *folded, BlockMasks *masks) {
+  uint64_t upper = 0, lower = 0, digit = 0, high = 0, lead = 0, follow = 0;
+  for (size_t i = 0; i < 64 && i < size; i += 16) {
+    __m128i bytes;
+    if (LIKELY(size - i >= 16))
+      bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    else
+      bytes = LoadTail(data + i, size - i);
+    __m128i is_upper = InRange(bytes, 'A', 'Z');
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(folded + i),
+                     _mm_or_si128(bytes, _mm_and_si128(
+                         is_upper, _mm_set1_epi8(0x20))));
+    upper |= Mask(is_upper) << i;
+    lower |= Mask(InRange(bytes, 'a', 'z')) << i;
+    digit |= Mask(InRange(bytes, '0', '9')) << i;
+    high |= Mask(bytes) << i;
+    lead |= Mask(_mm_or_si128(InRange(bytes, 0xc2, 0xcb),
+                              InRange(bytes, 0xce, 0xd3))) << i;
+    follow |= Mask(InRange(bytes, 0x80, 0xbf)) << i;
+  }
+  masks->upper = upper;
+  masks->lower = lower;
+  masks->digit = digit;
+  masks->high = high;
+  masks->lead = lead;
+  masks->follow = follow;
+}
+#else
+static const uint64_t kHighBits = 0x8080808080808080ULL;
+
+static inline uint64_t Repeat(const uint8_t byte) {
+  return 0x0101010101010101ULL * byte;
+}
+
+/**
+ * Find ASCII bytes from first to last, inclusive, in eight bytes.
+ *
+ * @return The high bit set in bytes which are in the range.
+ */
+static inline uint64_t InRange(const uint64_t word, const uint8_t first,
+                               const uint8_t last) {
+  // The high bit of a byte is set by the sums if the byte is at least first
+  // and greater than last, the seven low bits never carry over.
+  uint64_t low = word & ~kHighBits;
+  uint64_t ge_first = low + Repeat(0x80 - first);
+  uint64_t gt_last = low + Repeat(0x7f - last);
+  return (ge_first ^ gt_last) & ~word & kHighBits;
+}
+
+/**
+ * Same as InRange() for bytes from 0x80 to 0xff.
+ */
+static inline uint64_t InHighRange(const uint64_t word, const uint8_t first,
+                                   const uint8_t last) {
+  return InRange(word ^ kHighBits, first ^ 0x80, last ^ 0x80);
+}
+
+/**
+ * Gather high bits of eight bytes in a byte, the first byte gives bit 0.
+ */
+static inline uint64_t HighBits(uint64_t word) {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return ((word & kHighBits) * 0x0002040810204081ULL) >> 56;
+}
+
+static inline void ScanBlocks(const char *data, const size_t size,
+                              char *folded, BlockMasks *masks) {
+  uint64_t upper = 0, lower = 0, digit = 0, high = 0, lead = 0, follow = 0;
+  for (size_t i = 0; i < 64 && i < size; i += 8) {
+    uint64_t word = 0;
+    if (LIKELY(size - i >= 8)) {
+      memcpy(&word, data + i, 8);
+    } else {
+      char block[8] = {};
+      for (size_t j = 0; i + j < size; ++j)
+        block[j] = data[i + j];
+      memcpy(&word, block, 8);
+    }
+    uint64_t is_upper = InRange(word, 'A', 'Z');
+    uint64_t word_folded = word | (is_upper >> 2);  // 0x80 >> 2 is 0x20.
+    memcpy(folded + i, &word_folded, 8);
+    upper |= HighBits(is_upper) << i;
+    lower |= HighBits(InRange(word, 'a', 'z')) << i;
+    digit |= HighBits(InRange(word, '0', '9')) << i;
+    high |= HighBits(word) << i;
+    lead |= HighBits(InHighRange(word, 0xc2, 0xcb) |
+                     InHighRange(word, 0xce, 0xd3)) << i;
+    follow |= HighBits(InHighRange(word, 0x80, 0xbf)) << i;
+  }
+  masks->upper = upper;
+  masks->lower = lower;
+  masks->digit = digit;
+  masks->high = high;
+  masks->lead = lead;
+  masks->follow = follow;
+}
+#endif  // __SSE2__
+
+/**
+ * Decode one UTF-8 character and move the position after it.
+ *
+ * @return Code point, U+FFFD for a broken sequence.
+ */
+static inline uint32_t Decode(const std::string &str, size_t *pos) {
+  uint8_t lead = str[(*pos)++];
+  if (lead < 0x80)
+    return lead;
+
+  // Two byte sequences cover Latin-1 and Cyrillic.
+  if ((lead & 0xe0) == 0xc0 && *pos < str.size() &&
+      (str[*pos] & 0xc0) == 0x80)
+    return ((lead & 0x1f) << 6) | (str[(*pos)++] & 0x3f);
+
+  int length;
+  uint32_t c;
+  if ((lead & 0xe0) == 0xc0) {
+    length = 1;
+    c = lead & 0x1f;
+  } else if ((lead & 0xf0) == 0xe0) {
+    length = 2;
+    c = lead & 0x0f;
+  } else if ((lead & 0xf8) == 0xf0) {
+    length = 3;
+    c = lead & 0x07;
+  } else {
+    return 0xfffd;
+  }
+
+  for (int i = 0; i < length; ++i) {
+    if (*pos >= str.size() || (str[*pos] & 0xc0) != 0x80)
+      return 0xfffd;  // Broken byte is read as the next character.
+    c = (c << 6) | (str[(*pos)++] & 0x3f);
+  }
+  return c;
+}
+
+/**
+ * Compose the letter with the marks which follow it, like Unicode
+ * normalization form C does. Marks are taken in order of their combining
+ * classes, marks which can't be composed are dropped.
+ *
+ * @param letter The letter.
+ * @param marks Marks, in order of appearance.
+ * @param count Number of marks.
+ *
+ * @return Composed letter.
+ */
+static uint32_t ComposeMarks(uint32_t letter, uint32_t *marks,
+                             const size_t count) {
+  // Canonical order, the sort is stable.
+  for (size_t i = 1; i < count; ++i) {
+    uint32_t mark = marks[i];
+    size_t j = i;
+    for (; j > 0 && kCombiningClass[marks[j - 1] - 0x300] >
+                    kCombiningClass[mark - 0x300]; --j)
+      marks[j] = marks[j - 1];
+    marks[j] = mark;
+  }
+
+  // A mark is blocked by a dropped one of the same class.
+  int blocked = -1;
+  for (size_t i = 0; i < count; ++i) {
+    int cls = kCombiningClass[marks[i] - 0x300];
+    uint32_t composed = cls > blocked ? Compose(letter, marks[i]) : 0;
+    if (composed)
+      letter = composed;
+    else
+      blocked = cls;
+  }
+  return letter;
+}
+
+/**
+ * Room after the used part of the buffer, tokens are copied in blocks of
+ * this size.
+ */
+static const size_t kSlack = 16;
+
+/**
+ * Tokens of the current name. The list lives on the stack while the name is
+ * split, so its counters stay in registers although the buffer is written
+ * byte by byte.
+ */
+class TokenList {
+ public:
+  /**
+   * @param out Buffer for tokens, large enough for all of them.
+   */
+  explicit TokenList(char *out)
+      : out_(out), length_(0), count_(0), signatures_() {}
+
+  /**
+   * Get the tokens separated by spaces.
+   */
+  inline const char *get_tokens() const { return out_ + 1; }
+
+  /**
+   * Get length of the tokens with spaces.
+   */
+  inline size_t get_length() const { return length_ ? length_ - 1 : 0; }
+
+  /**
+   * Get number of the tokens.
+   */
+  inline size_t get_count() const { return count_; }
+
+  /**
+   * Get position of the next token. Every token follows a space, the one
+   * before the first token is not a part of the list.
+   */
+  inline char *Next() const { return out_ + length_ + 1; }
+
+  /**
+   * Add the token written at Next() unless it is there already. The buffer
+   * must have eight bytes after the token.
+   *
+   * @param size Length of the token, not zero.
+   */
+  inline void Commit(const size_t size) {
+    // Tokens are compared only when one with the same hash of length, first
+    // and last eight bytes was added before. Short tokens are masked without
+    // branches, their length is not predictable.
+    const char *token = Next();
+    const size_t head_size = size < 8 ? size : 8;
+    uint64_t head, tail;
+    memcpy(&head, token, 8);
+    memcpy(&tail, token + size - head_size, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    head &= ~0ULL >> (64 - head_size * 8);
+#else
+    head &= ~0ULL << (64 - head_size * 8);
+#endif
+    tail &= 0ULL - (size >= 8);
+    uint64_t hash = (head * 0x9e3779b97f4a7c15ULL) ^
+                    ((tail + size) * 0xc2b2ae3d27d4eb4fULL);
+    uint64_t &word = signatures_[hash >> 62];
+    uint64_t signature = 1ULL << ((hash >> 56) & 63);
+    if (UNLIKELY(word & signature) && Contains(token, size))
+      return;
+    word |= signature;
+
+    out_[length_] = ' ';
+    length_ += size + 1;
+    ++count_;
+  }
+
+  /**
+   * Copy the token and add it unless it is there already. The token must
+   * have kSlack bytes after it.
+   *
+   * @param data The token.
+   * @param size Length of the token, not zero.
+   */
+  inline void Add(const char *data, const size_t size) {
+    // Most tokens take one copy.
+    char *token = Next();
+    for (size_t i = 0; i < size; i += kSlack)
+      memcpy(token + i, data + i, kSlack);
+    Commit(size);
+  }
+
+ private:
+  /**
+   * Check if the token was added already.
+   */
+  bool Contains(const char *token, const size_t size) const {
+    for (size_t pos = 1; pos < length_;) {
+      const char *space =
+          static_cast<const char *>(memchr(out_ + pos, ' ', length_ - pos));
+      size_t end = space ? space - out_ : length_;
+      if (end - pos == size && !memcmp(out_ + pos, token, size))
+        return true;
+      pos = end + 1;
+    }
+    return false;
+  }
+
+  char *out_;
+  size_t length_;
+  size_t count_;
+
+  /**
+   * Bit set of hashes of the tokens.
+   */
+  uint64_t signatures_[4];
+};
+
+/**
+ * Decode the next character of the name and compose it with the marks
+ * which follow it.
+ *
+ * @param name The name.
+ * @param pos Position of the character, moved after it and its marks.
+ * @param slow Where to describe the character if it is not in kChars.
+ *
+ * @return Description of the character, NULL if only marks are left.
+ */
+static const CharInfo *DecodeChar(const std::string &name, size_t *pos,
+                                  CharInfo *slow) {
+  uint32_t c = Decode(name, pos);
+  while (IsMark(c)) {
+    if (*pos >= name.size())
+      return NULL;  // Marks after separators are dropped too.
+    c = Decode(name, pos);
+  }
+
+  // Marks are encoded as 0xcc 0x80 to 0xcd 0xaf.
+  uint32_t marks[kMaxMarks];
+  size_t count = 0;
+  while (*pos + 1 < name.size() &&
+         (static_cast<uint8_t>(name[*pos]) & 0xfe) == 0xcc) {
+    size_t next = *pos;
+    uint32_t mark = Decode(name, &next);
+    if (!IsMark(mark))
+      break;
+    if (count < kMaxMarks)
+      marks[count++] = mark;
+    *pos = next;
+  }
+  if (count)
+    c = ComposeMarks(c, marks, count);
+
+  if (c < kTableSize)
+    return &kChars.of[c];
+  Describe(c, slow);
+  return slow;
+}
+
+/**
+ * Same as DecodeChar(), ASCII characters and two byte ones from kChars
+ * which are not followed by marks are decoded without branches.
+ */
+static inline const CharInfo *NextChar(const std::string &name, size_t *pos,
+                                       CharInfo *slow) {
+  // The name is terminated, the byte after the last character is read as
+  // zero. Lead bytes 0xcc and 0xcd start marks.
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(name.data()) + *pos;
+  uint32_t lead = data[0];
+  uint32_t next = data[1];
+  bool two = ((lead >= 0xc2 && lead < 0xcc) || (lead >= 0xce && lead < 0xd4)) &&
+             (next & 0xc0) == 0x80;
+  if (LIKELY((lead < 0x80 || two) && (data[1 + two] & 0xfe) != 0xcc)) {
+    *pos += 1 + two;
+    return &kChars.of[two ? ((lead & 0x1f) << 6) | (next & 0x3f) : lead];
+  }
+  return DecodeChar(name, pos, slow);
+}
+
+/**
+ * Get class of the character at the position.
+ */
+static int ClassAt(const std::string &name, size_t pos) {
+  if (pos >= name.size())
+    return kSeparator;
+  CharInfo slow;
+  const CharInfo *info = DecodeChar(name, &pos, &slow);
+  return info ? info->cls : +kSeparator;
+}
+
+/**
+ * Add transliterations which are separated by spaces.
+ */
+static void AddLatin(const char *latin, const size_t length,
+                     TokenList *tokens) {
+  for (size_t pos = 0; pos < length;) {
+    const char *space =
+        static_cast<const char *>(memchr(latin + pos, ' ', length - pos));
+    size_t end = space - latin;
+    tokens->Add(latin + pos, end - pos);
+    pos = end + 1;
+  }
+}
+
+/**
+ * Get bits from first to last, exclusive.
+ */
+static inline uint64_t Bits(const int first, const int last) {
+  return (last < 64 ? 1ULL << last : 0) - (1ULL << first);
+}
+
+/**
+ * Split a name of ASCII characters and two byte characters from kChars
+ * which are not followed by marks, like Cyrillic and Latin-1 names. Folding
+ * keeps lengths of such characters, so the name is folded in place and
+ * words are cut out of it by bit masks like ASCII words.
+ *
+ * @param name The name.
+ * @param folded Where to fold the name, its size rounded up to 64 bytes.
+ * @param latin Where to keep transliterations, four letters for each
+ * character of the name.
+ * @param tokens Where to add words and transliterations.
+ *
+ * @return false if the name has other characters.
+ */
+static bool TokenizeBlocks(const std::string &name, char *folded, char *latin,
+                           TokenList *tokens) {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(name.data());
+  const size_t size = name.size();
+
+  // A word gets a transliteration if it has letters which are not ASCII
+  // and all of its letters have Latin forms. Transliterations are added
+  // after all words.
+  size_t latin_length = 0;
+  auto add_word = [&](const size_t start, const size_t end, const bool wide) {
+    tokens->Add(folded + start, end - start);
+    if (!wide)
+      return;
+    size_t length = latin_length;
+    for (size_t i = start; i < end;) {
+      bool two = data[i] >= 0x80;
+      const CharInfo &info = kChars.of[
+          two ? ((data[i] & 0x1f) << 6) | (data[i + 1] & 0x3f) : data[i]];
+      if (info.latin_length == kNoLatin)
+        return;
+      memcpy(latin + length, info.latin, 4);
+      length += info.latin_length;
+      i += 1 + two;
+    }
+    if (length > latin_length) {
+      latin[length] = ' ';
+      latin_length = length + 1;
+    }
+  };
+
+  // Words start at letters and digits after separators and at camelCase
+  // boundaries, they stop at the next separator or start. The loop goes
+  // over words, not bytes or boundaries, so it has little to mispredict.
+  // Bytes of two byte characters get classes of the characters. Classes
+  // of the last byte of the previous block are carried over, a word which
+  // is not stopped in the block is kept open.
+  uint64_t last_word = 0, last_upper = 0, last_lower = 0, last_digit = 0;
+  uint64_t last_letter = 0, last_lead = 0;
+  size_t word_start = 0;
+  bool open = false, open_wide = false;
+  for (size_t begin = 0; begin < size; begin += 64) {
+    const size_t left = size - begin;
+    BlockMasks masks;
+    char spill = folded[begin];  // Folded by the previous block.
+    ScanBlocks(name.data() + begin, left, folded + begin, &masks);
+    if (UNLIKELY(last_lead))
+      folded[begin] = spill;
+
+    // Every lead byte is followed by one continuation byte.
+    uint64_t letter = 0;
+    if (UNLIKELY(masks.high)) {
+      if (masks.follow != ((masks.lead << 1) | last_lead) ||
+          (masks.high & ~(masks.lead | masks.follow)))
+        return false;
+      for (uint64_t leads = masks.lead; leads; leads &= leads - 1) {
+        int i = __builtin_ctzll(leads);
+        const uint8_t *bytes = data + begin + i;
+        const CharInfo &info =
+            kChars.of[((bytes[0] & 0x1f) << 6) | (bytes[1] & 0x3f)];
+        if (UNLIKELY(info.utf8_length != 2))
+          return false;  // Folded to ASCII.
+        memcpy(folded + begin + i, info.utf8, 2);
+        uint64_t both = 3ULL << i;
+        masks.upper |= info.cls == kUpper ? both : 0;
+        masks.lower |= info.cls == kLower ? both : 0;
+        letter |= info.cls == kLetter ? both : 0;
+      }
+      if (last_lead) {
+        // The first byte continues the last character of the previous
+        // block.
+        masks.upper |= last_upper;
+        masks.lower |= last_lower;
+        letter |= last_letter;
+      }
+    }
+
+    uint64_t word = masks.upper | masks.lower | masks.digit | letter;
+    uint64_t prev_word = (word << 1) | last_word;
+    uint64_t prev_upper = (masks.upper << 1) | last_upper;
+    uint64_t prev_lower = (masks.lower << 1) | last_lower;
+    uint64_t prev_digit = (masks.digit << 1) | last_digit;
+
+    // The next character follows the last byte of a character.
+    uint64_t single = ~(masks.follow >> 1);
+    uint64_t next_lower = ((masks.lower >> 1) & single) |
+                          ((masks.lower >> 2) & ~single);
+    if (left > 64) {
+      if (masks.lead >> 63) {
+        next_lower |= static_cast<uint64_t>(
+            ClassAt(name, begin + 65) == kLower) << 63;
+      } else {
+        uint64_t lower = ClassAt(name, begin + 64) == kLower;
+        next_lower |= (lower << 63) | ((lower << 62) & masks.lead);
+      }
+    }
+
+    uint64_t starts = ((word & ~prev_word) |
+                       (masks.upper & (prev_lower | prev_digit |
+                                       (prev_upper & next_lower)))) &
+                      ~masks.follow;
+    uint64_t stops = (~word | starts) & prev_word;
+    if (open && stops) {
+      int stop = __builtin_ctzll(stops);
+      add_word(word_start, begin + stop,
+               open_wide || (masks.high & Bits(0, stop)));
+      open = false;
+    }
+    while (starts) {
+      int start = __builtin_ctzll(starts);
+      starts &= starts - 1;
+      uint64_t after = stops & ~((2ULL << start) - 1);
+      if (!after) {
+        open = true;
+        open_wide = masks.high & Bits(start, 64);
+        word_start = begin + start;
+        break;
+      }
+      int stop = __builtin_ctzll(after);
+      add_word(begin + start, begin + stop, masks.high & Bits(start, stop));
+    }
+
+    last_word = word >> 63;
+    last_upper = masks.upper >> 63;
+    last_lower = masks.lower >> 63;
+    last_digit = masks.digit >> 63;
+    last_letter = letter >> 63;
+    last_lead = masks.lead >> 63;
+  }
+  if (UNLIKELY(last_lead))
+    return false;  // Broken last character.
+
+  // A word which stops with the name stops with a block of 64 bytes.
+  if (open)
+    add_word(word_start, size, open_wide);
+  AddLatin(latin, latin_length, tokens);
+  return true;
+}
+
+/**
+ * Split a UTF-8 name.
+ *
+ * @param name The name.
+ * @param latin Where to keep transliterations, four letters for each
+ * character of the name.
+ * @param tokens Where to add words and transliterations.
+ */
+static void TokenizeUtf8(const std::string &name, char *latin,
+                         TokenList *tokens) {
+  // Words are encoded right in the list and committed when they end, their
+  // transliterations are separated by spaces and added after all words.
+  const size_t size = name.size();
+  size_t latin_length = 0;
+  size_t latin_start = 0;
+  bool translit = true;    // Every letter of the word has Latin form.
+  bool non_ascii = false;  // The word needs transliteration.
+  char *start = tokens->Next();
+  char *end = start;
+  auto end_word = [&]() {
+    if (end > start) {
+      tokens->Commit(end - start);
+      if (non_ascii && translit && latin_length > latin_start)
+        latin[latin_length++] = ' ';
+      else
+        latin_length = latin_start;
+      latin_start = latin_length;
+      translit = true;
+      non_ascii = false;
+    }
+    start = end = tokens->Next();
+  };
+
+  CharInfo slow;
+  int prev = kSeparator;
+  for (size_t pos = 0; pos < size;) {
+    const CharInfo *cur = NextChar(name, &pos, &slow);
+    if (UNLIKELY(cur == NULL))
+      break;
+    if (cur->cls == kSeparator) {
+      end_word();
+      prev = kSeparator;
+      continue;
+    }
+
+    // "fooBar", "foo2Bar" and "XMLParser".
+    if (UNLIKELY(cur->cls == kUpper) &&
+        (prev == kLower || prev == kDigit ||
+         (prev == kUpper && ClassAt(name, pos) == kLower)))
+      end_word();
+
+    memcpy(end, cur->utf8, 4);
+    end += cur->utf8_length;
+    non_ascii |= cur->folded >= 0x80;
+    if (cur->latin_length == kNoLatin) {
+      translit = false;
+    } else {
+      memcpy(latin + latin_length, cur->latin, 4);
+      latin_length += cur->latin_length;
+    }
+    prev = cur->cls;
+  }
+  end_word();
+  AddLatin(latin, latin_length, tokens);
+}
+
+size_t NameTokenizer::Tokenize(const std::string &name, std::string *tokens) {
+  // Folding keeps lengths of UTF-8 characters or makes them shorter, so
+  // words with spaces take at most twice the name. A transliteration takes
+  // at most four letters for each character and a space. The folded name
+  // and transliterations are collected after the tokens.
+  const size_t size = name.size();
+  const size_t scratch = 7 * size + 1 + kSlack;
+  const size_t bound = scratch + 6 * size + 64 + kSlack;
+  if (out_.size() < bound)
+    out_.resize(bound);
+
+  char *out = &out_[0];
+  char *folded = out + scratch;
+  char *latin = folded + size + 64;
+  TokenList list(out);
+  if (UNLIKELY(!TokenizeBlocks(name, folded, latin, &list))) {
+    list = TokenList(out);
+    TokenizeUtf8(name, latin, &list);
+  }
+
+  tokens->assign(list.get_tokens(), list.get_length());
+  return list.get_count();
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_NAMETOKENIZER_H_
+#define SPIDER_NAMETOKENIZER_H_
+
+#include <string>
+
+#include "common-inl.h"
+
+/**
+ * Splits file names in normalized words which are stored for search.
+ *
+ * A name is decoded from UTF-8, combining marks are composed with the
+ * preceding letter like Unicode normalization form C does and dropped if
+ * there is no precomposed letter, so "й" and "и" with a breve give the same
+ * word. Letters are case-folded. Words are separated by any
+ * non-alphanumeric character ('_', '.', '-', spaces, punctuation) and by
+ * camelCase boundaries: "XMLParser_v2.tar" gives "xml parser v2 tar".
+ * Words with Cyrillic or accented Latin letters are followed by their Latin
+ * transliteration, so "Матрица" is found both as "матрица" and "matritsa".
+ *
+ * Pure ASCII names, most of the names in practice, never get decoded: one
+ * pass over blocks of 16 bytes (eight without SSE2) checks, classifies and
+ * case-folds them, words are then cut out of the folded name by bit masks
+ * of their boundaries.
+ *
+ * The object keeps its buffers between calls, it is not thread safe.
+ */
+class NameTokenizer {
+ public:
+  NameTokenizer() {}
+
+  /**
+   * Split the name in tokens.
+   *
+   * @param name UTF-8 name of a file.
+   * @param tokens Where to store tokens separated by single spaces: words
+   * in order of appearance, then transliterations. Duplicates are removed.
+   *
+   * @return Number of tokens.
+   */
+  size_t Tokenize(const std::string &name, std::string *tokens);
+
+ private:
+  /**
+   * Tokens of the current name followed by the folded name or
+   * transliterations.
+   */
+  std::string out_;
+
+  DISALLOW_COPY_AND_ASSIGN(NameTokenizer);
+};
+
+#endif  // SPIDER_NAMETOKENIZER_H_
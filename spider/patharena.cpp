@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string>
+#include <vector>
+
+#include "spider/crawlbackend.h"
+#include "spider/patharena.h"
+
+const uint32_t PathArena::kRoot;
+
+PathArena::PathArena(const size_t capacity, const size_t bytes)
+    : capacity_(capacity) {
+  bytes_.reserve(bytes);
+  files_.reserve(capacity);
+}
+
+uint32_t PathArena::InternDir(const std::string &dir) {
+  auto found = index_.find(dir);
+  if (found != index_.end())
+    return found->second;
+
+  // Parents are interned first, the crawler mostly finds them in index_.
+  Dir entry;
+  size_t pos = dir.rfind('/');
+  if (pos == std::string::npos || pos < CrawlBackend::ServerOffset(dir)) {
+    entry.parent = kRoot;
+    pos = 0;
+  } else {
+    entry.parent = InternDir(dir.substr(0, pos));
+    ++pos;  // Skip '/'.
+  }
+  entry.length = dir.size() - pos;
+  entry.offset = Store(dir.data() + pos, entry.length);
+
+  uint32_t id = dirs_.size();
+  dirs_.push_back(entry);
+  index_.emplace(dir, id);
+  return id;
+}
+
+void PathArena::AddFile(const uint32_t dir, const std::string &name,
+                        const int64_t size, const time_t mtime) {
+  File file;
+  file.dir = dir;
+  file.length = name.size();
+  file.offset = Store(name.data(), file.length);
+  file.size = size;
+  file.mtime = mtime;
+  files_.push_back(file);
+}
+
+void PathArena::Clear() {
+  bytes_.clear();
+  dirs_.clear();
+  files_.clear();
+  index_.clear();
+}
+
+void PathArena::GetUrl(const size_t file, std::string *url) const {
+  const File &entry = files_[file];
+  const Dir &root = dirs_[Root(entry.dir)];
+  url->assign(bytes_.data() + root.offset, root.length);
+  url->push_back('/');
+  AppendPath(entry.dir, url);
+  url->append(bytes_.data() + entry.offset, entry.length);
+}
+
+void PathArena::GetServer(const size_t file, std::string *server) const {
+  const Dir &root = dirs_[Root(files_[file].dir)];
+  server->assign(bytes_.data() + root.offset, root.length);
+  server->erase(0, CrawlBackend::ServerOffset(*server));
+}
+
+void PathArena::GetPath(const size_t file, std::string *path) const {
+  const File &entry = files_[file];
+  path->clear();
+  AppendPath(entry.dir, path);
+  path->append(bytes_.data() + entry.offset, entry.length);
+}
+
+void PathArena::GetName(const size_t file, std::string *name) const {
+  const File &entry = files_[file];
+  name->assign(bytes_.data() + entry.offset, entry.length);
+}
+
+uint32_t PathArena::Store(const char *data, const size_t length) {
+  uint32_t offset = bytes_.size();
+  bytes_.insert(bytes_.end(), data, data + length);
+  return offset;
+}
+
+void PathArena::AppendPath(const uint32_t dir, std::string *out) const {
+  const Dir &entry = dirs_[dir];
+  if (entry.parent == kRoot)
+    return;
+
+  AppendPath(entry.parent, out);
+  out->append(bytes_.data() + entry.offset, entry.length);
+  out->push_back('/');
+}
+
+uint32_t PathArena::Root(uint32_t dir) const {
+  while (dirs_[dir].parent != kRoot)
+    dir = dirs_[dir].parent;
+  return dir;
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_PATHARENA_H_
+#define SPIDER_PATHARENA_H_
+
+#include <time.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * File found by the crawler.
+ */
+struct FoundFile {
+  /**
+   * Full URL of the file, "smb://server/path" or "file://server/path".
+   */
+  std::string path;
+
+  /**
+   * Size of the file in bytes, -1 if it is unknown.
+   */
+  int64_t size = -1;
+
+  /**
+   * Time of last modification, 0 if it is unknown.
+   */
+  time_t mtime = 0;
+};
+
+/**
+ * Batch of found files which owns their paths.
+ *
+ * Every directory is interned once per batch and stored as its last
+ * component with a link to the parent directory, so a deep tree costs one
+ * name per directory instead of a full URL per file. Names of directories
+ * and files are bump-allocated in one buffer. Clear() keeps all the memory,
+ * so a reused batch makes no allocations per file once it has grown to its
+ * working size.
+ *
+ * The object is not thread safe.
+ */
+class PathArena {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param capacity Maximum number of files in the batch.
+   * @param bytes Initial size of the buffer for names.
+   */
+  PathArena(const size_t capacity, const size_t bytes);
+
+  /**
+   * Find the directory in the batch or add it with all its parents.
+   *
+   * @param dir URL of the directory without the trailing "/".
+   *
+   * @return Id of the directory, valid until Clear().
+   */
+  uint32_t InternDir(const std::string &dir);
+
+  /**
+   * Add a file.
+   *
+   * @param dir Id of the directory returned by InternDir().
+   * @param name Name of the file without the directory.
+   * @param size Size of the file in bytes, -1 if it is unknown.
+   * @param mtime Time of last modification, 0 if it is unknown.
+   */
+  void AddFile(const uint32_t dir, const std::string &name,
+               const int64_t size, const time_t mtime);
+
+  /**
+   * Remove all directories and files but keep the memory.
+   */
+  void Clear();
+
+  /**
+   * Get full URL of the file.
+   *
+   * @param file Index of the file.
+   * @param url Where to store the URL.
+   */
+  void GetUrl(const size_t file, std::string *url) const;
+
+  /**
+   * Get server of the file.
+   *
+   * @param file Index of the file.
+   * @param server Where to store the server name.
+   */
+  void GetServer(const size_t file, std::string *server) const;
+
+  /**
+   * Get path of the file on its server, without the leading "/".
+   *
+   * @param file Index of the file.
+   * @param path Where to store the path.
+   */
+  void GetPath(const size_t file, std::string *path) const;
+
+  /**
+   * Get name of the file without the directory.
+   *
+   * @param file Index of the file.
+   * @param name Where to store the name.
+   */
+  void GetName(const size_t file, std::string *name) const;
+
+  /**
+   * Get size of the file.
+   *
+   * @param file Index of the file.
+   *
+   * @return Size in bytes, -1 if it is unknown.
+   */
+  inline int64_t get_size(const size_t file) const {
+    return files_[file].size;
+  }
+
+  /**
+   * Get time of last modification of the file.
+   *
+   * @param file Index of the file.
+   *
+   * @return Time of last modification, 0 if it is unknown.
+   */
+  inline time_t get_mtime(const size_t file) const {
+    return files_[file].mtime;
+  }
+
+  /**
+   * Get number of files in the batch.
+   *
+   * @return Number of files.
+   */
+  inline size_t size() const { return files_.size(); }
+
+  /**
+   * Check if there are no files in the batch.
+   *
+   * @return true if the batch is empty, false otherwise.
+   */
+  inline bool empty() const { return files_.empty(); }
+
+  /**
+   * Check if the batch can't take more files.
+   *
+   * @return true if the batch is full, false otherwise.
+   */
+  inline bool full() const { return files_.size() >= capacity_; }
+
+  /**
+   * Get number of interned directories.
+   *
+   * @return Number of directories.
+   */
+  inline size_t get_dirs() const { return dirs_.size(); }
+
+  /**
+   * Get number of used bytes of the name buffer.
+   *
+   * @return Number of bytes.
+   */
+  inline size_t get_bytes() const { return bytes_.size(); }
+
+ private:
+  /**
+   * Interned directory.
+   */
+  struct Dir {
+    /**
+     * Id of the parent directory, kRoot for "scheme://server".
+     */
+    uint32_t parent;
+
+    /**
+     * Position of the last component in bytes_, the root keeps the whole
+     * "scheme://server".
+     */
+    uint32_t offset;
+
+    /**
+     * Length of the last component.
+     */
+    uint32_t length;
+  };
+
+  /**
+   * File in the batch.
+   */
+  struct File {
+    /**
+     * Id of the directory.
+     */
+    uint32_t dir;
+
+    /**
+     * Position of the name in bytes_.
+     */
+    uint32_t offset;
+
+    /**
+     * Length of the name.
+     */
+    uint32_t length;
+
+    /**
+     * Size of the file in bytes, -1 if it is unknown.
+     */
+    int64_t size;
+
+    /**
+     * Time of last modification, 0 if it is unknown.
+     */
+    time_t mtime;
+  };
+
+  /**
+   * Parent of the root directories.
+   */
+  static const uint32_t kRoot = UINT32_MAX;
+
+  /**
+   * Copy the string at the end of bytes_.
+   *
+   * @param data The string.
+   * @param length Length of the string.
+   *
+   * @return Position of the copy.
+   */
+  uint32_t Store(const char *data, const size_t length);
+
+  /**
+   * Append path of the directory below its root, every component followed
+   * by "/".
+   *
+   * @param dir Id of the directory.
+   * @param out Where to append.
+   */
+  void AppendPath(const uint32_t dir, std::string *out) const;
+
+  /**
+   * Get id of the root directory of the directory.
+   *
+   * @param dir Id of the directory.
+   *
+   * @return Id of the root.
+   */
+  uint32_t Root(uint32_t dir) const;
+
+  /**
+   * Names of directories and files.
+   */
+  std::vector<char> bytes_;
+
+  /**
+   * Interned directories, index is the id.
+   */
+  std::vector<Dir> dirs_;
+
+  /**
+   * Files of the batch.
+   */
+  std::vector<File> files_;
+
+  /**
+   * Ids of interned directories by their URLs.
+   */
+  std::unordered_map<std::string, uint32_t> index_;
+
+  /**
+   * Maximum number of files.
+   */
+  const size_t capacity_;
+
+  DISALLOW_COPY_AND_ASSIGN(PathArena);
+};
+
+#endif  // SPIDER_PATHARENA_H_
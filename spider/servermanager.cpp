@@ -25,18 +25,34 @@
  */
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #include <netdb.h>
 #include <errno.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include "spider/servermanager.h"
 #include "config.h"
 
-ServerManager::ServerManager(const std::string &server) : keepalive_(0) {
+ServerManager::ServerManager(const std::string &server, const int leases)
+    : seq_(time(NULL)),
+      buf_(SCHEDULER_PACKET_SIZE),
+      count_(std::max(1, std::min(leases, SCHEDULER_MAX_ITEMS))),
+      ttl_(SCHEDULER_MAX_RETRY_AFTER),
+      renewal_(0),
+      stop_(false),
+      sockfd_(-1),
+      epollfd_(-1),
+      timerfd_(-1),
+      eventfd_(-1) {
   /*
    * Create socket and connect it to scheduler server.
    */
@@ -63,6 +79,7 @@ ServerManager::ServerManager(const std::string &server) : keepalive_(0) {
     if (connect(sockfd_, p->ai_addr, p->ai_addrlen) == -1) {
       MSS_ERROR("connect", errno);
       close(sockfd_);
+      sockfd_ = -1;
       continue;
     }
 
@@ -90,62 +107,331 @@ ServerManager::ServerManager(const std::string &server) : keepalive_(0) {
   for (p = servinfo; p != NULL; p = p->ai_next) {
     bind(sockfd_, p->ai_addr, p->ai_addrlen);
   }
+  freeaddrinfo(servinfo);
+
+  // The event loop waits for replies, the renewal timer and new requests.
+  epollfd_ = epoll_create1(EPOLL_CLOEXEC);
+  timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  eventfd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollfd_ == -1 || timerfd_ == -1 || eventfd_ == -1) {
+    MSS_FATAL("epoll_create1, timerfd_create or eventfd", errno);
+    close(sockfd_);
+    sockfd_ = -1;
+    return;
+  }
+
+  for (int fd : { sockfd_, timerfd_, eventfd_ }) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+      MSS_FATAL("epoll_ctl", errno);
+      close(sockfd_);
+      sockfd_ = -1;
+      return;
+    }
+  }
 
-  // Try to request new server after 5 seconds if no reply received.
-  struct timeval timeout;
-  timeout.tv_sec = 5;
-  timeout.tv_usec = 0;
-  if (setsockopt(sockfd_, SOL_SOCKET, SO_RCVTIMEO, &timeout,
-                 sizeof timeout) == -1)
-    MSS_FATAL_MESSAGE("setsockopt");
+  ArmTimer();
+  loopthread_ = std::thread(&ServerManager::EventLoop, this);
 }
 
 ServerManager::~ServerManager() {
-  close(sockfd_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Let other spiders take servers which this one didn't start.
+    if (!leases_.empty() && sockfd_ != -1) {
+      SchedulerMessage request;
+      request.type = ReleaseMessage;
+      for (const std::string &lease : leases_) {
+        request.items.emplace_back();
+        request.items.back().name = lease;
+      }
+      leases_.clear();
+      Submit(&request);
+    }
+
+    // The loop exits when all requests are done.
+    stop_ = true;
+  }
+  Wake();
+  if (loopthread_.joinable())
+    loopthread_.join();
+
+  for (int fd : { sockfd_, epollfd_, timerfd_, eventfd_ }) {
+    if (fd != -1)
+      close(fd);
+  }
 }
 
 std::string ServerManager::GetServer() {
-  char buf[257];
-
-  do {
-    send(sockfd_, "G", 1, 0);
-    memset(buf, 0, sizeof buf);
-    // Timeout if there are no free servers.
-    if (recv(sockfd_, buf, sizeof buf - 1, 0) == -1) {
-      MSS_ERROR("recv", errno);
-      sleep(5);
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!leases_.empty()) {
+        std::string server = leases_.front();
+        leases_.pop_front();
+        active_.insert(server);
+        return server;
+      }
+    }
+
+    SchedulerMessage request, reply;
+    request.type = LeaseMessage;
+    request.value = count_;
+    // Wait as long as scheduler tells if there are no free servers.
+    unsigned int wait = SCHEDULER_MAX_RETRY_AFTER;
+    if (Exchange(&request, &reply) == 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const SchedulerItem &item : reply.items)
+        leases_.push_back(item.name);
+      if (!leases_.empty())
+        continue;
+      wait = std::max<unsigned int>(reply.value, 1);
+    }
+    sleep(wait);
+  }
+}
+
+void ServerManager::ReleaseServer(const std::string &server,
+                                  const int64_t files, const int64_t changed) {
+  SchedulerMessage request;
+  request.type = ReleaseMessage;
+  request.items.resize(1);
+  request.items[0].name = server;
+  request.items[0].files = files;
+  request.items[0].changed = changed;
+
+  // The lease is not renewed from now on, and expires anyway if scheduler
+  // doesn't get the message.
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (LIKELY(active_.erase(server) && sockfd_ != -1))
+    Submit(&request);
+}
+
+void ServerManager::SplitItems(const std::vector<std::string> &items,
+                               std::vector<bool> *queued) {
+  queued->assign(items.size(), false);
+
+  SchedulerMessage request, reply;
+  request.type = SplitMessage;
+  std::vector<size_t> indexes;
+  for (size_t i = 0; i < items.size(); ++i) {
+    // Scheduler doesn't take names which don't fit in its reply.
+    if (items[i].size() <= SCHEDULER_COMMAND_SIZE) {
+      request.items.emplace_back();
+      request.items.back().name = items[i];
+      indexes.push_back(i);
+    }
+
+    if (request.items.size() == SCHEDULER_MAX_ITEMS ||
+        (i + 1 == items.size() && !request.items.empty())) {
+      // Items which got no reply are indexed by this spider.
+      if (Exchange(&request, &reply) == 0 &&
+          reply.items.size() == indexes.size()) {
+        for (size_t j = 0; j < indexes.size(); ++j)
+          (*queued)[indexes[j]] = reply.items[j].status;
+      }
+      request.items.clear();
+      indexes.clear();
+    }
+  }
+}
+
+bool ServerManager::SplitItem(const std::string &item) {
+  std::vector<bool> queued;
+  SplitItems(std::vector<std::string>(1, item), &queued);
+  return queued[0];
+}
+
+std::shared_ptr<ServerManager::Request> ServerManager::Submit(
+    SchedulerMessage *message) {
+  if (UNLIKELY(++seq_ == 0))
+    ++seq_;  // 0 means no request, see renewal_
+  message->seq = seq_;
+
+  std::shared_ptr<Request> request = std::make_shared<Request>();
+  request->message = *message;
+  SchedulerProtocol::Encode(*message, &request->data);
+  request->deadline = std::chrono::steady_clock::now();
+  requests_[seq_] = request;
+
+  Wake();
+  return request;
+}
+
+int ServerManager::Exchange(SchedulerMessage *request,
+                            SchedulerMessage *reply) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (UNLIKELY(sockfd_ == -1))
+    return -1;
+
+  std::shared_ptr<Request> pending = Submit(request);
+  replycv_.wait(lock, [&pending] { return pending->done; });
+  if (pending->result == 0)
+    *reply = pending->reply;
+  return pending->result;
+}
+
+void ServerManager::EventLoop() {
+  struct epoll_event events[3];
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (!(stop_ && requests_.empty())) {
+    int timeout = SendRequests();
+
+    lock.unlock();
+    int count = epoll_wait(epollfd_, events, 3, timeout);
+    lock.lock();
+    if (UNLIKELY(count == -1)) {
+      if (errno != EINTR)
+        MSS_ERROR("epoll_wait", errno);
+      continue;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      uint64_t value;
+      if (events[i].data.fd == sockfd_) {
+        ReceiveReplies();
+      } else if (events[i].data.fd == timerfd_) {
+        if (read(timerfd_, &value, sizeof value) == sizeof value)
+          Renew();
+      } else if (read(eventfd_, &value, sizeof value) == -1 &&
+                 errno != EAGAIN) {
+        MSS_ERROR("read", errno);
+      }
     }
-  } while (buf[0] == '\0');
+  }
+}
+
+int ServerManager::SendRequests() {
+  auto now = std::chrono::steady_clock::now();
+  auto next = std::chrono::steady_clock::time_point::max();
+
+  for (auto itr = requests_.begin(); itr != requests_.end(); ) {
+    Request &request = *itr->second;
+    if (request.deadline <= now) {
+      if (request.attempts == SCHEDULER_RETRIES) {
+        MSS_ERROR_MESSAGE("Scheduler doesn't reply");
+        if (itr->first == renewal_)
+          renewal_ = 0;
+        request.done = true;
+        itr = requests_.erase(itr);
+        replycv_.notify_all();
+        continue;
+      }
+
+      if (UNLIKELY(send(sockfd_, request.data.data(), request.data.size(),
+                        0) == -1))
+        MSS_ERROR("send", errno);
+
+      // The timeout doubles after each attempt.
+      request.deadline = now + std::chrono::milliseconds(
+          SCHEDULER_RETRY_TIMEOUT << request.attempts);
+      ++request.attempts;
+    }
+
+    next = std::min(next, request.deadline);
+    ++itr;
+  }
+
+  if (next == std::chrono::steady_clock::time_point::max())
+    return -1;
 
-  smbserver_ = buf;
+  // Round up, so that the deadline has passed when epoll_wait() returns.
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      next - now).count() + 1;
+}
 
-  keepalivemutex_.lock();
-  keepalive_ = 1;
-  keepalivemutex_.unlock();
+void ServerManager::ReceiveReplies() {
+  SchedulerMessage reply;
+  ssize_t size;
+  while ((size = recv(sockfd_, &buf_[0], buf_.size(), MSG_DONTWAIT)) != -1) {
+    // Replies to requests which were retried may come twice.
+    if (!SchedulerProtocol::Decode(&buf_[0], size, &reply))
+      continue;
+    auto itr = requests_.find(reply.seq);
+    if (itr == requests_.end() || itr->second->message.type != reply.type)
+      continue;
 
-  // Send Keep Alive messages until server is released.
-  keepalivethread_ = std::thread([this]() {
-    while (1) {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      std::string cmd = "G" + smbserver_;
-      send(sockfd_, cmd.c_str(), cmd.size(), 0);
+    if (reply.type == LeaseMessage || reply.type == RenewMessage) {
+      if (reply.ttl != ttl_ && reply.ttl > 0) {
+        ttl_ = reply.ttl;
+        ArmTimer();
+      }
+    }
 
-      {
-        std::lock_guard<std::mutex> lock(keepalivemutex_);
-        if (!keepalive_)
-          return;
+    if (reply.seq == renewal_)
+      renewal_ = 0;
+    if (reply.type == RenewMessage) {
+      for (const SchedulerItem &item : reply.items) {
+        if (!item.status) {
+          // It is not renewed any more, and its crawl has to stop.
+          MSS_WARN_MESSAGE(("Lease of " + item.name + " is lost").c_str());
+          leases_.erase(std::remove(leases_.begin(), leases_.end(),
+                                    item.name), leases_.end());
+          if (active_.erase(item.name) && lost_)
+            lost_(item.name);
+        }
       }
     }
-  });
-  return smbserver_;
+
+    itr->second->reply = reply;
+    itr->second->result = 0;
+    itr->second->done = true;
+    requests_.erase(itr);
+    replycv_.notify_all();
+  }
+
+  if (UNLIKELY(errno != EAGAIN && errno != EWOULDBLOCK))
+    MSS_ERROR("recv", errno);
 }
 
-void ServerManager::ReleaseServer() {
-  keepalivemutex_.lock();
-  keepalive_ = 0;
-  keepalivemutex_.unlock();
-  keepalivethread_.join();
+void ServerManager::Renew() {
+  // The previous renewal is still retried, renewal_ is the last of its
+  // messages.
+  if (renewal_ != 0)
+    return;
+
+  SchedulerMessage request;
+  request.type = RenewMessage;
+  for (const std::string &server : active_) {
+    request.items.emplace_back();
+    request.items.back().name = server;
+  }
+  for (const std::string &lease : leases_) {
+    request.items.emplace_back();
+    request.items.back().name = lease;
+  }
+
+  // One message takes SCHEDULER_MAX_ITEMS leases, more are renewed with
+  // several.
+  while (!request.items.empty()) {
+    SchedulerMessage part;
+    part.type = RenewMessage;
+    size_t count = std::min<size_t>(request.items.size(), SCHEDULER_MAX_ITEMS);
+    part.items.assign(request.items.end() - count, request.items.end());
+    request.items.resize(request.items.size() - count);
+    Submit(&part);
+    renewal_ = part.seq;
+  }
+}
+
+void ServerManager::ArmTimer() {
+  // A lease is renewed a few times during its time to live, so that a lost
+  // message doesn't lose it.
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = std::max<uint32_t>(ttl_ / 3, 1);
+  spec.it_interval.tv_nsec = 0;
+  spec.it_value = spec.it_interval;
+  if (UNLIKELY(timerfd_settime(timerfd_, 0, &spec, NULL) == -1))
+    MSS_ERROR("timerfd_settime", errno);
+}
 
-  std::string cmd = "R" + smbserver_;
-  send(sockfd_, cmd.c_str(), cmd.size(), 0);
+void ServerManager::Wake() {
+  uint64_t value = 1;
+  if (UNLIKELY(eventfd_ != -1 &&
+               write(eventfd_, &value, sizeof value) == -1))
+    MSS_ERROR("write", errno);
 }
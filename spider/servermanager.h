@@ -27,42 +27,228 @@
 #ifndef SPIDER_SERVERMANAGER_H_
 #define SPIDER_SERVERMANAGER_H_
 
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
-#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "scheduler/protocol.h"
 #include "common-inl.h"
+#include "config.h"
 
+/**
+ * Client of scheduler server. Takes several leases at once and hands them
+ * out one by one, any number of them may be indexed concurrently.
+ *
+ * One event loop thread owns the socket. It waits with epoll for replies,
+ * for the renewal timer (timerfd) and for new requests (eventfd), retries
+ * requests without reply and renews all held leases with one message.
+ */
 class ServerManager {
  public:
+  /**
+   * Function which is called with a server being indexed when its lease is
+   * lost, e.g. it expired and scheduler gave the server to another spider.
+   * Called from the event loop thread, must not call the manager.
+   */
+  typedef std::function<void(const std::string &server)> LostHandler;
+
   /**
    * Constructor which inits all variables and connects to scheduler server.
    *
    * @param server Server address.
+   * @param leases Number of leases to take at once.
    */
-  explicit ServerManager(const std::string &server);
+  explicit ServerManager(const std::string &server,
+                         const int leases = SPIDER_LEASES);
 
   /**
-   * Destructor.
+   * Destructor, releases servers which were leased but not indexed.
    */
   ~ServerManager();
 
   /**
-   * Get server to be indexed.
+   * Set function to call when a lease of a server being indexed is lost.
+   * Thread safe.
+   *
+   * @param handler New handler, empty to call nothing.
+   */
+  void set_lost_handler(const LostHandler &handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lost_ = handler;
+  }
+
+  /**
+   * Get server to be indexed. Blocks until scheduler gives one. Thread safe.
    */
   std::string GetServer();
 
   /**
-   * Release server when indexing is finished.
+   * Release server when indexing is finished. Doesn't wait for scheduler.
+   * A server whose lease is lost is not released, it may be leased by
+   * another spider already. Thread safe.
+   *
+   * @param server Server returned by GetServer().
+   * @param files Number of files found on the server, -1 if unknown.
+   * @param changed Number of new or changed files.
+   */
+  void ReleaseServer(const std::string &server, const int64_t files = -1,
+                     const int64_t changed = 0);
+
+  /**
+   * Hand shares or directories of the server being indexed back to
+   * scheduler, so that they are indexed as separate work items, possibly by
+   * other spiders. Thread safe.
+   *
+   * @param items Work item names, "server/share/path".
+   * @param queued Where to store for every item whether scheduler queued it
+   *        and it must be skipped.
+   */
+  void SplitItems(const std::vector<std::string> &items,
+                  std::vector<bool> *queued);
+
+  /**
+   * Hand one share or directory back to scheduler, see SplitItems().
+   *
+   * @param item Work item name, "server/share/path".
+   *
+   * @return true if scheduler queued the item and it must be skipped,
+   *         false if it should be indexed by this spider.
    */
-  void ReleaseServer();
+  bool SplitItem(const std::string &item);
 
  private:
-  std::mutex keepalivemutex_;
-  int keepalive_;
-  std::thread keepalivethread_;
-  std::string smbserver_;
+  /**
+   * Request waiting for reply.
+   */
+  struct Request {
+    SchedulerMessage message;
+    std::string data;
+    SchedulerMessage reply;
+    int attempts = 0;
+    std::chrono::steady_clock::time_point deadline;
+    bool done = false;
+    int result = -1;
+  };
+
+  /**
+   * Queue a request to be sent by the event loop. Must be called with
+   * mutex_ locked.
+   *
+   * @param message Request, its sequence number is set here.
+   *
+   * @return The queued request.
+   */
+  std::shared_ptr<Request> Submit(SchedulerMessage *message);
+
+  /**
+   * Send a request and wait for the reply. Thread safe.
+   *
+   * @param request Request, its sequence number is set here.
+   * @param reply Where to store the reply.
+   *
+   * @return 0 on success, -1 if scheduler doesn't reply.
+   */
+  int Exchange(SchedulerMessage *request, SchedulerMessage *reply);
+
+  /**
+   * Main loop of the event loop thread.
+   */
+  void EventLoop();
+
+  /**
+   * Send requests which are due and fail the ones out of attempts. Must be
+   * called with mutex_ locked.
+   *
+   * @return Milliseconds until the next retry, -1 if there are none.
+   */
+  int SendRequests();
+
+  /**
+   * Read all received replies and complete their requests. Must be called
+   * with mutex_ locked.
+   */
+  void ReceiveReplies();
+
+  /**
+   * Renew all held leases with one message. Must be called with mutex_
+   * locked.
+   */
+  void Renew();
+
+  /**
+   * Arm the renewal timer for the current ttl_.
+   */
+  void ArmTimer();
+
+  /**
+   * Wake up the event loop.
+   */
+  void Wake();
+
+  /**
+   * Guards everything below.
+   */
+  std::mutex mutex_;
+  /**
+   * Waiters for replies wait here.
+   */
+  std::condition_variable replycv_;
+  /**
+   * Sequence number of the last request.
+   */
+  uint32_t seq_;
+  /**
+   * Requests waiting for reply, by sequence number.
+   */
+  std::unordered_map<uint32_t, std::shared_ptr<Request> > requests_;
+  /**
+   * Buffer for received datagrams.
+   */
+  std::vector<char> buf_;
+  /**
+   * Servers being indexed.
+   */
+  std::unordered_set<std::string> active_;
+  /**
+   * Leased servers waiting to be indexed.
+   */
+  std::deque<std::string> leases_;
+  /**
+   * Function to call when a lease of a server being indexed is lost.
+   */
+  LostHandler lost_;
+  /**
+   * Number of leases to take at once.
+   */
+  int count_;
+  /**
+   * Lease time to live told by scheduler, in seconds.
+   */
+  uint32_t ttl_;
+  /**
+   * Sequence number of the renewal in flight, 0 if none.
+   */
+  uint32_t renewal_;
+  /**
+   * Set when the event loop should exit after all requests are done.
+   */
+  bool stop_;
+  std::thread loopthread_;
+
   int sockfd_;
+  int epollfd_;
+  int timerfd_;
+  int eventfd_;
   DISALLOW_COPY_AND_ASSIGN(ServerManager);
 };
 
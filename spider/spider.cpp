@@ -26,7 +26,6 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <libsmbclient.h>
 #include <unistd.h>
 #include <dirent.h>
 
@@ -38,44 +37,45 @@
 
 #include "config.h"
 #include "common-inl.h"
+#include "spider/contenthash.h"
+#include "spider/mimetypes.h"
 #include "spider/spider.h"
 
-static void libsmbmm_guest_auth_smbc_get_data(const char *server,
-                                              const char *share,
-                                              char *workgroup, int wgmaxlen,
-                                              char *username, int unmaxlen,
-                                              char *password, int pwmaxlen) {
-  strncpy(username, "Guest", unmaxlen - 1);
-  strncpy(password, "", pwmaxlen - 1);
-  strncpy(workgroup, "", wgmaxlen - 1);
-  // Hack to prevent qt warnings
-  server = server;
-  share = share;
-}
-
 Spider::Spider()
-    : db_name_(),
+    : free_batches_(DUMP_QUEUE_SIZE + 1),
+      full_batches_(DUMP_QUEUE_SIZE + 1),
+      db_name_(),
       db_server_(),
       db_user_(),
       db_password_() {
   openlog("spider", LOG_CONS | LOG_ODELAY, LOG_USER);
 
   mime_type_attr_ = NULL;
+  fingerprint_attr_ = NULL;
+  tokens_attr_ = NULL;
+  content_hash_attr_ = NULL;
+  full_hash_attr_ = NULL;
   pserver_manager_ = NULL;
   result_ = NULL;
-
-  if (smbc_init(libsmbmm_guest_auth_smbc_get_data, 0) < 0) {
-    DetectError();
-    MSS_FATAL("smbc_init", error_);
-    return;
-  }
-
-  // Create a directory to store file headers.
-  if (mkdir(TMPDIR, 00744 /* rwxr--r-- */) && errno != EEXIST) {
-    DetectError();
-    MSS_ERROR("mkdir", error_);
-    return;
-  }
+  crawler_ = NULL;
+  backend_ = NULL;
+  verify_backend_ = NULL;
+  verify_stop_ = false;
+  lease_lost_ = false;
+  cookie_ = NULL;
+  threads_ = CRAWLER_THREADS;
+  leases_ = SPIDER_LEASES;
+  split_dirs_ = SPIDER_SPLIT_DIRS;
+  split_depth_ = SPIDER_SPLIT_DEPTH;
+  dirents_size_ = DIRENTS_SIZE;
+  slow_dir_ms_ = SLOW_DIR_MS;
+  header_.resize(HEADERSIZE);
+  incremental_ = INCREMENTAL_CRAWL;
+  mime_by_extension_ = MIME_BY_EXTENSION;
+  tokenize_names_ = TOKENIZE_NAMES;
+  content_hash_ = CONTENT_HASH;
+  content_block_ = CONTENT_BLOCK_SIZE;
+  verify_duplicates_ = VERIFY_DUPLICATES;
 
   // Prepare to work with libmagic
   if ((cookie_ = magic_open(MAGIC_MIME_TYPE | MAGIC_ERROR)) == NULL) {
@@ -89,14 +89,26 @@ Spider::Spider()
     return;
   }
 
-  // Allocate memory to the result vector.
-  result_ = new(std::nothrow) std::vector<std::string>(VECTOR_SIZE);
+  // Allocate memory to the result batch.
+  result_ = new(std::nothrow) PathArena(VECTOR_SIZE, BATCH_BYTES);
   if (result_ == NULL) {
     error_ = ENOMEM;
     MSS_FATAL("result_", error_);
     return;
   }
-  last_ = result_->begin();
+
+  // Spare batches which are filled while previous ones are dumped.
+  for (int i = 0; i < DUMP_QUEUE_SIZE; ++i) {
+    PathArena *batch = new(std::nothrow) PathArena(VECTOR_SIZE, BATCH_BYTES);
+    if (UNLIKELY(batch == NULL)) {
+      error_ = ENOMEM;
+      MSS_FATAL("batch", error_);
+      return;
+    }
+    free_batches_.Push(batch);
+  }
+
+  writer_thread_ = std::thread(&Spider::WriterLoop, this);
 
   error_ = 0;
 }
@@ -122,6 +134,55 @@ int Spider::ReadConfig(const std::string &config) {
   scheduler_.assign(buf);
   scheduler_.erase(scheduler_.end() - 1);
 
+  // Read options.
+  while (getline(&buf, &size, fin) > 0) {
+    char name[32];
+    char server[256];
+    char dir[4096];
+    int value;
+    if (sscanf(buf, "mount %255s %4095s", server, dir) == 2) {
+      mounts_[server] = dir;
+      continue;
+    }
+
+    int count = sscanf(buf, "%31s %d %255s", name, &value, server);
+    if (count < 2)
+      continue;  // Empty or malformed line.
+
+    if (!strcmp(name, "mime_by_extension")) {
+      if (count == 3)
+        mime_by_extension_servers_[server] = value;
+      else
+        mime_by_extension_ = value;
+    } else if (!strcmp(name, "threads") && value > 0) {
+      threads_ = value;
+    } else if (!strcmp(name, "leases") && value > 0) {
+      leases_ = value;
+    } else if (!strcmp(name, "split_dirs") && value >= 0) {
+      split_dirs_ = value;
+    } else if (!strcmp(name, "split_depth") && value >= 0) {
+      split_depth_ = value;
+    } else if (!strcmp(name, "dirents_size") && value >= DIRENTS_MIN_SIZE) {
+      dirents_size_ = value;
+    } else if (!strcmp(name, "slow_dir_ms")) {
+      slow_dir_ms_ = value;
+    } else if (!strcmp(name, "incremental")) {
+      incremental_ = value;
+    } else if (!strcmp(name, "header_size") && value > 0) {
+      header_.resize(value);
+    } else if (!strcmp(name, "tokenize_names")) {
+      tokenize_names_ = value;
+    } else if (!strcmp(name, "content_hash")) {
+      content_hash_ = value;
+    } else if (!strcmp(name, "content_block_size") && value > 0) {
+      content_block_ = value;
+    } else if (!strcmp(name, "verify_duplicates")) {
+      verify_duplicates_ = value;
+    } else {
+      MSS_WARN_MESSAGE(("Unknown option: " + std::string(name)).c_str());
+    }
+  }
+
   free(buf);
   fclose(fin);
   return 0;
@@ -131,17 +192,28 @@ Spider::Spider(const std::string &config,
                const std::string &db_name,
                const std::string &db_server,
                const std::string &db_user,
-               const std::string &db_password) {
+               const std::string &db_password)
+    : Spider() {
+  if (error_)
+    return;
+
   if (ReadConfig(config) == -1)
     return;
 
-  pserver_manager_ = new(std::nothrow) ServerManager(scheduler_);
+  pserver_manager_ = new(std::nothrow) ServerManager(scheduler_, leases_);
   if (UNLIKELY(pserver_manager_ == NULL)) {
     error_ = ENOMEM;
     MSS_FATAL("pserver_manager_", error_);
     return;
   }
 
+  // Another spider may crawl the server now.
+  pserver_manager_->set_lost_handler([this](const std::string &server) {
+    std::lock_guard<std::mutex> lock(lease_mutex_);
+    if (server == crawled_server_)
+      lease_lost_ = true;
+  });
+
   db_name_ = db_name;
   db_server_ = db_server;
   db_user_ = db_user;
@@ -155,33 +227,58 @@ Spider::Spider(const std::string &config,
     return;
   }
 
-  // Detect an attribute to store mime types
-  mime_type_attr_ = FileAttribute::GetByNameAndType("mime-type",
-                                                    FileAttribute::faString);
-  if (!mime_type_attr_) {
-    // Create attribute if it doesn't exists
-    mime_type_attr_ = std::shared_ptr<FileAttribute>(
-        new(std::nothrow) FileAttribute("mime-type", FileAttribute::faString));
-    if (!mime_type_attr_) {
-      MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
-      error_ = ENOMSG;
-      delete result_;
-      result_ = NULL;
-    }
+  // Detect attributes to store mime types, tokens, fingerprints and content
+  // hashes.
+  if (InitStringAttr("mime-type", &mime_type_attr_) ||
+      (tokenize_names_ && InitStringAttr("tokens", &tokens_attr_)) ||
+      (incremental_ && InitStringAttr("fingerprint", &fingerprint_attr_)) ||
+      (content_hash_ &&
+       InitStringAttr("content-hash", &content_hash_attr_)) ||
+      (content_hash_ && verify_duplicates_ &&
+       InitStringAttr("content-hash-full", &full_hash_attr_))) {
+    delete result_;
+    result_ = NULL;
+    return;
   }
+
+  if (full_hash_attr_)
+    verifier_thread_ = std::thread(&Spider::VerifierLoop, this);
 }
 
 Spider::~Spider() {
+  // Stop crawler threads before anything they use is destroyed.
+  if (crawler_ != NULL)
+    delete crawler_;
+
+  // Verification may take long, it is interrupted between files.
+  if (verifier_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(verify_mutex_);
+      verify_stop_ = true;
+    }
+    verify_cond_.notify_one();
+    verifier_thread_.join();
+  }
+
+  // Let the writer dump everything queued and stop.
+  if (writer_thread_.joinable()) {
+    full_batches_.Push(DumpTask());
+    writer_thread_.join();
+  }
+
+  while (free_batches_.size())
+    delete free_batches_.Pop();
+
   // Close connection with data base
   if (!DatabaseEntity::Disconnect())
     MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
 
-  if (rmdir(TMPDIR))
-    MSS_ERROR("rmdir", errno);
-
   if (pserver_manager_ != NULL)
     delete pserver_manager_;
 
+  delete backend_;
+  delete verify_backend_;
+
   if (cookie_)
     magic_close(cookie_);
 
@@ -194,121 +291,172 @@ Spider::~Spider() {
 void Spider::Run() {
   while (1) {
     std::string server = pserver_manager_->GetServer();
+    {
+      std::lock_guard<std::mutex> lock(lease_mutex_);
+      crawled_server_ = server;
+      lease_lost_ = false;
+    }
+
     // Scan each server for all files.
-    if (UNLIKELY(ScanSMBDir("smb://" + server))) {
-      MSS_DEBUG_ERROR(("ScanSMBDir smb://" + server).c_str(), error_);
+    std::string url = ItemUrl(server);
+    if (UNLIKELY(ScanSMBDir(url))) {
+      MSS_DEBUG_ERROR(("ScanSMBDir " + url).c_str(), error_);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(lease_mutex_);
+      crawled_server_.clear();
     }
-    pserver_manager_->ReleaseServer();
-    // Added content to data base.
-    if (UNLIKELY(DumpToDataBase())) {
-      MSS_DEBUG_ERROR(("DumpToDataBase smb://" + server).c_str(), error_);
+
+    // Queue the rest of results to be added in data base, the next server
+    // is scanned while they are dumped. The writer releases the server
+    // after dumping them, so that scheduler gets the real change counts.
+    {
+      std::lock_guard<std::mutex> lock(result_mutex_);
+      SubmitBatch(server);
     }
+
+    // New files may have duplicates.
+    if (verifier_thread_.joinable())
+      RequestVerification();
   }
 }
 
 int Spider::ScanSMBDir(const std::string &dir) {
-  int directory_handler = 0, dirc = 0, dsize = 0;
-  char *dirp = NULL;
-  char buf[BUF_SIZE];
+  if (crawler_ == NULL) {
+    // Size and modification time are needed only to detect unchanged files.
+    crawler_ = new(std::nothrow) Crawler(threads_, [this](
+        const std::string &dir, const std::vector<CrawlEntry> &entries) {
+          AddFiles(dir, entries);
+        }, !!fingerprint_attr_,
+        [this](const std::string &scheme) { return CreateBackend(scheme); });
+    if (UNLIKELY(crawler_ == NULL)) {
+      error_ = ENOMEM;
+      MSS_FATAL("crawler_", error_);
+      return -1;
+    }
 
-  // Open given smb directory.
-  if (UNLIKELY((directory_handler = smbc_opendir(dir.c_str())) < 0)) {
-    DetectError();
-    MSS_ERROR(("smbc_opendir " + dir).c_str(), error_);
+    crawler_->set_slow_dir_ms(slow_dir_ms_);
+
+    // Only a spider with a scheduler can split its work.
+    if (pserver_manager_ != NULL && split_dirs_ > 0) {
+      crawler_->set_dir_filter([this](const std::string &dir,
+                                      std::vector<std::string> *subdirs) {
+        SplitWork(dir, subdirs);
+      });
+    }
+  }
+
+  if (UNLIKELY(!crawler_->is_ready())) {
+    error_ = crawler_->get_error();
+    MSS_ERROR("Crawler", error_);
+    // Try to start the workers again with the next scan.
+    delete crawler_;
+    crawler_ = NULL;
     return -1;
   }
 
-  // Getting content of the directory.
-  // smbc_getdents() returns the readen size.
-  // When no more content in the directory smbc_getdents() returns 0.
-  // Use smbc_getdents() while returned value not equal 0.
-  while (true) {
-    dirp = static_cast<char *>(buf);
-
-    // Get dir content which can placed in buf.
-    if (UNLIKELY((dirc = smbc_getdents(directory_handler,
-                                       (struct smbc_dirent *)dirp,
-                                       sizeof(buf)))) < 0) {
-      DetectError();
-      MSS_ERROR("smbc_getdents", error_);
-      return -1;
-    }
+  int result = crawler_->Scan(dir, &lease_lost_);
 
-    // Break the cycle if no more content in this directory.
-    if (dirc == 0)
-      break;
+  ReadDirStats stats = crawler_->get_stats();
+  char message[128];
+  snprintf(message, sizeof(message),
+           ": %zu directories, %zu entries, %zu calls, %lld ms",
+           crawler_->get_dirs(), stats.entries, stats.calls,
+           static_cast<long long>(stats.usec / 1000));  // NOLINT
+  MSS_INFO_MESSAGE(("Scanned " + dir + message).c_str());
 
-    // Put readen content in list
-    while (dirc > 0) {
-      dsize = ((struct smbc_dirent *)dirp)->dirlen;
+  if (UNLIKELY(result)) {
+    error_ = crawler_->get_error();
+    return -1;
+  }
 
-      // Ignoring "." and ".."
-      if ((strcmp(((struct smbc_dirent *)dirp)->name, ".") == 0) ||
-          (strcmp(((struct smbc_dirent *)dirp)->name, "..") == 0)) {
-        dirp += dsize;  // Promote pointer
-        dirc -= dsize;  // Decrease size
-        continue;
-      }
+  return 0;
+}
 
-      switch (((struct smbc_dirent *)dirp)->smbc_type) {
-        case SMBC_WORKGROUP: {
-          ScanSMBDir(dir + "/" + ((struct smbc_dirent *)dirp)->name);
-          break;
-        }
-        case SMBC_SERVER: {
-          ScanSMBDir(dir + "/" + ((struct smbc_dirent *)dirp)->name);
-          break;
-        }
-        case SMBC_FILE_SHARE: {
-          ScanSMBDir(dir + "/" + ((struct smbc_dirent *)dirp)->name);
-          break;
-        }
-        case SMBC_PRINTER_SHARE: {
-          // Do nothing
-          break;
-        }
-        case SMBC_COMMS_SHARE: {
-          // Do nothing
-          break;
-        }
-        case SMBC_IPC_SHARE: {
-          // Do nothing
-          break;
-        }
-        case SMBC_DIR: {
-          ScanSMBDir(dir + "/" + ((struct smbc_dirent *)dirp)->name);
-          break;
-        }
-        case SMBC_FILE: {
-          AddSMBFile(dir+"/"+((struct smbc_dirent *)dirp)->name);
-          break;
-        }
-        case SMBC_LINK: {
-          // Do nothing
-          break;
-        }
-        default: {
-          MSS_FATAL_MESSAGE("Unknown smb entry type");
-          assert(0);  // This can't happen
-        }
-      }
+std::string Spider::ItemUrl(const std::string &item) const {
+  if (mounts_.count(item.substr(0, item.find('/'))))
+    return "file://" + item;
+  return "smb://" + item;
+}
 
-      dirp += dsize;  // Promote pointer
-      dirc -= dsize;  // Decrease size
-    }
+CrawlBackend *Spider::CreateBackend(const std::string &scheme) const {
+  CrawlBackend *backend = CrawlBackend::Create(scheme, mounts_);
+  if (backend != NULL)
+    backend->set_buffer_size(dirents_size_);
+  return backend;
+}
+
+int Spider::UseBackend(const std::string &url, CrawlBackend **backend,
+                       std::string *scheme, int *error) {
+  std::string url_scheme = CrawlBackend::Scheme(url);
+  if (*backend != NULL && *scheme == url_scheme)
+    return 0;
+
+  delete *backend;
+  *backend = CreateBackend(url_scheme);
+  if (UNLIKELY(*backend == NULL)) {
+    *error = errno;
+    MSS_ERROR(("CrawlBackend::Create " + url_scheme).c_str(), *error);
+    return -1;
   }
+  *scheme = url_scheme;
+  return 0;
+}
 
-  // Close given smb directory
-  if (UNLIKELY(smbc_closedir(directory_handler) < 0)) {
-    DetectError();
-    MSS_ERROR(("smbc_closedir " + dir).c_str(), error_);
+bool Spider::ShouldSplit(const std::string &dir, const size_t subdirs) const {
+  if (split_dirs_ == 0)
+    return false;
+
+  // Count levels below the server root, "smb://server" is 0.
+  size_t depth = std::count(dir.begin() + CrawlBackend::ServerOffset(dir),
+                            dir.end(), '/');
+  if (depth == 0)
+    return true;  // shares
+
+  return subdirs >= split_dirs_ && depth < split_depth_;
+}
+
+void Spider::SplitWork(const std::string &dir,
+                       std::vector<std::string> *subdirs) {
+  if (!ShouldSplit(dir, subdirs->size()))
+    return;
+
+  // Keep only subdirectories which scheduler didn't take, work item name
+  // is the URL without "scheme://".
+  std::vector<std::string> items;
+  for (const std::string &subdir : *subdirs)
+    items.push_back(subdir.substr(CrawlBackend::ServerOffset(subdir)));
+
+  std::vector<bool> queued;
+  pserver_manager_->SplitItems(items, &queued);
+
+  std::vector<std::string> rest;
+  for (size_t i = 0; i < subdirs->size(); ++i) {
+    if (!queued[i])
+      rest.push_back(std::move((*subdirs)[i]));
+  }
+  subdirs->swap(rest);
+}
+
+int Spider::AddFileEntryInDataBase(const std::string &file,
+                                   const std::string &server) {
+  BatchWriter writer;
+  if (UNLIKELY(AddFileEntryInDataBase(file, server, &writer)))
+    return -1;
+
+  if (UNLIKELY(!writer.Flush())) {
+    MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return -1;
   }
 
   return 0;
 }
 
 int Spider::AddFileEntryInDataBase(const std::string &file,
-                                   const std::string &server) {
+                                   const std::string &server,
+                                   BatchWriter *writer) {
   if (UNLIKELY(file.empty() || server.empty())) {
     MSS_ERROR_MESSAGE("Given string is empthy.");
     error_ = EINVAL;
@@ -323,19 +471,28 @@ int Spider::AddFileEntryInDataBase(const std::string &file,
   }
   std::string name = file.substr(pos + 1);  // '+ 1' to delete '/' symbol.
 
-  // '+ 7':
-  // '+ 6' to delete "smb://" from full path to file
-  // '+ 1' to delete "/" after hostname
+  // Skip "scheme://", hostname and "/" after it.
   //
   // Example:
   // full path to a file = "smb://some.server/path/to/file"
   // server = some.server
   // path = path/to/file
   // file = file
-  std::string path = file.substr(server.length() + 7);
+  std::string path = file.substr(CrawlBackend::ServerOffset(file) +
+                                 server.length() + 1);
+
+  return IndexFile(file, server, path, &name, writer);
+}
+
+int Spider::IndexFile(const std::string &url, const std::string &server,
+                      const std::string &path, std::string *name,
+                      BatchWriter *writer) {
+  // Tokens are built from the original name, NameParser loses underscores.
+  if (tokens_attr_)
+    tokenizer_.Tokenize(*name, &tokens_);
 
   // Parsing file name to simplify further search.
-  if (UNLIKELY(NameParser(&name))) {
+  if (UNLIKELY(NameParser(name))) {
     MSS_DEBUG_MESSAGE("NameParser: -1 returned");
     return -1;
   }
@@ -343,9 +500,38 @@ int Spider::AddFileEntryInDataBase(const std::string &file,
   // TODO(yulyugin): Not detect parameter for existing entry
   // after issue #5 will fixed.
 
+  // Try to avoid opening the file.
+  const char *mime_type = NULL;
+  if (MimeByExtension(server))
+    mime_type = MimeTypeByExtension(path);
+
+  // Hashing reads the header anyway, libmagic gets the first block so that
+  // the file is opened once. Directories and unreadable files just have no
+  // content hash.
+  bool hashed = false;
+  if (content_hash_attr_) {
+    hashed = !HashContent(url, CONTENT_SAMPLES, &backend_, &backend_scheme_,
+                          &hash_, &error_,
+                          mime_type == NULL ? &mime_type : NULL);
+    if (!hashed && mime_type == NULL)
+      mime_type = error_ == EISDIR ? "inode/directory" : "unknown";
+  }
+  // Empty files have no blocks.
+  if (mime_type == NULL)
+    mime_type = DetectMimeType(url);
+
   // Add new entry or updaste existing
-  FileEntry entry(name, path, server);
-  FileParameter(entry, *mime_type_attr_, DetectMimeType(file), 0, true);
+  writer->AddFile(*name, path, server);
+  writer->AddParameter(path, server, mime_type_attr_->get_id(), mime_type, 0,
+                       true);
+  if (tokens_attr_ && !tokens_.empty())
+    writer->AddParameter(path, server, tokens_attr_->get_id(), tokens_, 0,
+                         true);
+
+  if (hashed) {
+    writer->AddParameter(path, server, content_hash_attr_->get_id(), hash_,
+                         0, true);
+  }
 
   return 0;
 }
@@ -357,180 +543,401 @@ int Spider::NameParser(std::string *name) {
     return -1;
   }
 
-  size_t pos;
-  while (true) {
-    if ((pos = name->find("_")) == std::string::npos)
-      return 0;  // No '_' symbols in name.
+  // Replace '_' with spaces in one pass.
+  std::replace(name->begin(), name->end(), '_', ' ');
+  return 0;
+}
+
+int Spider::DumpToDataBase() {
+  // Only the writer thread dumps, it owns header_, cookie_ and backend_.
+  if (UNLIKELY(!writer_thread_.joinable()))
+    return -1;  // error_ is set by the constructor.
 
-    name->replace(pos, 1, " ");  // Replase '_' with space.
+  {
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    SubmitBatch();
   }
 
-  return 0;
+  std::unique_lock<std::mutex> lock(dump_mutex_);
+  dump_cond_.wait(lock, [this] { return dumped_ == submitted_; });
+  int failures = dump_failures_;
+  dump_failures_ = 0;
+  return failures ? -1 : 0;
 }
 
-// TODO(yulyugin): Add check on errors and rollback transaction in case
-// of fatal error.
-int Spider::DumpToDataBase() {
-  if (UNLIKELY(last_ == result_->begin())) {
+int Spider::DumpBatch(const PathArena &batch) {
+  if (UNLIKELY(batch.empty())) {
     MSS_DEBUG_MESSAGE("No result's to dump.");
     return 0;
   }
 
-  // Extract the name of server.
-  // "smb://some.server/path/to/file" -> "some.server"
-  std::string server(result_->front(), 6, result_->front().find("/", 6) - 6);
-
   DatabaseEntity::StartTransaction();
-  /*if (UNLIKELY(!DatabaseEntity::get_db_error().empty())) {
+
+  BatchWriter writer;
+  // Reused for every file, the batch keeps only pieces of paths.
+  std::string url, server, path, name, key;
+
+  // Fingerprints saved during the previous crawl, key is server + "/" + path
+  // i.e. the URL without "scheme://".
+  std::unordered_map<std::string, std::string> known;
+  bool has_known = fingerprint_attr_ != NULL;
+  if (fingerprint_attr_) {
+    std::vector<std::pair<std::string, std::string> > files;
+    files.reserve(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+      if (batch.get_size(i) < 0)
+        continue;  // Will be reindexed anyway.
+
+      batch.GetServer(i, &server);
+      batch.GetPath(i, &path);
+      files.emplace_back(server, path);
+    }
+
+    // Without old fingerprints every file is just reindexed.
+    if (UNLIKELY(!writer.LoadParameters(files, fingerprint_attr_->get_id(),
+                                        &known))) {
+      MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
+      known.clear();
+      has_known = false;
+    }
+  }
+
+  std::string fingerprint;
+  int64_t changed = 0;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    batch.GetServer(i, &server);
+    batch.GetPath(i, &path);
+
+    if (fingerprint_attr_)
+      Fingerprint(batch.get_size(i), batch.get_mtime(i), &fingerprint);
+
+    // Unchanged file, only mark it as still existing.
+    if (!fingerprint.empty()) {
+      key.assign(server).append(1, '/').append(path);
+      auto old = known.find(key);
+      if (old != known.end() && old->second == fingerprint) {
+        writer.TouchFile(path, server);
+        continue;
+      }
+    }
+
+    batch.GetUrl(i, &url);
+    batch.GetName(i, &name);
+    if (UNLIKELY(IndexFile(url, server, path, &name, &writer))) {
+      MSS_DEBUG_ERROR("IndexFile", error_);
+      continue;
+    }
+    ++changed;
+
+    if (!fingerprint.empty()) {
+      writer.AddParameter(path, server, fingerprint_attr_->get_id(),
+                          fingerprint, 0, true);
+    }
+  }
+
+  if (UNLIKELY(!writer.Flush())) {
     MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
     error_ = ENOMSG;
+    DatabaseEntity::RollbackTransaction();
     return -1;
-  }*/
-
-  for (std::vector<std::string>::iterator itr = result_->begin();
-       itr != last_; ++itr) {
-    if (UNLIKELY(AddFileEntryInDataBase(*itr, server))) {
-      if (error_ == ENOMSG) {  // Data base error.
-        MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
-      } else {
-        MSS_DEBUG_ERROR("AddFileEntryInDataBase", error_);
-      }
-    }
   }
 
-  DatabaseEntity::CommitTransaction();
-  /*if (UNLIKELY(!DatabaseEntity::get_db_error().empty())) {
+  if (UNLIKELY(!DatabaseEntity::CommitTransaction())) {
     MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
     error_ = ENOMSG;
     return -1;
-  }*/
+  }
 
+  // Without old fingerprints every file looks changed, so the rate is not
+  // known.
+  if (!has_known)
+    item_files_ = -1;
+  if (item_files_ != -1) {
+    item_files_ += batch.size();
+    item_changed_ += changed;
+  }
   return 0;
 }
 
-void Spider::AddSMBFile(const std::string &name) {
-  *last_ = name;
-  ++last_;
+int Spider::HashContent(const std::string &url, const size_t count,
+                        CrawlBackend **backend, std::string *scheme,
+                        std::string *hash, int *error,
+                        const char **mime_type) {
+  if (UNLIKELY(UseBackend(url, backend, scheme, error)))
+    return -1;
 
-  if (UNLIKELY(last_ == result_->end())) {
-    DumpToDataBase();
-    last_ = result_->begin();
+  ContentHash content;
+  int64_t size;
+  if ((*backend)->ReadSamples(url, content_block_, count, &size,
+                              [&](const char *data, const size_t length) {
+                                if (mime_type && *mime_type == NULL) {
+                                  *mime_type = magic_buffer(
+                                      cookie_, data,
+                                      std::min(length, header_.size()));
+                                }
+                                content.Update(data, length);
+                              })) {
+    *error = (*backend)->get_error();
+    return -1;
   }
-}
 
-const char *Spider::DetectMimeType(const std::string &path) {
-  int smb_fd = smbc_open(path.c_str(), O_RDONLY, 0);
-  if (UNLIKELY(smb_fd < 0)) {
-    if (LIKELY(errno == EISDIR))
-      return "inode/directory";
+  // Equal hashes of files with different sizes are not duplicates.
+  hash->assign(std::to_string(size)).append(1, ':')
+       .append(ContentHash::ToHex(content.Digest()));
+  return 0;
+}
 
-    DetectError();
-    MSS_ERROR(("smbc_open " + path).c_str(), error_);
-    return "unknown";
-  }
+int Spider::VerifyDuplicates() {
+  // Groups of duplicates are loaded a page at a time, so memory doesn't
+  // grow with the database.
+  std::string after;
+  std::vector<int> ids;
+  std::unordered_map<int, std::string> verified;
+  BatchWriter writer;
+  std::string url, value, hash;
+  size_t hashed = 0, total = 0;
+  while (!verify_stop_) {
+    auto params = FileParameter::GetDuplicates(content_hash_attr_->get_id(),
+                                               after, VERIFY_PAGE_GROUPS);
+    if (UNLIKELY(!params)) {
+      MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+      verify_error_ = ENOMSG;
+      return -1;
+    }
+    if (params->empty())
+      break;
+    after = params->back()->get_str_value();
+    total += params->size();
+
+    // Full hashes saved by previous verifications, key is file id.
+    ids.clear();
+    for (const auto &param : *params)
+      ids.push_back(param->get_file()->get_id());
+
+    verified.clear();
+    auto full = FileParameter::GetByFiles(ids, full_hash_attr_->get_id());
+    if (UNLIKELY(!full)) {
+      MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+      verify_error_ = ENOMSG;
+      return -1;
+    }
+    for (const auto &param : *full)
+      verified[param->get_file()->get_id()] = param->get_str_value();
+
+    for (const auto &param : *params) {
+      if (verify_stop_)
+        break;
+
+      // A full hash stays valid while the content hash is the same.
+      std::shared_ptr<FileEntry> file = param->get_file();
+      value.assign(param->get_str_value()).append(1, '=');
+      auto old = verified.find(file->get_id());
+      if (old != verified.end() &&
+          !old->second.compare(0, value.size(), value))
+        continue;
 
-  // Extract name of the file
-  // Don't detele '/' symbol it need to form path.
-  std::string name(path, path.rfind("/"));
+      url = ItemUrl(file->get_server_name() + "/" + file->get_file_path());
+      if (UNLIKELY(HashContent(url, 0, &verify_backend_, &verify_scheme_,
+                               &hash, &verify_error_))) {
+        MSS_DEBUG_ERROR(("HashContent " + url).c_str(), verify_error_);
+        continue;
+      }
 
-  // Create a storage for file header in TMPDIR and open it
-  int fd = open((TMPDIR + name).c_str(), O_CREAT | O_RDWR | O_EXCL,
-                00744 /* rwxr--r-- */);
-  if (UNLIKELY(fd == -1)) {
-    if (LIKELY(errno = ENOTDIR)) {
-      // TODO(yulyugin): Check if TMPDIR doesn't exists create it.
+      // Keep only the hash, size is a part of the content hash.
+      value.append(hash, hash.find(':') + 1, std::string::npos);
+      writer.AddParameter(file->get_file_path(), file->get_server_name(),
+                          full_hash_attr_->get_id(), value, 0, true);
+      ++hashed;
     }
-    DetectError();
-    MSS_ERROR("open", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
+
+    if (UNLIKELY(!writer.Flush())) {
+      MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+      verify_error_ = ENOMSG;
+      return -1;
     }
-    return "unknown";
   }
 
-  void *buf = malloc(HEADERSIZE);  // Buffer to store header.
+  char message[96];
+  snprintf(message, sizeof(message),
+           "Verified duplicates: %zu files hashed of %zu", hashed, total);
+  MSS_INFO_MESSAGE(message);
+  return 0;
+}
 
-  // Copy file header to TMPDIR
-  if (UNLIKELY(smbc_read(smb_fd, buf, HEADERSIZE) < 0)) {
-    DetectError();
-    MSS_ERROR("smbc_read", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
-    }
-    if (UNLIKELY(close(fd))) {
-      DetectError();
-      MSS_ERROR("close", error_);
-    }
-    free(buf);
-    return "unknown";
+void Spider::AddSMBFile(const std::string &name) {
+  FoundFile file;
+  file.path = name;
+  AddSMBFile(file);
+}
+
+void Spider::AddSMBFile(const FoundFile &file) {
+  size_t pos = file.path.rfind('/');
+  if (UNLIKELY(pos == std::string::npos)) {
+    MSS_ERROR_MESSAGE(("Given string " + file.path +
+                       " have no '/' symbol.").c_str());
+    return;
   }
 
-  if (UNLIKELY(write(fd, buf, HEADERSIZE) < 0)) {
-    DetectError();
-    MSS_ERROR("write", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
-    }
-    if (UNLIKELY(close(fd))) {
-      DetectError();
-      MSS_ERROR("close", error_);
+  std::lock_guard<std::mutex> lock(result_mutex_);
+
+  result_->AddFile(result_->InternDir(file.path.substr(0, pos)),
+                   file.path.substr(pos + 1), file.size, file.mtime);
+
+  if (UNLIKELY(result_->full()))
+    SubmitBatch();
+}
+
+void Spider::AddFiles(const std::string &dir,
+                      const std::vector<CrawlEntry> &entries) {
+  std::lock_guard<std::mutex> lock(result_mutex_);
+
+  uint32_t id = result_->InternDir(dir);
+  for (const CrawlEntry &entry : entries) {
+    if (entry.is_dir)
+      continue;
+
+    // The directory is interned again in the next batch.
+    if (UNLIKELY(result_->full())) {
+      SubmitBatch();
+      id = result_->InternDir(dir);
     }
-    free(buf);
-    return "unknown";
+
+    result_->AddFile(id, entry.name, entry.size, entry.mtime);
   }
 
-  // Move to the begining of the file
-  if (UNLIKELY(lseek(fd, 0, SEEK_SET) != 0)) {
-    DetectError();
-    MSS_ERROR("lseek", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
+  if (UNLIKELY(result_->full()))
+    SubmitBatch();
+}
+
+void Spider::SubmitBatch(const std::string &release) {
+  DumpTask task;
+  if (!result_->empty())
+    task.batch = result_;
+  task.release = release;
+  if (task.batch == NULL && task.release.empty())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(dump_mutex_);
+    ++submitted_;
+  }
+  full_batches_.Push(task);
+
+  // Waits while all the other batches are queued or being dumped.
+  if (task.batch != NULL)
+    result_ = free_batches_.Pop();
+}
+
+void Spider::WriterLoop() {
+  while (true) {
+    DumpTask task = full_batches_.Pop();
+    if (task.batch == NULL && task.release.empty())
+      return;  // Spider is being destroyed.
+
+    int result = 0;
+    if (task.batch != NULL) {
+      result = DumpBatch(*task.batch);
+      if (UNLIKELY(result))
+        MSS_DEBUG_ERROR("DumpBatch", error_);
+
+      task.batch->Clear();
+      free_batches_.Push(task.batch);
     }
-    if (UNLIKELY(close(fd))) {
-      DetectError();
-      MSS_ERROR("close", error_);
+
+    if (!task.release.empty()) {
+      pserver_manager_->ReleaseServer(task.release, item_files_,
+                                      item_changed_);
+      item_files_ = 0;
+      item_changed_ = 0;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(dump_mutex_);
+      ++dumped_;
+      if (UNLIKELY(result))
+        ++dump_failures_;
     }
-    free(buf);
+    dump_cond_.notify_all();
+  }
+}
+
+void Spider::RequestVerification() {
+  {
+    std::lock_guard<std::mutex> lock(verify_mutex_);
+    verify_pending_ = true;
+  }
+  verify_cond_.notify_one();
+}
+
+void Spider::VerifierLoop() {
+  std::unique_lock<std::mutex> lock(verify_mutex_);
+  while (true) {
+    verify_cond_.wait(lock, [this] {
+      return verify_pending_ || verify_stop_;
+    });
+    if (verify_stop_)
+      return;  // Spider is being destroyed.
+
+    // Requests made during the verification start the next one.
+    verify_pending_ = false;
+    lock.unlock();
+    if (UNLIKELY(VerifyDuplicates()))
+      MSS_DEBUG_ERROR("VerifyDuplicates", verify_error_);
+    lock.lock();
+  }
+}
+
+const char *Spider::DetectMimeType(const std::string &path) {
+  if (UNLIKELY(UseBackend(path, &backend_, &backend_scheme_, &error_)))
+    return "unknown";
+
+  ssize_t size = backend_->ReadHeader(path, header_.data(), header_.size());
+  if (UNLIKELY(size < 0)) {
+    if (LIKELY(backend_->get_error() == EISDIR))
+      return "inode/directory";
+
+    error_ = backend_->get_error();
+    MSS_ERROR(("ReadHeader " + path).c_str(), error_);
     return "unknown";
   }
 
-  const char *mime_type = magic_descriptor(cookie_, fd);
+  const char *mime_type = magic_buffer(cookie_, header_.data(), size);
   if (UNLIKELY(mime_type == NULL)) {
     error_ = magic_errno(cookie_);
-    MSS_ERROR("magic_descriptor", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
-    }
-    if (UNLIKELY(close(fd))) {
-      DetectError();
-      MSS_ERROR("close", error_);
-    }
-    free(buf);
+    MSS_ERROR("magic_buffer", error_);
     return "unknown";
   }
 
-  if (UNLIKELY(smbc_close(smb_fd))) {
-    DetectError();
-    MSS_ERROR("smbc_close", error_);
-  }
-  free(buf);
+  return mime_type;
+}
 
-  // Remove temporary file.
-  if (UNLIKELY(unlink((TMPDIR + name).c_str()))) {
-    DetectError();
-    MSS_ERROR("unlink", error_);
-  }
+bool Spider::MimeByExtension(const std::string &server) const {
+  auto policy = mime_by_extension_servers_.find(server);
+  if (policy != mime_by_extension_servers_.end())
+    return policy->second;
 
-  return mime_type;
+  return mime_by_extension_;
 }
 
 int Spider::InitMimeTypeAttr()  {
-  if (mime_type_attr_)
+  return InitStringAttr("mime-type", &mime_type_attr_);
+}
+
+int Spider::InitFingerprintAttr()  {
+  return InitStringAttr("fingerprint", &fingerprint_attr_);
+}
+
+int Spider::InitTokensAttr()  {
+  return InitStringAttr("tokens", &tokens_attr_);
+}
+
+int Spider::InitContentHashAttr()  {
+  return InitStringAttr("content-hash", &content_hash_attr_);
+}
+
+int Spider::InitStringAttr(const std::string &name,
+                           std::shared_ptr<FileAttribute> *attr) {
+  if (*attr)
     return 0;
 
   if (ConnectToDataBase()) {
@@ -539,13 +946,12 @@ int Spider::InitMimeTypeAttr()  {
     return -1;
   }
 
-  mime_type_attr_ = FileAttribute::GetByNameAndType("mime-type",
-                                                    FileAttribute::faString);
-  if (UNLIKELY(!mime_type_attr_)) {
+  *attr = FileAttribute::GetByNameAndType(name, FileAttribute::faString);
+  if (UNLIKELY(!*attr)) {
     // Create attribute if it doesn't exists
-    mime_type_attr_ = std::shared_ptr<FileAttribute>(
-        new(std::nothrow) FileAttribute("mime-type", FileAttribute::faString));
-    if (UNLIKELY((!mime_type_attr_))) {
+    *attr = std::shared_ptr<FileAttribute>(
+        new(std::nothrow) FileAttribute(name, FileAttribute::faString));
+    if (UNLIKELY((!*attr))) {
       MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
       error_ = ENOMSG;
       return -1;
@@ -554,3 +960,17 @@ int Spider::InitMimeTypeAttr()  {
 
   return 0;
 }
+
+void Spider::Fingerprint(const int64_t size, const time_t mtime,
+                         std::string *fingerprint) {
+  if (size < 0) {
+    fingerprint->clear();
+    return;
+  }
+
+  char buf[48];
+  int length = snprintf(buf, sizeof(buf), "%lld:%lld",
+                        static_cast<long long>(size),    // NOLINT
+                        static_cast<long long>(mtime));  // NOLINT
+  fingerprint->assign(buf, length);
+}
@@ -32,11 +32,22 @@
 #include <string>
 #include <list>
 #include <vector>
+#include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
 
 #include "common-inl.h"
+#include "spider/boundedqueue.h"
+#include "spider/crawlbackend.h"
+#include "spider/crawler.h"
+#include "spider/nametokenizer.h"
+#include "spider/patharena.h"
 #include "spider/servermanager.h"
 #include "data-storage/entities.h"
+#include "data-storage/batchwriter.h"
 
 /**
  * Class to index files located in local network.
@@ -67,6 +78,29 @@ class Spider {
   /**
    * Read configuration file.
    *
+   * The first line is the scheduler hostname. Each next line is an option
+   * in "name value" form:
+   * threads - number of threads which scan smb directories.
+   * incremental - 1 to skip files which size and modification time didn't
+   * change since the previous crawl, 0 to always reindex.
+   * header_size - number of bytes read from the beginning of a file to
+   * detect its MIME type.
+   * mime_by_extension - 1 to detect MIME type by the file extension when it
+   * is known and read the header only otherwise, 0 to always read the header.
+   * A server name may follow the value to set it only for this server.
+   * leases - number of servers taken from scheduler at once.
+   * split_dirs - hand subdirectories of a directory with at least this
+   * number of subdirectories back to scheduler as separate work items,
+   * 0 to crawl every server as a whole.
+   * split_depth - split only directories less than this number of levels
+   * below the server root.
+   * mount - "mount server directory" crawls the server in the local
+   * directory where it is mounted instead of through smb.
+   * dirents_size - size in bytes of the buffer which every crawler thread
+   * fills with directory entries in one call.
+   * slow_dir_ms - log directories which take longer to read, -1 to log
+   * nothing.
+   *
    * @param config Configuration file name.
    */
   int ReadConfig(const std::string &config);
@@ -94,23 +128,41 @@ class Spider {
   /**
    * Get set of indexed files which still don't dumped in data base.
    *
-   * @return Get vector of indexed files.
+   * @return Batch of indexed files.
    */
-  inline std::vector<std::string> get_result() const { return *result_; }
+  inline const PathArena &get_result() const { return *result_; }
 
   /**
-   * Get an iterator to the last indexed file.
+   * Get a MIME type attribute.
    *
-   * @return iterator to the last indexed file.
+   * @return MIME type attribute.
    */
-  inline std::vector<std::string>::iterator get_last() const { return last_; }
+  inline FileAttribute get_mime_type_attr() const { return *mime_type_attr_; }
 
   /**
-   * Get a MIME type attribute.
+   * Get a fingerprint attribute.
    *
-   * @return MIME type attribute.
+   * @return Fingerprint attribute.
    */
-  inline FileAttribute get_mime_type_attr() const { return *mime_type_attr_; }
+  inline FileAttribute get_fingerprint_attr() const {
+    return *fingerprint_attr_;
+  }
+
+  /**
+   * Get an attribute of search tokens.
+   *
+   * @return Tokens attribute.
+   */
+  inline FileAttribute get_tokens_attr() const { return *tokens_attr_; }
+
+  /**
+   * Get an attribute of content hashes.
+   *
+   * @return Content hash attribute.
+   */
+  inline FileAttribute get_content_hash_attr() const {
+    return *content_hash_attr_;
+  }
 #endif  // DOXYGEN_SHOULD_SKIP_THIS
 
  protected:
@@ -151,12 +203,52 @@ class Spider {
 #endif  // DOXYGEN_SHOULD_SKIP_THIS
 
   /**
-   * Dump the result vector to data base.
+   * Pass the result vector to the writer thread and wait until it dumps
+   * all the submitted batches.
    *
-   * @return 0 on success, -1 otherwise.
+   * @return 0 on success, -1 if any batch since the last call failed.
    */
   int DumpToDataBase();
 
+  /**
+   * Add files to data base in one transaction.
+   *
+   * @param batch Files to be added.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int DumpBatch(const PathArena &batch);
+
+  /**
+   * Hash whole contents of files which have equal content hashes and store
+   * the results, so that duplicates found by samples are confirmed. Files
+   * which didn't change since the previous call are skipped.
+   *
+   * @return 0 on success, -1 otherwise and verify_error_ is set.
+   */
+  int VerifyDuplicates();
+
+  /**
+   * Hash content of the file. Doesn't touch error_, so that the verifier
+   * thread can call it too.
+   *
+   * @param url URL of the file.
+   * @param count Number of sampled blocks, 0 to hash the whole file.
+   * @param backend Backend to read the file, replaced if it doesn't serve
+   * the scheme of the URL.
+   * @param scheme Scheme served by the backend.
+   * @param hash Where to store the hash in "size:hash" form.
+   * @param error Where to store the error.
+   * @param mime_type Where to store MIME type of the first block, NULL if
+   * it is not needed. Only for the writer thread, which owns cookie_.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int HashContent(const std::string &url, const size_t count,
+                  CrawlBackend **backend, std::string *scheme,
+                  std::string *hash, int *error,
+                  const char **mime_type = NULL);
+
   /**
    * Connect to data base server.
    *
@@ -187,9 +279,41 @@ class Spider {
                              const std::string &server);
 
   /**
-   * Search files in smb directory and all subdirectories.
+   * Buffer new file entry in the writer, it will be stored in data base
+   * on the writer flush.
    *
-   * @param dir name of the smb directory.
+   * @param file Full path to file in network which should be added in data
+   * base.
+   * @param server Name of the server when file is stored.
+   * @param writer Writer to buffer the entry in.
+   *
+   * @return 0 on siccess, -1 otherwise.
+   */
+  int AddFileEntryInDataBase(const std::string &file,
+                             const std::string &server,
+                             BatchWriter *writer);
+
+  /**
+   * Buffer file entry which path is already split in the writer.
+   *
+   * @param url Full URL of the file.
+   * @param server Name of the server when file is stored.
+   * @param path Path of the file on the server.
+   * @param name Name of the file, it is parsed in place.
+   * @param writer Writer to buffer the entry in.
+   *
+   * @return 0 on siccess, -1 otherwise.
+   */
+  int IndexFile(const std::string &url, const std::string &server,
+                const std::string &path, std::string *name,
+                BatchWriter *writer);
+
+  /**
+   * Search files in directory and all subdirectories.
+   *
+   * Directories are scanned in parallel by the crawler threads.
+   *
+   * @param dir URL of the directory, "smb://" or "file://".
    *
    * @return 0 if functions completed, -1 otherwise.
    */
@@ -198,7 +322,8 @@ class Spider {
   /**
    * Parsing the given name.
    *
-   * Now just replace '_' symbols with spaces.
+   * Now just replace '_' symbols with spaces, search tokens are built by
+   * NameTokenizer.
    *
    * @param name Name to be parsed.
    *
@@ -207,7 +332,8 @@ class Spider {
   int NameParser(std::string *name);
 
   /**
-   * Add a file to result vector and if it full - dump it to data base.
+   * Add a file to result vector and if it full - pass it to the writer
+   * thread. Thread safe.
    *
    * @param name Name to be added.
    *
@@ -216,9 +342,28 @@ class Spider {
   void AddSMBFile(const std::string &name);
 
   /**
-   * Detect MIME type of given file.
+   * Add a found file with its size and modification time to result vector
+   * and if it full - pass it to the writer thread. Thread safe.
+   *
+   * @param file File to be added.
+   */
+  void AddSMBFile(const FoundFile &file);
+
+  /**
+   * Add files of the directory read by the crawler to result batch, full
+   * batches are passed to the writer thread. Thread safe.
+   *
+   * @param dir URL of the directory.
+   * @param entries Entries of the directory, subdirectories are skipped.
+   */
+  void AddFiles(const std::string &dir,
+                const std::vector<CrawlEntry> &entries);
+
+  /**
+   * Detect MIME type of given file by its header. The header is read in
+   * header_ and checked in memory.
    *
-   * @param name Name of the file to be observed.
+   * @param name URL of the file to be observed.
    *
    * @return Mime type of given file on success, "unknown" otherwise.
    */
@@ -231,21 +376,371 @@ class Spider {
    */
   int InitMimeTypeAttr();
 
+  /**
+   * Initilize file attribute to store size and modification time of files
+   * in data base.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int InitFingerprintAttr();
+
+  /**
+   * Initilize file attribute to store search tokens of file names in data
+   * base.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int InitTokensAttr();
+
+  /**
+   * Initilize file attribute to store content hashes of files in data base.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int InitContentHashAttr();
+
+  /**
+   * Check whether MIME types of files on the server may be detected by
+   * extension.
+   *
+   * @param server Name of the server.
+   *
+   * @return true if extensions may be used, false otherwise.
+   */
+  bool MimeByExtension(const std::string &server) const;
+
+  /**
+   * Get URL of the work item: "file://" if its server is mounted, "smb://"
+   * otherwise.
+   *
+   * @param item Server name, optionally followed by a path.
+   *
+   * @return URL of the item.
+   */
+  std::string ItemUrl(const std::string &item) const;
+
+  /**
+   * Create a crawl backend for the scheme which knows mount points of the
+   * spider.
+   *
+   * @param scheme Scheme of URLs.
+   *
+   * @return New backend or NULL on error.
+   */
+  CrawlBackend *CreateBackend(const std::string &scheme) const;
+
+  /**
+   * Make sure the backend serves the scheme of the URL, create a new one if
+   * it doesn't.
+   *
+   * @param url URL to be read.
+   * @param backend Backend, may be NULL.
+   * @param scheme Scheme served by the backend.
+   * @param error Where to store the error.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int UseBackend(const std::string &url, CrawlBackend **backend,
+                 std::string *scheme, int *error);
+
+  /**
+   * Check whether subdirectories of the directory should be handed back to
+   * scheduler. Shares of a server are always handed back, directories are
+   * when they are wide and close to the server root.
+   *
+   * @param dir URL of the directory.
+   * @param subdirs Number of subdirectories in the directory.
+   *
+   * @return true if subdirectories should be split, false otherwise.
+   */
+  bool ShouldSplit(const std::string &dir, const size_t subdirs) const;
+
+  /**
+   * Crawler filter which hands subdirectories back to scheduler and removes
+   * the ones which scheduler has queued.
+   *
+   * @param dir URL of the directory.
+   * @param subdirs Subdirectories found in the directory.
+   */
+  void SplitWork(const std::string &dir, std::vector<std::string> *subdirs);
+
  private:
+  /**
+   * Work for the writer thread.
+   */
+  struct DumpTask {
+    /**
+     * Files to be dumped, may be NULL.
+     */
+    PathArena *batch = NULL;
+
+    /**
+     * Work item to be released after the batch is dumped, the writer stops
+     * when both batch and release are empty.
+     */
+    std::string release;
+  };
+
   /**
    * Save last occured error in error_.
    */
   inline void DetectError() { error_ = errno; }
 
   /**
-   * Vector with scan results.
+   * Find a string attribute in data base, create it if it doesn't exist.
+   *
+   * @param name Name of the attribute.
+   * @param attr Where to store the attribute.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int InitStringAttr(const std::string &name,
+                     std::shared_ptr<FileAttribute> *attr);
+
+  /**
+   * Build a fingerprint of the file which changes when the file is modified.
+   *
+   * @param size Size of the file, -1 if it is unknown.
+   * @param mtime Time of last modification of the file.
+   * @param fingerprint Where to store the fingerprint in "size:mtime" form,
+   * empty string if size and modification time of the file are unknown.
+   */
+  static void Fingerprint(const int64_t size, const time_t mtime,
+                          std::string *fingerprint);
+
+  /**
+   * Pass the result vector to the writer thread and take an empty one.
+   * Blocks while the writer is busy with all other batches.
+   * Must be called with result_mutex_ locked.
+   *
+   * @param release Work item whose files are all in this or previous
+   *        batches, the writer releases it with the counts of dumped and
+   *        changed files.
+   */
+  void SubmitBatch(const std::string &release = std::string());
+
+  /**
+   * Main loop of the writer thread: dump batches until an empty task is
+   * received.
+   */
+  void WriterLoop();
+
+  /**
+   * Start a verification of duplicates in the verifier thread, if it is
+   * busy the next one starts when the current one ends.
+   */
+  void RequestVerification();
+
+  /**
+   * Main loop of the verifier thread: verify duplicates on request until
+   * the spider is destroyed.
+   */
+  void VerifierLoop();
+
+  /**
+   * Batch with scan results.
+   */
+  PathArena *result_ = NULL;
+
+  /**
+   * Protects result_ from the crawler threads.
+   */
+  std::mutex result_mutex_;
+
+  /**
+   * Empty batches to be filled.
+   */
+  BoundedQueue<PathArena *> free_batches_;
+
+  /**
+   * Filled batches waiting for the writer thread.
+   */
+  BoundedQueue<DumpTask> full_batches_;
+
+  /**
+   * Thread which adds filled batches in data base.
+   */
+  std::thread writer_thread_;
+
+  /**
+   * Protects the counters of batches passed to and dumped by the writer.
+   */
+  std::mutex dump_mutex_;
+
+  /**
+   * Signaled when the writer dumps a batch.
+   */
+  std::condition_variable dump_cond_;
+
+  /**
+   * Number of batches passed to the writer thread.
+   */
+  uint64_t submitted_ = 0;
+
+  /**
+   * Number of batches dumped by the writer thread.
+   */
+  uint64_t dumped_ = 0;
+
+  /**
+   * Number of batches failed since the last DumpToDataBase call.
+   */
+  int dump_failures_ = 0;
+
+  /**
+   * Files dumped since the last release, -1 if not known because the
+   * crawl is not incremental. Used only by the writer thread.
+   */
+  int64_t item_files_ = 0;
+
+  /**
+   * New or changed files dumped since the last release. Used only by the
+   * writer thread.
+   */
+  int64_t item_changed_ = 0;
+
+  /**
+   * Thread which verifies duplicates, runs only if verify_duplicates_ is
+   * set.
+   */
+  std::thread verifier_thread_;
+
+  /**
+   * Protects verify_pending_ and verify_stop_.
+   */
+  std::mutex verify_mutex_;
+
+  /**
+   * Signaled when a verification is requested or the spider is destroyed.
+   */
+  std::condition_variable verify_cond_;
+
+  /**
+   * Whether a verification is requested.
+   */
+  bool verify_pending_ = false;
+
+  /**
+   * Whether the verifier thread should stop, checked between files too.
+   */
+  std::atomic<bool> verify_stop_;
+
+  /**
+   * Last error of the verifier thread, error_ belongs to the others.
+   */
+  int verify_error_ = 0;
+
+  /**
+   * Pool of threads which scan smb directories. Created on the first scan.
+   */
+  Crawler *crawler_;
+
+  /**
+   * Protects crawled_server_.
+   */
+  std::mutex lease_mutex_;
+
+  /**
+   * Server being crawled, empty between crawls.
+   */
+  std::string crawled_server_;
+
+  /**
+   * Set when the lease of the crawled server is lost, the crawl stops.
+   */
+  std::atomic<bool> lease_lost_;
+
+  /**
+   * Number of crawler threads.
+   */
+  int threads_;
+
+  /**
+   * Number of leases taken from scheduler at once.
+   */
+  int leases_;
+
+  /**
+   * Minimal number of subdirectories in a directory to split them, 0
+   * disables splitting.
+   */
+  size_t split_dirs_;
+
+  /**
+   * Directories deeper than this are not split.
+   */
+  size_t split_depth_;
+
+  /**
+   * Size of directory entries buffers of crawl backends.
+   */
+  size_t dirents_size_;
+
+  /**
+   * Directories which take longer to read are logged, milliseconds.
+   */
+  int slow_dir_ms_;
+
+  /**
+   * Whether files which didn't change since the previous crawl are skipped.
+   */
+  bool incremental_;
+
+  /**
+   * Whether MIME types are detected by extensions when possible.
+   */
+  bool mime_by_extension_;
+
+  /**
+   * Whether search tokens of file names are stored.
+   */
+  bool tokenize_names_;
+
+  /**
+   * Whether content hashes of files are stored.
+   */
+  bool content_hash_;
+
+  /**
+   * Size of sampled blocks of content hashes.
+   */
+  size_t content_block_;
+
+  /**
+   * Whether files with equal content hashes are hashed whole.
+   */
+  bool verify_duplicates_;
+
+  /**
+   * Servers for which mime_by_extension_ is overridden.
    */
-  std::vector<std::string> *result_ = NULL;
+  std::unordered_map<std::string, bool> mime_by_extension_servers_;
 
   /**
-   * last Iterator on last valid element in result vector.
+   * Directories where servers are mounted.
    */
-  std::vector<std::string>::iterator last_;
+  CrawlBackend::MountTable mounts_;
+
+  /**
+   * Backend for calls made outside of the crawler threads, NULL before the
+   * first call.
+   */
+  CrawlBackend *backend_;
+
+  /**
+   * URL scheme served by backend_.
+   */
+  std::string backend_scheme_;
+
+  /**
+   * Backend of the verifier thread, NULL before the first call.
+   */
+  CrawlBackend *verify_backend_;
+
+  /**
+   * URL scheme served by verify_backend_.
+   */
+  std::string verify_scheme_;
 
   /**
    * Name of the database on the server where data is stored.
@@ -273,11 +768,55 @@ class Spider {
    */
   magic_t cookie_;
 
+  /**
+   * Buffer for file headers, reused for every file. Like cookie_ it is used
+   * only by the thread which dumps results.
+   */
+  std::vector<char> header_;
+
   /**
    * Id of attribute to store MIME type in data base.
    */
   std::shared_ptr<FileAttribute> mime_type_attr_;
 
+  /**
+   * Attribute to store size and modification time of files in data base.
+   * NULL when incremental crawl is disabled.
+   */
+  std::shared_ptr<FileAttribute> fingerprint_attr_;
+
+  /**
+   * Attribute to store search tokens of file names in data base. Tokens
+   * are not stored while it is NULL, i.e. unless tokenize_names_ is set.
+   */
+  std::shared_ptr<FileAttribute> tokens_attr_;
+
+  /**
+   * Attribute to store hashes of sampled content of files in data base.
+   * NULL when content hashes are disabled.
+   */
+  std::shared_ptr<FileAttribute> content_hash_attr_;
+
+  /**
+   * Attribute to store hashes of whole content of files with equal content
+   * hashes in "content hash=full hash" form. NULL unless duplicates are
+   * verified.
+   */
+  std::shared_ptr<FileAttribute> full_hash_attr_;
+
+  /**
+   * Tokenizer of file names and buffer for its tokens. Like header_ they
+   * are used only by the thread which dumps results.
+   */
+  NameTokenizer tokenizer_;
+  std::string tokens_;
+
+  /**
+   * Buffer for content hashes of files, used only by the thread which dumps
+   * results.
+   */
+  std::string hash_;
+
   /*
    * Scheduler hostname.
    */
@@ -1,4 +1,7 @@
 TEMPLATE = lib
-SOURCES += spider.cpp main.cpp servermanager.cpp
-HEADERS += spider.h servermanager.h
+SOURCES += spider.cpp main.cpp servermanager.cpp crawler.cpp crawlbackend.cpp \
+           mimetypes.cpp patharena.cpp nametokenizer.cpp contenthash.cpp \
+           ../scheduler/protocol.cpp
+HEADERS += spider.h servermanager.h crawler.h crawlbackend.h boundedqueue.h \
+           mimetypes.h patharena.h nametokenizer.h contenthash.h
 OTHER_FILES += Makefile
@@ -0,0 +1,3 @@
+TEMPLATE = subdirs
+SUBDIRS += mimebench.pro queuebench.pro namebench.pro
+OTHER_FILES += Makefile
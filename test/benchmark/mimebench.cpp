@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compares MIME type detection of a file header through a temporary file
+// (magic_descriptor) with detection in memory (magic_buffer).
+//
+// Usage: mimebench [iterations] [header size]
+
+#include <fcntl.h>
+#include <magic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+#define MIMEBENCH_TMPDIR "/tmp"
+
+/**
+ * Headers of some widespread file types.
+ */
+static std::vector<std::string> SampleHeaders(const size_t size) {
+  static const char *kPrefixes[] = {
+    "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n",
+    "\x89PNG\r\n\x1a\n\0\0\0\rIHDR",
+    "\x7f" "ELF\x02\x01\x01\0\0\0\0\0\0\0\0\0",
+    "PK\x03\x04\x14\0\0\0\x08\0",
+    "\x1f\x8b\x08\0\0\0\0\0\0\x03",
+    "#!/bin/sh\necho hello world\n",
+  };
+  static const size_t kLengths[] = { 14, 16, 16, 10, 10, 27 };
+
+  std::vector<std::string> headers;
+  for (size_t i = 0; i < sizeof(kLengths) / sizeof(kLengths[0]); ++i) {
+    std::string header(kPrefixes[i], kLengths[i]);
+    header.resize(size, ' ');
+    headers.push_back(header);
+  }
+  return headers;
+}
+
+/**
+ * Detect MIME type the way spider did it before: copy the header in a
+ * temporary file and pass its descriptor to libmagic.
+ */
+static const char *DetectThroughFile(magic_t cookie, const std::string &name,
+                                     const std::string &header) {
+  int fd = open(name.c_str(), O_CREAT | O_RDWR | O_EXCL,
+                00744 /* rwxr--r-- */);
+  if (fd == -1) {
+    perror("open");
+    return NULL;
+  }
+
+  const char *mime_type = NULL;
+  if (write(fd, header.data(), header.size()) < 0)
+    perror("write");
+  else if (lseek(fd, 0, SEEK_SET) != 0)
+    perror("lseek");
+  else
+    mime_type = magic_descriptor(cookie, fd);
+
+  close(fd);
+  if (unlink(name.c_str()))
+    perror("unlink");
+  return mime_type;
+}
+
+int main(int argc, char *argv[]) {
+  long iterations = argc > 1 ? atol(argv[1]) : 10000;
+  long size = argc > 2 ? atol(argv[2]) : HEADERSIZE;
+  if (iterations <= 0 || size <= 0) {
+    fprintf(stderr, "usage: %s [iterations] [header size]\n", argv[0]);
+    return 1;
+  }
+
+  magic_t cookie = magic_open(MAGIC_MIME_TYPE | MAGIC_ERROR);
+  if (cookie == NULL || magic_load(cookie, NULL) == -1) {
+    fprintf(stderr, "magic: %s\n", magic_error(cookie));
+    return 1;
+  }
+
+  std::vector<std::string> headers = SampleHeaders(size);
+  std::string name = MIMEBENCH_TMPDIR "/mimebench." + std::to_string(getpid());
+
+  // Both ways must agree, otherwise the comparison is meaningless.
+  for (const std::string &header : headers) {
+    const char *by_file = DetectThroughFile(cookie, name, header);
+    std::string file_type(by_file ? by_file : "(null)");
+    const char *by_buffer = magic_buffer(cookie, header.data(), header.size());
+    std::string buffer_type(by_buffer ? by_buffer : "(null)");
+    if (file_type != buffer_type) {
+      fprintf(stderr, "mismatch: %s != %s\n", file_type.c_str(),
+              buffer_type.c_str());
+      return 1;
+    }
+  }
+
+  typedef std::chrono::steady_clock Clock;
+
+  Clock::time_point start = Clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    if (DetectThroughFile(cookie, name, headers[i % headers.size()]) == NULL)
+      return 1;
+  }
+  double file_time =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  start = Clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    const std::string &header = headers[i % headers.size()];
+    if (magic_buffer(cookie, header.data(), header.size()) == NULL)
+      return 1;
+  }
+  double buffer_time =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("header size: %ld bytes, iterations: %ld\n", size, iterations);
+  printf("temporary file: %8.2f us per file\n", file_time * 1e6 / iterations);
+  printf("magic_buffer:   %8.2f us per file\n",
+         buffer_time * 1e6 / iterations);
+  printf("speedup:        %8.2fx\n", file_time / buffer_time);
+
+  magic_close(cookie);
+  return 0;
+}
@@ -0,0 +1,3 @@
+TEMPLATE = app
+TARGET = mimebench
+SOURCES += mimebench.cpp
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compares the cost per file name of the old NameParser loop, which looked
+// for '_' from the beginning of the name after every replacement, with the
+// tokenizer which normalizes and splits the name in one pass.
+//
+// Usage: namebench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "spider/nametokenizer.h"
+
+/**
+ * Names in the proportions found on our servers: mostly ASCII, a good share
+ * of Cyrillic.
+ */
+static std::vector<std::string> SampleNames() {
+  std::vector<std::string> names = {
+    "The_Matrix_1999_BDRip_1080p_x264_DTS-HD_MA_5.1.mkv",
+    "lecture_notes_theoretical_mechanics_2013_part_2.pdf",
+    "IMG_20130512_184512_HDR.jpg",
+    "setup_OpenOffice_4.0.1_Win_x86_install_ru.exe",
+    "ReadMe.txt",
+    "Матрица_Перезагрузка_2003_BDRip.avi",
+    "Лекции_по_матанализу_Иванов_2012_весна.djvu",
+    "Ёлки_новогодние_фото_2013.zip",
+  };
+  return names;
+}
+
+/**
+ * NameParser the way spider did it before.
+ */
+static void OldNameParser(std::string *name) {
+  size_t pos;
+  while ((pos = name->find("_")) != std::string::npos)
+    name->replace(pos, 1, " ");
+}
+
+int main(int argc, char *argv[]) {
+  long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+  if (iterations <= 0) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::string> names = SampleNames();
+  typedef std::chrono::steady_clock Clock;
+
+  // Every iteration copies the name, like spider does for every file.
+  std::string name;
+  size_t checksum = 0;
+  Clock::time_point start = Clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    name = names[i % names.size()];
+    OldNameParser(&name);
+    checksum += name.size();
+  }
+  double old_time =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  start = Clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    name = names[i % names.size()];
+    std::replace(name.begin(), name.end(), '_', ' ');
+    checksum += name.size();
+  }
+  double replace_time =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  NameTokenizer tokenizer;
+  std::string tokens;
+  size_t count = 0;
+  start = Clock::now();
+  for (long i = 0; i < iterations; ++i)
+    count += tokenizer.Tokenize(names[i % names.size()], &tokens);
+  double tokenize_time =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("names: %zu, iterations: %ld, tokens per name: %.1f\n",
+         names.size(), iterations, static_cast<double>(count) / iterations);
+  printf("old NameParser: %8.1f ns per name\n", old_time * 1e9 / iterations);
+  printf("std::replace:   %8.1f ns per name\n",
+         replace_time * 1e9 / iterations);
+  printf("NameTokenizer:  %8.1f ns per name\n",
+         tokenize_time * 1e9 / iterations);
+
+  return checksum == 0;
+}
@@ -0,0 +1,3 @@
+TEMPLATE = app
+TARGET = namebench
+SOURCES += namebench.cpp ../../spider/nametokenizer.cpp
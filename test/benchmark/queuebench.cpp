@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Drives the scheduler server queue with the traffic of many spiders: every
+// round each spider sends a keepalive for its server and some of them
+// release the server and get a new one. Compares ServerQueue with the list
+// based queue scheduler used before.
+//
+// Usage: queuebench [servers] [spiders] [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "scheduler/serverqueue.h"
+
+// Share of spiders which finish their server every round, in percents.
+#define QUEUEBENCH_RELEASE_PERCENT 10
+
+/**
+ * The queue the way scheduler kept it before: a ring of servers searched
+ * linearly.
+ */
+class ListQueue {
+ public:
+  void AddServer(const std::string &name) {
+    if (std::find(names_.begin(), names_.end(), name) != names_.end())
+      return;
+    ++size_;
+    last_ = names_.insert(last_, name);
+    last_time_ = times_.insert(last_time_, 0);
+  }
+
+  std::string CmdGet() {
+    time_t current = time(NULL);
+    auto head = last_;
+    bool found = false;
+    do {
+      found = current - *last_time_ > kMaxWait;
+      if (found)
+        break;
+      Next();
+    } while (last_ != head);
+
+    if (!found)
+      return "";
+    *last_time_ = current;
+    std::string name = *last_;
+    Next();
+    return name;
+  }
+
+  long get_size() const { return size_; }
+
+  void CmdGet(const std::string &name) { Set(name, time(NULL)); }
+  void CmdRelease(const std::string &name) { Set(name, 0); }
+
+ private:
+  void Next() {
+    ++last_time_;
+    if (++last_ == names_.end()) {
+      last_ = names_.begin();
+      last_time_ = times_.begin();
+    }
+  }
+
+  void Set(const std::string &name, const time_t value) {
+    auto time = times_.begin();
+    for (auto it = names_.begin(); it != names_.end(); ++it, ++time) {
+      if (*it == name) {
+        *time = value;
+        return;
+      }
+    }
+  }
+
+  static const time_t kMaxWait = 60;
+
+  long size_ = 0;
+  std::list<std::string> names_;
+  std::list<time_t> times_;
+  std::list<std::string>::iterator last_ = names_.begin();
+  std::list<time_t>::iterator last_time_ = times_.begin();
+};
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Fill a queue with servers.
+ *
+ * @return Time in seconds.
+ */
+template <class Queue>
+static double Fill(Queue *queue, const std::vector<std::string> &names) {
+  Clock::time_point start = Clock::now();
+  for (const std::string &name : names)
+    queue->AddServer(name);
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Run spider commands on a filled queue.
+ *
+ * @return Time of all commands in seconds.
+ */
+template <class Queue>
+static double Run(Queue *queue, const long spiders, const long rounds,
+                  long *commands) {
+  // Servers scanned recently, spiders get servers from the middle of the
+  // queue like in a long running scheduler.
+  for (long i = 0; i < static_cast<long>(queue->get_size()) / 2; ++i)
+    queue->CmdGet();
+
+  Clock::time_point start = Clock::now();
+
+  std::vector<std::string> leases(spiders);
+  for (std::string &lease : leases)
+    lease = queue->CmdGet();
+  *commands = spiders;
+
+  for (long round = 0; round < rounds; ++round) {
+    for (long spider = 0; spider < spiders; ++spider) {
+      std::string &lease = leases[spider];
+      queue->CmdGet(lease);
+      ++*commands;
+
+      if ((spider + round) % (100 / QUEUEBENCH_RELEASE_PERCENT) == 0) {
+        queue->CmdRelease(lease);
+        lease = queue->CmdGet();
+        *commands += 2;
+      }
+    }
+  }
+
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  long servers = argc > 1 ? atol(argv[1]) : 100000;
+  long spiders = argc > 2 ? atol(argv[2]) : 1000;
+  long rounds = argc > 3 ? atol(argv[3]) : 10;
+  if (servers <= 0 || spiders <= 0 || spiders > servers || rounds <= 0) {
+    fprintf(stderr, "usage: %s [servers] [spiders] [rounds]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::string> names;
+  names.reserve(servers);
+  for (long i = 0; i < servers; ++i)
+    names.push_back("server" + std::to_string(i) + ".local");
+
+  long commands = 0;
+  ServerQueue heap_queue;
+  double heap_fill = Fill(&heap_queue, names);
+  double heap_time = Run(&heap_queue, spiders, rounds, &commands);
+
+  ListQueue list_queue;
+  double list_fill = Fill(&list_queue, names);
+  double list_time = Run(&list_queue, spiders, rounds, &commands);
+
+  printf("servers: %ld, spiders: %ld, rounds: %ld, commands: %ld\n",
+         servers, spiders, rounds, commands);
+  printf("               add servers   per command\n");
+  printf("list queue:  %10.3f s %10.3f us\n", list_fill,
+         list_time * 1e6 / commands);
+  printf("ServerQueue: %10.3f s %10.3f us\n", heap_fill,
+         heap_time * 1e6 / commands);
+  printf("speedup:     %10.2fx %10.2fx\n", list_fill / heap_fill,
+         list_time / heap_time);
+  return 0;
+}
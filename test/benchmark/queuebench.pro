@@ -0,0 +1,5 @@
+TEMPLATE = app
+TARGET = queuebench
+SOURCES += queuebench.cpp ../../scheduler/serverqueue.cpp \
+           ../../scheduler/schedulingpolicy.cpp \
+           ../../scheduler/statelog.cpp
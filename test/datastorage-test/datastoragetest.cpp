@@ -24,6 +24,13 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 #include "config.h"
 #include "common-inl.h"
 #include "datastoragetest.h"
@@ -77,6 +84,125 @@ void FileEntryTest::GetByPathOnServerTestCase() {
                          db_file->get_timestamp() >= time.tv_sec);
 }
 
+void FileEntryTest::LongPathTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  // Longer than the initial result buffer of prepared statements.
+  std::string path("long/path/" + std::string(BUF_SIZE * 2, 'a'));
+  std::string server("test.server");
+  FileEntry file("long path", path, server);
+
+  std::shared_ptr<FileEntry> db_file = FileEntry::GetByPathOnServer(path,
+                                                                    server);
+  CPPUNIT_ASSERT_MESSAGE("Error in GetByPathOnServer", db_file);
+  CPPUNIT_ASSERT_MESSAGE("Error in path", db_file->get_file_path() == path);
+
+  db_file = FileEntry::GetById(file.get_id());
+  CPPUNIT_ASSERT_MESSAGE("Error in GetById", db_file);
+  CPPUNIT_ASSERT_MESSAGE("Error in path", db_file->get_file_path() == path);
+}
+
+void FileEntryTest::CacheTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  std::string path("path/to/cached_file");
+  std::string server("test.server");
+  FileEntry file("cached file", path, server);
+
+  std::shared_ptr<FileEntry> by_id = FileEntry::GetById(file.get_id());
+  std::shared_ptr<FileEntry> by_path = FileEntry::GetByPathOnServer(path,
+                                                                    server);
+  CPPUNIT_ASSERT_MESSAGE("Error in GetById", by_id);
+  CPPUNIT_ASSERT_MESSAGE("Error in GetByPathOnServer", by_path);
+  CPPUNIT_ASSERT_MESSAGE("Wrong id", by_path->get_id() == file.get_id());
+  CPPUNIT_ASSERT_MESSAGE("Cached entry is shared", by_id != by_path);
+
+  // Batch writer keeps the id and drops the cached entry.
+  BatchWriter writer;
+  writer.AddFile("renamed file", path, server);
+  CPPUNIT_ASSERT_MESSAGE("Flush", writer.Flush());
+
+  by_id = FileEntry::GetById(file.get_id());
+  CPPUNIT_ASSERT_MESSAGE("Error in GetById", by_id);
+  CPPUNIT_ASSERT_MESSAGE("Stale entry by id",
+                         by_id->get_name() == "renamed file");
+  by_path = FileEntry::GetByPathOnServer(path, server);
+  CPPUNIT_ASSERT_MESSAGE("Stale entry by path",
+                         by_path && by_path->get_name() == "renamed file");
+
+  // "replace" gives the file a new id.
+  FileEntry replaced("replaced file", path, server);
+  by_path = FileEntry::GetByPathOnServer(path, server);
+  CPPUNIT_ASSERT_MESSAGE("Stale entry by path",
+                         by_path && by_path->get_id() == replaced.get_id());
+  CPPUNIT_ASSERT_MESSAGE("Deleted entry by id",
+                         replaced.get_id() == file.get_id() ||
+                         !FileEntry::GetById(file.get_id()));
+}
+
+void FileEntryTest::StreamTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  const int count = 100;
+  BatchWriter writer;
+  for (int i = 0; i < count; ++i) {
+    writer.AddFile("streamed file " + std::to_string(i),
+                   "stream/file_" + std::to_string(i), "stream.server");
+  }
+  CPPUNIT_ASSERT_MESSAGE("Flush", writer.Flush());
+
+  int visited = 0;
+  CPPUNIT_ASSERT_MESSAGE("GetEachByServer", FileEntry::GetEachByServer(
+      "stream.server", [&](const FileEntry &entry) {
+    ++visited;
+    return entry.get_server_name() == "stream.server";
+  }));
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of files", visited == count);
+
+  // Stop early, the connection must be usable right after.
+  visited = 0;
+  CPPUNIT_ASSERT_MESSAGE("FindEachByName", FileEntry::FindEachByName(
+      "streamed file", [&](const FileEntry &) { return ++visited < 10; }));
+  CPPUNIT_ASSERT_MESSAGE("Not stopped", visited == 10);
+
+  // Offset and limit are applied by the data base, with and without the
+  // name index.
+  for (int indexed = 0; indexed < 2; ++indexed) {
+    if (indexed)
+      FileEntry::set_name_index(TrigramIndex::Load());
+    std::vector<int> ids;
+    CPPUNIT_ASSERT_MESSAGE("FindEachByName", FileEntry::FindEachByName(
+        "streamed file", [&](const FileEntry &entry) {
+      ids.push_back(entry.get_id());
+      return true;
+    }, 95, 10));
+    CPPUNIT_ASSERT_MESSAGE("Wrong number of files", ids.size() == 5);
+  }
+  FileEntry::set_name_index(nullptr);
+
+  visited = 0;
+  CPPUNIT_ASSERT_MESSAGE("GetEachByServer", FileEntry::GetEachByServer(
+      "stream.server", [&](const FileEntry &) {
+    ++visited;
+    return true;
+  }, 0, 7));
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of files", visited == 7);
+
+  visited = 0;
+  CPPUNIT_ASSERT_MESSAGE("GetEachByName", FileEntry::GetEachByName(
+      "streamed file 7", [&](const FileEntry &) {
+    ++visited;
+    return true;
+  }));
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of files", visited == 1);
+}
+
 void FileAttributeTest::setUp() {
   CPPUNIT_ASSERT_MESSAGE("Error in reading configuration files",
                          read_database_config(&name_, &server_, &user_,
@@ -131,3 +257,384 @@ void FileParameterTest::ConstructorsTestCase() {
   CPPUNIT_ASSERT_MESSAGE("FileParameter", param);
   CPPUNIT_ASSERT_MESSAGE("Wrong number of parameters", param->size() == 1);
 }
+
+void FileParameterTest::BulkLoadTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  FileAttribute type("bulk-type", FileAttribute::faString);
+  FileAttribute size("bulk-size", FileAttribute::faNum);
+
+  std::vector<int> ids;
+  const int count = PARAMETER_LOAD_CHUNK + 10;
+  BatchWriter writer;
+  for (int i = 0; i < count; ++i) {
+    std::string path("bulk/file_" + std::to_string(i));
+    writer.AddFile("file " + std::to_string(i), path, "bulk.server");
+    writer.AddParameter(path, "bulk.server", type.get_id(),
+                        i % 2 ? "video/avi" : "audio/mpeg", 0, false);
+    writer.AddParameter(path, "bulk.server", size.get_id(), "", i, false);
+  }
+  CPPUNIT_ASSERT_MESSAGE("Flush", writer.Flush());
+  for (int i = 0; i < count; ++i) {
+    auto file = FileEntry::GetByPathOnServer("bulk/file_" + std::to_string(i),
+                                             "bulk.server");
+    CPPUNIT_ASSERT_MESSAGE("FileEntry", file);
+    ids.push_back(file->get_id());
+  }
+
+  // More files than one query takes.
+  auto params = FileParameter::GetByFiles(ids);
+  CPPUNIT_ASSERT_MESSAGE("GetByFiles", params);
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of parameters",
+                         params->size() == static_cast<size_t>(count * 2));
+  std::unordered_map<int, std::shared_ptr<FileAttribute> > attributes;
+  for (const auto &param : *params) {
+    auto &attr = attributes[param->get_attr()->get_id()];
+    if (!attr)
+      attr = param->get_attr();
+    CPPUNIT_ASSERT_MESSAGE("Attribute is not shared",
+                           param->get_attr() == attr);
+  }
+  CPPUNIT_ASSERT(attributes.size() == 2);
+
+  params = FileParameter::GetByFiles(ids, size.get_id());
+  CPPUNIT_ASSERT_MESSAGE("GetByFiles", params && params->size() ==
+                         static_cast<size_t>(count));
+  for (const auto &param : *params) {
+    CPPUNIT_ASSERT_MESSAGE("Wrong file", param->get_file()->get_name() ==
+                           "file " + std::to_string(param->get_num_value()));
+  }
+
+  params = FileParameter::GetByValue(std::string("video/avi"), type.get_id());
+  CPPUNIT_ASSERT_MESSAGE("GetByValue", params &&
+                         params->size() >= static_cast<size_t>(count / 2));
+  for (const auto &param : *params) {
+    CPPUNIT_ASSERT_MESSAGE("Wrong attribute",
+                           param->get_attr() == params->at(0)->get_attr());
+    CPPUNIT_ASSERT_MESSAGE("No file", param->get_file());
+  }
+}
+
+void FileParameterTest::DuplicatesTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  FileAttribute hash("dup-hash", FileAttribute::faString);
+
+  // The same file on two servers and a unique one.
+  BatchWriter writer;
+  writer.AddFile("movie", "video/movie.avi", "dup1.server");
+  writer.AddFile("movie", "films/movie.avi", "dup2.server");
+  writer.AddFile("other", "video/other.avi", "dup1.server");
+  writer.AddParameter("video/movie.avi", "dup1.server", hash.get_id(),
+                      "100:0123456789abcdef", 0, true);
+  writer.AddParameter("films/movie.avi", "dup2.server", hash.get_id(),
+                      "100:0123456789abcdef", 0, true);
+  writer.AddParameter("video/other.avi", "dup1.server", hash.get_id(),
+                      "100:fedcba9876543210", 0, true);
+  CPPUNIT_ASSERT_MESSAGE("Flush", writer.Flush());
+
+  auto params = FileParameter::GetDuplicates(hash.get_id());
+  CPPUNIT_ASSERT_MESSAGE("GetDuplicates", params);
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of duplicates", params->size() == 2);
+  CPPUNIT_ASSERT(params->at(0)->get_file()->get_server_name() ==
+                 "dup1.server");
+  CPPUNIT_ASSERT(params->at(1)->get_file()->get_server_name() ==
+                 "dup2.server");
+  CPPUNIT_ASSERT(params->at(0)->get_str_value() ==
+                 params->at(1)->get_str_value());
+
+  // The page after the only group is empty.
+  params = FileParameter::GetDuplicates(hash.get_id(), std::string(), 1);
+  CPPUNIT_ASSERT_MESSAGE("Wrong first page", params && params->size() == 2);
+  params = FileParameter::GetDuplicates(hash.get_id(),
+                                        params->back()->get_str_value(), 1);
+  CPPUNIT_ASSERT_MESSAGE("Wrong next page", params && params->empty());
+}
+
+void BatchWriterTest::setUp() {
+  CPPUNIT_ASSERT_MESSAGE("Error in reading configuration files",
+                         read_database_config(&name_, &server_, &user_,
+                                              &password_,
+                                              "../" DATABASE_CONFIG) == 0);
+}
+
+void BatchWriterTest::FlushTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  FileAttribute attr("test-attr", FileAttribute::faString);
+  std::string server("batch.server");
+
+  BatchWriter writer;
+  writer.AddFile("file one", "path/to/file_one", server);
+  writer.AddFile("file two", "path/to/file_two", server);
+  writer.AddParameter("path/to/file_one", server, attr.get_id(), "one", 0,
+                      true);
+  writer.AddParameter("path/to/file_two", server, attr.get_id(), "two", 0,
+                      true);
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of files",
+                         writer.get_files_count() == 2);
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of parameters",
+                         writer.get_parameters_count() == 2);
+
+  struct timeval time;
+  gettimeofday(&time, NULL);
+
+  CPPUNIT_ASSERT_MESSAGE("Flush", writer.Flush());
+  CPPUNIT_ASSERT_MESSAGE("Buffers not cleared",
+                         writer.get_files_count() == 0 &&
+                         writer.get_parameters_count() == 0);
+
+  auto file = FileEntry::GetByPathOnServer("path/to/file_one", server);
+  CPPUNIT_ASSERT_MESSAGE("Error in GetByPathOnServer", file);
+  CPPUNIT_ASSERT_MESSAGE("Error in name", file->get_name() == "file one");
+  CPPUNIT_ASSERT_MESSAGE("Error in timestamp",
+                         file->get_timestamp() >= time.tv_sec);
+
+  auto param = FileParameter::GetByFileAndAttribute(*file, attr);
+  CPPUNIT_ASSERT_MESSAGE("FileParameter", param);
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of parameters", param->size() == 1);
+  CPPUNIT_ASSERT_MESSAGE("Wrong value",
+                         param->at(0)->get_str_value() == "one");
+
+  // Writing the same file again must keep its id.
+  int id = file->get_id();
+  writer.AddFile("file one", "path/to/file_one", server);
+  CPPUNIT_ASSERT_MESSAGE("Flush", writer.Flush());
+  file = FileEntry::GetByPathOnServer("path/to/file_one", server);
+  CPPUNIT_ASSERT_MESSAGE("Id changed on update", file->get_id() == id);
+}
+
+void BatchWriterTest::SmallStatementsTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  FileAttribute attr("test-attr", FileAttribute::faString);
+  std::string server("batch.server");
+
+  // Every row gets its own statement.
+  BatchWriter writer(1);
+  for (int i = 0; i < 10; ++i) {
+    std::string path = "small/file_" + std::to_string(i);
+    writer.AddFile("file", path, server);
+    writer.AddParameter(path, server, attr.get_id(), path, i, false);
+  }
+  CPPUNIT_ASSERT_MESSAGE("Flush", writer.Flush());
+
+  for (int i = 0; i < 10; ++i) {
+    std::string path = "small/file_" + std::to_string(i);
+    auto file = FileEntry::GetByPathOnServer(path, server);
+    CPPUNIT_ASSERT_MESSAGE("Error in GetByPathOnServer", file);
+    auto param = FileParameter::GetByFileAndAttribute(*file, attr);
+    CPPUNIT_ASSERT_MESSAGE("FileParameter", param && param->size() == 1);
+    CPPUNIT_ASSERT_MESSAGE("Wrong value",
+                           param->at(0)->get_num_value() == i);
+  }
+}
+
+void TrigramIndexTest::AddTestCase() {
+  TrigramIndex index;
+  CPPUNIT_ASSERT(index.Add(1, "some file"));
+  CPPUNIT_ASSERT(index.Add(1000000, "another file"));
+  CPPUNIT_ASSERT_MESSAGE("Ids out of order", !index.Add(5, "old file"));
+  CPPUNIT_ASSERT_MESSAGE("Short name", index.Add(1000001, "ab"));
+  CPPUNIT_ASSERT(index.get_size() == 3);
+}
+
+void TrigramIndexTest::FindTestCase() {
+  TrigramIndex index;
+  CPPUNIT_ASSERT(index.Add(1, "Vladimir Visotsky"));
+  CPPUNIT_ASSERT(index.Add(2, "Putin Vladimir Vladimirovich"));
+  CPPUNIT_ASSERT(index.Add(300, "some music.mp3"));
+  CPPUNIT_ASSERT(index.Add(70000, "MUSIC collection"));
+
+  std::vector<int> ids;
+  CPPUNIT_ASSERT(index.Find("vladimir", &ids));
+  CPPUNIT_ASSERT_MESSAGE("Wrong ids", ids == std::vector<int>({1, 2}));
+
+  // Case insensitive, ids far from each other.
+  CPPUNIT_ASSERT(index.Find("Music", &ids));
+  CPPUNIT_ASSERT_MESSAGE("Wrong ids", ids == std::vector<int>({300, 70000}));
+
+  CPPUNIT_ASSERT(index.Find("nothing", &ids));
+  CPPUNIT_ASSERT_MESSAGE("Unexpected ids", ids.empty());
+
+  // Trigrams are present, the name is not: candidates are a superset.
+  CPPUNIT_ASSERT(index.Find("music.mp3 collection", &ids));
+  CPPUNIT_ASSERT_MESSAGE("Unexpected ids", ids.empty());
+
+  CPPUNIT_ASSERT_MESSAGE("Too short substring", !index.Find("mu", &ids));
+
+  // Only the data base knows how these are matched.
+  CPPUNIT_ASSERT_MESSAGE("Wildcard", !index.Find("vlad_mir", &ids));
+  CPPUNIT_ASSERT_MESSAGE("Wildcard", !index.Find("100%", &ids));
+  CPPUNIT_ASSERT_MESSAGE("Not ASCII",
+                         !index.Find("\xd0\x9c\xd1\x83\xd0\xb7", &ids));
+
+  // Accented names may fold to any ASCII query.
+  CPPUNIT_ASSERT(index.Add(70001, "Caf\xc3\xa9 music"));
+  CPPUNIT_ASSERT(index.get_last_id() == 70001);
+  CPPUNIT_ASSERT(index.Find("cafe", &ids));
+  CPPUNIT_ASSERT_MESSAGE("Wrong ids", ids == std::vector<int>({70001}));
+  CPPUNIT_ASSERT(index.Find("Music", &ids));
+  CPPUNIT_ASSERT_MESSAGE("Wrong ids",
+                         ids == std::vector<int>({300, 70000, 70001}));
+}
+
+void ConnectionPoolTest::setUp() {
+  CPPUNIT_ASSERT_MESSAGE("Error in reading configuration files",
+                         read_database_config(&name_, &server_, &user_,
+                                              &password_,
+                                              "../" DATABASE_CONFIG) == 0);
+}
+
+void ConnectionPoolTest::CheckoutTestCase() {
+  ConnectionPool pool(name_, server_, user_, password_, 1, 1);
+  std::string error;
+
+  PooledConnection *connection = pool.Checkout(&error);
+  CPPUNIT_ASSERT_MESSAGE(error, connection != nullptr);
+  CPPUNIT_ASSERT(pool.get_open_count() == 1);
+
+  CPPUNIT_ASSERT_MESSAGE("Checkout over pool size",
+                         pool.Checkout(&error) == nullptr);
+
+  pool.Release(connection);
+  CPPUNIT_ASSERT(pool.get_idle_count() == 1);
+  CPPUNIT_ASSERT_MESSAGE("Idle connection isn't reused",
+                         pool.Checkout(&error) == connection);
+
+  pool.Release(connection, true);
+  CPPUNIT_ASSERT_MESSAGE("Broken connection is kept",
+                         pool.get_open_count() == 0);
+
+  pool.Close();
+  CPPUNIT_ASSERT_MESSAGE("Checkout from closed pool",
+                         pool.Checkout(&error) == nullptr);
+}
+
+void ConnectionPoolTest::ThreadsTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, true, 2));
+
+  // More threads than connections, each one uses its own transaction.
+  std::atomic<int> failed(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([i, &failed]() {
+      std::string server("pool.test." + std::to_string(i));
+      if (!DatabaseEntity::StartTransaction()) {
+        ++failed;
+        return;
+      }
+      FileEntry("test file", "path/to/test_file", server);
+      if (!FileEntry::GetByPathOnServer("path/to/test_file", server))
+        ++failed;
+      DatabaseEntity::RollbackTransaction();
+      DatabaseEntity::ReleaseConnection();
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  CPPUNIT_ASSERT_MESSAGE("Query in thread failed", failed == 0);
+}
+
+void ConnectionPoolTest::StatementCacheTestCase() {
+  ConnectionPool pool(name_, server_, user_, password_, 1, 1);
+  std::string error;
+
+  PooledConnection *connection = pool.Checkout(&error);
+  CPPUNIT_ASSERT_MESSAGE(error, connection != nullptr);
+
+  StatementCache &statements = connection->get_statements();
+  PreparedStatement &query =
+      statements.Get("select id from mss_files where id = ?");
+  CPPUNIT_ASSERT(query.get_param_count() == 1);
+  CPPUNIT_ASSERT_MESSAGE("Statement isn't cached",
+                         &statements.Get("select id from mss_files "
+                                         "where id = ?") == &query);
+  CPPUNIT_ASSERT(statements.get_size() == 1);
+
+  query.BindInt(0, -1);
+  query.Execute();
+  CPPUNIT_ASSERT_MESSAGE("Row for wrong id", !query.Fetch());
+
+  CPPUNIT_ASSERT_THROW(statements.Get("not a statement"), mysqlpp::Exception);
+  CPPUNIT_ASSERT(statements.get_size() == 1);
+
+  pool.Release(connection);
+}
+
+void EntityCacheTest::EvictionTestCase() {
+  // Two shards of two values.
+  EntityCache<int, std::string> cache(4, 2);
+  std::shared_ptr<const std::string> evicted;
+  for (int i = 0; i < 4; ++i) {
+    cache.Put(i, std::make_shared<const std::string>(std::to_string(i)),
+              &evicted);
+  }
+  CPPUNIT_ASSERT_MESSAGE("Unexpected eviction", !evicted);
+  CPPUNIT_ASSERT(cache.get_size() == 4);
+
+  // 0 is used, so 2 is the oldest value of its shard.
+  CPPUNIT_ASSERT(cache.Get(0) && *cache.Get(0) == "0");
+  cache.Put(4, std::make_shared<const std::string>("4"), &evicted);
+  CPPUNIT_ASSERT_MESSAGE("Wrong evicted value", evicted && *evicted == "2");
+  CPPUNIT_ASSERT(!cache.Get(2));
+  CPPUNIT_ASSERT(cache.Get(0) && cache.Get(4) && cache.Get(1));
+  CPPUNIT_ASSERT(cache.get_size() == 4);
+
+  std::shared_ptr<const std::string> removed = cache.Remove(1);
+  CPPUNIT_ASSERT_MESSAGE("Remove", removed && *removed == "1");
+  CPPUNIT_ASSERT(!cache.Get(1));
+  CPPUNIT_ASSERT(!cache.Remove(1));
+
+  cache.Clear();
+  CPPUNIT_ASSERT(cache.get_size() == 0);
+  CPPUNIT_ASSERT(cache.get_hits() > 0 && cache.get_misses() > 0);
+}
+
+void EntityCacheTest::VersionTestCase() {
+  EntityCache<std::string, int> cache(0);
+
+  // Value read before a write of the row is dropped.
+  uint64_t version = cache.get_version();
+  cache.Remove("file");
+  CPPUNIT_ASSERT_MESSAGE("Stale value stored",
+                         !cache.Put("file", std::make_shared<const int>(1),
+                                    version));
+  CPPUNIT_ASSERT(!cache.Get("file"));
+
+  version = cache.get_version();
+  cache.Expire();
+  CPPUNIT_ASSERT(!cache.Put("file", std::make_shared<const int>(1), version));
+
+  version = cache.get_version();
+  CPPUNIT_ASSERT(cache.Put("file", std::make_shared<const int>(2), version));
+  CPPUNIT_ASSERT(cache.Get("file") && *cache.Get("file") == 2);
+
+  // No limit.
+  for (int i = 0; i < ENTITY_CACHE_SHARDS * 4; ++i)
+    cache.Put(std::to_string(i), std::make_shared<const int>(i));
+  CPPUNIT_ASSERT(cache.get_size() == ENTITY_CACHE_SHARDS * 4 + 1);
+}
+
+void EntityCacheTest::TimeToLiveTestCase() {
+  EntityCache<int, int> cache(0, 1, 50);
+  cache.Put(1, std::make_shared<const int>(1));
+  CPPUNIT_ASSERT(cache.Get(1) && *cache.Get(1) == 1);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  cache.Put(2, std::make_shared<const int>(2));
+  CPPUNIT_ASSERT_MESSAGE("Old value is used", !cache.Get(1));
+  CPPUNIT_ASSERT(cache.Get(2));
+  CPPUNIT_ASSERT_MESSAGE("Old value is kept", cache.get_size() == 1);
+}
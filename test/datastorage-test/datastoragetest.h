@@ -32,15 +32,25 @@
 #include <iostream>
 
 #include "data-storage/entities.h"
+#include "data-storage/batchwriter.h"
+#include "data-storage/trigramindex.h"
+#include "data-storage/connectionpool.h"
+#include "data-storage/entitycache.h"
 
 class FileEntryTest : public CppUnit::TestFixture {
  public:
   void setUp();
   void GetByPathOnServerTestCase();
+  void LongPathTestCase();
+  void CacheTestCase();
+  void StreamTestCase();
 
  private:
   CPPUNIT_TEST_SUITE(FileEntryTest);
   CPPUNIT_TEST(GetByPathOnServerTestCase);
+  CPPUNIT_TEST(LongPathTestCase);
+  CPPUNIT_TEST(CacheTestCase);
+  CPPUNIT_TEST(StreamTestCase);
   CPPUNIT_TEST_SUITE_END();
 
   std::string name_;
@@ -69,10 +79,14 @@ class FileParameterTest : public CppUnit::TestFixture {
  public:
   void setUp();
   void ConstructorsTestCase();
+  void BulkLoadTestCase();
+  void DuplicatesTestCase();
 
  private:
   CPPUNIT_TEST_SUITE(FileParameterTest);
   CPPUNIT_TEST(ConstructorsTestCase);
+  CPPUNIT_TEST(BulkLoadTestCase);
+  CPPUNIT_TEST(DuplicatesTestCase);
   CPPUNIT_TEST_SUITE_END();
 
   std::string name_;
@@ -81,4 +95,68 @@ class FileParameterTest : public CppUnit::TestFixture {
   std::string password_;
 };
 
+class BatchWriterTest : public CppUnit::TestFixture {
+ public:
+  void setUp();
+  void FlushTestCase();
+  void SmallStatementsTestCase();
+
+ private:
+  CPPUNIT_TEST_SUITE(BatchWriterTest);
+  CPPUNIT_TEST(FlushTestCase);
+  CPPUNIT_TEST(SmallStatementsTestCase);
+  CPPUNIT_TEST_SUITE_END();
+
+  std::string name_;
+  std::string server_;
+  std::string user_;
+  std::string password_;
+};
+
+class TrigramIndexTest : public CppUnit::TestFixture {
+ public:
+  void AddTestCase();
+  void FindTestCase();
+
+ private:
+  CPPUNIT_TEST_SUITE(TrigramIndexTest);
+  CPPUNIT_TEST(AddTestCase);
+  CPPUNIT_TEST(FindTestCase);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+class ConnectionPoolTest : public CppUnit::TestFixture {
+ public:
+  void setUp();
+  void CheckoutTestCase();
+  void ThreadsTestCase();
+  void StatementCacheTestCase();
+
+ private:
+  CPPUNIT_TEST_SUITE(ConnectionPoolTest);
+  CPPUNIT_TEST(CheckoutTestCase);
+  CPPUNIT_TEST(ThreadsTestCase);
+  CPPUNIT_TEST(StatementCacheTestCase);
+  CPPUNIT_TEST_SUITE_END();
+
+  std::string name_;
+  std::string server_;
+  std::string user_;
+  std::string password_;
+};
+
+class EntityCacheTest : public CppUnit::TestFixture {
+ public:
+  void EvictionTestCase();
+  void VersionTestCase();
+  void TimeToLiveTestCase();
+
+ private:
+  CPPUNIT_TEST_SUITE(EntityCacheTest);
+  CPPUNIT_TEST(EvictionTestCase);
+  CPPUNIT_TEST(VersionTestCase);
+  CPPUNIT_TEST(TimeToLiveTestCase);
+  CPPUNIT_TEST_SUITE_END();
+};
+
 #endif  // TEST_DATASTORAGETEST_H_
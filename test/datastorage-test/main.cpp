@@ -31,6 +31,10 @@
 CPPUNIT_TEST_SUITE_REGISTRATION(FileEntryTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileAttributeTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileParameterTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(BatchWriterTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(TrigramIndexTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(ConnectionPoolTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(EntityCacheTest);
 
 int main() {
   CppUnit::TextUi::TestRunner runner;
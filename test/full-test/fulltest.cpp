@@ -28,6 +28,7 @@
 #include "test/datastorage-test/datastoragetest.h"
 #include "test/spider-test/spidertest.h"
 #include "test/serverqueue-test/serverqueuetest.h"
+#include "test/searchd-test/searchdtest.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(SocketAddressTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(UDPSocketTest);
@@ -37,7 +38,11 @@ CPPUNIT_TEST_SUITE_REGISTRATION(AbstractSocketTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileEntryTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileAttributeTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileParameterTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(BatchWriterTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(TrigramIndexTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(ConnectionPoolTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(ServerQueueTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(SearchServerTest);
 
 int main() {
   CppUnit::TextUi::TestRunner runner;
@@ -0,0 +1,5 @@
+TEMPLATE = app
+TARGET = searchdtest
+SOURCES += searchdtest.cpp main.cpp
+HEADERS += searchdtest.h
+OTHER_FILES += Makefile
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <signal.h>
+#include <sys/socket.h>
+
+#include <set>
+#include <string>
+#include <thread>
+
+#include "cppsockets/tcpsocket.h"
+#include "searchdtest.h"
+
+void SearchServerTest::ProtocolTestCase() {
+  SearchRequest request;
+  request.id = 42;
+  request.type = GetByAttributeRequest;
+  request.offset = 100;
+  request.limit = 70000;
+  request.query = "mime-type";
+  request.value = "application/pdf";
+
+  std::string buf;
+  SearchProtocol::EncodeRequest(request, &buf);
+  request.id = 43;
+  SearchProtocol::EncodeRequest(request, &buf);
+  size_t size = buf.size() / 2;
+
+  // Incomplete frame.
+  SearchRequest decoded;
+  CPPUNIT_ASSERT(SearchProtocol::DecodeRequest(buf.substr(0, size - 1), 0,
+                                               1024, &decoded) == 0);
+
+  // Two pipelined frames.
+  CPPUNIT_ASSERT(SearchProtocol::DecodeRequest(buf, 0, 1024, &decoded) ==
+                 static_cast<ssize_t>(size));
+  CPPUNIT_ASSERT(decoded.id == 42);
+  CPPUNIT_ASSERT(decoded.type == GetByAttributeRequest);
+  CPPUNIT_ASSERT(decoded.offset == 100);
+  CPPUNIT_ASSERT(decoded.limit == 70000);
+  CPPUNIT_ASSERT(decoded.query == "mime-type");
+  CPPUNIT_ASSERT(decoded.value == "application/pdf");
+
+  CPPUNIT_ASSERT(SearchProtocol::DecodeRequest(buf, size, 1024, &decoded) ==
+                 static_cast<ssize_t>(size));
+  CPPUNIT_ASSERT(decoded.id == 43);
+
+  CPPUNIT_ASSERT_MESSAGE("Too big frame",
+                         SearchProtocol::DecodeRequest(buf, 0, size - 1,
+                                                       &decoded) == -1);
+}
+
+void SearchServerTest::PipelineTestCase() {
+  signal(SIGPIPE, SIG_IGN);
+
+  SearchServer server(0, 2);
+  CPPUNIT_ASSERT(!server.get_error());
+  std::thread loop([&server]() { server.Run(); });
+
+  TCPSocket client;
+  CPPUNIT_ASSERT(!client.ConnectToHost("127.0.0.1", server.get_port()));
+
+  // Requests of unknown type are answered without the data base.
+  std::string buf;
+  SearchRequest request;
+  request.type = 0;
+  request.offset = 0;
+  request.limit = 0;
+  for (request.id = 1; request.id <= 10; ++request.id)
+    SearchProtocol::EncodeRequest(request, &buf);
+  CPPUNIT_ASSERT(client.WriteData(&buf[0], buf.size()) == buf.size());
+
+  std::string input;
+  std::set<uint32_t> ids;
+  char chunk[256];
+  while (ids.size() < 10) {
+    size_t count = client.ReadData(chunk, sizeof(chunk));
+    CPPUNIT_ASSERT(count != 0 && count != static_cast<size_t>(-1));
+    input.append(chunk, count);
+
+    size_t pos = 0;
+    uint32_t length, id;
+    while (SearchProtocol::ReadUint32(input, input.size(), &pos, &length) &&
+           input.size() >= pos + length) {
+      CPPUNIT_ASSERT(SearchProtocol::ReadUint32(input, pos + length, &pos,
+                                                &id));
+      CPPUNIT_ASSERT_MESSAGE("Error expected", input[pos] == ErrorStatus);
+      ids.insert(id);
+      pos += length - 4;
+      input.erase(0, pos);
+      pos = 0;
+    }
+  }
+  CPPUNIT_ASSERT_MESSAGE("Wrong ids", *ids.begin() == 1 && *ids.rbegin() == 10);
+
+  server.Stop();
+  loop.join();
+}
+
+void SearchServerTest::HalfCloseTestCase() {
+  signal(SIGPIPE, SIG_IGN);
+
+  SearchServer server(0, 2);
+  CPPUNIT_ASSERT(!server.get_error());
+  std::thread loop([&server]() { server.Run(); });
+
+  TCPSocket client;
+  CPPUNIT_ASSERT(!client.ConnectToHost("127.0.0.1", server.get_port()));
+
+  std::string buf;
+  SearchRequest request;
+  request.type = 0;
+  request.offset = 0;
+  request.limit = 0;
+  for (request.id = 1; request.id <= 10; ++request.id)
+    SearchProtocol::EncodeRequest(request, &buf);
+  CPPUNIT_ASSERT(client.WriteData(&buf[0], buf.size()) == buf.size());
+  CPPUNIT_ASSERT(!shutdown(client.get_descriptor(), SHUT_WR));
+
+  // All requests are answered, then the server closes the connection.
+  std::string input;
+  char chunk[256];
+  while (true) {
+    size_t count = client.ReadData(chunk, sizeof(chunk));
+    CPPUNIT_ASSERT(count != static_cast<size_t>(-1));
+    if (count == 0)
+      break;
+    input.append(chunk, count);
+  }
+
+  size_t pos = 0;
+  std::set<uint32_t> ids;
+  uint32_t length, id;
+  while (SearchProtocol::ReadUint32(input, input.size(), &pos, &length)) {
+    size_t end = pos + length;
+    CPPUNIT_ASSERT(SearchProtocol::ReadUint32(input, end, &pos, &id));
+    ids.insert(id);
+    pos = end;
+  }
+  CPPUNIT_ASSERT_MESSAGE("Lost responses", ids.size() == 10);
+
+  server.Stop();
+  loop.join();
+}
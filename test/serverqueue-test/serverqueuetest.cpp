@@ -30,8 +30,13 @@
 #include <unistd.h>
 
 #include <cppunit/TestAssert.h>
+#include <memory>
+#include <set>
+#include <string>
 
+#include "scheduler/protocol.h"
 #include "scheduler/serverqueue.h"
+#include "scheduler/statelog.h"
 #include "serverqueuetest.h"
 
 ServerQueueTest::ServerQueueTest() : ServerQueue() {}
@@ -144,3 +149,222 @@ void ServerQueueTest::GetAfterRelease() {
 
   CPPUNIT_ASSERT_MESSAGE("Misplaced head of the queue", CmdGet() == "three");
 }
+
+void ServerQueueTest::RenewLease() {
+  AddServer("one");
+  AddServer("two");
+
+  CPPUNIT_ASSERT(CmdLease("spider1") == "two");
+  CPPUNIT_ASSERT_MESSAGE("Lease not renewed", CmdRenew("two", "spider1"));
+  CPPUNIT_ASSERT_MESSAGE("Lease renewed by another spider",
+                         !CmdRenew("two", "spider2"));
+  CPPUNIT_ASSERT_MESSAGE("Free server renewed", !CmdRenew("one", "spider1"));
+  CPPUNIT_ASSERT(!CmdRenew("three", "spider1"));
+  CmdRelease("two");
+  CPPUNIT_ASSERT_MESSAGE("Released lease renewed",
+                         !CmdRenew("two", "spider1"));
+
+  // A lease taken by a text command goes to the first spider renewing it.
+  CPPUNIT_ASSERT(CmdGet() == "one");
+  CPPUNIT_ASSERT(CmdRenew("one", "spider2"));
+  CPPUNIT_ASSERT(!CmdRenew("one", "spider1"));
+}
+
+void ServerQueueTest::GetEveryServerOnce() {
+  for (int i = 0; i < 1000; ++i)
+    AddServer("server" + std::to_string(i));
+  AddServer("server0");
+  CPPUNIT_ASSERT_MESSAGE("Duplicated server added", get_size() == 1000);
+
+  std::set<std::string> servers;
+  for (int i = 0; i < 1000; ++i)
+    servers.insert(CmdGet());
+  CPPUNIT_ASSERT_MESSAGE("Server given out twice", servers.size() == 1000);
+  CPPUNIT_ASSERT_MESSAGE("Busy server given out", CmdGet().empty());
+
+  CmdRelease("server500");
+  CmdRelease("server10");
+  CPPUNIT_ASSERT_MESSAGE("Wrong order of released servers",
+                         CmdGet() == "server500");
+  CPPUNIT_ASSERT_MESSAGE("Wrong order of released servers",
+                         CmdGet() == "server10");
+}
+
+void ServerQueueTest::FreshnessPolicyOrder() {
+  AddServer("cold", 1);
+  AddServer("hot", 10);
+  set_policy(std::unique_ptr<SchedulingPolicy>(new FreshnessPolicy(3600)));
+
+  CPPUNIT_ASSERT_MESSAGE("Priority is ignored", CmdGet() == "hot");
+  CPPUNIT_ASSERT_MESSAGE("Priority is ignored", CmdGet() == "cold");
+
+  // Nothing changed on cold server, everything on hot one.
+  CmdRelease("cold", 100, 0);
+  CmdRelease("hot", 100, 100);
+  CPPUNIT_ASSERT(get_servers_list().front().get_stats().change_rate == 1);
+  CPPUNIT_ASSERT_MESSAGE("Change rate is ignored", CmdGet() == "hot");
+  CPPUNIT_ASSERT_MESSAGE("Change rate is ignored", CmdGet() == "cold");
+}
+
+void ServerQueueTest::SplitServer() {
+  AddServer("big", 5);
+  CPPUNIT_ASSERT(CmdGet() == "big");
+
+  CPPUNIT_ASSERT_MESSAGE("Share is not queued", CmdSplit("big/share"));
+  CPPUNIT_ASSERT_MESSAGE("Directory is not queued",
+                         CmdSplit("big/share/dir"));
+  CPPUNIT_ASSERT_MESSAGE("Queued item is rejected", CmdSplit("big/share"));
+  CPPUNIT_ASSERT_MESSAGE("Unknown server is split",
+                         !CmdSplit("small/share"));
+  CPPUNIT_ASSERT_MESSAGE("Server is split", !CmdSplit("big"));
+  CPPUNIT_ASSERT_MESSAGE("Empty item is queued", !CmdSplit("big/"));
+  CPPUNIT_ASSERT(get_size() == 3);
+
+  // Items are given out while the server is busy, the newest first.
+  CPPUNIT_ASSERT(CmdGet() == "big/share/dir");
+  CPPUNIT_ASSERT(CmdGet() == "big/share");
+  CPPUNIT_ASSERT(CmdGet().empty());
+  CPPUNIT_ASSERT(get_servers_list().back().get_stats().priority == 5);
+}
+
+void ServerQueueTest::MessageEncoding() {
+  SchedulerMessage message;
+  message.type = ReleaseMessage;
+  message.seq = 0xdeadbeef;
+  message.items.resize(2);
+  message.items[0].name = "server/share";
+  message.items[0].files = 100;
+  message.items[0].changed = 7;
+  message.items[1].name = "server";
+
+  std::string data;
+  SchedulerProtocol::Encode(message, &data);
+  CPPUNIT_ASSERT(SchedulerProtocol::IsMessage(data.data(), data.size()));
+  CPPUNIT_ASSERT_MESSAGE("Text command is a message",
+                         !SchedulerProtocol::IsMessage("Gserver", 7));
+
+  SchedulerMessage decoded;
+  CPPUNIT_ASSERT(SchedulerProtocol::Decode(data.data(), data.size(),
+                                           &decoded));
+  CPPUNIT_ASSERT(decoded.type == ReleaseMessage);
+  CPPUNIT_ASSERT(decoded.seq == 0xdeadbeef);
+  CPPUNIT_ASSERT(decoded.items.size() == 2);
+  CPPUNIT_ASSERT(decoded.items[0].name == "server/share");
+  CPPUNIT_ASSERT(decoded.items[0].files == 100);
+  CPPUNIT_ASSERT(decoded.items[0].changed == 7);
+  CPPUNIT_ASSERT_MESSAGE("Unknown count is lost",
+                         decoded.items[1].files == -1);
+
+  CPPUNIT_ASSERT_MESSAGE("Truncated message is decoded",
+                         !SchedulerProtocol::Decode(data.data(),
+                                                    data.size() - 1,
+                                                    &decoded));
+}
+
+void ServerQueueTest::PersistState() {
+  char state[] = SERVERQUEUETEMPLATE;
+  int fd = mkstemp(state);
+  CPPUNIT_ASSERT(fd != -1);
+  close(fd);
+  unlink(state);
+  std::string log = std::string(state) + ".log";
+
+  {
+    ServerQueue queue(buf_);
+    CPPUNIT_ASSERT(!queue.OpenState(state));
+    CPPUNIT_ASSERT(queue.CmdGet() == "test2");
+    CPPUNIT_ASSERT(queue.CmdSplit("test2/share"));
+    CPPUNIT_ASSERT(queue.CmdGet() == "test2/share");
+    queue.CmdRelease("test2/share", 10, 5);
+    CPPUNIT_ASSERT(!queue.SyncState());
+  }
+
+  // A torn record at the end is ignored.
+  FILE *fp = fopen(log.c_str(), "a");
+  CPPUNIT_ASSERT(fp != NULL);
+  fputs("garbage", fp);
+  fclose(fp);
+
+  for (int run = 0; run < 2; ++run) {
+    ServerQueue queue(buf_);
+    CPPUNIT_ASSERT(!queue.OpenState(state));
+    CPPUNIT_ASSERT_MESSAGE("Split item is lost", queue.get_size() == 3);
+
+    bool found = false;
+    for (auto &server : queue.get_servers_list()) {
+      if (server.get_name() == "test2/share") {
+        found = true;
+        CPPUNIT_ASSERT_MESSAGE("Last crawl is lost",
+                               server.get_stats().last_crawl != 0);
+        CPPUNIT_ASSERT(server.get_stats().change_rate == 0.5);
+      }
+    }
+    CPPUNIT_ASSERT(found);
+  }
+
+  // The lease of test2 is kept, released item goes after never crawled.
+  ServerQueue queue(buf_);
+  CPPUNIT_ASSERT(!queue.OpenState(state));
+  CPPUNIT_ASSERT(queue.CmdGet() == "test1");
+  CPPUNIT_ASSERT(queue.CmdGet() == "test2/share");
+  CPPUNIT_ASSERT_MESSAGE("Lease is lost", queue.CmdGet().empty());
+
+  unlink(log.c_str());
+  unlink((std::string(state) + ".snapshot").c_str());
+}
+
+void ServerQueueTest::StateSnapshot() {
+  char state[] = SERVERQUEUETEMPLATE;
+  int fd = mkstemp(state);
+  CPPUNIT_ASSERT(fd != -1);
+  close(fd);
+  unlink(state);
+
+  StateLog::Record old_a, new_a, b;
+  old_a.name = new_a.name = "a";
+  old_a.ticket = 1;
+  new_a.ticket = 2;
+  b.name = "b";
+
+  {
+    StateLog log(state);
+    CPPUNIT_ASSERT(!log.Load([](const StateLog::Record &) {
+      CPPUNIT_FAIL("Record in empty state");
+    }));
+    log.Append(old_a);
+    CPPUNIT_ASSERT(!log.Flush());
+    CPPUNIT_ASSERT(!log.Snapshot(std::vector<StateLog::Record>(1, new_a)));
+    log.Append(b);
+  }
+
+  std::vector<StateLog::Record> records;
+  StateLog log(state);
+  CPPUNIT_ASSERT(!log.Load([&records](const StateLog::Record &record) {
+    records.push_back(record);
+  }));
+  CPPUNIT_ASSERT_MESSAGE("Log before snapshot is replayed",
+                         records.size() == 2);
+  CPPUNIT_ASSERT(records[0].name == "a" && records[0].ticket == 2);
+  CPPUNIT_ASSERT(records[1].name == "b");
+  CPPUNIT_ASSERT(StateLog::Crc32("123456789", 9) == 0xcbf43926);
+
+  // Records appended while the snapshot is written go to the new log.
+  StateLog::Record c;
+  c.name = "c";
+  CPPUNIT_ASSERT(!log.StartSnapshot());
+  log.Append(c);
+  CPPUNIT_ASSERT(!log.Flush());
+  CPPUNIT_ASSERT(!log.FinishSnapshot(log.WriteSnapshot(records)));
+  CPPUNIT_ASSERT(!log.is_snapshotting());
+
+  records.clear();
+  StateLog reloaded(state);
+  CPPUNIT_ASSERT(!reloaded.Load([&records](const StateLog::Record &record) {
+    records.push_back(record);
+  }));
+  CPPUNIT_ASSERT_MESSAGE("Record after snapshot is lost",
+                         records.size() == 3 && records[2].name == "c");
+
+  unlink((std::string(state) + ".log").c_str());
+  unlink((std::string(state) + ".snapshot").c_str());
+}
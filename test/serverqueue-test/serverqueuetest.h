@@ -47,6 +47,13 @@ class ServerQueueTest : public CppUnit::TestFixture, public ServerQueue {
   void GetNonExistentServer();
   void ReleaseNonExistentServer();
   void GetAfterRelease();
+  void RenewLease();
+  void GetEveryServerOnce();
+  void FreshnessPolicyOrder();
+  void SplitServer();
+  void MessageEncoding();
+  void PersistState();
+  void StateSnapshot();
 
   void setUp();
   void tearDown();
@@ -63,6 +70,13 @@ class ServerQueueTest : public CppUnit::TestFixture, public ServerQueue {
   CPPUNIT_TEST(GetNonExistentServer);
   CPPUNIT_TEST(ReleaseNonExistentServer);
   CPPUNIT_TEST(GetAfterRelease);
+  CPPUNIT_TEST(RenewLease);
+  CPPUNIT_TEST(GetEveryServerOnce);
+  CPPUNIT_TEST(FreshnessPolicyOrder);
+  CPPUNIT_TEST(SplitServer);
+  CPPUNIT_TEST(MessageEncoding);
+  CPPUNIT_TEST(PersistState);
+  CPPUNIT_TEST(StateSnapshot);
   CPPUNIT_TEST_SUITE_END();
 
   char buf_[sizeof SERVERQUEUETEMPLATE];
@@ -29,13 +29,18 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <string.h>
 
 #include <algorithm>
+#include <thread>
 
 #include "config.h"
 #include "common-inl.h"
 #include "spidertest.h"
 #include "scheduler/schedulerserver.h"
+#include "spider/boundedqueue.h"
+#include "spider/contenthash.h"
+#include "spider/mimetypes.h"
 
 SpiderTest::SpiderTest() : Spider() {}
 
@@ -81,9 +86,13 @@ void SpiderTest::ServerInteractionTestCase() {
     ServerManager pserver_manager("localhost");
     
     CPPUNIT_ASSERT(pserver_manager.GetServer() == "test2");
-    pserver_manager.ReleaseServer();
+    pserver_manager.ReleaseServer("test2");
     CPPUNIT_ASSERT(pserver_manager.GetServer() == "test1");
-    pserver_manager.ReleaseServer();
+    CPPUNIT_ASSERT(pserver_manager.SplitItem("test1/share"));
+    CPPUNIT_ASSERT(!pserver_manager.SplitItem("unknown/share"));
+    pserver_manager.ReleaseServer("test1");
+    CPPUNIT_ASSERT(pserver_manager.GetServer() == "test1/share");
+    pserver_manager.ReleaseServer("test1/share");
   }
 }
 
@@ -99,12 +108,22 @@ void SpiderTest::ScanSMBDirTestCase() {
   std::string dir("smb://helena.ilab.mipt.ru/incoming/mipt-smb-search-test");
 
   CPPUNIT_ASSERT(!spider.ScanSMBDir(dir));
-  std::vector<std::string> files = spider.get_result();
-  CPPUNIT_ASSERT_MESSAGE("test_file not found", files[0] == dir + "/test_file");
+  std::vector<std::string> files;
+  const PathArena &result = spider.get_result();
+  for (size_t i = 0; i < result.size(); ++i) {
+    files.push_back(std::string());
+    result.GetUrl(i, &files.back());
+  }
+  // Directories are scanned in parallel so files may come in any order.
+  auto last = files.end();
+  CPPUNIT_ASSERT_MESSAGE("test_file not found",
+                         std::find(files.begin(), last,
+                                   dir + "/test_file") != last);
   CPPUNIT_ASSERT_MESSAGE("test_folder/test_file not found",
-                         files[1] == dir + "/test_folder/test_file");
+                         std::find(files.begin(), last,
+                                   dir + "/test_folder/test_file") != last);
   CPPUNIT_ASSERT_MESSAGE("Wrong number of search elements",
-                         *get_last() == files[2]);
+                         files.size() == 2);
 }
 
 void SpiderTest::NameParserTestCase() {
@@ -120,6 +139,53 @@ void SpiderTest::NameParserTestCase() {
   CPPUNIT_ASSERT(spider.get_error() == EINVAL);
 }
 
+void SpiderTest::NameTokenizerTestCase() {
+  NameTokenizer tokenizer;
+  std::string tokens;
+
+  CPPUNIT_ASSERT(tokenizer.Tokenize("XMLParser_v2.tar.gz", &tokens) == 5);
+  CPPUNIT_ASSERT(tokens == "xml parser v2 tar gz");
+  CPPUNIT_ASSERT(tokenizer.Tokenize("fooBar-baz.MKV", &tokens) == 4);
+  CPPUNIT_ASSERT(tokens == "foo bar baz mkv");
+  CPPUNIT_ASSERT(tokenizer.Tokenize("S01E02", &tokens) == 2);
+  CPPUNIT_ASSERT(tokens == "s01 e02");
+
+  // Repeated words are stored once.
+  CPPUNIT_ASSERT(tokenizer.Tokenize("Disk_1_of_2_disk", &tokens) == 4);
+  CPPUNIT_ASSERT(tokens == "disk 1 of 2");
+
+  // Cyrillic words are followed by their transliterations.
+  CPPUNIT_ASSERT(tokenizer.Tokenize("\xd0\x9c\xd0\xb0\xd1\x82\xd1\x80\xd0\xb8"
+                                    "\xd1\x86\xd0\xb0_1999.mkv", &tokens) == 4);
+  CPPUNIT_ASSERT(tokens == "\xd0\xbc\xd0\xb0\xd1\x82\xd1\x80\xd0\xb8\xd1\x86"
+                           "\xd0\xb0 1999 mkv matritsa");
+
+  // Decomposed letters are composed.
+  CPPUNIT_ASSERT(tokenizer.Tokenize("\xd0\x95\xcc\x88\xd0\xb6", &tokens) == 2);
+  CPPUNIT_ASSERT(tokens == "\xd1\x91\xd0\xb6 ezh");
+
+  CPPUNIT_ASSERT(tokenizer.Tokenize("__", &tokens) == 0);
+  CPPUNIT_ASSERT(tokens.empty());
+
+  // Precomposed and decomposed spellings give the same word.
+  CPPUNIT_ASSERT(tokenizer.Tokenize("Caf\xc3\xa9", &tokens) == 2);
+  CPPUNIT_ASSERT(tokens == "caf\xc3\xa9 cafe");
+  CPPUNIT_ASSERT(tokenizer.Tokenize("Cafe\xcc\x81", &tokens) == 2);
+  CPPUNIT_ASSERT(tokens == "caf\xc3\xa9 cafe");
+
+  // Words and camelCase boundaries across blocks of 64 bytes.
+  std::string name = std::string(60, 'a') + "_bcdEfgh." + std::string(70, 'x');
+  CPPUNIT_ASSERT(tokenizer.Tokenize(name, &tokens) == 4);
+  CPPUNIT_ASSERT(tokens == std::string(60, 'a') + " bcd efgh " +
+                           std::string(70, 'x'));
+  name = std::string(63, 'a') + "Bc";
+  CPPUNIT_ASSERT(tokenizer.Tokenize(name, &tokens) == 2);
+  CPPUNIT_ASSERT(tokens == std::string(63, 'a') + " bc");
+  name = std::string(63, 'A') + "Bc";
+  CPPUNIT_ASSERT(tokenizer.Tokenize(name, &tokens) == 2);
+  CPPUNIT_ASSERT(tokens == std::string(63, 'a') + " bc");
+}
+
 void SpiderTest::AddFileEntryInDataBaseTestCase() {
   SpiderTest spider;
   CPPUNIT_ASSERT(!spider.get_error());
@@ -129,6 +195,7 @@ void SpiderTest::AddFileEntryInDataBaseTestCase() {
   spider.set_db_password(password_);
 
   CPPUNIT_ASSERT(!spider.InitMimeTypeAttr());
+  CPPUNIT_ASSERT(!spider.InitTokensAttr());
 
   std::string server("some.server");
   std::string name("file");
@@ -152,6 +219,9 @@ void SpiderTest::AddFileEntryInDataBaseTestCase() {
       *db_file, spider.get_mime_type_attr());
   CPPUNIT_ASSERT_MESSAGE("No such attribute", param);
   CPPUNIT_ASSERT_MESSAGE("Wrong number of attributes", param->size() == 1);
+  param = FileParameter::GetByFileAndAttribute(*db_file,
+                                               spider.get_tokens_attr());
+  CPPUNIT_ASSERT_MESSAGE("No tokens attribute", param);
 }
 
 void SpiderTest::DumpToDataBaseTestCase() {
@@ -195,6 +265,57 @@ void SpiderTest::DumpToDataBaseTestCase() {
                          current_time.tv_sec <= db_file->get_timestamp());
 }
 
+void SpiderTest::IncrementalDumpTestCase() {
+  SpiderTest spider;
+  CPPUNIT_ASSERT(!spider.get_error());
+  spider.set_db_name(name_);
+  spider.set_db_server(server_);
+  spider.set_db_user(user_);
+  spider.set_db_password(password_);
+
+  CPPUNIT_ASSERT(!spider.InitMimeTypeAttr());
+  CPPUNIT_ASSERT(!spider.InitFingerprintAttr());
+
+  FoundFile file;
+  file.path = "smb://some.server/path/to/incremental";
+  file.size = 10;
+  file.mtime = 100;
+
+  spider.AddSMBFile(file);
+  CPPUNIT_ASSERT(!spider.DumpToDataBase());
+
+  auto db_file = FileEntry::GetByPathOnServer("path/to/incremental",
+                                              "some.server");
+  CPPUNIT_ASSERT_MESSAGE("No such entry in data base", db_file);
+  auto param = FileParameter::GetByFileAndAttribute(
+      *db_file, spider.get_fingerprint_attr());
+  CPPUNIT_ASSERT_MESSAGE("No fingerprint", param && param->size() == 1);
+  CPPUNIT_ASSERT_MESSAGE("Wrong fingerprint",
+                         (*param)[0]->get_str_value() == "10:100");
+
+  // Unchanged file is only marked as seen.
+  struct timeval current_time;
+  gettimeofday(&current_time, NULL);
+
+  spider.AddSMBFile(file);
+  CPPUNIT_ASSERT(!spider.DumpToDataBase());
+
+  db_file = FileEntry::GetByPathOnServer("path/to/incremental", "some.server");
+  CPPUNIT_ASSERT_MESSAGE("FileEntry timestamp",
+                         current_time.tv_sec <= db_file->get_timestamp());
+
+  // Changed file gets a new fingerprint.
+  file.mtime = 200;
+  spider.AddSMBFile(file);
+  CPPUNIT_ASSERT(!spider.DumpToDataBase());
+
+  param = FileParameter::GetByFileAndAttribute(*db_file,
+                                               spider.get_fingerprint_attr());
+  CPPUNIT_ASSERT_MESSAGE("No fingerprint", param && param->size() == 1);
+  CPPUNIT_ASSERT_MESSAGE("Fingerprint not updated",
+                         (*param)[0]->get_str_value() == "10:200");
+}
+
 void SpiderTest::DetectMimeTypeTestCase() {
   SpiderTest spider;
 
@@ -210,3 +331,309 @@ void SpiderTest::DetectMimeTypeTestCase() {
   CPPUNIT_ASSERT_MESSAGE("PDF file not recognized",
                          !strcmp(type, "application/pdf"));
 }
+
+void SpiderTest::MimeTypeByExtensionTestCase() {
+  const char *type = MimeTypeByExtension("path/to/file.pdf");
+  CPPUNIT_ASSERT_MESSAGE("PDF file not recognized",
+                         type && !strcmp(type, "application/pdf"));
+
+  type = MimeTypeByExtension("smb://some.server/Movie.MKV");
+  CPPUNIT_ASSERT_MESSAGE("Upper case extension not recognized",
+                         type && !strcmp(type, "video/x-matroska"));
+
+  CPPUNIT_ASSERT_MESSAGE("Unknown extension",
+                         !MimeTypeByExtension("path/to/file.dat"));
+  CPPUNIT_ASSERT_MESSAGE("No extension",
+                         !MimeTypeByExtension("path/to.dir/file"));
+  CPPUNIT_ASSERT_MESSAGE("Empty extension", !MimeTypeByExtension("file."));
+  CPPUNIT_ASSERT_MESSAGE("Long extension",
+                         !MimeTypeByExtension("file.pdfpdfpdfpdf"));
+
+  // Policy can be overridden per server.
+  char config[] = SPIDERTESTTEMPLATE;
+  int fd = mkstemp(config);
+  CPPUNIT_ASSERT(fd != -1);
+  FILE *fp = fdopen(fd, "w");
+  fputs("localhost\nmime_by_extension 0\nmime_by_extension 1 fast.server\n",
+        fp);
+  fclose(fp);
+
+  SpiderTest spider;
+  CPPUNIT_ASSERT(spider.MimeByExtension("some.server"));
+  CPPUNIT_ASSERT(!spider.ReadConfig(config));
+  CPPUNIT_ASSERT(!spider.MimeByExtension("some.server"));
+  CPPUNIT_ASSERT(spider.MimeByExtension("fast.server"));
+  unlink(config);
+}
+
+void SpiderTest::ShouldSplitTestCase() {
+  SpiderTest spider;
+  CPPUNIT_ASSERT_MESSAGE("Shares", spider.ShouldSplit("smb://server", 1));
+  CPPUNIT_ASSERT_MESSAGE("Narrow directory",
+                         !spider.ShouldSplit("smb://server/share",
+                                             SPIDER_SPLIT_DIRS - 1));
+  CPPUNIT_ASSERT_MESSAGE("Wide directory",
+                         spider.ShouldSplit("smb://server/share",
+                                            SPIDER_SPLIT_DIRS));
+
+  std::string deep("smb://server");
+  for (int i = 0; i < SPIDER_SPLIT_DEPTH; ++i)
+    deep += "/dir";
+  CPPUNIT_ASSERT_MESSAGE("Deep directory",
+                         !spider.ShouldSplit(deep, SPIDER_SPLIT_DIRS));
+
+  char config[] = SPIDERTESTTEMPLATE;
+  int fd = mkstemp(config);
+  CPPUNIT_ASSERT(fd != -1);
+  FILE *fp = fdopen(fd, "w");
+  fputs("localhost\nsplit_dirs 0\n", fp);
+  fclose(fp);
+
+  CPPUNIT_ASSERT(!spider.ReadConfig(config));
+  CPPUNIT_ASSERT_MESSAGE("Splitting is not disabled",
+                         !spider.ShouldSplit("smb://server", 1));
+  unlink(config);
+}
+
+void SpiderTest::LocalBackendTestCase() {
+  char root[] = SPIDERTESTTEMPLATE;
+  CPPUNIT_ASSERT(mkdtemp(root) != NULL);
+  std::string dir(root);
+  CPPUNIT_ASSERT(!mkdir((dir + "/test_folder").c_str(), 0700));
+  FILE *fp = fopen((dir + "/test_file").c_str(), "w");
+  CPPUNIT_ASSERT(fp != NULL);
+  fputs("%PDF-1.4\n", fp);
+  fclose(fp);
+
+  char config[] = SPIDERTESTTEMPLATE;
+  int fd = mkstemp(config);
+  CPPUNIT_ASSERT(fd != -1);
+  fp = fdopen(fd, "w");
+  fprintf(fp, "localhost\nmount local.server %s\ndirents_size 65536\n", root);
+  fclose(fp);
+
+  SpiderTest spider;
+  CPPUNIT_ASSERT(!spider.ReadConfig(config));
+  CPPUNIT_ASSERT_MESSAGE("Mounted server is not local",
+                         spider.ItemUrl("local.server/share") ==
+                         "file://local.server/share");
+  CPPUNIT_ASSERT_MESSAGE("Other servers are not smb",
+                         spider.ItemUrl("some.server") == "smb://some.server");
+
+  CrawlBackend *backend = spider.CreateBackend("file");
+  CPPUNIT_ASSERT(backend != NULL);
+  CPPUNIT_ASSERT_MESSAGE("Buffer size is not set",
+                         backend->get_buffer_size() == 65536);
+  std::vector<CrawlEntry> entries;
+  CPPUNIT_ASSERT(!backend->ReadDir("file://local.server", true, &entries));
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of entries", entries.size() == 2);
+  CPPUNIT_ASSERT_MESSAGE("Wrong statistics",
+                         backend->get_stats().entries == 2 &&
+                         backend->get_stats().calls == 2);
+  std::sort(entries.begin(), entries.end(),
+            [](const CrawlEntry &a, const CrawlEntry &b) {
+              return a.name < b.name; });
+  CPPUNIT_ASSERT(entries[0].name == "test_file" && !entries[0].is_dir);
+  CPPUNIT_ASSERT_MESSAGE("Wrong file size", entries[0].size == 9);
+  CPPUNIT_ASSERT(entries[1].name == "test_folder" && entries[1].is_dir);
+
+  CPPUNIT_ASSERT(backend->ReadDir("file://unknown.server", false,
+                                  &entries) == -1);
+  CPPUNIT_ASSERT(backend->get_error() == ENOENT);
+  delete backend;
+
+  // A failed directory doesn't stop the next scans.
+  std::atomic<size_t> files(0);
+  Crawler crawler(2, [&files](const std::string &dir,
+                              const std::vector<CrawlEntry> &entries) {
+    files += entries.size();
+  });
+  CPPUNIT_ASSERT(crawler.is_ready());
+  CPPUNIT_ASSERT(crawler.Scan("file://" + dir + "/no_such_folder") == -1);
+  CPPUNIT_ASSERT(crawler.get_error() == ENOENT);
+  CPPUNIT_ASSERT(!crawler.Scan("file://" + dir));
+  CPPUNIT_ASSERT(!crawler.get_error() && files == 2);
+
+  // A cancelled scan reads nothing more, the next one is not affected.
+  std::atomic<bool> cancel(true);
+  files = 0;
+  CPPUNIT_ASSERT(crawler.Scan("file://" + dir, &cancel) == -1);
+  CPPUNIT_ASSERT(crawler.get_error() == ECANCELED && files == 0);
+  CPPUNIT_ASSERT(!crawler.Scan("file://" + dir) && files == 2);
+
+  const char *type = spider.DetectMimeType("file://local.server/test_folder");
+  CPPUNIT_ASSERT_MESSAGE("Directory not recognized",
+                         !strcmp(type, "inode/directory"));
+  type = spider.DetectMimeType("file://" + dir + "/test_file");
+  CPPUNIT_ASSERT_MESSAGE("PDF file not recognized",
+                         !strcmp(type, "application/pdf"));
+
+  unlink(config);
+  unlink((dir + "/test_file").c_str());
+  rmdir((dir + "/test_folder").c_str());
+  rmdir(root);
+}
+
+void SpiderTest::ContentHashTestCase() {
+  // Reference values of XXH64 with seed 0.
+  CPPUNIT_ASSERT(ContentHash::ToHex(ContentHash::Hash("", 0)) ==
+                 "ef46db3751d8e999");
+  CPPUNIT_ASSERT(ContentHash::Hash("abc", 3) == 0x44bc2cf5ad770999ULL);
+  std::string text("The quick brown fox jumps over the lazy dog");
+  CPPUNIT_ASSERT(ContentHash::Hash(text.data(), text.size()) ==
+                 0x0b242d361fda71bcULL);
+
+  // Digest doesn't depend on pieces.
+  ContentHash hash;
+  for (size_t i = 0; i < text.size(); i += 5)
+    hash.Update(text.data() + i, std::min<size_t>(5, text.size() - i));
+  CPPUNIT_ASSERT(hash.Digest() == ContentHash::Hash(text.data(),
+                                                    text.size()));
+
+  char root[] = SPIDERTESTTEMPLATE;
+  CPPUNIT_ASSERT(mkdtemp(root) != NULL);
+  std::string dir(root);
+  std::string data;
+  for (int i = 0; i < 1000; ++i)
+    data.push_back('a' + i % 26);
+  for (const char *name : {"/copy_1", "/copy_2", "/other"}) {
+    FILE *fp = fopen((dir + name).c_str(), "w");
+    CPPUNIT_ASSERT(fp != NULL);
+    fputs(data.c_str(), fp);
+    fclose(fp);
+  }
+  // Change a byte between the sampled blocks.
+  FILE *fp = fopen((dir + "/other").c_str(), "r+");
+  CPPUNIT_ASSERT(fp != NULL);
+  fseek(fp, 200, SEEK_SET);
+  fputc('#', fp);
+  fclose(fp);
+
+  CrawlBackend *backend = CrawlBackend::Create("file");
+  CPPUNIT_ASSERT(backend != NULL);
+  std::vector<std::pair<size_t, std::string> > blocks;
+  int64_t size = 0;
+  auto handler = [&blocks](const char *data, const size_t length) {
+    blocks.emplace_back(length, std::string(data, length));
+  };
+  CPPUNIT_ASSERT(!backend->ReadSamples("file://" + dir + "/copy_1", 100, 3,
+                                       &size, handler));
+  CPPUNIT_ASSERT_MESSAGE("Wrong size", size == 1000);
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of blocks", blocks.size() == 3);
+  CPPUNIT_ASSERT(blocks[0].second == data.substr(0, 100));
+  CPPUNIT_ASSERT(blocks[1].second == data.substr(450, 100));
+  CPPUNIT_ASSERT(blocks[2].second == data.substr(900, 100));
+
+  // Whole file is read when blocks cover it.
+  blocks.clear();
+  CPPUNIT_ASSERT(!backend->ReadSamples("file://" + dir + "/copy_1", 400, 0,
+                                       &size, handler));
+  CPPUNIT_ASSERT(blocks.size() == 3 && blocks[2].first == 200);
+
+  blocks.clear();
+  CPPUNIT_ASSERT(backend->ReadSamples("file://" + dir, 100, 3, &size,
+                                      handler) == -1);
+  CPPUNIT_ASSERT(backend->get_error() == EISDIR && blocks.empty());
+  delete backend;
+
+  char config[] = SPIDERTESTTEMPLATE;
+  int fd = mkstemp(config);
+  CPPUNIT_ASSERT(fd != -1);
+  fp = fdopen(fd, "w");
+  fprintf(fp, "localhost\nmount local.server %s\ncontent_block_size 100\n",
+          root);
+  fclose(fp);
+
+  SpiderTest spider;
+  CPPUNIT_ASSERT(!spider.ReadConfig(config));
+  CrawlBackend *spider_backend = NULL;
+  std::string scheme, copy_1, copy_2, other, full;
+  int error = 0;
+  const char *mime_type = NULL;
+  CPPUNIT_ASSERT(!spider.HashContent("file://local.server/copy_1", 3,
+                                     &spider_backend, &scheme, &copy_1,
+                                     &error, &mime_type));
+  CPPUNIT_ASSERT_MESSAGE("MIME type of the first block",
+                         mime_type != NULL &&
+                         strcmp(mime_type, "text/plain") == 0);
+  CPPUNIT_ASSERT(!spider.HashContent("file://local.server/copy_2", 3,
+                                     &spider_backend, &scheme, &copy_2,
+                                     &error));
+  CPPUNIT_ASSERT(!spider.HashContent("file://local.server/other", 3,
+                                     &spider_backend, &scheme, &other,
+                                     &error));
+  CPPUNIT_ASSERT(!spider.HashContent("file://local.server/other", 0,
+                                     &spider_backend, &scheme, &full,
+                                     &error));
+  CPPUNIT_ASSERT(scheme == "file");
+  CPPUNIT_ASSERT(spider.HashContent("file://local.server", 3,
+                                    &spider_backend, &scheme, &full,
+                                    &error) == -1 && error == EISDIR);
+  CPPUNIT_ASSERT_MESSAGE("Wrong hash form",
+                         copy_1.compare(0, 5, "1000:") == 0 &&
+                         copy_1.size() == 21);
+  CPPUNIT_ASSERT_MESSAGE("Copies differ", copy_1 == copy_2);
+  CPPUNIT_ASSERT_MESSAGE("Unsampled change is seen", other == copy_1);
+  CPPUNIT_ASSERT_MESSAGE("Full hash misses the change", full != copy_1);
+  delete spider_backend;
+
+  unlink(config);
+  for (const char *name : {"/copy_1", "/copy_2", "/other"})
+    unlink((dir + name).c_str());
+  rmdir(root);
+}
+
+void SpiderTest::PathArenaTestCase() {
+  PathArena batch(3, 16);
+  uint32_t dir = batch.InternDir("smb://some.server/share/dir");
+  CPPUNIT_ASSERT_MESSAGE("Parents are not interned", batch.get_dirs() == 3);
+  CPPUNIT_ASSERT_MESSAGE("Directory is interned twice",
+                         batch.InternDir("smb://some.server/share/dir") == dir);
+  batch.AddFile(dir, "file_1", 10, 100);
+  batch.AddFile(batch.InternDir("smb://some.server/share"), "file_2", -1, 0);
+  CPPUNIT_ASSERT(batch.get_dirs() == 3);
+  CPPUNIT_ASSERT(batch.size() == 2 && !batch.full());
+
+  std::string str;
+  batch.GetUrl(0, &str);
+  CPPUNIT_ASSERT(str == "smb://some.server/share/dir/file_1");
+  batch.GetServer(0, &str);
+  CPPUNIT_ASSERT(str == "some.server");
+  batch.GetPath(0, &str);
+  CPPUNIT_ASSERT(str == "share/dir/file_1");
+  batch.GetName(0, &str);
+  CPPUNIT_ASSERT(str == "file_1");
+  CPPUNIT_ASSERT(batch.get_size(0) == 10 && batch.get_mtime(0) == 100);
+  batch.GetPath(1, &str);
+  CPPUNIT_ASSERT(str == "share/file_2");
+  CPPUNIT_ASSERT(batch.get_size(1) == -1);
+
+  batch.AddFile(batch.InternDir("file://other.server"), "file_3", 1, 1);
+  CPPUNIT_ASSERT(batch.full());
+  batch.GetUrl(2, &str);
+  CPPUNIT_ASSERT(str == "file://other.server/file_3");
+  batch.GetServer(2, &str);
+  CPPUNIT_ASSERT(str == "other.server");
+
+  batch.Clear();
+  CPPUNIT_ASSERT(batch.empty() && batch.get_dirs() == 0 &&
+                 batch.get_bytes() == 0);
+}
+
+void SpiderTest::BoundedQueueTestCase() {
+  BoundedQueue<int> queue(2);
+
+  // Producer is blocked most of the time by the small capacity.
+  std::thread producer([&queue]() {
+    for (int i = 0; i < 100; ++i)
+      queue.Push(i);
+  });
+
+  for (int i = 0; i < 100; ++i) {
+    CPPUNIT_ASSERT_MESSAGE("Queue is too big", queue.size() <= 2);
+    CPPUNIT_ASSERT_MESSAGE("Wrong order", queue.Pop() == i);
+  }
+
+  producer.join();
+  CPPUNIT_ASSERT_MESSAGE("Queue is not empty", queue.size() == 0);
+}
@@ -43,9 +43,17 @@ class SpiderTest : public CppUnit::TestFixture, public Spider {
   void ServerInteractionTestCase();
   void ScanSMBDirTestCase();
   void NameParserTestCase();
+  void NameTokenizerTestCase();
   void AddFileEntryInDataBaseTestCase();
   void DetectMimeTypeTestCase();
+  void MimeTypeByExtensionTestCase();
   void DumpToDataBaseTestCase();
+  void IncrementalDumpTestCase();
+  void ShouldSplitTestCase();
+  void LocalBackendTestCase();
+  void ContentHashTestCase();
+  void PathArenaTestCase();
+  void BoundedQueueTestCase();
 
   void setUp();
   void tearDown();
@@ -55,9 +63,17 @@ class SpiderTest : public CppUnit::TestFixture, public Spider {
   CPPUNIT_TEST(ServerInteractionTestCase);
   CPPUNIT_TEST(ScanSMBDirTestCase);
   CPPUNIT_TEST(NameParserTestCase);
+  CPPUNIT_TEST(NameTokenizerTestCase);
   CPPUNIT_TEST(AddFileEntryInDataBaseTestCase);
   CPPUNIT_TEST(DetectMimeTypeTestCase);
+  CPPUNIT_TEST(MimeTypeByExtensionTestCase);
   CPPUNIT_TEST(DumpToDataBaseTestCase);
+  CPPUNIT_TEST(IncrementalDumpTestCase);
+  CPPUNIT_TEST(ShouldSplitTestCase);
+  CPPUNIT_TEST(LocalBackendTestCase);
+  CPPUNIT_TEST(ContentHashTestCase);
+  CPPUNIT_TEST(PathArenaTestCase);
+  CPPUNIT_TEST(BoundedQueueTestCase);
   CPPUNIT_TEST_SUITE_END();
 
   std::string name_;
@@ -5,7 +5,9 @@ SUBDIRS +=                  \
     datastorage-test        \
     spider-test             \
     serverqueue-test        \
-    full-test
+    searchd-test            \
+    full-test               \
+    benchmark
 
 OTHER_FILES += testing.sh   \
                Makefile
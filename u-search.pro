@@ -4,6 +4,7 @@ SUBDIRS +=          \
     data-storage    \
     spider          \
     scheduler       \
+    searchd         \
     test
 HEADERS += common-inl.h
 OTHER_FILES +=      \